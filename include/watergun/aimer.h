@@ -19,12 +19,9 @@
 
 
 /* INCLUDES */
-#include <array>
-#include <coin/CoinPackedMatrix.hpp>
-#include <coin/ClpSimplex.hpp>
-#include <complex>
 #include <list>
-#include <utility>
+#include <vector>
+#include <watergun/planner.h>
 #include <watergun/tracker.h>
 
 
@@ -47,54 +44,37 @@ namespace watergun
 /** class aimer : tracker
  * 
  * Extenstion to tracker which adds aiming capabilities to tracking.
+ * The aiming itself is performed by a planner, configured from the tracker's camera.
  */
 class watergun::aimer : public tracker
 {
 public:
 
-    /** struct gun_position
-     * 
-     * The position of the watergun in terms of yaw and pitch in radians.
-     */
-    struct gun_position { double yaw, pitch; bool out_of_range = false; };
-
-    /** struct single_movement
-     * 
-     * Describes an amount of constant movement starting at a given point.
-     * A movement plan is a list of single movements.
-     */
-    struct single_movement
-    {
-        /* The duration for which the movement should last, or has lasted for */
-        clock::duration duration;
-
-        /* The time at which the movement was started, or maximum if not started */
-        clock::time_point timestamp;
-
-        /* The rate of change of yaw during this movement */
-        double yaw_rate;
-
-        /* The exact pitch to end with at the end of this movement */
-        double ending_pitch;
-
-        /* Whether the gun ends up on target by the end of the movement */
-        bool ends_on_target = false;
-    };
+    /* Typedefs from the planner */
+    typedef planner::gun_position         gun_position;
+    typedef planner::single_movement      single_movement;
+    typedef planner::engagement           engagement;
+    typedef planner::solver_context       solver_context;
+    typedef planner::target_selection     target_selection;
+    typedef planner::target_score         target_score;
+    typedef planner::sequencing_workspace sequencing_workspace;
 
 
 
     /** @name constructor
      * 
-     * @brief Sets up tracker, then begins processing aim data.
+     * @brief Sets up tracker, then the planner.
      * @param _water_rate: The velocity of the water leaving the watergun (depends on psi etc).
      * @param _air_resistance: Horizontal deceleration of the water, to model small amounts of air resistance.
      * @param _max_yaw_velocity: Maximum yaw angular velocity in radians per second.
-     * @param _max_yaw_acceleration: Maximum yaw angular acceleration in radians per second squared.
+     * @param _yaw_torque: The torque curve of the yaw axis, giving the maximum yaw angular acceleration in radians per second squared at each velocity.
+     * @param _max_pitch_velocity: Maximum pitch angular velocity in radians per second.
+     * @param _pitch_torque: The torque curve of the pitch axis, giving the maximum pitch angular acceleration in radians per second squared at each velocity.
      * @param _aim_period: The period of time in seconds with which to aspire to be correctly aimed within. Defaults to the length of a frame, if set to 0 duration.
      * @param _camera_offset: The position of the camera relative to a custom origin. Defaults to the camera being the origin.
      * @throw watergun_exception, if configuration cannot be completed (e.g. config file or denice not found).
      */
-    aimer ( double _water_rate, double _air_resistance, double _max_yaw_velocity, double _max_yaw_acceleration, clock::duration _aim_period = clock::duration { 0 }, vector3d _camera_offset = vector3d {} );
+    aimer ( double _water_rate, double _air_resistance, double _max_yaw_velocity, const torque_curve& _yaw_torque, double _max_pitch_velocity, const torque_curve& _pitch_torque, clock::duration _aim_period = clock::duration { 0 }, vector3d _camera_offset = vector3d {} );
 
     /** @name destructor
      * 
@@ -104,103 +84,76 @@ public:
 
 
 
-    /** @name  calculate_aim
+    /** @name  get_planner
      * 
-     * @brief  From a tracked user, find the yaw and pitch the watergun must shoot to hit the user for the given water velocity.
-     * @param  user: The user to aim at.
-     * @return A gun position. If the user cannot be hit, yaw is set to the user's angle, and pitch is set to 45 degrees.
+     * @brief  Get the planner which performs the aiming. The planner is re-entrant, so may be shared with other threads.
+     * @return A const reference to the planner.
      */
-    gun_position calculate_aim ( const tracked_user& user ) const;
+    const planner& get_planner () const noexcept { return aim_planner; }
 
-    /** @name  choose_target
+    /** @name  set_water_rate
      * 
-     * @brief  Choose a user to aim at from the given list.
-     * @param  users: The users to aim at.
-     * @return The tracked user the gun has chosen to aim for. The tracked user will be updated to represent the user's projected current position.
+     * @brief  See planner::set_water_rate.
      */
-    tracked_user choose_target ( const std::vector<tracked_user>& users ) const;
+    void set_water_rate ( double water_rate ) noexcept { aim_planner.set_water_rate ( water_rate ); }
 
-    /** @name  calculate_future_movements
-     * 
-     * @brief  Over the next n lots of aim periods, create a list of single movements to follow to keep on track with hitting a tracked user.
-     *         The output list will be shorter than n elements, if it becomes not possible to hit the targeted user.
-     * @param  user: The tracked user to aim for.
-     * @param  current_movement: The current movement of the gun.
-     * @param  n: The number of aim periods to single movements plans for.
-     * @return The list of single movements forming a movement plan.
-     */
-    std::list<single_movement> calculate_future_movements ( const tracked_user& user, const single_movement& current_movement, int n ) const;
-
-
-
-protected:
-
-    /* The water velocity */
-    double water_rate;
-
-    /* Horizontal deceleration of water */
-    double air_resistance;
-
-    /* Maximum yaw angular velocity and acceleration */
-    double max_yaw_velocity, max_yaw_acceleration;
-
-    /* The period of time with which the gun should aspire to be aiming at a user within */
-    clock::duration aim_period; double aim_period_s;
-
-
-
-private:
-
-    /* The current model for movement planning */
-    mutable ClpSimplex movement_model;
-
-    /* The multiple to increase the movement model size by */
-    const int movement_model_size_multiple { 20 };
-
-    /* The number of radians away from hitting the user, the gun has to be to be considered 'on target' */
-    const double on_target_threshold { 5. * ( M_PI / 180. ) };
 
 
+    /** @name  calculate_aim
+     * 
+     * @brief  See planner::calculate_aim.
+     */
+    gun_position calculate_aim ( const tracked_user& user ) const { return aim_planner.calculate_aim ( user ); }
 
-    /** @name  create_basic_movement_model
+    /** @name  choose_target
      * 
-     * @brief  Create a linear programming model for n future movements into the future. The constraint bounds will need to be modified later for the model to work.
-     * @param  n: The number of movements in the model.
-     * @return ClpModel object.
+     * @brief  See planner::choose_target.
      */
-    ClpModel create_basic_movement_model ( int n ) const;
+    tracked_user choose_target ( const std::vector<tracked_user>& users, const single_movement& current_movement, target_selection& selection, std::vector<target_score> * scores = nullptr ) const
+        { return aim_planner.choose_target ( users, current_movement, selection, scores ); }
 
-    /** @name  specialize_movement_model
+    /** @name  sequence_targets
      * 
-     * @brief  Make a basic movement model specific to a given tracked user.
-     * @param  clp_model: A reference to the model to refine.
-     * @param  user: The tracked user to aim for.
-     * @param  current_movement: The current movement of the gun.
-     * @return An array of gun positions at each period of the mode.
+     * @brief  See planner::sequence_targets.
      */
-    std::vector<gun_position> specialize_movement_model ( ClpModel& clp_model, const tracked_user& user, const single_movement& current_movement ) const;
+    std::vector<engagement> sequence_targets ( std::span<const tracked_user> users, const single_movement& current_movement, target_selection& selection, std::vector<target_score> * scores = nullptr ) const
+        { return aim_planner.sequence_targets ( users, current_movement, selection, scores ); }
 
+    /** @name  sequence_targets
+     * 
+     * @brief  See planner::sequence_targets.
+     */
+    void sequence_targets ( std::span<const tracked_user> users, const single_movement& current_movement, target_selection& selection, sequencing_workspace& workspace, std::vector<engagement>& best_sequence, std::vector<target_score> * scores = nullptr ) const
+        { aim_planner.sequence_targets ( users, current_movement, selection, workspace, best_sequence, scores ); }
 
+    /** @name  create_sequencing_workspace
+     * 
+     * @brief  See planner::create_sequencing_workspace.
+     */
+    sequencing_workspace create_sequencing_workspace ( std::size_t max_users ) const { return aim_planner.create_sequencing_workspace ( max_users ); }
 
-    /** @name  solve_quadratic
+    /** @name  create_solver_context
      * 
-     * @brief  Solves a quadratic equation with given coeficients in decreasing power order.
-     * @param  c0: The first coeficient (x^2).
-     * @param  c1: The first coeficient (x^1).
-     * @param  c2: The first coeficient (x^0).
-     * @return An array of two (possibly complex) solutions.
+     * @brief  See planner::create_solver_context.
      */
-    static std::array<std::complex<double>, 2> solve_quadratic ( const std::complex<double>& c0, const std::complex<double>& c1, const std::complex<double>& c2 );
+    solver_context create_solver_context () const { return aim_planner.create_solver_context (); }
 
-    /** @name  solve_quartic
+    /** @name  calculate_future_movements
      * 
-     * @brief  Solves a quartic equation with given coeficients in decreasing power order.
-     *         Special thanks to Sidney Cadot (https://github.com/sidneycadot) for the function implementation.
-     * @param  c0: The first coeficient (x^4)...
-     * @param  c4: The last coeficient (x^0).
-     * @return Array of four (possibly complex) solutions.
+     * @brief  See planner::calculate_future_movements.
      */
-    static std::array<std::complex<double>, 4> solve_quartic ( const std::complex<double>& c0, const std::complex<double>& c1, const std::complex<double>& c2, const std::complex<double>& c3, const std::complex<double>& c4 ) noexcept;
+    std::list<single_movement> calculate_future_movements ( const tracked_user& user, const single_movement& current_movement, int n, solver_context& context ) const
+        { return aim_planner.calculate_future_movements ( user, current_movement, n, context ); }
+
+
+
+protected:
+
+    /* The period of time with which the gun should aspire to be aiming at a user within */
+    clock::duration aim_period;
+
+    /* The planner */
+    planner aim_planner;
 
 };
 
@@ -0,0 +1,256 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * include/watergun/command_scheduler.h
+ * 
+ * Header file for scheduling valve commands at absolute times, and recording when they were really executed.
+ * 
+ */
+
+
+
+/* HEADER GUARD */
+#ifndef WATERGUN_COMMAND_SCHEDULER_H_INCLUDED
+#define WATERGUN_COMMAND_SCHEDULER_H_INCLUDED
+
+
+
+/* INCLUDES */
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include <watergun/realtime.h>
+#include <watergun/ring_buffer.h>
+#include <watergun/solenoid.h>
+#include <watergun/watergun_exception.h>
+
+
+
+/* DECLARATIONS */
+
+namespace watergun
+{
+    /** class command_scheduler
+     * 
+     * Executes valve commands at absolute times on the monotonic clock, and records when each was really executed.
+     */
+    class command_scheduler;
+}
+
+
+
+/* COMMAND_SCHEDULER DEFINITION */
+
+/** class command_scheduler
+ * 
+ * Executes valve commands at absolute times on the monotonic clock, and records when each was really executed.
+ * The steppers follow setpoints streamed by the controller rather than scheduled commands, so only the solenoid valve is commanded here.
+ * Pending commands are kept in a binary heap, and executed by whichever single thread calls execute_due, which should be a real-time thread.
+ * Commands due at the same time are executed in the order they were scheduled.
+ * Only the executing thread may schedule and cancel commands, but the execution log may be read from any thread.
+ */
+class watergun::command_scheduler
+{
+public:
+
+    /* The clock commands are scheduled on */
+    typedef monotonic_clock clock;
+
+    /** struct command
+     * 
+     * A single valve command.
+     */
+    struct command
+    {
+        /* The time at which to execute the command */
+        clock::time_point due;
+
+        /* Whether to open the valve, rather than close it */
+        bool open;
+
+        /* A tag for the caller to identify the command by */
+        std::size_t tag;
+    };
+
+    /** struct executed_command
+     * 
+     * A command, along with when it was really executed.
+     */
+    struct executed_command
+    {
+        /* The command */
+        command cmd;
+
+        /* The time at which the command was executed */
+        clock::time_point executed_at;
+    };
+
+
+
+    /** @name constructor
+     * 
+     * @brief Set up the scheduler for the valve, and allocate the heap and execution log.
+     * @param _solenoid_valve: The solenoid valve to command.
+     * @param max_pending: The number of pending commands to reserve space for.
+     * @param log_size: The number of executed commands to remember.
+     * @throw watergun_exception, if the log size is zero.
+     */
+    command_scheduler ( solenoid& _solenoid_valve, std::size_t max_pending, std::size_t log_size );
+
+    /** @name deleted copy constructor
+     * 
+     * @brief Copying is not allowed, since the scheduler commands the valve.
+     */
+    command_scheduler ( const command_scheduler& other ) = delete;
+
+
+
+    /** @name  schedule
+     * 
+     * @brief  Schedule a command. Only the executing thread may call this.
+     * @param  cmd: The command.
+     * @return Nothing.
+     */
+    void schedule ( const command& cmd );
+
+    /** @name  cancel
+     * 
+     * @brief  Cancel all pending commands. Only the executing thread may call this.
+     * @return Nothing.
+     */
+    void cancel () noexcept { pending.clear (); }
+
+    /** @name  next_due
+     * 
+     * @brief  Get the time at which the next pending command is due.
+     * @return The time point, or the maximum time point if there are no pending commands.
+     */
+    clock::time_point next_due () const noexcept { return pending.empty () ? clock::time_point::max () : pending.front ().cmd.due; }
+
+    /** @name  execute_due
+     * 
+     * @brief  Execute all commands which are due, recording when each was executed, and passing the record to a callback.
+     * @param  on_executed: A function called with each executed_command after it has been executed.
+     * @return The number of commands executed.
+     */
+    template<class F> std::size_t execute_due ( F on_executed );
+
+
+
+    /** @name  get_executed_commands
+     * 
+     * @brief  Get the remembered executed commands, oldest first.
+     * @return Vector of executed commands.
+     */
+    std::vector<executed_command> get_executed_commands () const;
+
+    /** @name  get_max_lateness
+     * 
+     * @brief  Get the largest time by which a command has been executed after it was due.
+     * @return The duration.
+     */
+    clock::duration get_max_lateness () const;
+
+
+
+private:
+
+    /** struct pending_command
+     * 
+     * A pending command, along with the order it was scheduled in, to break ties.
+     */
+    struct pending_command
+    {
+        command cmd;
+        std::uint64_t sequence;
+    };
+
+    /* The valve */
+    solenoid& solenoid_valve;
+
+    /* The heap of pending commands, ordered so that the front is due first */
+    std::vector<pending_command> pending;
+    std::uint64_t next_sequence { 0 };
+
+    /* The ring buffer of executed commands */
+    ring_buffer<executed_command> executed_log;
+
+    /* The largest lateness so far */
+    clock::duration max_lateness { 0 };
+
+    /* A mutex to protect the execution log and lateness */
+    mutable std::mutex log_mx;
+
+
+
+    /** @name  later
+     * 
+     * @brief  Heap comparator, which orders commands so that the earliest due, then earliest scheduled, is at the front.
+     * @param  lhs: The left hand command.
+     * @param  rhs: The right hand command.
+     * @return True if lhs should be executed after rhs.
+     */
+    static bool later ( const pending_command& lhs, const pending_command& rhs ) noexcept
+        { return lhs.cmd.due > rhs.cmd.due || ( lhs.cmd.due == rhs.cmd.due && lhs.sequence > rhs.sequence ); }
+
+    /** @name  execute
+     * 
+     * @brief  Execute a single command on the valve.
+     * @param  cmd: The command.
+     * @return Nothing.
+     */
+    void execute ( const command& cmd );
+
+    /** @name  record
+     * 
+     * @brief  Record an executed command in the log.
+     * @param  executed: The executed command.
+     * @return Nothing.
+     */
+    void record ( const executed_command& executed );
+
+};
+
+
+
+/* COMMAND_SCHEDULER IMPLEMENTATION */
+
+
+
+/** @name  execute_due
+ * 
+ * @brief  Execute all commands which are due, recording when each was executed, and passing the record to a callback.
+ * @param  on_executed: A function called with each executed_command after it has been executed.
+ * @return The number of commands executed.
+ */
+template<class F> std::size_t watergun::command_scheduler::execute_due ( F on_executed )
+{
+    /* Execute commands while the front of the heap is due */
+    std::size_t num_executed = 0;
+    while ( !pending.empty () && pending.front ().cmd.due <= clock::now () )
+    {
+        /* Pop the command */
+        std::pop_heap ( pending.begin (), pending.end (), later );
+        const command cmd = pending.back ().cmd; pending.pop_back ();
+
+        /* Execute and record it */
+        execute ( cmd );
+        const executed_command executed { cmd, clock::now () };
+        record ( executed );
+        on_executed ( executed );
+        ++num_executed;
+    }
+
+    /* Return the number executed */
+    return num_executed;
+}
+
+
+
+/* HEADER GUARD */
+#endif /* #ifndef WATERGUN_COMMAND_SCHEDULER_H_INCLUDED */
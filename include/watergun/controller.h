@@ -19,10 +19,20 @@
 
 
 /* INCLUDES */
-#include <list>
+#include <array>
+#include <vector>
 #include <watergun/aimer.h>
+#include <watergun/command_scheduler.h>
+#include <watergun/fire_control.h>
+#include <watergun/motion_executor.h>
+#include <watergun/planning_pool.h>
+#include <watergun/pressure_model.h>
+#include <watergun/realtime.h>
+#include <watergun/seqlock.h>
+#include <watergun/setpoint_generator.h>
 #include <watergun/solenoid.h>
 #include <watergun/stepper.h>
+#include <watergun/triple_buffer.h>
 
 
 
@@ -57,15 +67,23 @@ public:
      * @param _pitch_stepper: The pitch stepper motor to use.
      * @param _solenoid_valve: The solenoid valve to use.
      * @param _search_yaw_velocity: The yaw angular velocity in radians per second when searching for a user.
-     * @param _water_rate: The velocity of the water leaving the watergun (depends on psi etc).
+     * @param _pressure: The model of the water pressure, which gives the velocity of the water leaving the watergun, and is told when the valve opens and closes.
      * @param _air_resistance: Horizontal deceleration of the water, to model small amounts of air resistance.
      * @param _max_yaw_velocity: Maximum yaw angular velocity in radians per second.
-     * @param _max_yaw_acceleration: Maximum yaw angular acceleration in radians per second squared.
+     * @param _yaw_torque: The torque curve of the yaw axis, giving the maximum yaw angular acceleration in radians per second squared at each velocity.
+     * @param _max_pitch_velocity: Maximum pitch angular velocity in radians per second.
+     * @param _pitch_torque: The torque curve of the pitch axis, giving the maximum pitch angular acceleration in radians per second squared at each velocity.
      * @param _aim_period: The period of time in seconds with which to aspire to be correctly aimed within.
      * @param _camera_offset: The position of the camera relative to a custom origin. Defaults to the camera being the origin.
+     * @param _switching_penalty: The time penalty for switching away from the current target.
+     * @param _min_target_dwell: The minimum time to stay on a target once it has been chosen.
+     * @param _setpoint_frequency: The frequency in Hz at which the yaw velocity and pitch setpoints are updated between plan periods, typically 250 to 1000.
+     * @param _valve: The timing characteristics of the solenoid valve.
+     * @param _burst: The burst pattern to fire with. Defaults to firing continuously while on target.
+     * @param _max_fire_lead: The latest time after the start of a plan at which water may be predicted to land.
      * @throw watergun_exception, if configuration cannot be completed (e.g. config file or denice not found).
      */
-    controller ( pwm_stepper& _yaw_stepper, gpio_stepper& _pitch_stepper, solenoid& _solenoid_valve, double _search_yaw_velocity, double _water_rate, double _air_resistance, double _max_yaw_velocity, double _max_yaw_acceleration, clock::duration _aim_period = clock::duration { 0 }, vector3d _camera_offset = vector3d {} );
+    controller ( pwm_stepper& _yaw_stepper, gpio_stepper& _pitch_stepper, solenoid& _solenoid_valve, double _search_yaw_velocity, pressure_model& _pressure, double _air_resistance, double _max_yaw_velocity, const torque_curve& _yaw_torque, double _max_pitch_velocity, const torque_curve& _pitch_torque, clock::duration _aim_period = clock::duration { 0 }, vector3d _camera_offset = vector3d {}, clock::duration _switching_penalty = std::chrono::milliseconds { 200 }, clock::duration _min_target_dwell = std::chrono::milliseconds { 500 }, double _setpoint_frequency = 500., const valve_dynamics& _valve = valve_dynamics {}, const burst_pattern& _burst = burst_pattern {}, clock::duration _max_fire_lead = std::chrono::milliseconds { 750 } );
 
     /** @name destructor
      * 
@@ -82,6 +100,20 @@ public:
      */
     single_movement get_current_movement () const;
 
+    /** @name  get_executed_commands
+     * 
+     * @brief  Immediately returns the most recently executed valve commands, along with when they were really executed.
+     * @return Vector of executed commands, oldest first.
+     */
+    std::vector<command_scheduler::executed_command> get_executed_commands () const;
+
+    /** @name  get_target_scores
+     * 
+     * @brief  Immediately returns the scores given to each user during the last target selection.
+     * @return Vector of target scores.
+     */
+    std::vector<target_score> get_target_scores () const;
+
 
 
     /** @name  dynamic_project_tracked_user
@@ -111,35 +143,107 @@ private:
     /* Solenoid valve */
     solenoid& solenoid_valve;
 
+    /* The model of the water pressure */
+    pressure_model& pressure;
+
+
 
+    /* A snapshot of the current movement, written by the actuator thread and read without locking */
+    seqlock<single_movement> current_movement_snapshot;
 
-    /* A double ended queue of single movements, representing past and future movements */
-    std::list<single_movement> movement_plan;
+    /* The number of future single movements to plan, which is fixed so that planning does not allocate */
+    static constexpr int plan_horizon { 30 };
 
-    /* An iterator to the current movement being applied */
-    std::list<single_movement>::iterator current_movement;
+    /* The number of tracked users to reserve space for when planning, beyond which planning may allocate */
+    static constexpr std::size_t max_planned_users { 16 };
 
-    /* A mutex to protect the movement plan and iterator */
-    mutable std::mutex movement_mx;
+    /* Plans published by the planner thread to the actuator thread. Each buffer has space for the future movements and the search movement which follows them. */
+    triple_buffer<std::vector<single_movement>> plan_handoff;
 
-    /* The number of future single movements to store in the movement plan */
-    int num_future_movements;
+    /* The number of executed valve commands to remember */
+    static constexpr std::size_t command_log_size { 4096 };
+
+    /* The fire control which computes the valve commands of each plan, and the buffer they are computed into, only used by the actuator thread */
+    fire_control fire_controller;
+    std::vector<fire_control::valve_command> valve_commands;
+
+    /* How long before a valve command is due for the actuator thread to stop waiting and start spinning, so that the valve is switched with sub-millisecond precision */
+    static constexpr monotonic_clock::duration valve_spin_window { std::chrono::microseconds { 200 } };
+
+    /* The scheduler which executes the valve commands of the current plan, only used by the actuator thread */
+    command_scheduler actuator_scheduler;
+
+    /* The executor which moves the yaw and pitch steppers together, one setpoint period at a time */
+    motion_executor axis_executor;
+
+    /* The period between setpoint updates, and the generator of setpoints from the current plan, only used by the actuator thread */
+    monotonic_clock::duration setpoint_period;
+    setpoint_generator plan_setpoints;
+
+    /** struct setpoint_nudge
+     * 
+     * A correction to the yaw, made when a new frame shows the target deviating from where it was predicted to be.
+     * The nudge corrects the plan solved from the previous frame, which is still running while the plan for the new frame is solved.
+     * The plan for the new frame is solved as though the nudge has already been made, so the whole correction is applied, on top of whichever plan is running.
+     */
+    struct setpoint_nudge
+    {
+        /* The change in yaw to add, in radians */
+        double yaw;
 
+        /* How long to spread the change over, which is the expected time to solve and publish the plan for the new frame */
+        monotonic_clock::duration duration;
 
+        /* When the nudge was issued */
+        monotonic_clock::time_point issued;
+    };
 
-    /* A thread to handle the updating of the movement plan */
+    /* The latest nudge, written by the planner thread and read by the actuator thread */
+    seqlock<setpoint_nudge> setpoint_nudge_snapshot;
+
+    /* A mutex and condition variable used only to wake the actuator thread when a plan is published */
+    std::mutex actuator_mx;
+    std::condition_variable_any actuator_cv;
+
+
+
+    /* The current target selection, only accessed by the controller thread */
+    target_selection selection;
+
+    /* The scores from the last target selection, and a mutex to protect them */
+    std::vector<target_score> target_scores;
+    mutable std::mutex target_scores_mx;
+
+    /* The number of candidate targets to speculatively plan movements for */
+    static constexpr int num_candidate_plans { 3 };
+
+    /* The pool which plans movements for the candidate targets */
+    planning_pool<plan_horizon> candidate_planner;
+
+
+
+    /* A thread to plan movements, and a thread to apply them to the motors */
     std::jthread controller_thread;
+    std::jthread actuator_thread;
 
 
 
     /** @name  movement_planner_thread_function
      * 
-     * @brief  Function run by controller_thread. Continuously updates movement_plan, and notifies the condition variable.
+     * @brief  Function run by controller_thread. Continuously plans future movements and publishes them to the actuator thread.
      * @param  stoken: The stop token for the jthread.
      * @return Nothing.
      */
     void movement_planner_thread_function ( std::stop_token stoken );
 
+    /** @name  actuator_thread_function
+     * 
+     * @brief  Function run by actuator_thread. Generates setpoints from the latest published plan at the setpoint frequency, queues them as coordinated segments of both axes, and executes the valve commands when due.
+     * @param  stoken: The stop token for the jthread.
+     * @return Nothing.
+     */
+    void actuator_thread_function ( std::stop_token stoken );
+
 };
 
 
@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * include/watergun/fire_control.h
+ * 
+ * Header file for computing when to open and close the solenoid valve from a movement plan, the dynamics of the valve and the time of flight of the water.
+ * 
+ */
+
+
+
+/* HEADER GUARD */
+#ifndef WATERGUN_FIRE_CONTROL_H_INCLUDED
+#define WATERGUN_FIRE_CONTROL_H_INCLUDED
+
+
+
+/* INCLUDES */
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <span>
+#include <vector>
+#include <watergun/planner.h>
+#include <watergun/realtime.h>
+#include <watergun/watergun_exception.h>
+
+
+
+/* DECLARATIONS */
+
+namespace watergun
+{
+    /** struct valve_dynamics
+     * 
+     * The timing characteristics of the solenoid valve.
+     */
+    struct valve_dynamics;
+
+    /** struct burst_pattern
+     * 
+     * How to break each on-target window into pulses of water.
+     */
+    struct burst_pattern;
+
+    /** class fire_control
+     * 
+     * Computes when to open and close the solenoid valve, so that water leaves the nozzle only while the gun is on target.
+     */
+    class fire_control;
+}
+
+
+
+/* VALVE_DYNAMICS DEFINITION */
+
+/** struct valve_dynamics
+ * 
+ * The timing characteristics of the solenoid valve.
+ */
+struct watergun::valve_dynamics
+{
+    /* The delay between commanding the valve open and water leaving the nozzle */
+    monotonic_clock::duration open_latency { std::chrono::milliseconds { 15 } };
+
+    /* The delay between commanding the valve closed and water no longer leaving the nozzle */
+    monotonic_clock::duration close_latency { std::chrono::milliseconds { 10 } };
+
+    /* The shortest useful flow of water. Shorter flows are lengthened to this, centred on the original. */
+    monotonic_clock::duration min_open { std::chrono::milliseconds { 20 } };
+
+    /* The shortest time the valve should be closed between two flows. Shorter gaps are bridged by keeping the valve open. */
+    monotonic_clock::duration min_closed { std::chrono::milliseconds { 30 } };
+};
+
+
+
+/* BURST_PATTERN DEFINITION */
+
+/** struct burst_pattern
+ * 
+ * How to break each on-target window into pulses of water.
+ */
+struct watergun::burst_pattern
+{
+    /* The length of each pulse of water, or zero to fire continuously through each on-target window */
+    monotonic_clock::duration pulse_on { 0 };
+
+    /* The gap between pulses */
+    monotonic_clock::duration pulse_off { 0 };
+
+    /* The maximum number of pulses per on-target window, or zero for no limit */
+    int max_pulses { 0 };
+};
+
+
+
+/* FIRE_CONTROL DEFINITION */
+
+/** class fire_control
+ * 
+ * Computes when to open and close the solenoid valve, so that water leaves the nozzle only while the gun is on target.
+ * The gun is on target at the end of each movement of a plan which ends on target, so a run of such movements is a window during which water should leave the nozzle.
+ * The aim already leads the user by the time of flight of the water, but the further ahead the impact is, the less the prediction can be trusted,
+ * so a window is cut short once water leaving the nozzle would land later than the maximum lead after the start of the plan.
+ * Each window may be broken into pulses, and the valve commands are brought forward by the latency of the valve, so that water starts and stops when planned.
+ * Flows shorter than the valve can usefully make are lengthened, and gaps too short to be worth closing the valve for are bridged.
+ * Each plan replaces the commands of the last, so the state the valve was left in is carried into the next plan: a flow which is still open carries on if the new plan fires straight away,
+ * and the minimum open and closed times are kept across the change of plan.
+ * When rationing, each window gets only a single flow of the shortest useful length, so that the remaining pressure is spread over more targets.
+ */
+class watergun::fire_control
+{
+public:
+
+    /* The clock valve commands are scheduled on */
+    typedef monotonic_clock clock;
+
+    /** struct valve_command
+     * 
+     * A command to open or close the valve.
+     */
+    struct valve_command
+    {
+        /* The time to command the valve, relative to the start of the plan */
+        clock::duration due;
+
+        /* True to open the valve, false to close it */
+        bool open;
+
+        /* The index of the movement which starts the on-target window this command belongs to */
+        std::size_t movement;
+    };
+
+    /** struct valve_state
+     * 
+     * The state of the valve and the gun when a plan starts, left behind by earlier plans.
+     */
+    struct valve_state
+    {
+        /* Whether the valve was last commanded open */
+        bool open { false };
+
+        /* How long before the start of the plan the valve was last commanded */
+        clock::duration since { clock::duration::max () };
+
+        /* Whether the gun is already on target at the start of the plan, so that a window at the start of the plan begins immediately */
+        bool on_target { false };
+    };
+
+
+
+    /** @name constructor
+     * 
+     * @brief Set up fire control for a valve and burst pattern.
+     * @param _valve: The timing characteristics of the valve.
+     * @param _pattern: The burst pattern to fire with.
+     * @param _max_lead: The latest time after the start of a plan at which water may be predicted to land.
+     * @throw watergun_exception, if any duration is negative, or the pattern has a pulse length but no gap.
+     */
+    fire_control ( const valve_dynamics& _valve, const burst_pattern& _pattern, clock::duration _max_lead );
+
+
+
+    /** @name  schedule
+     * 
+     * @brief  Compute the valve commands for a plan. Commands are produced in order of time, alternating between open and close.
+     *         They start with an open, unless the valve is already open, in which case they start with the close which ends the flow carried on from earlier plans.
+     * @param  plan: The movements of the plan, starting from the start of the plan.
+     * @param  commands: Cleared, then set to the valve commands. Reserve max_commands elements to avoid allocating.
+     * @param  state: The state of the valve and the gun at the start of the plan. A default constructed state is a valve closed long ago, with the gun off target.
+     * @param  ration: True to save water, such as when the pressure is low, by firing only a single shortest useful flow at the start of each window. Defaults to false.
+     * @return The total time from the start of the plan for which water will leave the nozzle, which is proportional to the water used.
+     */
+    clock::duration schedule ( std::span<const planner::single_movement> plan, std::vector<valve_command>& commands, const valve_state& state, bool ration = false ) const;
+
+    /** @name  max_commands
+     * 
+     * @brief  Find the largest number of commands which schedule may produce for a plan.
+     * @param  movements: The number of movements in the plan.
+     * @param  on_target_time: The longest time for which a plan may be on target.
+     * @return The number of commands.
+     */
+    std::size_t max_commands ( std::size_t movements, clock::duration on_target_time ) const noexcept;
+
+    /** @name  get_valve_dynamics
+     * 
+     * @brief  Get the timing characteristics of the valve.
+     * @return The valve dynamics.
+     */
+    const valve_dynamics& get_valve_dynamics () const noexcept { return valve; }
+
+
+
+private:
+
+    /* The timing characteristics of the valve */
+    valve_dynamics valve;
+
+    /* The burst pattern */
+    burst_pattern pattern;
+
+    /* The latest time after the start of a plan at which water may be predicted to land */
+    clock::duration max_lead;
+
+};
+
+
+
+/* HEADER GUARD */
+#endif /* #ifndef WATERGUN_FIRE_CONTROL_H_INCLUDED */
@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * include/watergun/fixed_planner.h
+ * 
+ * Header file for planning movements over a fixed horizon known at compile time, without allocating in the steady state.
+ * 
+ */
+
+
+
+/* HEADER GUARD */
+#ifndef WATERGUN_FIXED_PLANNER_H_INCLUDED
+#define WATERGUN_FIXED_PLANNER_H_INCLUDED
+
+
+
+/* INCLUDES */
+#include <array>
+#include <watergun/planner.h>
+
+
+
+/* DECLARATIONS */
+
+namespace watergun
+{
+    /** class fixed_planner
+     * 
+     * Plans movements over a fixed horizon of N aim periods, without allocating.
+     */
+    template<int N> class fixed_planner;
+}
+
+
+
+/* FIXED_PLANNER DEFINITION */
+
+/** class fixed_planner
+ * 
+ * Plans movements over a fixed horizon of N aim periods, without allocating.
+ * All allocation by the planner happens on construction: planning then only modifies the bounds of a model of fixed size, and writes into caller-provided buffers.
+ * Whether the solver itself allocates while solving depends on the Clp build, which test/zero_allocation_test checks.
+ * Like a solver context, a fixed planner must not be used by more than one thread at a time.
+ */
+template<int N> class watergun::fixed_planner
+{
+public:
+
+    /* The number of aim periods planned for */
+    static constexpr int horizon = N;
+
+    /* Typedefs from the planner */
+    typedef planner::clock           clock;
+    typedef planner::tracked_user    tracked_user;
+    typedef planner::gun_position    gun_position;
+    typedef planner::single_movement single_movement;
+
+    /* A buffer of future movements */
+    typedef std::array<single_movement, N> movement_buffer;
+
+
+
+    /** @name constructor
+     * 
+     * @brief Create the movement model for the horizon.
+     * @param _movement_planner: The planner to take the gun's parameters from.
+     */
+    explicit fixed_planner ( const planner& _movement_planner );
+
+    /** @name deleted copy constructor
+     * 
+     * @brief Copying is not allowed, since each fixed planner should own its model.
+     */
+    fixed_planner ( const fixed_planner& other ) = delete;
+
+
+
+    /** @name  calculate_future_movements
+     * 
+     * @brief  Over the next N aim periods, fill a buffer of single movements to follow to keep on track with hitting a tracked user.
+     *         If the user cannot be reached within the horizon, the gun gets as close as it can, and no movement is marked as ending on target past the horizon.
+     * @param  user: The tracked user to aim for.
+     * @param  current_movement: The current movement of the gun.
+     * @param  future_movements: The buffer to write the future movements into.
+     * @return True if the plan ends on target, false otherwise.
+     */
+    bool calculate_future_movements ( const tracked_user& user, const single_movement& current_movement, movement_buffer& future_movements );
+
+
+
+private:
+
+    /* The planner to take the gun's parameters from */
+    const planner& movement_planner;
+
+    /* The movement model */
+    ClpSimplex movement_model;
+
+    /* The gun positions produced by specializing the model */
+    std::array<gun_position, N> gun_positions;
+
+    /* The objective row, which weights the distance off target of each axis at each period */
+    static constexpr std::array<double, N * 4> objective_row = [] ()
+    {
+        std::array<double, N * 4> row {};
+        for ( int i = 0; i < N; ++i ) row [ N + i ] = row [ N * 3 + i ] = planner::objective_weight ( i );
+        return row;
+    } ();
+
+};
+
+
+
+/* FIXED_PLANNER IMPLEMENTATION */
+
+
+
+/** @name constructor
+ * 
+ * @brief Create the movement model for the horizon.
+ * @param _movement_planner: The planner to take the gun's parameters from.
+ */
+template<int N> watergun::fixed_planner<N>::fixed_planner ( const planner& _movement_planner )
+    : movement_planner { _movement_planner }
+    , movement_model { movement_planner.create_basic_movement_model ( N, objective_row.data () ) }
+{
+    /* Keep the solver's work arrays between solves, rather than freeing and reallocating them each time */
+    movement_model.setPersistenceFlag ( 1 );
+}
+
+
+
+/** @name  calculate_future_movements
+ * 
+ * @brief  Over the next N aim periods, fill a buffer of single movements to follow to keep on track with hitting a tracked user.
+ *         If the user cannot be reached within the horizon, the gun gets as close as it can, and no movement is marked as ending on target past the horizon.
+ * @param  user: The tracked user to aim for.
+ * @param  current_movement: The current movement of the gun.
+ * @param  future_movements: The buffer to write the future movements into.
+ * @return True if the plan ends on target, false otherwise.
+ */
+template<int N> bool watergun::fixed_planner<N>::calculate_future_movements ( const tracked_user& user, const single_movement& current_movement, movement_buffer& future_movements )
+{
+    /* Specialize the model and attempt to solve it */
+    movement_planner.specialize_movement_model ( movement_model, user, current_movement, gun_positions );
+    movement_model.dual ();
+
+    /* If it is infeasible to get on target by the end of the horizon, release the final on target constraints, solve again, then restore them */
+    const bool feasible = !movement_model.isProvenPrimalInfeasible ();
+    if ( !feasible )
+    {
+        movement_model.setColumnUpper ( N * 2 - 1, COIN_DBL_MAX ); movement_model.setColumnUpper ( N * 4 - 1, COIN_DBL_MAX );
+        movement_model.dual ();
+        movement_model.setColumnUpper ( N * 2 - 1, 0. ); movement_model.setColumnUpper ( N * 4 - 1, 0. );
+    }
+
+    /* Read the solution into the future movements */
+    movement_planner.read_movement_solution ( movement_model, user, current_movement, gun_positions, future_movements );
+
+    /* Return whether the plan ends on target */
+    return feasible && future_movements.back ().ends_on_target;
+}
+
+
+
+/* EXPLICIT INSTANTIATIONS */
+
+/* Fixed planners for common horizon sizes, which are explicitly instantiated in the planning library */
+extern template class watergun::fixed_planner<15>;
+extern template class watergun::fixed_planner<30>;
+extern template class watergun::fixed_planner<60>;
+
+
+
+/* HEADER GUARD */
+#endif /* #ifndef WATERGUN_FIXED_PLANNER_H_INCLUDED */
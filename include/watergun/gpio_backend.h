@@ -0,0 +1,277 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * include/watergun/gpio_backend.h
+ * 
+ * Header file for the interface of a provider of GPIO lines and PWM outputs, so that devices do not depend on how their pins are driven.
+ * 
+ */
+
+
+
+/* HEADER GUARD */
+#ifndef WATERGUN_GPIO_BACKEND_H_INCLUDED
+#define WATERGUN_GPIO_BACKEND_H_INCLUDED
+
+
+
+/* INCLUDES */
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <watergun/realtime.h>
+
+
+
+/* DECLARATIONS */
+
+namespace watergun
+{
+    /** class gpio_output_group
+     * 
+     * A group of output lines which are requested together, and can be updated together.
+     */
+    class gpio_output_group;
+
+    /** class gpio_input_line
+     * 
+     * A single input line, which can be read and can report edges.
+     */
+    class gpio_input_line;
+
+    /** class pwm_output
+     * 
+     * A single PWM output, with a duty cycle of a half.
+     */
+    class pwm_output;
+
+    /** class analog_input
+     * 
+     * A single analog input, such as an ADC channel.
+     */
+    class analog_input;
+
+    /** class gpio_backend
+     * 
+     * The interface of a provider of GPIO lines, PWM outputs and analog inputs.
+     */
+    class gpio_backend;
+
+    /** @name  default_gpio_backend
+     * 
+     * @brief  Get the backend used by devices which are not given another, which is provided by mraa_gpio_backend.cpp.
+     *         Builds without mraa must give every device a backend.
+     * @return The backend.
+     */
+    gpio_backend& default_gpio_backend ();
+}
+
+
+
+/* GPIO_OUTPUT_GROUP DEFINITION */
+
+/** class gpio_output_group
+ * 
+ * A group of output lines which are requested together, and can be updated together.
+ * Bit i of the values and mask passed to write corresponds to the i'th pin the group was requested with. A backend should update all of the selected lines
+ * with as few operations as it can, ideally one.
+ */
+class watergun::gpio_output_group
+{
+public:
+
+    /** @name virtual destructor */
+    virtual ~gpio_output_group () = default;
+
+
+
+    /** @name  write
+     * 
+     * @brief  Set the values of some of the lines in the group.
+     * @param  values: The values of the lines, one bit per line.
+     * @param  mask: Which lines to set, one bit per line. Bits for pins which were not present when the group was requested are ignored.
+     * @return Nothing.
+     */
+    virtual void write ( std::uint32_t values, std::uint32_t mask ) = 0;
+
+};
+
+
+
+/* GPIO_INPUT_LINE DEFINITION */
+
+/** class gpio_input_line
+ * 
+ * A single input line, which can be read and can report edges.
+ */
+class watergun::gpio_input_line
+{
+public:
+
+    /* The clock edges are timestamped on */
+    typedef monotonic_clock clock;
+
+    /** struct edge_event
+     * 
+     * A change in the value of the line.
+     */
+    struct edge_event
+    {
+        /* When the edge happened */
+        clock::time_point timestamp;
+
+        /* True for a rising edge, false for a falling edge */
+        bool rising;
+    };
+
+
+
+    /** @name virtual destructor */
+    virtual ~gpio_input_line () = default;
+
+
+
+    /** @name  read
+     * 
+     * @brief  Read the current value of the line.
+     * @return 1 if high, 0 if low.
+     */
+    virtual int read () = 0;
+
+    /** @name  wait_edge
+     * 
+     * @brief  Wait for the next edge on the line. Edges which happened since the last call, or since the line was requested, are reported first.
+     * @param  timeout: The longest time to wait.
+     * @param  event: Set to the edge, if there was one.
+     * @return True if there was an edge, false if the wait timed out.
+     */
+    virtual bool wait_edge ( clock::duration timeout, edge_event& event ) = 0;
+
+};
+
+
+
+/* PWM_OUTPUT DEFINITION */
+
+/** class pwm_output
+ * 
+ * A single PWM output, with a duty cycle of a half.
+ */
+class watergun::pwm_output
+{
+public:
+
+    /** @name virtual destructor */
+    virtual ~pwm_output () = default;
+
+
+
+    /** @name  set_period_us
+     * 
+     * @brief  Set the period of the output.
+     * @param  period_us: The period in whole microseconds.
+     * @return Nothing.
+     */
+    virtual void set_period_us ( int period_us ) = 0;
+
+    /** @name  enable
+     * 
+     * @brief  Start or stop the output. While stopped, the output is low.
+     * @param  enabled: True to start, false to stop.
+     * @return Nothing.
+     */
+    virtual void enable ( bool enabled ) = 0;
+
+};
+
+
+
+/* ANALOG_INPUT DEFINITION */
+
+/** class analog_input
+ * 
+ * A single analog input, such as an ADC channel.
+ */
+class watergun::analog_input
+{
+public:
+
+    /** @name virtual destructor */
+    virtual ~analog_input () = default;
+
+
+
+    /** @name  read
+     * 
+     * @brief  Read the input.
+     * @return The reading as a fraction of the full scale of the input, from 0 to 1.
+     */
+    virtual double read () = 0;
+
+};
+
+
+
+/* GPIO_BACKEND DEFINITION */
+
+/** class gpio_backend
+ * 
+ * The interface of a provider of GPIO lines, PWM outputs and analog inputs.
+ * Pin numbers are interpreted by the backend, and a pin number of -1 means that the pin is not present.
+ */
+class watergun::gpio_backend
+{
+public:
+
+    /** @name virtual destructor */
+    virtual ~gpio_backend () = default;
+
+
+
+    /** @name  request_outputs
+     * 
+     * @brief  Request a group of output lines, all initially low.
+     * @param  pins: The pin number of each line in the group, or -1 for a line which is not present.
+     * @throw  watergun_exception, if the lines cannot be requested.
+     * @return The group.
+     */
+    virtual std::unique_ptr<gpio_output_group> request_outputs ( const std::vector<int>& pins ) = 0;
+
+    /** @name  request_input
+     * 
+     * @brief  Request an input line, which detects edges from when it is requested.
+     * @param  pin: The pin number.
+     * @param  pull_up: True for pull up, false for pull down.
+     * @throw  watergun_exception, if the line cannot be requested.
+     * @return The line.
+     */
+    virtual std::unique_ptr<gpio_input_line> request_input ( int pin, bool pull_up ) = 0;
+
+    /** @name  request_pwm
+     * 
+     * @brief  Request a PWM output, initially stopped.
+     * @param  pin: The pin number.
+     * @throw  watergun_exception, if the output cannot be requested.
+     * @return The output.
+     */
+    virtual std::unique_ptr<pwm_output> request_pwm ( int pin ) = 0;
+
+    /** @name  request_analog
+     * 
+     * @brief  Request an analog input.
+     * @param  pin: The pin number.
+     * @throw  watergun_exception, if the input cannot be requested, or the backend has no analog inputs.
+     * @return The input.
+     */
+    virtual std::unique_ptr<analog_input> request_analog ( int pin ) = 0;
+
+};
+
+
+
+/* HEADER GUARD */
+#endif /* #ifndef WATERGUN_GPIO_BACKEND_H_INCLUDED */
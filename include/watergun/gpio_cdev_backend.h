@@ -0,0 +1,286 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * include/watergun/gpio_cdev_backend.h
+ * 
+ * Header file for the GPIO backend which drives lines through the Linux GPIO character device, and PWM outputs through sysfs.
+ * 
+ */
+
+
+
+/* HEADER GUARD */
+#ifndef WATERGUN_GPIO_CDEV_BACKEND_H_INCLUDED
+#define WATERGUN_GPIO_CDEV_BACKEND_H_INCLUDED
+
+
+
+/* INCLUDES */
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <watergun/gpio_backend.h>
+#include <watergun/watergun_exception.h>
+
+
+
+/* DECLARATIONS */
+
+namespace watergun
+{
+    /** class gpio_cdev_backend
+     * 
+     * The GPIO backend which drives lines through the Linux GPIO character device.
+     */
+    class gpio_cdev_backend;
+}
+
+
+
+/* GPIO_CDEV_BACKEND DEFINITION */
+
+/** class gpio_cdev_backend
+ * 
+ * The GPIO backend which drives lines through the Linux GPIO character device, using version 2 of the uAPI which libgpiod v2 is built on.
+ * Pin numbers are line offsets on a single chip, such as /dev/gpiochip0. All of the lines of an output group are requested together,
+ * so updating any of them is a single ioctl. Input lines detect both edges in the kernel, which timestamps each edge when its interrupt is handled,
+ * so the timestamps do not depend on when the line is read. If the hardware timestamp engine is used, edges are timestamped by the hardware itself,
+ * which is only suitable on platforms where the engine counts on the monotonic clock.
+ * The character device has no PWM, so PWM outputs are channels of a sysfs PWM chip, such as /sys/class/pwm/pwmchip0.
+ */
+class watergun::gpio_cdev_backend : public gpio_backend
+{
+public:
+
+    /** @name constructor
+     * 
+     * @brief Open the GPIO chip.
+     * @param chip_path: The path of the chip's character device.
+     * @param _pwm_chip_path: The sysfs directory of the PWM chip.
+     * @param _hardware_timestamps: True to timestamp edges with the hardware timestamp engine, false for kernel timestamps on the monotonic clock.
+     * @throw watergun_exception, if the chip cannot be opened.
+     */
+    explicit gpio_cdev_backend ( const std::string& chip_path, std::string _pwm_chip_path = "/sys/class/pwm/pwmchip0", bool _hardware_timestamps = false );
+
+    /** @name deleted copy constructor
+     * 
+     * @brief Copying is not allowed, since the chip would be closed twice.
+     */
+    gpio_cdev_backend ( const gpio_cdev_backend& other ) = delete;
+
+    /** @name destructor
+     * 
+     * @brief Close the chip. Lines which have been requested stay requested until they are destroyed.
+     */
+    ~gpio_cdev_backend ();
+
+
+
+    /** @name  request_outputs
+     * 
+     * @brief  Request a group of output lines, all initially low.
+     * @param  pins: The line offset of each line in the group, or -1 for a line which is not present.
+     * @throw  watergun_exception, if the lines cannot be requested.
+     * @return The group.
+     */
+    std::unique_ptr<gpio_output_group> request_outputs ( const std::vector<int>& pins ) override;
+
+    /** @name  request_input
+     * 
+     * @brief  Request an input line, which detects edges from when it is requested.
+     * @param  pin: The line offset.
+     * @param  pull_up: True for pull up, false for pull down.
+     * @throw  watergun_exception, if the line cannot be requested.
+     * @return The line.
+     */
+    std::unique_ptr<gpio_input_line> request_input ( int pin, bool pull_up ) override;
+
+    /** @name  request_pwm
+     * 
+     * @brief  Request a PWM output, initially stopped, exporting the channel if it is not already.
+     * @param  pin: The channel of the PWM chip.
+     * @throw  watergun_exception, if the output cannot be requested.
+     * @return The output.
+     */
+    std::unique_ptr<watergun::pwm_output> request_pwm ( int pin ) override;
+
+    /** @name  request_analog
+     * 
+     * @brief  The character device has no analog inputs, so this always throws.
+     * @param  pin: The pin number.
+     * @throw  watergun_exception, always.
+     * @return Nothing.
+     */
+    std::unique_ptr<analog_input> request_analog ( int pin ) override;
+
+
+
+private:
+
+    /** class output_group
+     * 
+     * A group of output lines, requested together from the chip.
+     */
+    class output_group : public gpio_output_group
+    {
+    public:
+
+        /** @name constructor
+         * 
+         * @brief Take ownership of a line request.
+         * @param _request_fd: The file descriptor of the line request.
+         * @param _group_bits: The bit of the group for each line of the request.
+         */
+        output_group ( int _request_fd, std::vector<unsigned> _group_bits ) : request_fd { _request_fd }, group_bits { std::move ( _group_bits ) } {}
+
+        /** @name destructor
+         * 
+         * @brief Release the lines.
+         */
+        ~output_group ();
+
+        /** @name  write
+         * 
+         * @brief  Set the values of some of the lines in the group with a single ioctl.
+         * @param  values: The values of the lines, one bit per line.
+         * @param  mask: Which lines to set, one bit per line.
+         * @throw  watergun_exception, if the lines cannot be set.
+         * @return Nothing.
+         */
+        void write ( std::uint32_t values, std::uint32_t mask ) override;
+
+    private:
+
+        /* The file descriptor of the line request */
+        const int request_fd;
+
+        /* The bit of the group for each line of the request, since lines which are not present are not requested */
+        const std::vector<unsigned> group_bits;
+    };
+
+    /** class input_line
+     * 
+     * An input line, requested from the chip with edge detection.
+     */
+    class input_line : public gpio_input_line
+    {
+    public:
+
+        /** @name constructor
+         * 
+         * @brief Take ownership of a line request.
+         * @param _request_fd: The file descriptor of the line request.
+         */
+        explicit input_line ( int _request_fd ) : request_fd { _request_fd } {}
+
+        /** @name destructor
+         * 
+         * @brief Release the line.
+         */
+        ~input_line ();
+
+        /** @name  read
+         * 
+         * @brief  Read the current value of the line.
+         * @throw  watergun_exception, if the line cannot be read.
+         * @return 1 if high, 0 if low.
+         */
+        int read () override;
+
+        /** @name  wait_edge
+         * 
+         * @brief  Wait for the next edge event from the kernel.
+         * @param  timeout: The longest time to wait.
+         * @param  event: Set to the edge, if there was one.
+         * @throw  watergun_exception, if the events cannot be read.
+         * @return True if there was an edge, false if the wait timed out.
+         */
+        bool wait_edge ( clock::duration timeout, edge_event& event ) override;
+
+    private:
+
+        /* The file descriptor of the line request */
+        const int request_fd;
+    };
+
+    /** class pwm_output
+     * 
+     * A channel of a sysfs PWM chip.
+     */
+    class pwm_output : public watergun::pwm_output
+    {
+    public:
+
+        /** @name constructor
+         * 
+         * @brief Open the channel's attributes, and stop it.
+         * @param channel_path: The sysfs directory of the channel.
+         */
+        explicit pwm_output ( const std::string& channel_path );
+
+        /** @name destructor
+         * 
+         * @brief Stop the channel, and close its attributes.
+         */
+        ~pwm_output ();
+
+        /** @name  set_period_us
+         * 
+         * @brief  Set the period of the output, keeping the duty cycle at a half.
+         * @param  period_us: The period in whole microseconds.
+         * @throw  watergun_exception, if the period cannot be set.
+         * @return Nothing.
+         */
+        void set_period_us ( int period_us ) override;
+
+        /** @name  enable
+         * 
+         * @brief  Start or stop the output.
+         * @param  enabled: True to start, false to stop.
+         * @throw  watergun_exception, if the output cannot be started or stopped.
+         * @return Nothing.
+         */
+        void enable ( bool enabled ) override;
+
+    private:
+
+        /* The file descriptors of the period, duty cycle and enable attributes */
+        int period_fd { -1 }, duty_cycle_fd { -1 }, enable_fd { -1 };
+
+        /* The period last written in nanoseconds */
+        long period_ns { 0 };
+
+        /** @name  write_attribute
+         * 
+         * @brief  Write a number to an attribute.
+         * @param  fd: The file descriptor of the attribute.
+         * @param  value: The number to write.
+         * @throw  watergun_exception, if the write fails.
+         * @return Nothing.
+         */
+        static void write_attribute ( int fd, long value );
+    };
+
+
+
+    /* The file descriptor of the chip */
+    int chip_fd;
+
+    /* The sysfs directory of the PWM chip */
+    const std::string pwm_chip_path;
+
+    /* Whether to use the hardware timestamp engine */
+    const bool hardware_timestamps;
+
+};
+
+
+
+/* HEADER GUARD */
+#endif /* #ifndef WATERGUN_GPIO_CDEV_BACKEND_H_INCLUDED */
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * include/watergun/jitter_histogram.h
+ * 
+ * Header file for a lock-free histogram of how late timed events happen.
+ * 
+ */
+
+
+
+/* HEADER GUARD */
+#ifndef WATERGUN_JITTER_HISTOGRAM_H_INCLUDED
+#define WATERGUN_JITTER_HISTOGRAM_H_INCLUDED
+
+
+
+/* INCLUDES */
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+
+/* DECLARATIONS */
+
+namespace watergun
+{
+    /** class jitter_histogram
+     * 
+     * A lock-free histogram of how late timed events happen, in microsecond bins.
+     */
+    class jitter_histogram;
+}
+
+
+
+/* JITTER_HISTOGRAM DEFINITION */
+
+/** class jitter_histogram
+ * 
+ * A lock-free histogram of how late timed events happen, in microsecond bins.
+ * A single thread records lateness, which costs a few relaxed atomic operations, and any thread may read the histogram.
+ * Events earlier than their ideal time fall in the first bin, and events later than the last bin fall in an overflow bin.
+ */
+class watergun::jitter_histogram
+{
+public:
+
+    /* The number of microsecond bins, not including the overflow bin */
+    static constexpr std::size_t num_bins { 256 };
+
+
+
+    /** @name  record
+     * 
+     * @brief  Record the lateness of an event. Only one thread may record events.
+     * @param  lateness: How late the event happened compared to its ideal time.
+     * @return Nothing.
+     */
+    void record ( std::chrono::nanoseconds lateness ) noexcept;
+
+    /** @name  reset
+     * 
+     * @brief  Clear the histogram. Should only be called by the recording thread, or while nothing is being recorded.
+     * @return Nothing.
+     */
+    void reset () noexcept;
+
+
+
+    /** @name  get_counts
+     * 
+     * @brief  Get the number of events in each microsecond bin, followed by the overflow bin.
+     * @return Vector of num_bins + 1 counts.
+     */
+    std::vector<std::uint64_t> get_counts () const;
+
+    /** @name  get_count
+     * 
+     * @brief  Get the total number of events recorded.
+     * @return The count.
+     */
+    std::uint64_t get_count () const noexcept { return count.load ( std::memory_order_relaxed ); }
+
+    /** @name  get_max
+     * 
+     * @brief  Get the largest lateness recorded.
+     * @return The lateness.
+     */
+    std::chrono::nanoseconds get_max () const noexcept { return std::chrono::nanoseconds { max.load ( std::memory_order_relaxed ) }; }
+
+    /** @name  get_percentile
+     * 
+     * @brief  Get an upper bound on the lateness of a fraction of events, to the resolution of the bins.
+     * @param  fraction: The fraction of events, between 0 and 1.
+     * @return The upper edge of the bin which the percentile lies in, or the maximum lateness if it lies in the overflow bin.
+     */
+    std::chrono::nanoseconds get_percentile ( double fraction ) const;
+
+
+
+private:
+
+    /* The bins and the overflow bin */
+    std::array<std::atomic<std::uint64_t>, num_bins + 1> bins {};
+
+    /* The total number of events, and the largest lateness in nanoseconds */
+    std::atomic<std::uint64_t> count { 0 };
+    std::atomic<std::int64_t> max { 0 };
+
+};
+
+
+
+/* HEADER GUARD */
+#endif /* #ifndef WATERGUN_JITTER_HISTOGRAM_H_INCLUDED */
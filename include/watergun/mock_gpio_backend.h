@@ -0,0 +1,448 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * include/watergun/mock_gpio_backend.h
+ * 
+ * Header file for a GPIO backend which drives no hardware, but timestamps every transition so that it can be analysed or dumped as a VCD file.
+ * 
+ */
+
+
+
+/* HEADER GUARD */
+#ifndef WATERGUN_MOCK_GPIO_BACKEND_H_INCLUDED
+#define WATERGUN_MOCK_GPIO_BACKEND_H_INCLUDED
+
+
+
+/* INCLUDES */
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <watergun/gpio_backend.h>
+#include <watergun/realtime.h>
+#include <watergun/watergun_exception.h>
+
+
+
+/* DECLARATIONS */
+
+namespace watergun
+{
+    /** class mock_gpio_backend
+     * 
+     * A GPIO backend which drives no hardware, but timestamps every transition so that it can be analysed or dumped as a VCD file.
+     */
+    class mock_gpio_backend;
+}
+
+
+
+/* MOCK_GPIO_BACKEND DEFINITION */
+
+/** class mock_gpio_backend
+ * 
+ * A GPIO backend which drives no hardware, but timestamps every transition so that it can be analysed or dumped as a VCD file.
+ * Each pin is a signal, which records a transition whenever a write changes it. PWM outputs record changes of period, and their square wave is generated
+ * when the signal is analysed or dumped, restarting at each change, so a PWM output left running for a long time gives a long dump. Input lines hold the value given by set_input, and report an edge each time it changes.
+ * Every pin may only be requested once. Since the mock does not depend on mraa, devices given a mock backend can be built and run on any Linux machine,
+ * so that step timing can be measured without a logic analyser.
+ */
+class watergun::mock_gpio_backend : public gpio_backend
+{
+public:
+
+    /* The clock transitions are timestamped on */
+    typedef monotonic_clock clock;
+
+    /** struct transition
+     * 
+     * A change of a signal.
+     */
+    struct transition
+    {
+        /* When the change happened */
+        clock::time_point time;
+
+        /* The new value, which is 0 or 1 for a GPIO line, or the period in nanoseconds of a running PWM output, or 0 if it is stopped */
+        std::uint64_t value;
+    };
+
+    /** struct pulse_statistics
+     * 
+     * Statistics of the pulses of a signal, from rising edge to rising edge.
+     */
+    struct pulse_statistics
+    {
+        /* The number of pulses */
+        std::size_t pulses { 0 };
+
+        /* The mean pulse rate between the first and last pulse, in pulses per second */
+        double mean_rate { 0. };
+
+        /* The shortest and longest time for which a pulse was high */
+        clock::duration min_width { 0 }, max_width { 0 };
+
+        /* The shortest, mean and longest interval between consecutive pulses */
+        clock::duration min_interval { 0 }, mean_interval { 0 }, max_interval { 0 };
+
+        /* The largest change between consecutive intervals, which is the timing error of a pulse train which should be changing smoothly */
+        clock::duration max_interval_change { 0 };
+    };
+
+
+
+    /** @name constructor
+     * 
+     * @brief Start the timeline of the mock at the current time.
+     */
+    mock_gpio_backend ();
+
+    /** @name deleted copy constructor
+     * 
+     * @brief Copying is not allowed, since lines refer to the backend.
+     */
+    mock_gpio_backend ( const mock_gpio_backend& other ) = delete;
+
+
+
+    /** @name  request_outputs
+     * 
+     * @brief  Request a group of output lines, all initially low.
+     * @param  pins: The pin number of each line in the group, or -1 for a line which is not present.
+     * @throw  watergun_exception, if a pin has already been requested.
+     * @return The group.
+     */
+    std::unique_ptr<gpio_output_group> request_outputs ( const std::vector<int>& pins ) override;
+
+    /** @name  request_input
+     * 
+     * @brief  Request an input line, which is initially high if pulled up, and low if pulled down.
+     * @param  pin: The pin number.
+     * @param  pull_up: True for pull up, false for pull down.
+     * @throw  watergun_exception, if the pin has already been requested.
+     * @return The line.
+     */
+    std::unique_ptr<gpio_input_line> request_input ( int pin, bool pull_up ) override;
+
+    /** @name  request_pwm
+     * 
+     * @brief  Request a PWM output, initially stopped.
+     * @param  pin: The pin number.
+     * @throw  watergun_exception, if the pin has already been requested.
+     * @return The output.
+     */
+    std::unique_ptr<watergun::pwm_output> request_pwm ( int pin ) override;
+
+    /** @name  request_analog
+     * 
+     * @brief  Request an analog input, initially reading 0.
+     * @param  pin: The pin number.
+     * @throw  watergun_exception, if the pin has already been requested.
+     * @return The input.
+     */
+    std::unique_ptr<watergun::analog_input> request_analog ( int pin ) override;
+
+
+
+    /** @name  set_input
+     * 
+     * @brief  Drive an input line, as though its pin changed now.
+     * @param  pin: The pin number of the input line.
+     * @param  value: The new value, 0 or 1.
+     * @throw  watergun_exception, if the pin is not an input line.
+     * @return Nothing.
+     */
+    void set_input ( int pin, int value );
+
+    /** @name  set_analog
+     * 
+     * @brief  Drive an analog input.
+     * @param  pin: The pin number of the analog input.
+     * @param  value: The new reading, as a fraction of full scale.
+     * @throw  watergun_exception, if the pin is not an analog input.
+     * @return Nothing.
+     */
+    void set_analog ( int pin, double value );
+
+    /** @name  get_transitions
+     * 
+     * @brief  Get the transitions of a signal, oldest first.
+     * @param  pin: The pin number.
+     * @throw  watergun_exception, if the pin has not been requested.
+     * @return Vector of transitions.
+     */
+    std::vector<transition> get_transitions ( int pin ) const;
+
+    /** @name  analyse_pulses
+     * 
+     * @brief  Find the statistics of the pulses of a signal, such as the step pin of a stepper.
+     * @param  pin: The pin number.
+     * @throw  watergun_exception, if the pin has not been requested.
+     * @return The statistics.
+     */
+    pulse_statistics analyse_pulses ( int pin ) const;
+
+    /** @name  write_vcd
+     * 
+     * @brief  Write every signal as a value change dump, with nanosecond resolution, starting at the construction of the mock.
+     * @param  out: The stream to write to.
+     * @return Nothing.
+     */
+    void write_vcd ( std::ostream& out ) const;
+
+    /** @name  write_vcd
+     * 
+     * @brief  Write every signal as a value change dump file, with nanosecond resolution, starting at the construction of the mock.
+     * @param  path: The path of the file.
+     * @throw  watergun_exception, if the file cannot be written.
+     * @return Nothing.
+     */
+    void write_vcd ( const std::string& path ) const;
+
+
+
+private:
+
+    /** enum class signal_kind
+     * 
+     * The kinds of signal.
+     */
+    enum class signal_kind { output, input, pwm };
+
+    /** struct signal
+     * 
+     * A single requested pin.
+     */
+    struct signal
+    {
+        /* The kind of signal */
+        signal_kind kind;
+
+        /* The initial value, the current value, and the transitions from one to the other */
+        std::uint64_t initial, value;
+        std::vector<transition> transitions;
+
+        /* The edges of an input line which have not yet been waited for */
+        std::deque<gpio_input_line::edge_event> pending_edges;
+    };
+
+    /** class output_group
+     * 
+     * A group of mock output lines.
+     */
+    class output_group : public gpio_output_group
+    {
+    public:
+
+        /** @name constructor
+         * 
+         * @brief Set up the group.
+         * @param _backend: The backend to record transitions in.
+         * @param _pins: The pin number of each line, or -1 for a line which is not present.
+         */
+        output_group ( mock_gpio_backend& _backend, std::vector<int> _pins ) : backend { _backend }, pins { std::move ( _pins ) } {}
+
+        /** @name  write
+         * 
+         * @brief  Set the values of some of the lines in the group, recording a transition for each line which changes, all at the same time.
+         * @param  values: The values of the lines, one bit per line.
+         * @param  mask: Which lines to set, one bit per line.
+         * @return Nothing.
+         */
+        void write ( std::uint32_t values, std::uint32_t mask ) override;
+
+    private:
+
+        /* The backend, and the pin number of each line */
+        mock_gpio_backend& backend;
+        const std::vector<int> pins;
+    };
+
+    /** class input_line
+     * 
+     * A mock input line, driven by set_input.
+     */
+    class input_line : public gpio_input_line
+    {
+    public:
+
+        /** @name constructor
+         * 
+         * @brief Set up the line.
+         * @param _backend: The backend which drives the line.
+         * @param _pin: The pin number.
+         */
+        input_line ( mock_gpio_backend& _backend, int _pin ) : backend { _backend }, pin { _pin } {}
+
+        /** @name  read
+         * 
+         * @brief  Read the current value of the line.
+         * @return 1 if high, 0 if low.
+         */
+        int read () override;
+
+        /** @name  wait_edge
+         * 
+         * @brief  Wait for the next edge driven by set_input.
+         * @param  timeout: The longest time to wait.
+         * @param  event: Set to the edge, if there was one.
+         * @return True if there was an edge, false if the wait timed out.
+         */
+        bool wait_edge ( clock::duration timeout, edge_event& event ) override;
+
+    private:
+
+        /* The backend, and the pin number */
+        mock_gpio_backend& backend;
+        const int pin;
+    };
+
+    /** class pwm_output
+     * 
+     * A mock PWM output.
+     */
+    class pwm_output : public watergun::pwm_output
+    {
+    public:
+
+        /** @name constructor
+         * 
+         * @brief Set up the output.
+         * @param _backend: The backend to record transitions in.
+         * @param _pin: The pin number.
+         */
+        pwm_output ( mock_gpio_backend& _backend, int _pin ) : backend { _backend }, pin { _pin } {}
+
+        /** @name  set_period_us
+         * 
+         * @brief  Set the period of the output, recording a transition if it is running.
+         * @param  period_us: The period in whole microseconds.
+         * @return Nothing.
+         */
+        void set_period_us ( int period_us ) override;
+
+        /** @name  enable
+         * 
+         * @brief  Start or stop the output, recording a transition if it changes.
+         * @param  enabled: True to start, false to stop.
+         * @return Nothing.
+         */
+        void enable ( bool enabled ) override;
+
+    private:
+
+        /* The backend, and the pin number */
+        mock_gpio_backend& backend;
+        const int pin;
+
+        /* The period in nanoseconds, and whether the output is running */
+        std::uint64_t period_ns { 0 };
+        bool running { false };
+    };
+
+    /** class analog_input
+     * 
+     * A mock analog input, driven by set_analog.
+     */
+    class analog_input : public watergun::analog_input
+    {
+    public:
+
+        /** @name constructor
+         * 
+         * @brief Set up the input.
+         * @param _backend: The backend which drives the input.
+         * @param _pin: The pin number.
+         */
+        analog_input ( mock_gpio_backend& _backend, int _pin ) : backend { _backend }, pin { _pin } {}
+
+        /** @name  read
+         * 
+         * @brief  Read the input.
+         * @return The reading last set by set_analog.
+         */
+        double read () override;
+
+    private:
+
+        /* The backend, and the pin number */
+        mock_gpio_backend& backend;
+        const int pin;
+    };
+
+
+
+    /* The start of the timeline */
+    const clock::time_point start;
+
+    /* The signals by pin number */
+    std::map<int, signal> signals;
+
+    /* The readings of analog inputs by pin number, which are not signals, since they are not digital */
+    std::map<int, double> analog_readings;
+
+    /* Mutex to protect the signals, and a condition variable to signal edges of input lines */
+    mutable std::mutex mock_mx;
+    std::condition_variable edge_cv;
+
+
+
+    /** @name  add_signal
+     * 
+     * @brief  Add a signal for a newly requested pin. The mock mutex should already be locked.
+     * @param  pin: The pin number.
+     * @param  kind: The kind of signal.
+     * @param  value: The initial value.
+     * @throw  watergun_exception, if the pin has already been requested.
+     * @return Nothing.
+     */
+    void add_signal ( int pin, signal_kind kind, std::uint64_t value );
+
+    /** @name  record
+     * 
+     * @brief  Record a new value of a signal, if it has changed. The mock mutex should already be locked.
+     * @param  pin: The pin number.
+     * @param  value: The new value.
+     * @param  time: When the value changed.
+     * @return True if the value changed.
+     */
+    bool record ( int pin, std::uint64_t value, clock::time_point time );
+
+    /** @name  find_signal
+     * 
+     * @brief  Find the signal of a pin. The mock mutex should already be locked.
+     * @param  pin: The pin number.
+     * @throw  watergun_exception, if the pin has not been requested.
+     * @return The signal.
+     */
+    const signal& find_signal ( int pin ) const;
+
+    /** @name  levels
+     * 
+     * @brief  Find the changes of the logic level of a signal, generating the square waves of a PWM output. The mock mutex should already be locked.
+     * @param  sig: The signal.
+     * @param  end: The time at which a running PWM output is considered to stop.
+     * @return Vector of transitions, with values of 0 or 1.
+     */
+    static std::vector<transition> levels ( const signal& sig, clock::time_point end );
+
+};
+
+
+
+/* HEADER GUARD */
+#endif /* #ifndef WATERGUN_MOCK_GPIO_BACKEND_H_INCLUDED */
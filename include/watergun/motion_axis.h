@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * include/watergun/motion_axis.h
+ * 
+ * Header file for the interface of an axis which can be moved as part of a coordinated multi-axis movement.
+ * 
+ */
+
+
+
+/* HEADER GUARD */
+#ifndef WATERGUN_MOTION_AXIS_H_INCLUDED
+#define WATERGUN_MOTION_AXIS_H_INCLUDED
+
+
+
+/* INCLUDES */
+#include <chrono>
+#include <cstdint>
+#include <watergun/realtime.h>
+
+
+
+/* DECLARATIONS */
+
+namespace watergun
+{
+    /** class motion_axis
+     * 
+     * The interface of an axis which can be moved as part of a coordinated multi-axis movement.
+     */
+    class motion_axis;
+}
+
+
+
+/* MOTION_AXIS DEFINITION */
+
+/** class motion_axis
+ * 
+ * The interface of an axis which can be moved as part of a coordinated multi-axis movement.
+ * Segments are timed against the monotonic clock. A movement is a sequence of segments, each of which moves every axis by an angle over the same duration. At the start of each segment,
+ * the executor of the movement tells each axis its angle, and the axis replies with how many steps the executor should clock for it over the segment.
+ * Software stepped axes have their steps clocked by the executor, so they reply with their number of steps, and make one each time they are clocked.
+ * Axes which time their own steps, such as those stepped by hardware PWM, set their rate at the start of the segment and reply with zero steps.
+ */
+class watergun::motion_axis
+{
+public:
+
+    /** @name virtual destructor */
+    virtual ~motion_axis () = default;
+
+
+
+    /** @name  begin_segment
+     * 
+     * @brief  Begin a segment of a coordinated movement. Called by the executor at the start of the segment.
+     * @param  angle: The change in angle over the segment, positive meaning clockwise.
+     * @param  duration: The duration of the segment.
+     * @return The number of steps the executor should clock over the segment by calling segment_step, or zero if the axis times its own steps.
+     */
+    virtual std::uint64_t begin_segment ( double angle, monotonic_clock::duration duration ) = 0;
+
+    /** @name  segment_step
+     * 
+     * @brief  Make the next step of the current segment. Called by the executor as many times as begin_segment replied, spread evenly over the segment.
+     * @return Nothing.
+     */
+    virtual void segment_step () = 0;
+
+};
+
+
+
+/* HEADER GUARD */
+#endif /* #ifndef WATERGUN_MOTION_AXIS_H_INCLUDED */
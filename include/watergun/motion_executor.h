@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * include/watergun/motion_executor.h
+ * 
+ * Header file for executing coordinated movements of several axes on a single timing thread.
+ * 
+ */
+
+
+
+/* HEADER GUARD */
+#ifndef WATERGUN_MOTION_EXECUTOR_H_INCLUDED
+#define WATERGUN_MOTION_EXECUTOR_H_INCLUDED
+
+
+
+/* INCLUDES */
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+#include <watergun/jitter_histogram.h>
+#include <watergun/motion_axis.h>
+#include <watergun/realtime.h>
+#include <watergun/watergun_exception.h>
+
+
+
+/* DECLARATIONS */
+
+namespace watergun
+{
+    /** class motion_executor
+     * 
+     * Executes coordinated movements of several axes on a single timing thread, so that every axis starts and finishes each segment together.
+     */
+    class motion_executor;
+}
+
+
+
+/* MOTION_EXECUTOR DEFINITION */
+
+/** class motion_executor
+ * 
+ * Executes coordinated movements of several axes on a single timing thread, so that every axis starts and finishes each segment together.
+ * Segments are queued, and played back to back. At the start of a segment, each axis is told its angle and replies with a number of steps.
+ * The steps of all axes are then interleaved on one timeline with a digital differential analyser: the axis with the most steps is clocked at evenly spaced ticks
+ * over the segment, and each other axis steps on the ticks where its accumulated share of steps passes a whole step, as in Bresenham's line algorithm.
+ * Axes which time their own steps are only told their angle at the start of the segment, so both kinds of axis share the segment boundaries.
+ */
+class watergun::motion_executor
+{
+public:
+
+    /* The clock segments are timed against */
+    typedef monotonic_clock clock;
+
+    /* The maximum number of axes, and the number of segments which may be queued */
+    static constexpr std::size_t max_axes { 4 };
+    static constexpr std::size_t queue_size { 4 };
+
+    /** struct segment
+     * 
+     * A segment of a coordinated movement.
+     */
+    struct segment
+    {
+        /* The duration of the segment */
+        clock::duration duration;
+
+        /* The change in angle of each axis, in the order the axes were given to the executor */
+        std::array<double, max_axes> angles;
+    };
+
+
+
+    /** @name constructor
+     * 
+     * @brief Start the timing thread.
+     * @param _axes: The axes to move, which must remain valid for the lifetime of the executor.
+     * @throw watergun_exception, if there are no axes, too many axes, or an axis is null.
+     */
+    explicit motion_executor ( std::vector<motion_axis *> _axes );
+
+    /** @name deleted copy constructor
+     * 
+     * @brief Copying is not allowed, since the timing thread refers to the executor.
+     */
+    motion_executor ( const motion_executor& other ) = delete;
+
+    /** @name destructor
+     * 
+     * @brief Stop and join the timing thread.
+     */
+    ~motion_executor ();
+
+
+
+    /** @name  queue_segment
+     * 
+     * @brief  Queue a segment, to be played immediately after the segments before it, or immediately if there are none.
+     * @param  seg: The segment.
+     * @throw  watergun_exception, if the duration is negative.
+     * @return True if the segment was queued, or false if the queue is full.
+     */
+    bool queue_segment ( const segment& seg );
+
+    /** @name  clear
+     * 
+     * @brief  Remove all queued segments which have not yet started.
+     * @return Nothing.
+     */
+    void clear ();
+
+
+
+    /** @name  get_tick_jitter
+     * 
+     * @brief  Get the histogram of how late each tick of the timeline has been compared to when it was due.
+     * @return The histogram.
+     */
+    const jitter_histogram& get_tick_jitter () const noexcept { return tick_jitter; }
+
+
+
+private:
+
+    /* How long before a tick is due to stop sleeping and start spinning, which must cover the wake up latency of the scheduler */
+    static constexpr clock::duration spin_window { std::chrono::microseconds { 150 } };
+
+    /* The axes */
+    const std::vector<motion_axis *> axes;
+
+    /* The ring buffer of queued segments, the index of the oldest, and the number queued */
+    std::array<segment, queue_size> queue;
+    std::size_t queue_head { 0 }, queue_count { 0 };
+
+    /* The lateness of each tick */
+    jitter_histogram tick_jitter;
+
+    /* Mutex and condition variable for protecting the queue */
+    std::mutex executor_mx;
+    std::condition_variable_any executor_cv;
+
+    /* The timing thread */
+    std::jthread executor_thread;
+
+
+
+    /** @name  play_segment
+     * 
+     * @brief  Play a single segment on all of the axes.
+     * @param  seg: The segment.
+     * @param  start: The time at which to start the segment.
+     * @param  stoken: The stop token for the jthread, which stops playback between ticks.
+     * @return Nothing.
+     */
+    void play_segment ( const segment& seg, clock::time_point start, const std::stop_token& stoken );
+
+    /** @name  executor_thread_function
+     * 
+     * @brief  Function run by executor_thread. Plays queued segments back to back.
+     * @param  stoken: The stop token for the jthread.
+     * @return Nothing.
+     */
+    void executor_thread_function ( std::stop_token stoken );
+
+};
+
+
+
+/* HEADER GUARD */
+#endif /* #ifndef WATERGUN_MOTION_EXECUTOR_H_INCLUDED */
@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * include/watergun/mraa_gpio_backend.h
+ * 
+ * Header file for the GPIO backend which drives pins through mraa, one pin at a time.
+ * 
+ */
+
+
+
+/* HEADER GUARD */
+#ifndef WATERGUN_MRAA_GPIO_BACKEND_H_INCLUDED
+#define WATERGUN_MRAA_GPIO_BACKEND_H_INCLUDED
+
+
+
+/* INCLUDES */
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mraa/aio.hpp>
+#include <mraa/gpio.hpp>
+#include <mraa/pwm.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+#include <watergun/gpio_backend.h>
+#include <watergun/watergun_exception.h>
+
+
+
+/* DECLARATIONS */
+
+namespace watergun
+{
+    /** class mraa_gpio_backend
+     * 
+     * The GPIO backend which drives pins through mraa, one pin at a time.
+     */
+    class mraa_gpio_backend;
+}
+
+
+
+/* MRAA_GPIO_BACKEND DEFINITION */
+
+/** class mraa_gpio_backend
+ * 
+ * The GPIO backend which drives pins through mraa, one pin at a time.
+ * Pin numbers are mraa pin numbers. Updating a group writes each changed line separately, and edges are found by polling, so their timestamps are
+ * only as accurate as the polling period. This is the backend devices use if they are not given another, through default_gpio_backend.
+ */
+class watergun::mraa_gpio_backend : public gpio_backend
+{
+public:
+
+    /* How often an input line is polled while waiting for an edge */
+    static constexpr gpio_input_line::clock::duration poll_period { std::chrono::milliseconds { 1 } };
+
+
+
+    /** @name  request_outputs
+     * 
+     * @brief  Request a group of output lines, all initially low.
+     * @param  pins: The pin number of each line in the group, or -1 for a line which is not present.
+     * @throw  watergun_exception, if the lines cannot be requested.
+     * @return The group.
+     */
+    std::unique_ptr<gpio_output_group> request_outputs ( const std::vector<int>& pins ) override;
+
+    /** @name  request_input
+     * 
+     * @brief  Request an input line, which detects edges from when it is requested.
+     * @param  pin: The pin number.
+     * @param  pull_up: True for pull up, false for pull down.
+     * @throw  watergun_exception, if the line cannot be requested.
+     * @return The line.
+     */
+    std::unique_ptr<gpio_input_line> request_input ( int pin, bool pull_up ) override;
+
+    /** @name  request_pwm
+     * 
+     * @brief  Request a PWM output, initially stopped.
+     * @param  pin: The pin number.
+     * @throw  watergun_exception, if the output cannot be requested.
+     * @return The output.
+     */
+    std::unique_ptr<watergun::pwm_output> request_pwm ( int pin ) override;
+
+    /** @name  request_analog
+     * 
+     * @brief  Request an analog input.
+     * @param  pin: The mraa AIO pin number.
+     * @throw  watergun_exception, if the input cannot be requested.
+     * @return The input.
+     */
+    std::unique_ptr<watergun::analog_input> request_analog ( int pin ) override;
+
+
+
+private:
+
+    /** class output_group
+     * 
+     * A group of mraa output pins.
+     */
+    class output_group : public gpio_output_group
+    {
+    public:
+
+        /** @name constructor
+         * 
+         * @brief Open each present pin as an output, and write a 0.
+         * @param pins: The pin number of each line, or -1 for a line which is not present.
+         */
+        explicit output_group ( const std::vector<int>& pins );
+
+        /** @name  write
+         * 
+         * @brief  Set the values of some of the lines in the group, writing each line which changes.
+         * @param  values: The values of the lines, one bit per line.
+         * @param  mask: Which lines to set, one bit per line.
+         * @return Nothing.
+         */
+        void write ( std::uint32_t values, std::uint32_t mask ) override;
+
+    private:
+
+        /* The GPIO object of each line, or null for a line which is not present, and which lines are present.
+         * The objects are held by pointer, since mraa GPIO objects close their pin on destruction, so cannot be default constructed or copied.
+         */
+        std::vector<std::unique_ptr<mraa::Gpio>> lines;
+        std::uint32_t present { 0 };
+
+        /* The values last written */
+        std::uint32_t state { 0 };
+    };
+
+    /** class input_line
+     * 
+     * An mraa input pin, polled for edges.
+     */
+    class input_line : public gpio_input_line
+    {
+    public:
+
+        /** @name constructor
+         * 
+         * @brief Open the pin as an input.
+         * @param pin: The pin number.
+         * @param pull_up: True for pull up, false for pull down.
+         */
+        input_line ( int pin, bool pull_up );
+
+        /** @name  read
+         * 
+         * @brief  Read the current value of the line.
+         * @return 1 if high, 0 if low.
+         */
+        int read () override { return gpio.read () ? 1 : 0; }
+
+        /** @name  wait_edge
+         * 
+         * @brief  Poll the line until its value differs from the last value seen.
+         * @param  timeout: The longest time to wait.
+         * @param  event: Set to the edge, if there was one.
+         * @return True if there was an edge, false if the wait timed out.
+         */
+        bool wait_edge ( clock::duration timeout, edge_event& event ) override;
+
+    private:
+
+        /* The GPIO object */
+        mraa::Gpio gpio;
+
+        /* The last value seen while waiting for edges */
+        int last_value;
+    };
+
+    /** class pwm_output
+     * 
+     * An mraa PWM pin.
+     */
+    class pwm_output : public watergun::pwm_output
+    {
+    public:
+
+        /** @name constructor
+         * 
+         * @brief Open the pin, stopped with a duty cycle of a half.
+         * @param pin: The pin number.
+         */
+        explicit pwm_output ( int pin );
+
+        /** @name  set_period_us
+         * 
+         * @brief  Set the period of the output.
+         * @param  period_us: The period in whole microseconds.
+         * @return Nothing.
+         */
+        void set_period_us ( int period_us ) override { pwm.period_us ( period_us ); }
+
+        /** @name  enable
+         * 
+         * @brief  Start or stop the output.
+         * @param  enabled: True to start, false to stop.
+         * @return Nothing.
+         */
+        void enable ( bool enabled ) override { pwm.enable ( enabled ); }
+
+    private:
+
+        /* The PWM object */
+        mraa::Pwm pwm;
+    };
+
+    /** class analog_input
+     * 
+     * An mraa AIO pin.
+     */
+    class analog_input : public watergun::analog_input
+    {
+    public:
+
+        /** @name constructor
+         * 
+         * @brief Open the pin.
+         * @param pin: The pin number.
+         */
+        explicit analog_input ( int pin ) : aio { static_cast<unsigned> ( pin ) } {}
+
+        /** @name  read
+         * 
+         * @brief  Read the input.
+         * @return The reading as a fraction of the full scale of the input, from 0 to 1.
+         */
+        double read () override { return aio.readFloat (); }
+
+    private:
+
+        /* The AIO object */
+        mraa::Aio aio;
+    };
+
+};
+
+
+
+/* HEADER GUARD */
+#endif /* #ifndef WATERGUN_MRAA_GPIO_BACKEND_H_INCLUDED */
@@ -0,0 +1,526 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * include/watergun/planner.h
+ * 
+ * Header file for the planning core: ballistics, target scoring and movement planning.
+ * The planner is independent of the tracking sensor and motor hardware, and is re-entrant given a solver context per thread.
+ * 
+ */
+
+
+
+/* HEADER GUARD */
+#ifndef WATERGUN_PLANNER_H_INCLUDED
+#define WATERGUN_PLANNER_H_INCLUDED
+
+
+
+/* INCLUDES */
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <coin/CoinPackedMatrix.hpp>
+#include <coin/ClpSimplex.hpp>
+#include <complex>
+#include <cmath>
+#include <list>
+#include <span>
+#include <utility>
+#include <vector>
+#include <watergun/torque_curve.h>
+#include <watergun/tracked_user.h>
+#include <watergun/utility.h>
+#include <watergun/watergun_exception.h>
+
+
+
+/* DECLARATIONS */
+
+namespace watergun
+{
+    /** class planner
+     * 
+     * Plans how the watergun should aim at and move onto tracked users.
+     */
+    class planner;
+
+    /** class fixed_planner
+     * 
+     * Plans movements over a fixed horizon of N aim periods, without allocating.
+     */
+    template<int N> class fixed_planner;
+}
+
+
+
+/* PLANNER DEFINITION */
+
+/** class planner
+ * 
+ * Plans how the watergun should aim at and move onto tracked users.
+ */
+class watergun::planner
+{
+public:
+
+    /* Clock typedefs */
+    typedef tracking_clock clock;
+
+    /* The tracked user structure */
+    typedef watergun::tracked_user tracked_user;
+
+
+    /** struct gun_position
+     * 
+     * The position of the watergun in terms of yaw and pitch in radians, and the time of flight in seconds of water fired from it.
+     */
+    struct gun_position { double yaw, pitch; bool out_of_range = false; double flight_time = 0.; };
+
+    /** struct single_movement
+     * 
+     * Describes an amount of constant movement starting at a given point.
+     * A movement plan is a list of single movements.
+     */
+    struct single_movement
+    {
+        /* The duration for which the movement should last, or has lasted for */
+        clock::duration duration;
+
+        /* The time at which the movement was started, or maximum if not started */
+        clock::time_point timestamp;
+
+        /* The rate of change of yaw during this movement */
+        double yaw_rate;
+
+        /* The rate of change of pitch during this movement */
+        double pitch_rate;
+
+        /* The exact pitch to end with at the end of this movement */
+        double ending_pitch;
+
+        /* Whether the gun ends up on target (in both yaw and pitch) by the end of the movement */
+        bool ends_on_target = false;
+
+        /* The time of flight in seconds of water fired at the end of this movement, if it ends on target */
+        double flight_time = 0.;
+    };
+
+    /** struct engagement
+     * 
+     * Describes a single target within a sequence of engagements.
+     * An engagement sequence is a vector of engagements, to be carried out in order.
+     */
+    struct engagement
+    {
+        /* The user to engage, as they were passed to the sequencer */
+        tracked_user user;
+
+        /* The estimated time to slew onto the user, from the end of the previous engagement */
+        clock::duration slew_time;
+
+        /* The time to dwell on the user once on target */
+        clock::duration dwell_time;
+
+        /* The number of hits the dwell time should produce */
+        int hits;
+    };
+
+    /** struct solver_context
+     * 
+     * The solver state required to plan movements. Planning is re-entrant, so long as each concurrently planning thread uses its own context.
+     */
+    struct solver_context
+    {
+        /* The current model for movement planning */
+        ClpSimplex movement_model;
+    };
+
+    /** struct target_selection
+     * 
+     * The choice of target carried between frames, which adds hysteresis to target selection.
+     */
+    struct target_selection
+    {
+        /* The time penalty for switching away from the current target, and the minimum time to stay on a target once chosen */
+        clock::duration switching_penalty;
+        clock::duration min_dwell;
+
+        /* The ID of the current target, or 0 for none, and the time at which it was chosen */
+        int id = 0;
+        clock::time_point since = clock::time_point {};
+
+        /** @name  locked
+         * 
+         * @brief  Get whether the current target must be kept, as the minimum dwell has not yet passed.
+         * @param  now: The current time.
+         * @return True if locked, false otherwise.
+         */
+        bool locked ( clock::time_point now ) const noexcept { return id != 0 && now - since < min_dwell; }
+
+        /** @name  update
+         * 
+         * @brief  Record the target that has been chosen, resetting the dwell timer if it has changed.
+         * @param  target_id: The ID of the chosen target.
+         * @param  now: The current time.
+         * @return Nothing.
+         */
+        void update ( int target_id, clock::time_point now ) noexcept { if ( target_id != id ) { id = target_id; since = now; } }
+    };
+
+    /** struct target_score
+     * 
+     * The score given to a user during target selection, exposed for telemetry.
+     */
+    struct target_score
+    {
+        /* The user ID */
+        int id;
+
+        /* The estimated time for the gun to get on target, including any switching penalty */
+        clock::duration time_to_target;
+
+        /* The score given to the user */
+        double score;
+    };
+
+    /** struct sequencing_workspace
+     * 
+     * The buffers used while sequencing targets. Reusing a workspace between frames means sequencing does not allocate in the steady state.
+     */
+    struct sequencing_workspace
+    {
+        /** struct option
+         * 
+         * A user who could extend the sequence, along with the slew onto them.
+         */
+        struct option
+        {
+            /* The index of the user, and the time to slew onto them */
+            std::size_t user; clock::duration slew_time;
+
+            /* The position and rate of change of the aim once on target */
+            gun_position aim, aim_rate;
+
+            /* The hits per second of the sequence if extended by a single hit on the user */
+            double rate;
+        };
+
+        /* The sequence currently being explored */
+        std::vector<engagement> sequence;
+
+        /* Which users have been visited in the current sequence */
+        std::vector<bool> visited;
+
+        /* The best hits per second and time to target of sequences starting with each user */
+        std::vector<double> head_rates; std::vector<clock::duration> head_times;
+
+        /* The options at each depth of the sequence */
+        std::vector<option> options;
+    };
+
+
+
+    /** @name constructor
+     * 
+     * @brief Sets up the planner with the ballistic and motion parameters of the watergun.
+     * @param _water_rate: The velocity of the water leaving the watergun (depends on psi etc).
+     * @param _air_resistance: Horizontal deceleration of the water, to model small amounts of air resistance.
+     * @param _max_yaw_velocity: Maximum yaw angular velocity in radians per second.
+     * @param _yaw_torque: The torque curve of the yaw axis, giving the maximum yaw angular acceleration in radians per second squared at each velocity.
+     * @param _max_pitch_velocity: Maximum pitch angular velocity in radians per second.
+     * @param _pitch_torque: The torque curve of the pitch axis, giving the maximum pitch angular acceleration in radians per second squared at each velocity.
+     * @param _aim_period: The period of time with which to aspire to be correctly aimed within.
+     * @param _max_depth: The maximum distance at which a user can be tracked.
+     * @throw watergun_exception, if the aim period is not positive, or either axis cannot accelerate at its maximum velocity.
+     */
+    planner ( double _water_rate, double _air_resistance, double _max_yaw_velocity, const torque_curve& _yaw_torque, double _max_pitch_velocity, const torque_curve& _pitch_torque, clock::duration _aim_period, double _max_depth );
+
+
+
+    /** @name  get_aim_period
+     * 
+     * @brief  Get the period of time with which the gun aspires to be aiming at a user within.
+     * @return The aim period.
+     */
+    clock::duration get_aim_period () const noexcept { return aim_period; }
+
+    /** @name  get_max_yaw_velocity
+     * 
+     * @brief  Get the maximum yaw angular velocity.
+     * @return The velocity in radians per second.
+     */
+    double get_max_yaw_velocity () const noexcept { return max_yaw_velocity; }
+
+    /** @name  get_yaw_torque
+     * 
+     * @brief  Get the torque curve of the yaw axis.
+     * @return The torque curve.
+     */
+    const torque_curve& get_yaw_torque () const noexcept { return yaw_torque; }
+
+
+
+    /** @name  get_water_rate
+     * 
+     * @brief  Get the velocity of the water leaving the watergun. May be called from any thread.
+     * @return The water velocity.
+     */
+    double get_water_rate () const noexcept { return water_rate.load ( std::memory_order_relaxed ); }
+
+    /** @name  set_water_rate
+     * 
+     * @brief  Change the velocity of the water leaving the watergun, as the pressure behind it changes. May be called from any thread.
+     *         Each aim and plan is calculated with a single water velocity, so is consistent even if it changes part way through.
+     * @param  _water_rate: The new water velocity.
+     * @return Nothing.
+     */
+    void set_water_rate ( double _water_rate ) noexcept { water_rate.store ( _water_rate, std::memory_order_relaxed ); }
+
+
+
+    /** @name  calculate_aim
+     * 
+     * @brief  From a tracked user, find the yaw and pitch the watergun must shoot to hit the user for the current water velocity.
+     * @param  user: The user to aim at.
+     * @return A gun position. If the user cannot be hit, yaw is set to the user's angle, and pitch is set to 45 degrees.
+     */
+    gun_position calculate_aim ( const tracked_user& user ) const { return calculate_aim ( user, get_water_rate () ); }
+
+    /** @name  calculate_aim
+     * 
+     * @brief  From a tracked user, find the yaw and pitch the watergun must shoot to hit the user for a given water velocity.
+     * @param  user: The user to aim at.
+     * @param  rate: The water velocity.
+     * @return A gun position. If the user cannot be hit, yaw is set to the user's angle, and pitch is set to 45 degrees.
+     */
+    gun_position calculate_aim ( const tracked_user& user, double rate ) const;
+
+    /** @name  choose_target
+     * 
+     * @brief  Choose a user to aim at from the given list, based on the estimated time for the gun to get on target from its current movement.
+     *         Switching away from the current target is penalised, and is not allowed at all until the minimum dwell has passed.
+     * @param  users: The users to aim at.
+     * @param  current_movement: The current movement of the gun.
+     * @param  selection: The current target selection, which will be updated with the chosen target.
+     * @param  scores: If not null, will be set to the scores of each user which can be hit.
+     * @return The tracked user the gun has chosen to aim for, or a user with a zero COM if no user can be hit.
+     */
+    tracked_user choose_target ( const std::vector<tracked_user>& users, const single_movement& current_movement, target_selection& selection, std::vector<target_score> * scores = nullptr ) const;
+
+    /** @name  sequence_targets
+     * 
+     * @brief  Plan an ordered engagement of several users, choosing the order and dwell times to maximise the expected hits per second.
+     *         This is solved as a small orienteering problem. Every user who can be hit is first scored as the head of a sequence by their best single engagement,
+     *         then sequences are deepened best first under each head, pruning those which cannot beat the best found so far, until the sequencing budget is exhausted.
+     *         The first engagement is subject to the same hysteresis as choose_target, and the selection will be updated with it.
+     * @param  users: The users to aim at.
+     * @param  current_movement: The current movement of the gun.
+     * @param  selection: The current target selection, which will be updated with the first engagement.
+     * @param  scores: If not null, will be set to the best hits per second of a sequence starting with each user which can be hit.
+     * @return The best engagement sequence found, which is empty if no user can be hit.
+     */
+    std::vector<engagement> sequence_targets ( std::span<const tracked_user> users, const single_movement& current_movement, target_selection& selection, std::vector<target_score> * scores = nullptr ) const;
+
+    /** @name  sequence_targets
+     * 
+     * @brief  As above, but using the buffers of a workspace and writing the best sequence into a caller-provided vector, so that nothing is allocated
+     *         so long as the workspace, sequence and scores have the capacity for the number of users.
+     * @param  users: The users to aim at.
+     * @param  current_movement: The current movement of the gun.
+     * @param  selection: The current target selection, which will be updated with the first engagement.
+     * @param  workspace: The workspace to sequence in, which must not be in use by any other thread.
+     * @param  best_sequence: Will be set to the best engagement sequence found, which is empty if no user can be hit.
+     * @param  scores: If not null, will be set to the best hits per second of a sequence starting with each user which can be hit.
+     * @return Nothing.
+     */
+    void sequence_targets ( std::span<const tracked_user> users, const single_movement& current_movement, target_selection& selection, sequencing_workspace& workspace, std::vector<engagement>& best_sequence, std::vector<target_score> * scores = nullptr ) const;
+
+    /** @name  create_sequencing_workspace
+     * 
+     * @brief  Create a workspace for sequencing targets, with the capacity to sequence a number of users without allocating.
+     * @param  max_users: The number of users to reserve space for.
+     * @return The sequencing workspace.
+     */
+    sequencing_workspace create_sequencing_workspace ( std::size_t max_users ) const;
+
+    /** @name  create_solver_context
+     * 
+     * @brief  Create a new solver context for planning movements.
+     * @return The solver context.
+     */
+    solver_context create_solver_context () const;
+
+    /** @name  calculate_future_movements
+     * 
+     * @brief  Over the next n lots of aim periods, create a list of single movements to follow to keep on track with hitting a tracked user.
+     *         Both the yaw and pitch axes are planned, each subject to its own velocity and acceleration limits.
+     *         The output list will be shorter than n elements, if it becomes not possible to hit the targeted user.
+     * @param  user: The tracked user to aim for.
+     * @param  current_movement: The current movement of the gun.
+     * @param  n: The number of aim periods to single movements plans for.
+     * @param  context: The solver context to plan with, which must not be in use by any other thread.
+     * @return The list of single movements forming a movement plan.
+     */
+    std::list<single_movement> calculate_future_movements ( const tracked_user& user, const single_movement& current_movement, int n, solver_context& context ) const;
+
+
+
+private:
+
+    /* Fixed horizon planners share the planner's movement model */
+    template<int N> friend class fixed_planner;
+
+
+
+    /* The water velocity, which may change while planning */
+    std::atomic<double> water_rate;
+
+    /* Horizontal deceleration of water */
+    double air_resistance;
+
+    /* Maximum yaw angular velocity and torque curve */
+    double max_yaw_velocity; torque_curve yaw_torque;
+
+    /* Maximum pitch angular velocity and torque curve */
+    double max_pitch_velocity; torque_curve pitch_torque;
+
+    /* The period of time with which the gun should aspire to be aiming at a user within */
+    clock::duration aim_period; double aim_period_s;
+
+    /* The maximum distance at which a user can be tracked */
+    double max_depth;
+
+
+    /* The multiple to increase the movement model size by */
+    const int movement_model_size_multiple { 20 };
+
+    /* The number of radians away from hitting the user, the gun has to be to be considered 'on target' */
+    const double on_target_threshold { 5. * ( M_PI / 180. ) };
+
+    /* The time the gun must dwell on a user to score a single hit */
+    const clock::duration hit_dwell_time { std::chrono::milliseconds { 250 } };
+
+    /* The maximum number of consecutive hits to plan on a single user, and the value of each repeated hit relative to the previous */
+    const int max_hits_per_engagement { 3 };
+    const double repeat_hit_value { 0.5 };
+
+    /* The maximum number of users in an engagement sequence, and the maximum time into the future the sequence may extend to */
+    const int max_sequence_length { 6 };
+    const clock::duration sequence_horizon { std::chrono::seconds { 3 } };
+
+    /* The time budget for finding an engagement sequence */
+    const clock::duration sequencing_budget { std::chrono::milliseconds { 3 } };
+
+
+
+    /** @name  objective_weight
+     * 
+     * @brief  The weight given to the distance off target at the end of the i'th period, so that later periods are more desireable to minimise.
+     * @param  i: The period index.
+     * @return 1.1 to the power of i.
+     */
+    static constexpr double objective_weight ( int i ) noexcept { double w = 1.; while ( i-- > 0 ) w *= 1.1; return w; }
+
+    /** @name  create_basic_movement_model
+     * 
+     * @brief  Create a linear programming model for n future movements into the future. The constraint bounds will need to be modified later for the model to work.
+     *         The model contains a yaw block followed by a pitch block, each with 2n variables and 2n + 2k(n+1) constraints, where k is the number of lines in the torque curve of the axis.
+     * @param  n: The number of movements in the model.
+     * @param  objective_row: The objective coefficients for all 4n variables, or null to generate them using objective_weight.
+     * @return ClpModel object.
+     */
+    ClpModel create_basic_movement_model ( int n, const double * objective_row = nullptr ) const;
+
+    /** @name  movement_model_rows
+     * 
+     * @brief  Get the number of constraints in one axis of a movement model.
+     * @param  torque: The torque curve of the axis.
+     * @param  n: The number of movements in the model.
+     * @return The number of rows.
+     */
+    static int movement_model_rows ( const torque_curve& torque, int n ) noexcept { return n * 2 + ( n + 1 ) * 2 * static_cast<int> ( torque.get_lines ().size () ); }
+
+    /** @name  specialize_movement_model
+     * 
+     * @brief  Make a basic movement model specific to a given tracked user.
+     * @param  clp_model: A reference to the model to refine.
+     * @param  user: The tracked user to aim for.
+     * @param  current_movement: The current movement of the gun.
+     * @param  gun_positions: Set to the gun positions at the end of each period of the model. Must be the same size as the model.
+     * @return Nothing.
+     */
+    void specialize_movement_model ( ClpModel& clp_model, const tracked_user& user, const single_movement& current_movement, std::span<gun_position> gun_positions ) const;
+
+    /** @name  read_movement_solution
+     * 
+     * @brief  Read the solution of a solved movement model into single movements.
+     * @param  clp_model: The solved model.
+     * @param  user: The tracked user the model was specialized for.
+     * @param  current_movement: The current movement of the gun.
+     * @param  gun_positions: The gun positions produced by specializing the model.
+     * @param  future_movements: Set to the future movements. No more movements than are in the model may be read.
+     * @return Nothing.
+     */
+    void read_movement_solution ( const ClpModel& clp_model, const tracked_user& user, const single_movement& current_movement, std::span<const gun_position> gun_positions, std::span<single_movement> future_movements ) const;
+
+
+
+    /** @name  estimate_slew_time
+     * 
+     * @brief  Estimate the time taken for the gun to move from its current position onto a user, using time-optimal bang-bang movement on each axis.
+     * @param  from: The current position of the gun.
+     * @param  yaw_rate: The current yaw velocity of the gun.
+     * @param  pitch_rate: The current pitch velocity of the gun.
+     * @param  user: The tracked user to slew onto.
+     * @param  start: The time at which the slew starts.
+     * @param  aim: Set to the position of the gun once on target.
+     * @param  aim_rate: Set to the rate of change of the aim once on target.
+     * @return The estimated slew time, or the maximum duration if the user cannot be hit.
+     */
+    clock::duration estimate_slew_time ( const gun_position& from, double yaw_rate, double pitch_rate, const tracked_user& user, clock::time_point start, gun_position& aim, gun_position& aim_rate ) const;
+
+    /** @name  min_axis_time
+     * 
+     * @brief  Find the minimum time for a single axis to travel a displacement and come to rest, given velocity and acceleration limits.
+     * @param  displacement: The displacement to travel.
+     * @param  initial_rate: The initial velocity of the axis.
+     * @param  max_velocity: The maximum velocity of the axis.
+     * @param  max_acceleration: The maximum acceleration of the axis.
+     * @return The minimum time in seconds.
+     */
+    static double min_axis_time ( double displacement, double initial_rate, double max_velocity, double max_acceleration ) noexcept;
+
+
+
+    /** @name  solve_quadratic
+     * 
+     * @brief  Solves a quadratic equation with given coeficients in decreasing power order.
+     * @param  c0: The first coeficient (x^2).
+     * @param  c1: The first coeficient (x^1).
+     * @param  c2: The first coeficient (x^0).
+     * @return An array of two (possibly complex) solutions.
+     */
+    static std::array<std::complex<double>, 2> solve_quadratic ( const std::complex<double>& c0, const std::complex<double>& c1, const std::complex<double>& c2 );
+
+    /** @name  solve_quartic
+     * 
+     * @brief  Solves a quartic equation with given coeficients in decreasing power order.
+     *         Special thanks to Sidney Cadot (https://github.com/sidneycadot) for the function implementation.
+     * @param  c0: The first coeficient (x^4)...
+     * @param  c4: The last coeficient (x^0).
+     * @return Array of four (possibly complex) solutions.
+     */
+    static std::array<std::complex<double>, 4> solve_quartic ( const std::complex<double>& c0, const std::complex<double>& c1, const std::complex<double>& c2, const std::complex<double>& c3, const std::complex<double>& c4 ) noexcept;
+
+};
+
+
+
+/* HEADER GUARD */
+#endif /* #ifndef WATERGUN_PLANNER_H_INCLUDED */
+
+
@@ -0,0 +1,298 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * include/watergun/planning_pool.h
+ * 
+ * Header file for speculatively planning movements for several candidate targets in parallel.
+ * 
+ */
+
+
+
+/* HEADER GUARD */
+#ifndef WATERGUN_PLANNING_POOL_H_INCLUDED
+#define WATERGUN_PLANNING_POOL_H_INCLUDED
+
+
+
+/* INCLUDES */
+#include <array>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+#include <watergun/fixed_planner.h>
+#include <watergun/realtime.h>
+
+
+
+/* DECLARATIONS */
+
+namespace watergun
+{
+    /** class planning_pool
+     * 
+     * A pool of worker threads, each with their own fixed planner, which plan movements over N aim periods for candidate targets concurrently.
+     */
+    template<int N> class planning_pool;
+}
+
+
+
+/* PLANNING_POOL DEFINITION */
+
+/** class planning_pool
+ * 
+ * A pool of worker threads, each with their own fixed planner, which plan movements over N aim periods for candidate targets concurrently.
+ * The workers write their plans straight into buffers provided by the caller, so planning does not allocate in the steady state.
+ */
+template<int N> class watergun::planning_pool
+{
+public:
+
+    /* The number of aim periods planned for */
+    static constexpr int horizon = N;
+
+    /* Typedefs from the planner */
+    typedef planner::clock           clock;
+    typedef planner::tracked_user    tracked_user;
+    typedef planner::single_movement single_movement;
+
+    /** struct candidate_plan
+     * 
+     * A movement plan for a single candidate target, along with measures of its quality.
+     */
+    struct candidate_plan
+    {
+        /* The candidate target */
+        tracked_user user;
+
+        /* The planned movements */
+        typename fixed_planner<N>::movement_buffer movements;
+
+        /* The time until the first movement which ends on target, or the maximum duration if the plan never gets on target */
+        clock::duration time_to_target;
+
+        /* The fraction of planned movements which end on target */
+        double on_target_fraction;
+    };
+
+
+
+    /** @name constructor
+     * 
+     * @brief Create the fixed planners and start the worker threads.
+     * @param _planner: The planner to plan movements with.
+     * @param _num_workers: The number of worker threads.
+     * @throw watergun_exception, if the number of workers is not positive.
+     */
+    planning_pool ( const planner& _planner, int _num_workers );
+
+    /** @name deleted copy constructor
+     * 
+     * @brief Copying is not allowed, since the workers refer to the pool.
+     */
+    planning_pool ( const planning_pool& other ) = delete;
+
+    /** @name destructor
+     * 
+     * @brief Stop and join the worker threads.
+     */
+    ~planning_pool ();
+
+
+
+    /** @name  plan
+     * 
+     * @brief  Plan movements for each of the candidate targets on the worker threads, and wait for all of the plans to complete.
+     *         Only one thread should call this function at a time, and the candidates and results must stay alive until it returns.
+     * @param  candidates: The candidate targets.
+     * @param  current_movement: The current movement of the gun.
+     * @param  results: The buffer to write a candidate plan for each candidate target into, in the same order.
+     * @throw  watergun_exception, if there are fewer results than candidates.
+     * @return Nothing.
+     */
+    void plan ( std::span<const tracked_user> candidates, const single_movement& current_movement, std::span<candidate_plan> results );
+
+
+
+private:
+
+    /* The planner to plan movements with */
+    const planner& movement_planner;
+
+    /* The candidates being planned for, the current movement they are being planned with, and the results */
+    std::span<const tracked_user> jobs;
+    single_movement job_movement;
+    std::span<candidate_plan> job_results;
+
+    /* The index of the next job to take, and the number of jobs completed */
+    std::size_t next_job { 0 }, completed_jobs { 0 };
+
+    /* A mutex to protect the jobs, and condition variables to signal new jobs and completed jobs */
+    std::mutex pool_mx;
+    std::condition_variable_any jobs_cv, completed_cv;
+
+    /* The fixed planner owned by each worker */
+    std::vector<std::unique_ptr<fixed_planner<N>>> movement_plans;
+
+    /* The worker threads */
+    std::vector<std::jthread> workers;
+
+
+
+    /** @name  worker_thread_function
+     * 
+     * @brief  Function run by each worker thread. Takes jobs and plans them with its own fixed planner.
+     * @param  stoken: The stop token for the jthread.
+     * @param  worker_plans: The fixed planner owned by this worker.
+     * @return Nothing.
+     */
+    void worker_thread_function ( std::stop_token stoken, fixed_planner<N>& worker_plans );
+
+};
+
+
+
+/* PLANNING_POOL IMPLEMENTATION */
+
+
+
+/** @name constructor
+ * 
+ * @brief Create the fixed planners and start the worker threads.
+ * @param _planner: The planner to plan movements with.
+ * @param _num_workers: The number of worker threads.
+ * @throw watergun_exception, if the number of workers is not positive.
+ */
+template<int N> watergun::planning_pool<N>::planning_pool ( const planner& _planner, const int _num_workers )
+    : movement_planner { _planner }
+{
+    /* Throw if there are no workers, since no plan would ever complete */
+    if ( _num_workers <= 0 ) throw watergun_exception { "Planning pool must have at least one worker" };
+
+    /* Create a fixed planner for each worker, which is all the allocation planning needs */
+    for ( int i = 0; i < _num_workers; ++i ) movement_plans.push_back ( std::make_unique<fixed_planner<N>> ( movement_planner ) );
+
+    /* Start the workers, each with their own fixed planner */
+    for ( int i = 0; i < _num_workers; ++i ) workers.emplace_back ( [ this, &worker_plans = * movement_plans.at ( i ) ] ( std::stop_token stoken ) { worker_thread_function ( std::move ( stoken ), worker_plans ); } );
+}
+
+
+
+/** @name destructor
+ * 
+ * @brief Stop and join the worker threads.
+ */
+template<int N> watergun::planning_pool<N>::~planning_pool ()
+{
+    /* Join the threads */
+    for ( std::jthread& worker : workers ) if ( worker.joinable () ) { worker.request_stop (); worker.join (); }
+}
+
+
+
+/** @name  plan
+ * 
+ * @brief  Plan movements for each of the candidate targets on the worker threads, and wait for all of the plans to complete.
+ *         Only one thread should call this function at a time, and the candidates and results must stay alive until it returns.
+ * @param  candidates: The candidate targets.
+ * @param  current_movement: The current movement of the gun.
+ * @param  results: The buffer to write a candidate plan for each candidate target into, in the same order.
+ * @throw  watergun_exception, if there are fewer results than candidates.
+ * @return Nothing.
+ */
+template<int N> void watergun::planning_pool<N>::plan ( const std::span<const tracked_user> candidates, const single_movement& current_movement, const std::span<candidate_plan> results )
+{
+    /* Throw if there is not space for the results */
+    if ( results.size () < candidates.size () ) throw watergun_exception { "Planning pool given fewer results than candidates" };
+
+    /* Lock the mutex */
+    std::unique_lock<std::mutex> lock { pool_mx };
+
+    /* Set up the jobs */
+    jobs = candidates; job_movement = current_movement; job_results = results;
+    next_job = 0; completed_jobs = 0;
+
+    /* Notify the workers, and wait for them to complete all of the jobs */
+    jobs_cv.notify_all ();
+    completed_cv.wait ( lock, [ this ] { return completed_jobs == jobs.size (); } );
+
+    /* Forget the jobs, since they belong to the caller */
+    jobs = {}; job_results = {};
+}
+
+
+
+/** @name  worker_thread_function
+ * 
+ * @brief  Function run by each worker thread. Takes jobs and plans them with its own fixed planner.
+ * @param  stoken: The stop token for the jthread.
+ * @param  worker_plans: The fixed planner owned by this worker.
+ * @return Nothing.
+ */
+template<int N> void watergun::planning_pool<N>::worker_thread_function ( std::stop_token stoken, fixed_planner<N>& worker_plans )
+{
+    /* Take on the planning worker real-time role */
+    enter_realtime_role ( thread_role::planning_worker );
+
+    /* Lock the mutex */
+    std::unique_lock<std::mutex> lock { pool_mx };
+
+    /* Loop while not signalled to end */
+    while ( !stoken.stop_requested () )
+    {
+        /* Wait for a job to become availible */
+        if ( !jobs_cv.wait ( lock, stoken, [ this ] { return next_job < jobs.size (); } ) ) continue;
+
+        /* Take the job, and copy what is needed to plan it. The result is only written by this worker until the job is complete. */
+        const std::size_t job = next_job++;
+        const tracked_user user = jobs [ job ]; const single_movement current_movement = job_movement;
+        candidate_plan& result = job_results [ job ];
+
+        /* Unlock the mutex while planning */
+        lock.unlock ();
+
+        /* Plan the movements, and find the time to target and on target fraction.
+         * If planning fails, the job still completes, with a plan which holds the gun still and never gets on target, so that plan does not wait forever.
+         */
+        result.user = user; result.time_to_target = clock::duration::max (); result.on_target_fraction = 0.;
+        try
+        {
+            worker_plans.calculate_future_movements ( user, current_movement, result.movements );
+            int on_target = 0; for ( const single_movement& movement : result.movements ) if ( movement.ends_on_target )
+            {
+                if ( on_target++ == 0 ) result.time_to_target = movement.timestamp + movement.duration - user.timestamp;
+            }
+            result.on_target_fraction = static_cast<double> ( on_target ) / N;
+        } catch ( ... )
+        {
+            const clock::duration aim_period = movement_planner.get_aim_period ();
+            for ( int i = 0; i < N; ++i ) result.movements [ i ] = single_movement { aim_period, user.timestamp + aim_period * i, 0., 0., current_movement.ending_pitch };
+            result.time_to_target = clock::duration::max (); result.on_target_fraction = 0.;
+        }
+
+        /* Relock the mutex and notify if all jobs are complete */
+        lock.lock ();
+        if ( ++completed_jobs == jobs.size () ) completed_cv.notify_all ();
+    }
+}
+
+
+
+/* EXPLICIT INSTANTIATIONS */
+
+/* Planning pools for common horizon sizes, which are explicitly instantiated in the planning library */
+extern template class watergun::planning_pool<15>;
+extern template class watergun::planning_pool<30>;
+extern template class watergun::planning_pool<60>;
+
+
+
+/* HEADER GUARD */
+#endif /* #ifndef WATERGUN_PLANNING_POOL_H_INCLUDED */
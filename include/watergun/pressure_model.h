@@ -0,0 +1,246 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * include/watergun/pressure_model.h
+ * 
+ * Header file for modelling the pressure of the water reservoir, and the velocity of the water leaving the nozzle which follows from it.
+ * 
+ */
+
+
+
+/* HEADER GUARD */
+#ifndef WATERGUN_PRESSURE_MODEL_H_INCLUDED
+#define WATERGUN_PRESSURE_MODEL_H_INCLUDED
+
+
+
+/* INCLUDES */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <watergun/gpio_backend.h>
+#include <watergun/realtime.h>
+#include <watergun/watergun_exception.h>
+
+
+
+/* DECLARATIONS */
+
+namespace watergun
+{
+    /** class pressure_model
+     * 
+     * Models the pressure of the water reservoir as water is fired, and the velocity of the water leaving the nozzle.
+     */
+    class pressure_model;
+}
+
+
+
+/* PRESSURE_MODEL DEFINITION */
+
+/** class pressure_model
+ * 
+ * Models the pressure of the water reservoir as water is fired, and the velocity of the water leaving the nozzle.
+ * The reservoir is pressurised by a pocket of air, which expands isothermally as water leaves through the nozzle, so the pressure falls the longer the valve is open.
+ * The velocity of the water follows from Bernoulli's equation, scaled by a velocity coefficient for the losses of the nozzle.
+ * The model is integrated forwards whenever the valve is switched or the model is updated, and only changes while the valve is open.
+ * If a pressure sensor is present, a thread polls it and corrects the modelled pressure to the reading, so that the model does not drift.
+ * The water rate and pressure are published atomically, so may be read by any thread without blocking.
+ */
+class watergun::pressure_model
+{
+public:
+
+    /* The clock the valve is switched on */
+    typedef monotonic_clock clock;
+
+    /** struct state
+     * 
+     * A snapshot of the modelled reservoir.
+     */
+    struct state
+    {
+        /* The gauge pressure in Pa */
+        double pressure;
+
+        /* The velocity of the water leaving the nozzle in m/s */
+        double water_rate;
+
+        /* The volume of water remaining in m^3 */
+        double water_volume;
+
+        /* True if the pressure is below the low pressure threshold, or the water has run out */
+        bool low;
+    };
+
+
+
+    /** @name constructor
+     * 
+     * @brief Set up the model of a freshly filled reservoir, and start polling the pressure sensor if there is one.
+     * @param _pressure: The gauge pressure of the full reservoir in Pa.
+     * @param _air_volume: The volume of air in the full reservoir in m^3.
+     * @param _water_volume: The volume of water in the full reservoir in m^3.
+     * @param _nozzle_area: The cross-sectional area of the nozzle in m^2.
+     * @param _velocity_coefficient: The ratio of the real velocity of the water to that given by Bernoulli's equation, between 0 and 1.
+     * @param _low_pressure: The gauge pressure in Pa below which the pressure is considered low.
+     * @param _sensor_pin: The analog input pin of the pressure sensor, or -1 for not present.
+     * @param _sensor_scale: The gauge pressure in Pa per unit of sensor reading, where the reading is a fraction of full scale.
+     * @param _sensor_offset: The gauge pressure in Pa at a sensor reading of 0.
+     * @param _backend: The backend which provides the analog input. Defaults to default_gpio_backend.
+     * @throw watergun_exception, if a volume, area or coefficient is not positive, the pressure is negative, or the sensor cannot be set up.
+     */
+    pressure_model ( double _pressure, double _air_volume, double _water_volume, double _nozzle_area, double _velocity_coefficient, double _low_pressure, int _sensor_pin = -1, double _sensor_scale = 0., double _sensor_offset = 0., gpio_backend& _backend = default_gpio_backend () );
+
+    /** @name deleted copy constructor
+     * 
+     * @brief Copying is not allowed, since the sensor cannot be shared.
+     */
+    pressure_model ( const pressure_model& other ) = delete;
+
+    /** @name destructor
+     * 
+     * @brief Close and join the sensor thread.
+     */
+    ~pressure_model ();
+
+
+
+    /** @name  set_valve
+     * 
+     * @brief  Record that the valve opened or closed, integrating the model up to that time first.
+     * @param  open: True if the valve opened, false if it closed.
+     * @param  at: When water started or stopped leaving the nozzle.
+     * @return Nothing.
+     */
+    void set_valve ( bool open, clock::time_point at );
+
+    /** @name  update
+     * 
+     * @brief  Integrate the model up to a time, publishing the new water rate and pressure. Times before the last update are ignored.
+     * @param  now: The time to integrate to. Defaults to now.
+     * @return Nothing.
+     */
+    void update ( clock::time_point now = clock::now () );
+
+    /** @name  refill
+     * 
+     * @brief  Reset the model to a freshly filled reservoir.
+     * @return Nothing.
+     */
+    void refill ();
+
+
+
+    /** @name  get_water_rate
+     * 
+     * @brief  Get the velocity of the water leaving the nozzle, as of the last update.
+     * @return The velocity in m/s.
+     */
+    double get_water_rate () const noexcept { return water_rate.load ( std::memory_order_relaxed ); }
+
+    /** @name  get_pressure
+     * 
+     * @brief  Get the gauge pressure of the reservoir, as of the last update.
+     * @return The pressure in Pa.
+     */
+    double get_pressure () const noexcept { return pressure.load ( std::memory_order_relaxed ); }
+
+    /** @name  is_low
+     * 
+     * @brief  Find out whether the pressure is low, or the water has run out, as of the last update.
+     * @return True if firing should be rationed.
+     */
+    bool is_low () const noexcept { return low.load ( std::memory_order_relaxed ); }
+
+    /** @name  get_state
+     * 
+     * @brief  Get a consistent snapshot of the model, as of the last update.
+     * @return The state.
+     */
+    state get_state () const;
+
+
+
+private:
+
+    /* The density of water in kg/m^3, and atmospheric pressure in Pa */
+    static constexpr double water_density { 1000. }, atmospheric_pressure { 101325. };
+
+    /* The longest step to integrate the model over at once */
+    static constexpr clock::duration max_step { std::chrono::milliseconds { 1 } };
+
+    /* The period between readings of the pressure sensor */
+    static constexpr clock::duration sensor_period { std::chrono::milliseconds { 20 } };
+
+    /* The gauge pressure, air volume and water volume of the full reservoir */
+    const double initial_pressure, initial_air_volume, initial_water_volume;
+
+    /* The area of the nozzle, the velocity coefficient, and the low pressure threshold */
+    const double nozzle_area, velocity_coefficient, low_pressure;
+
+    /* The scale and offset of the sensor */
+    const double sensor_scale, sensor_offset;
+
+    /* The product of the absolute pressure and air volume, which is constant as the air expands, the volumes of air and water, whether the valve is open, and the time of the last update */
+    double pressure_volume, air_volume, water_volume;
+    bool valve_open { false };
+    clock::time_point last_update;
+
+    /* Mutex for protecting the model variables */
+    mutable std::mutex model_mx;
+
+    /* The published water rate, gauge pressure and low flag */
+    std::atomic<double> water_rate, pressure;
+    std::atomic<bool> low;
+
+    /* The pressure sensor, or null if not present */
+    std::unique_ptr<analog_input> sensor;
+
+    /* Condition variable used only to wait between sensor readings */
+    std::condition_variable_any sensor_cv;
+
+    /* Thread for polling the sensor */
+    std::jthread sensor_thread;
+
+
+
+    /** @name  integrate
+     * 
+     * @brief  Integrate the model up to a time. The model mutex should already be locked before this function is called.
+     * @param  now: The time to integrate to.
+     * @return Nothing.
+     */
+    void integrate ( clock::time_point now ) noexcept;
+
+    /** @name  publish
+     * 
+     * @brief  Publish the water rate, pressure and low flag of the model. The model mutex should already be locked before this function is called.
+     * @return Nothing.
+     */
+    void publish () noexcept;
+
+    /** @name  sensor_thread_function
+     * 
+     * @brief  The function which the sensor thread runs to correct the modelled pressure to the sensor readings.
+     * @param  stoken: The stop token for the jthread.
+     * @return Nothing.
+     */
+    void sensor_thread_function ( std::stop_token stoken );
+
+};
+
+
+
+/* HEADER GUARD */
+#endif /* #ifndef WATERGUN_PRESSURE_MODEL_H_INCLUDED */
@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * include/watergun/rate_history.h
+ * 
+ * Header file for a bounded history of piecewise constant rates, supporting fast lookup of the integrated value at any point in time.
+ * 
+ */
+
+
+
+/* HEADER GUARD */
+#ifndef WATERGUN_RATE_HISTORY_H_INCLUDED
+#define WATERGUN_RATE_HISTORY_H_INCLUDED
+
+
+
+/* INCLUDES */
+#include <algorithm>
+#include <cstddef>
+#include <watergun/ring_buffer.h>
+#include <watergun/utility.h>
+#include <watergun/watergun_exception.h>
+
+
+
+/* DECLARATIONS */
+
+namespace watergun
+{
+    /** class rate_history
+     * 
+     * A fixed capacity ring buffer of rate changes, which stores the integrated value at the start of each.
+     */
+    template<class Clock> class rate_history;
+}
+
+
+
+/* RATE_HISTORY DEFINITION */
+
+/** class rate_history
+ * 
+ * A fixed capacity ring buffer of rate changes, which stores the integrated value at the start of each.
+ * Once full, the oldest changes are overwritten, so memory use is constant however long the history is kept for.
+ * Looking up the value at a point in time is a binary search over the ring.
+ * The class is not thread safe.
+ */
+template<class Clock> class watergun::rate_history
+{
+public:
+
+    /* The clock rate changes are timestamped with */
+    typedef Clock clock;
+
+
+
+    /** @name constructor
+     * 
+     * @brief Allocate the ring buffer, starting with a rate of zero from now.
+     * @param _capacity: The maximum number of rate changes to remember.
+     * @throw watergun_exception, if the capacity is zero.
+     */
+    explicit rate_history ( std::size_t _capacity );
+
+
+
+    /** @name  push
+     * 
+     * @brief  Change the rate from a point in time. Changes scheduled after that point in time which are yet to be superseded are discarded.
+     * @param  start: The point in time the new rate starts from.
+     * @param  rate: The new rate.
+     * @return Nothing.
+     */
+    void push ( typename clock::time_point start, double rate ) noexcept;
+
+    /** @name  current_rate
+     * 
+     * @brief  Get the most recently pushed rate.
+     * @return The rate.
+     */
+    double current_rate () const noexcept { return entries.back ().rate; }
+
+
+
+    /** @name  value_at
+     * 
+     * @brief  Get the integrated value at a point in time, relative to the oldest remembered change.
+     *         Times before the oldest remembered change are clamped to its start, and times after the latest change assume the latest rate continues.
+     * @param  timestamp: The point in time.
+     * @return The integrated value.
+     */
+    double value_at ( typename clock::time_point timestamp ) const noexcept;
+
+    /** @name  delta
+     * 
+     * @brief  Get the change in integrated value between two points in time.
+     * @param  from: The first point in time.
+     * @param  to: The second point in time.
+     * @return The change in value.
+     */
+    double delta ( typename clock::time_point from, typename clock::time_point to ) const noexcept { return value_at ( to ) - value_at ( from ); }
+
+
+
+private:
+
+    /** struct entry
+     * 
+     * A rate change, along with the integrated value at its start.
+     */
+    struct entry
+    {
+        typename clock::time_point start;
+        double rate;
+        double start_value;
+    };
+
+    /* The ring buffer of entries, oldest first */
+    ring_buffer<entry> entries;
+
+};
+
+
+
+/* RATE_HISTORY IMPLEMENTATION */
+
+
+
+/** @name constructor
+ * 
+ * @brief Allocate the ring buffer, starting with a rate of zero from now.
+ * @param _capacity: The maximum number of rate changes to remember.
+ * @throw watergun_exception, if the capacity is zero.
+ */
+template<class Clock> watergun::rate_history<Clock>::rate_history ( const std::size_t _capacity )
+    : entries { _capacity }
+{
+    /* Throw if the capacity is zero */
+    if ( _capacity == 0 ) throw watergun_exception { "Rate history capacity must be positive" };
+
+    /* Start with a rate of zero */
+    entries.push_back ( entry { clock::now (), 0., 0. } );
+}
+
+
+
+/** @name  push
+ * 
+ * @brief  Change the rate from a point in time. Changes scheduled after that point in time which are yet to be superseded are discarded.
+ * @param  start: The point in time the new rate starts from.
+ * @param  rate: The new rate.
+ * @return Nothing.
+ */
+template<class Clock> void watergun::rate_history<Clock>::push ( const typename clock::time_point start, const double rate ) noexcept
+{
+    /* Discard changes which would start after this one, keeping at least one entry */
+    while ( entries.size () > 1 && entries.back ().start > start ) entries.pop_back ();
+
+    /* Find the value at which the new rate starts */
+    const entry previous = entries.back ();
+    const double start_value = previous.start_value + previous.rate * duration_to_seconds ( std::max ( start, previous.start ) - previous.start ).count ();
+
+    /* Store the new entry, dropping the oldest once full */
+    entries.push_back ( entry { std::max ( start, previous.start ), rate, start_value } );
+}
+
+
+
+/** @name  value_at
+ * 
+ * @brief  Get the integrated value at a point in time, relative to the oldest remembered change.
+ *         Times before the oldest remembered change are clamped to its start, and times after the latest change assume the latest rate continues.
+ * @param  timestamp: The point in time.
+ * @return The integrated value.
+ */
+template<class Clock> double watergun::rate_history<Clock>::value_at ( const typename clock::time_point timestamp ) const noexcept
+{
+    /* Clamp to the start of the oldest entry */
+    if ( timestamp <= entries [ 0 ].start ) return entries [ 0 ].start_value;
+
+    /* Binary search for the last entry which started before the timestamp */
+    std::size_t lower = 0, upper = entries.size ();
+    while ( upper - lower > 1 )
+    {
+        const std::size_t middle = lower + ( upper - lower ) / 2;
+        if ( entries [ middle ].start <= timestamp ) lower = middle; else upper = middle;
+    }
+
+    /* Add on the value since the start of that entry */
+    const entry& found = entries [ lower ];
+    return found.start_value + found.rate * duration_to_seconds ( timestamp - found.start ).count ();
+}
+
+
+
+/* HEADER GUARD */
+#endif /* #ifndef WATERGUN_RATE_HISTORY_H_INCLUDED */
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * include/watergun/realtime.h
+ * 
+ * Header file for the opt-in real-time scheduling profile: thread priorities and CPU affinity by role, memory locking and absolute deadline sleeps.
+ * 
+ */
+
+
+
+/* HEADER GUARD */
+#ifndef WATERGUN_REALTIME_H_INCLUDED
+#define WATERGUN_REALTIME_H_INCLUDED
+
+
+
+/* INCLUDES */
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+
+
+/* DECLARATIONS */
+
+namespace watergun
+{
+    /* The clock used for absolute deadlines, which is CLOCK_MONOTONIC on Linux */
+    typedef std::chrono::steady_clock monotonic_clock;
+
+    /** enum class thread_role
+     * 
+     * The roles of the threads which the real-time profile applies to.
+     */
+    enum class thread_role { tracker, planner, planning_worker, actuator, stepper };
+
+    /** struct realtime_profile
+     * 
+     * Scheduling settings for each thread role, and whether to lock the process' memory.
+     */
+    struct realtime_profile;
+
+    /** struct realtime_report
+     * 
+     * The result of the startup self-check, describing which parts of the real-time profile could be applied.
+     */
+    struct realtime_report;
+
+
+
+    /** @name  enable_realtime_profile
+     * 
+     * @brief  Enable a real-time profile for the process, then check which parts of it can be applied.
+     *         This should be called before any watergun objects are constructed, since threads only take on the profile as they start.
+     *         Without calling this function, all threads run with default scheduling.
+     * @param  profile: The profile to enable.
+     * @return A report of which parts of the profile could be applied.
+     */
+    realtime_report enable_realtime_profile ( const realtime_profile& profile );
+
+    /** @name  enter_realtime_role
+     * 
+     * @brief  Apply the scheduling settings of a role to the calling thread, and prefault its stack.
+     *         Does nothing if no real-time profile has been enabled.
+     * @param  role: The role of the calling thread.
+     * @return True if the settings were applied, or there is no profile to apply, false otherwise.
+     */
+    bool enter_realtime_role ( thread_role role ) noexcept;
+
+    /** @name  sleep_until_monotonic
+     * 
+     * @brief  Sleep until an absolute time on the monotonic clock, using clock_nanosleep, so that periodic work does not drift.
+     * @param  deadline: The time to sleep until.
+     * @return Nothing.
+     */
+    void sleep_until_monotonic ( monotonic_clock::time_point deadline ) noexcept;
+
+    /** @name  sleep_then_spin_until_monotonic
+     * 
+     * @brief  Wait until an absolute time on the monotonic clock, sleeping with clock_nanosleep until shortly before, then spinning on the clock.
+     *         Spinning avoids the wake up latency of the scheduler, which is far larger than the precision needed to time step pulses.
+     * @param  deadline: The time to wait until.
+     * @param  spin_window: How long before the deadline to stop sleeping and start spinning. Waits shorter than this do not sleep at all.
+     * @return The time at which the deadline was seen to have passed.
+     */
+    monotonic_clock::time_point sleep_then_spin_until_monotonic ( monotonic_clock::time_point deadline, monotonic_clock::duration spin_window ) noexcept;
+}
+
+
+
+/* REALTIME_PROFILE DEFINITION */
+
+/** struct realtime_profile
+ * 
+ * Scheduling settings for each thread role, and whether to lock the process' memory.
+ */
+struct watergun::realtime_profile
+{
+    /** struct role_settings
+     * 
+     * The scheduling settings for a single thread role.
+     */
+    struct role_settings
+    {
+        /* The SCHED_FIFO priority, or 0 to keep default scheduling */
+        int priority;
+
+        /* The CPU to pin the thread to, or -1 to not pin it */
+        int cpu;
+    };
+
+    /* The settings for each role. The step and actuation threads are the most time critical, then the tracker which timestamps frames, then planning. */
+    role_settings stepper         { 80, -1 };
+    role_settings actuator        { 70, -1 };
+    role_settings tracker         { 50, -1 };
+    role_settings planner         { 40, -1 };
+    role_settings planning_worker {  0, -1 };
+
+    /* Whether to lock all current and future memory, so that time critical threads do not page fault */
+    bool lock_memory { true };
+
+    /* The number of bytes of stack to prefault in each thread entering a role */
+    std::size_t prefault_stack_size { 64 * 1024 };
+
+
+
+    /** @name  settings
+     * 
+     * @brief  Get the settings for a role.
+     * @param  role: The role.
+     * @return The settings.
+     */
+    const role_settings& settings ( thread_role role ) const noexcept;
+};
+
+
+
+/* REALTIME_REPORT DEFINITION */
+
+/** struct realtime_report
+ * 
+ * The result of the startup self-check, describing which parts of the real-time profile could be applied.
+ */
+struct watergun::realtime_report
+{
+    /* Whether memory was locked */
+    bool memory_locked;
+
+    /* Whether SCHED_FIFO scheduling at the highest requested priority is permitted */
+    bool fifo_scheduling;
+
+    /* Whether all requested CPUs exist and can be pinned to */
+    bool cpu_affinity;
+
+    /* A human readable description of the report, including reasons for failures */
+    std::string description;
+};
+
+
+
+/* HEADER GUARD */
+#endif /* #ifndef WATERGUN_REALTIME_H_INCLUDED */
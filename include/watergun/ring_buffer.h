@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * include/watergun/ring_buffer.h
+ * 
+ * Header file for a fixed capacity ring buffer, which overwrites its oldest element once full.
+ * 
+ */
+
+
+
+/* HEADER GUARD */
+#ifndef WATERGUN_RING_BUFFER_H_INCLUDED
+#define WATERGUN_RING_BUFFER_H_INCLUDED
+
+
+
+/* INCLUDES */
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+
+
+/* DECLARATIONS */
+
+namespace watergun
+{
+    /** class ring_buffer
+     * 
+     * A fixed capacity ring buffer, which overwrites its oldest element once full.
+     */
+    template<class T> class ring_buffer;
+}
+
+
+
+/* RING_BUFFER DEFINITION */
+
+/** class ring_buffer
+ * 
+ * A fixed capacity ring buffer, which overwrites its oldest element once full.
+ * All storage is allocated on construction, so pushing never allocates. Elements are indexed by age, where 0 is the oldest.
+ * The class is not thread safe.
+ */
+template<class T> class watergun::ring_buffer
+{
+public:
+
+    /** @name constructor
+     * 
+     * @brief Allocate the storage. The buffer must have a non-zero capacity before anything is pushed.
+     * @param _capacity: The maximum number of elements to remember.
+     */
+    explicit ring_buffer ( const std::size_t _capacity ) : elements ( _capacity ) {}
+
+
+
+    /** @name  push_back
+     * 
+     * @brief  Add an element as the newest. If full, the oldest element is dropped to make room.
+     * @param  element: The element to add.
+     * @return Nothing.
+     */
+    void push_back ( const T& element ) noexcept ( std::is_nothrow_copy_assignable_v<T> )
+    {
+        /* If full, drop the oldest element, otherwise grow, then store the element */
+        if ( count == elements.size () ) head = ( head + 1 ) % elements.size (); else ++count;
+        back () = element;
+    }
+
+    /** @name  pop_back
+     * 
+     * @brief  Remove the newest element. The buffer must not be empty.
+     * @return Nothing.
+     */
+    void pop_back () noexcept { --count; }
+
+
+
+    /** @name  size, capacity, empty
+     * 
+     * @brief  Get the number of elements, the maximum number of elements, or whether there are no elements.
+     * @return The size, capacity, or whether empty.
+     */
+    std::size_t size () const noexcept { return count; }
+    std::size_t capacity () const noexcept { return elements.size (); }
+    bool empty () const noexcept { return count == 0; }
+
+    /** @name  operator []
+     * 
+     * @brief  Get an element by its age, where 0 is the oldest.
+     * @param  i: The index of the element from the oldest.
+     * @return The element.
+     */
+    const T& operator [] ( const std::size_t i ) const noexcept { return elements [ ( head + i ) % elements.size () ]; }
+    T& operator [] ( const std::size_t i ) noexcept { return elements [ ( head + i ) % elements.size () ]; }
+
+    /** @name  back
+     * 
+     * @brief  Get the newest element. The buffer must not be empty.
+     * @return The element.
+     */
+    const T& back () const noexcept { return ( * this ) [ count - 1 ]; }
+    T& back () noexcept { return ( * this ) [ count - 1 ]; }
+
+
+
+private:
+
+    /* The storage for the elements */
+    std::vector<T> elements;
+
+    /* The index of the oldest element, and the number of elements in use */
+    std::size_t head { 0 }, count { 0 };
+
+};
+
+
+
+/* HEADER GUARD */
+#endif /* #ifndef WATERGUN_RING_BUFFER_H_INCLUDED */
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * include/watergun/seqlock.h
+ * 
+ * Header file for a snapshot of a small value, written by a single thread and read by any number of threads without locking.
+ * 
+ */
+
+
+
+/* HEADER GUARD */
+#ifndef WATERGUN_SEQLOCK_H_INCLUDED
+#define WATERGUN_SEQLOCK_H_INCLUDED
+
+
+
+/* INCLUDES */
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+
+
+/* DECLARATIONS */
+
+namespace watergun
+{
+    /** class seqlock
+     * 
+     * A snapshot of a trivially copyable value, written by a single thread and read by many without locking.
+     */
+    template<class T> class seqlock;
+}
+
+
+
+/* SEQLOCK DEFINITION */
+
+/** class seqlock
+ * 
+ * A snapshot of a trivially copyable value, written by a single thread and read by many without locking.
+ * The writer never waits. Readers retry if the value was being written while they read it.
+ * The value is stored as atomic words, so that concurrent reads and writes are well defined.
+ */
+template<class T> class watergun::seqlock
+{
+public:
+
+    /* The value must be trivially copyable */
+    static_assert ( std::is_trivially_copyable_v<T>, "seqlock value must be trivially copyable" );
+
+    /** @name constructor
+     * 
+     * @brief Initialize the snapshot.
+     * @param initial: The initial value.
+     */
+    explicit seqlock ( const T& initial = T {} ) noexcept { store ( initial ); }
+
+    /** @name deleted copy constructor
+     * 
+     * @brief Copying is not allowed, since the value is shared between threads.
+     */
+    seqlock ( const seqlock& other ) = delete;
+
+
+
+    /** @name  store
+     * 
+     * @brief  Store a new value. Only one thread may call this.
+     * @param  value: The value to store.
+     * @return Nothing.
+     */
+    void store ( const T& value ) noexcept
+    {
+        /* Split the value into words */
+        std::array<std::uint64_t, num_words> value_words {}; std::memcpy ( value_words.data (), &value, sizeof ( T ) );
+
+        /* Mark the value as being written, write the words, then mark it as written */
+        const std::uint64_t seq = sequence.load ( std::memory_order_relaxed );
+        sequence.store ( seq + 1, std::memory_order_relaxed );
+        std::atomic_thread_fence ( std::memory_order_release );
+        for ( std::size_t i = 0; i < num_words; ++i ) words [ i ].store ( value_words [ i ], std::memory_order_relaxed );
+        sequence.store ( seq + 2, std::memory_order_release );
+    }
+
+    /** @name  load
+     * 
+     * @brief  Load the value, retrying while it is being written.
+     * @return The value.
+     */
+    T load () const noexcept
+    {
+        /* Read the words until the sequence is even and unchanged across the read */
+        std::array<std::uint64_t, num_words> value_words; std::uint64_t seq; do
+        {
+            seq = sequence.load ( std::memory_order_acquire );
+            for ( std::size_t i = 0; i < num_words; ++i ) value_words [ i ] = words [ i ].load ( std::memory_order_relaxed );
+            std::atomic_thread_fence ( std::memory_order_acquire );
+        } while ( ( seq & 1 ) || seq != sequence.load ( std::memory_order_relaxed ) );
+
+        /* Reassemble the value */
+        T value; std::memcpy ( static_cast<void *> ( &value ), value_words.data (), sizeof ( T ) );
+        return value;
+    }
+
+
+
+private:
+
+    /* The number of words needed to store the value */
+    static constexpr std::size_t num_words { ( sizeof ( T ) + sizeof ( std::uint64_t ) - 1 ) / sizeof ( std::uint64_t ) };
+
+    /* The sequence number, which is odd while the value is being written */
+    std::atomic<std::uint64_t> sequence { 0 };
+
+    /* The words of the value */
+    std::array<std::atomic<std::uint64_t>, num_words> words {};
+
+};
+
+
+
+/* HEADER GUARD */
+#endif /* #ifndef WATERGUN_SEQLOCK_H_INCLUDED */
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * include/watergun/setpoint_generator.h
+ * 
+ * Header file for interpolating a plan of piecewise constant movements into smooth yaw velocity and pitch setpoints.
+ * 
+ */
+
+
+
+/* HEADER GUARD */
+#ifndef WATERGUN_SETPOINT_GENERATOR_H_INCLUDED
+#define WATERGUN_SETPOINT_GENERATOR_H_INCLUDED
+
+
+
+/* INCLUDES */
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+#include <watergun/planner.h>
+
+
+
+/* DECLARATIONS */
+
+namespace watergun
+{
+    /** class setpoint_generator
+     * 
+     * Interpolates a plan of piecewise constant movements into smooth yaw velocity and pitch setpoints.
+     */
+    class setpoint_generator;
+}
+
+
+
+/* SETPOINT_GENERATOR DEFINITION */
+
+/** class setpoint_generator
+ * 
+ * Interpolates a plan of piecewise constant movements into smooth yaw velocity and pitch setpoints.
+ * The yaw velocity ramps linearly from each movement's rate to the next, over a window centred on the boundary between them which spans half of each movement.
+ * Since each ramp is symmetric about the boundary, the change in yaw over the plan is preserved, and the acceleration of the ramp is the same as the plan's.
+ * The exception is the start of the plan, where the velocity ramps from the starting rate to the first movement's rate over the first half of the movement.
+ * The pitch moves linearly from each movement's starting pitch to its ending pitch.
+ */
+class watergun::setpoint_generator
+{
+public:
+
+    /* Typedefs from the planner */
+    typedef planner::clock           clock;
+    typedef planner::single_movement single_movement;
+
+    /** struct setpoint
+     * 
+     * The setpoints at a single point in time.
+     */
+    struct setpoint
+    {
+        /* The yaw velocity */
+        double yaw_rate;
+
+        /* The pitch */
+        double pitch;
+
+        /* The index of the movement in the plan which the setpoint lies in */
+        std::size_t movement;
+    };
+
+
+
+    /** @name constructor
+     * 
+     * @brief Reserve space for plans.
+     * @param max_movements: The largest number of movements in a plan to reserve space for.
+     */
+    explicit setpoint_generator ( std::size_t max_movements );
+
+
+
+    /** @name  load
+     * 
+     * @brief  Load a new plan, which starts at offset zero.
+     * @param  plan: The plan of movements. The reference must remain valid until another plan is loaded.
+     * @param  start_yaw_rate: The yaw velocity at the start of the plan, which is ramped from into the first movement.
+     * @param  start_pitch: The pitch at the start of the plan.
+     * @return Nothing.
+     */
+    void load ( const std::vector<single_movement>& plan, double start_yaw_rate, double start_pitch );
+
+    /** @name  at
+     * 
+     * @brief  Get the setpoints at an offset from the start of the plan.
+     * @param  offset: The time since the start of the plan.
+     * @return The setpoints.
+     */
+    setpoint at ( clock::duration offset ) const noexcept;
+
+    /** @name  empty
+     * 
+     * @brief  Find out whether a plan is loaded.
+     * @return True if there is no plan.
+     */
+    bool empty () const noexcept { return !plan || plan->empty (); }
+
+
+
+private:
+
+    /* The loaded plan */
+    const std::vector<single_movement> * plan { nullptr };
+
+    /* The yaw velocity and pitch before the plan */
+    double start_yaw_rate { 0. }, start_pitch { 0. };
+
+    /* The offset of the start of each movement */
+    std::vector<clock::duration> starts;
+
+};
+
+
+
+/* HEADER GUARD */
+#endif /* #ifndef WATERGUN_SETPOINT_GENERATOR_H_INCLUDED */
@@ -19,7 +19,8 @@
 
 
 /* INCLUDES */
-#include <mraa/gpio.hpp>
+#include <memory>
+#include <watergun/gpio_backend.h>
 #include <watergun/watergun_exception.h>
 
 
@@ -29,7 +30,7 @@
 namespace watergun
 {
     /** class solenoid
-     *
+     * 
      * Class to abstract the control of a solenoid valve.
      */
     class solenoid;
@@ -40,7 +41,7 @@ namespace watergun
 /* SOLENOID DEFINITION */
 
 /** class solenoid
- *
+ * 
  * Class to abstract the control of a solenoid valve.
  */
 class watergun::solenoid
@@ -51,8 +52,9 @@ public:
      * 
      * @brief Give a pin number to set up the solenoid
      * @param _solenoid_pin: The pin number to use for the solenoid.
+     * @param backend: The backend which provides the GPIO line. Defaults to default_gpio_backend.
      */
-    solenoid ( int _solenoid_pin );
+    solenoid ( int _solenoid_pin, gpio_backend& backend = default_gpio_backend () );
 
 
 
@@ -61,14 +63,14 @@ public:
      * @brief  Set the solenoid to be powered on.
      * @return Nothing.
      */
-    void power_on () { if ( !solenoid_state ) solenoid_gpio.write ( solenoid_state = 1 ); }
+    void power_on () { if ( !solenoid_state ) solenoid_line->write ( solenoid_state = 1, 1 ); }
 
     /** @name  power_off
      * 
      * @brief  Set the solenoid valve to be powered off.
      * @return Nothing.
      */
-    void power_off () { if ( solenoid_state ) solenoid_gpio.write ( solenoid_state = 0 ); }
+    void power_off () { if ( solenoid_state ) solenoid_line->write ( solenoid_state = 0, 1 ); }
 
     /** @name  is_powered
      * 
@@ -84,8 +86,8 @@ private:
     /* The pin number for the solenoid */
     int solenoid_pin;
 
-    /* The GPIO object for the pin */
-    mraa::Gpio solenoid_gpio;
+    /* The GPIO line for the pin */
+    std::unique_ptr<gpio_output_group> solenoid_line;
 
     /* Whether the solenoid is currently powered */
     int solenoid_state { 0 };
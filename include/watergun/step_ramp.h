@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * include/watergun/step_ramp.h
+ * 
+ * Header file for precomputed stepper acceleration ramps, and an integer step interval generator which follows them.
+ * 
+ */
+
+
+
+/* HEADER GUARD */
+#ifndef WATERGUN_STEP_RAMP_H_INCLUDED
+#define WATERGUN_STEP_RAMP_H_INCLUDED
+
+
+
+/* INCLUDES */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include <watergun/torque_curve.h>
+#include <watergun/watergun_exception.h>
+
+
+
+/* DECLARATIONS */
+
+namespace watergun
+{
+    /** class step_ramp
+     * 
+     * A precomputed table of the intervals between consecutive steps when accelerating a stepper motor from rest.
+     */
+    class step_ramp;
+
+    /** class step_generator
+     * 
+     * Generates the direction of and interval after each step of a motion, by walking up and down a step_ramp.
+     */
+    class step_generator;
+}
+
+
+
+/* STEP_RAMP DEFINITION */
+
+/** class step_ramp
+ * 
+ * A precomputed table of the intervals between consecutive steps when accelerating a stepper motor from rest.
+ * Element i of the table is the interval in nanoseconds between step i and step i + 1, so the table ends once the maximum velocity is reached.
+ * Decelerating to rest walks the table backwards, so is the mirror image of accelerating.
+ * Without jerk limiting, the table is generated with the integer recurrence from AVR446 (D. Austin, "Generate stepper-motor speed profiles in real time").
+ * With jerk limiting, the acceleration ramps up to and down from its maximum, giving an S-curve, and the table is generated by solving for the time of each step.
+ * If the acceleration is limited by a torque curve which falls with velocity, the table is instead generated by integrating the motion one step at a time.
+ */
+class watergun::step_ramp
+{
+public:
+
+    /* The type of a step interval in nanoseconds */
+    typedef std::uint32_t interval_type;
+
+
+
+    /** @name constructor
+     * 
+     * @brief Precompute the table of step intervals.
+     * @param _microstep_size: The angle of a single step in radians.
+     * @param max_velocity: The maximum angular velocity in rad/sec.
+     * @param torque: The torque curve, giving the maximum angular acceleration in rad/sec^2 at each velocity.
+     * @param max_jerk: The maximum angular jerk in rad/sec^3, or 0 for unlimited jerk.
+     * @param min_interval: The minimum interval between steps.
+     * @throw watergun_exception, if the step size or velocity is not positive, the torque curve cannot accelerate at the maximum velocity, or the jerk is negative.
+     */
+    step_ramp ( double _microstep_size, double max_velocity, const torque_curve& torque, double max_jerk, std::chrono::nanoseconds min_interval );
+
+
+
+    /** @name  microstep_size
+     * 
+     * @brief  Get the angle of a single step.
+     * @return The angle in radians.
+     */
+    double microstep_size () const noexcept { return step_angle; }
+
+    /** @name  size
+     * 
+     * @brief  Get the number of intervals in the table, which is the number of steps taken to reach maximum velocity from rest.
+     * @return The number of intervals, which is at least one.
+     */
+    std::size_t size () const noexcept { return intervals.size (); }
+
+    /** @name  operator []
+     * 
+     * @brief  Get an interval from the table.
+     * @param  i: The index of the interval.
+     * @return The interval in nanoseconds.
+     */
+    interval_type operator [] ( std::size_t i ) const noexcept { return intervals [ i ]; }
+
+    /** @name  level_for_velocity
+     * 
+     * @brief  Find the lowest level of the ramp at which the motor moves at least as fast as a velocity.
+     *         The level is the number of intervals walked up the table, and a motor cruising at level k waits the interval at index k - 1 between steps.
+     * @param  velocity: The angular velocity in rad/sec.
+     * @return The level, which is between one and the size of the table.
+     */
+    std::size_t level_for_velocity ( double velocity ) const noexcept;
+
+
+
+private:
+
+    /* The angle of a single step */
+    double step_angle;
+
+    /* The table of intervals */
+    std::vector<interval_type> intervals;
+
+};
+
+
+
+/* STEP_GENERATOR DEFINITION */
+
+/** class step_generator
+ * 
+ * Generates the direction of and interval after each step of a motion, by walking up and down a step_ramp.
+ * The state of the motion is its level on the ramp and the signed number of steps remaining, so computing each step is only a few comparisons and a table lookup.
+ * The motion may be retargeted at any time without stopping. If the new target is within the stopping distance, or behind the motor, the motor decelerates,
+ * overshooting if necessary, then reverses.
+ */
+class watergun::step_generator
+{
+public:
+
+    /** struct step
+     * 
+     * A step to make.
+     */
+    struct step
+    {
+        /* The direction of the step, +1 or -1 */
+        int direction;
+
+        /* The interval in nanoseconds to wait after the step before the next, or 0 if the motion has finished */
+        step_ramp::interval_type interval;
+    };
+
+
+
+    /** @name  retarget
+     * 
+     * @brief  Change the number of steps remaining and the cruising level. The ramp can only be changed while at rest.
+     * @param  _ramp: The ramp to follow, which must remain valid until the motion has finished.
+     * @param  _remaining: The signed number of steps to the new target from the current position.
+     * @param  _cruise_level: The level on the ramp to cruise at, which is clamped to the ramp.
+     * @return Nothing.
+     */
+    void retarget ( const step_ramp& _ramp, std::int64_t _remaining, std::size_t _cruise_level ) noexcept;
+
+    /** @name  change_ramp
+     * 
+     * @brief  Change to a different ramp mid-motion, such as one for a different step size, moving to the level of the new ramp with the same velocity.
+     * @param  _ramp: The ramp to follow, which must remain valid until the motion has finished.
+     * @param  _remaining: The signed number of steps of the new ramp to the target from the current position.
+     * @param  _cruise_level: The level on the new ramp to cruise at, which is clamped to the ramp.
+     * @return Nothing.
+     */
+    void change_ramp ( const step_ramp& _ramp, std::int64_t _remaining, std::size_t _cruise_level ) noexcept;
+
+    /** @name  moving
+     * 
+     * @brief  Find out whether there are steps left to make.
+     * @return True if the motor is moving or has steps remaining.
+     */
+    bool moving () const noexcept { return remaining != 0 || level != 0; }
+
+    /** @name  at_rest
+     * 
+     * @brief  Find out whether the motor is at rest, so the ramp may be changed.
+     * @return True if the motor is at rest.
+     */
+    bool at_rest () const noexcept { return level == 0; }
+
+    /** @name  next
+     * 
+     * @brief  Get the next step to make, updating the state of the motion as though it has been made. Should only be called while moving.
+     * @return The step.
+     */
+    step next () noexcept;
+
+
+
+private:
+
+    /* The ramp being followed */
+    const step_ramp * ramp { nullptr };
+
+    /* The signed number of steps remaining, the direction of travel, the level on the ramp, and the level to cruise at */
+    std::int64_t remaining { 0 };
+    int direction { 1 };
+    std::size_t level { 0 }, cruise_level { 1 };
+
+};
+
+
+
+/* HEADER GUARD */
+#endif /* #ifndef WATERGUN_STEP_RAMP_H_INCLUDED */
@@ -24,14 +24,26 @@
 #include <chrono>
 #include <cmath>
 #include <condition_variable>
+#include <limits>
 #include <list>
-#include <mraa/gpio.hpp>
-#include <mraa/pwm.hpp>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <numbers>
 #include <string>
 #include <thread>
+#include <watergun/gpio_backend.h>
+#include <watergun/jitter_histogram.h>
+#include <watergun/motion_axis.h>
+#include <watergun/rate_history.h>
+#include <watergun/realtime.h>
+#include <watergun/ring_buffer.h>
+#include <watergun/step_ramp.h>
+#include <watergun/torque_curve.h>
+#include <watergun/triple_buffer.h>
 #include <watergun/utility.h>
 #include <watergun/watergun_exception.h>
+#include <watergun/waveform.h>
 
 
 
@@ -56,10 +68,94 @@ namespace watergun
      * Stepper motor controller, where the step pin is controlled by GPIO.
      */
     class gpio_stepper;
+
+    /** struct homing_config
+     * 
+     * The settings for homing a GPIO stepper on its position pin.
+     */
+    struct homing_config;
+
+    /** struct homing_result
+     * 
+     * How repeatable homing a GPIO stepper on its position pin was.
+     */
+    struct homing_result;
+
+    /** struct index_correction
+     * 
+     * A correction made to the angle of a GPIO stepper when it passed its position pin in normal operation.
+     */
+    struct index_correction;
 }
 
 
 
+/* HOMING_CONFIG DEFINITION */
+
+/** struct homing_config
+ * 
+ * The settings for homing a GPIO stepper on its position pin.
+ */
+struct watergun::homing_config
+{
+    /* The velocities of the fast and slow approaches to the position pin, in rad/sec, which are limited by the maximum motor velocity */
+    double fast_velocity { 2. }, slow_velocity { 0.05 };
+
+    /* How far to back off from the position pin after the fast approach, in radians */
+    double back_off { 0.1 };
+
+    /* The furthest the fast approach may travel before the position pin activates, in radians */
+    double max_travel { 2. * std::numbers::pi };
+
+    /* The longest homing may take */
+    monotonic_clock::duration timeout { std::chrono::seconds { 10 } };
+
+    /* The largest error which passing the position pin in normal operation may correct, beyond which the edge is taken to be spurious, or 0 to never correct in normal operation */
+    double max_index_correction { 0.1 };
+};
+
+
+
+/* HOMING_RESULT DEFINITION */
+
+/** struct homing_result
+ * 
+ * How repeatable homing a GPIO stepper on its position pin was.
+ */
+struct watergun::homing_result
+{
+    /* How much further the fast approach travelled than the slow approach before the position pin was seen to activate, which is mostly the lag in detecting the pin at speed */
+    double approach_difference;
+
+    /* The correction made to the angle of the motor, which is how far it had drifted since the last calibration, or since construction */
+    double correction;
+
+    /* How long homing took */
+    monotonic_clock::duration duration;
+};
+
+
+
+/* INDEX_CORRECTION DEFINITION */
+
+/** struct index_correction
+ * 
+ * A correction made to the angle of a GPIO stepper when it passed its position pin in normal operation.
+ */
+struct watergun::index_correction
+{
+    /* When the position pin activated */
+    monotonic_clock::time_point time;
+
+    /* The error in the angle of the motor when the pin activated, which is positive if the motor was further clockwise than its steps suggested */
+    double error;
+
+    /* Whether the error was corrected, or was too large and taken to be a spurious edge */
+    bool applied;
+};
+
+
+
 /* STEPPER_BASE DEFINITION */
 
 
@@ -83,8 +179,10 @@ public:
      * @param _microstep_pin_1: The second pin for microstepping control, or -1 for always off, or -2 for always on.
      * @param _microstep_pin_2: The third pin for microstepping control, or -1 for always off, or -2 for always on.
      * @param _sleep_pin: The pin number for motor sleep control, or -1 for not present.
+     * @param gpio_step: True if the step pin is controlled by GPIO, so is requested along with the other control pins.
+     * @param _backend: The backend which provides the GPIO lines.
      */
-    stepper_base ( double _step_size, double _min_step_freq, int _step_pin, int _dir_pin, int _microstep_pin_0, int _microstep_pin_1, int _microstep_pin_2, int _sleep_pin );
+    stepper_base ( double _step_size, double _min_step_freq, int _step_pin, int _dir_pin, int _microstep_pin_0, int _microstep_pin_1, int _microstep_pin_2, int _sleep_pin, bool gpio_step, gpio_backend& _backend );
 
     /** @name deleted copy constructor
      * 
@@ -116,15 +214,38 @@ protected:
     /* Pin numbers */
     const int step_pin, dir_pin, microstep_pin_0, microstep_pin_1, microstep_pin_2, sleep_pin;
 
-    /* The Gpio objects, not including the step pin */
-    mraa::Gpio dir_gpio, microstep_gpio_0, microstep_gpio_1, microstep_gpio_2, sleep_gpio;
+    /** enum control_bit
+     * 
+     * The bit of each control line, in the same positions as the pins of a waveform, with the sleep line after them.
+     */
+    enum control_bit : std::uint32_t { step_bit = waveform::step_bit, dir_bit = waveform::dir_bit, microstep_bit_0 = waveform::microstep_bit_0, microstep_bit_1 = waveform::microstep_bit_1, microstep_bit_2 = waveform::microstep_bit_2, sleep_bit = 1 << 5 };
+
+    /* The backend which provides the GPIO lines */
+    gpio_backend& backend;
 
-    /* The states of those gpio objects */
-    int dir_state { 0 }, microstep_state_0 { 0 }, microstep_state_1 { 0 }, microstep_state_2 { 0 }, sleep_state { 0 };
+    /* The control lines, requested together so that any number of them are written with one update. The step line is only present if stepped by GPIO. */
+    std::unique_ptr<gpio_output_group> control_lines;
+
+    /* The values last written to the control lines */
+    std::uint32_t control_state { 0 };
 
     /* The availible microstepping numbers (0 for full step, 1 for 1/2, etc.) */
     std::list<int> availible_microstep_numbers { 0, 1, 2, 3, 4, 5 };
 
+    /* The fraction by which the velocity must pass the edge of a microstep number's band before the microstep number is changed */
+    const double microstep_hysteresis { 0.25 };
+
+    /* The microstep number last written to the microstep pins, or -1 if the motor has not yet been enabled */
+    int active_microstep_number { -1 };
+
+
+
+    /* The number of indexer positions per full step, which is the finest microstep of the DRV8825, and the number of positions in an electrical cycle */
+    static constexpr int indexer_resolution { 32 }, indexer_cycle { 128 };
+
+    /* The position of the driver's indexer within an electrical cycle, in the finest microsteps */
+    int indexer_phase { 0 };
+
 
 
     /** @name  choose_microstep_number
@@ -135,50 +256,72 @@ protected:
      */
     int choose_microstep_number ( double velocity ) const;
 
+    /** @name  choose_microstep_number
+     * 
+     * @brief  Choose the best microstep number for a given angular velocity, keeping the current microstep number unless the velocity
+     *         is outside of its band by more than the hysteresis, so that a velocity near the edge of a band does not keep changing the microstep number.
+     * @param  velocity: The angular velocity to choose based on.
+     * @param  current: The current microstep number, or -1 for none.
+     * @return The microstep number (one of availible_microstep_numbers).
+     */
+    int choose_microstep_number ( double velocity, int current ) const;
 
 
-    /** @name  disable_motor
+
+    /** @name  advance_phase
      * 
-     * @brief  Put the motor to sleep and turn off all direction and microstepping and direction pins.
-     * @return Nothing.
+     * @brief  Advance an indexer phase by the steps which make up an angle.
+     * @param  phase: The indexer phase before the steps.
+     * @param  angle: The change in angle the steps caused (negative for anti-clockwise).
+     * @return The indexer phase after the steps, wrapped into an electrical cycle.
      */
-    void disable_motor ();
+    int advance_phase ( int phase, double angle ) const noexcept;
 
-    /** @name  enable_motor
+    /** @name  microstep_aligned
      * 
-     * @brief  Take the motor out of sleep, and set up the microstepping and direction pins.
-     * @param  microstep_number: The microstep number to use.
-     * @param  direction: True for clockwise, false for anticlockwise.
-     * @return Nothing.
+     * @brief  Find out whether a step can be made with a microstep number without losing position.
+     *         The DRV8825 snaps its indexer to the next position which is valid for the microstep number at each step, so the phase must already be valid.
+     *         A finer microstep number is always aligned, and a coarser one is at latest aligned at the next full step.
+     * @param  phase: The indexer phase.
+     * @param  microstep_number: The microstep number.
+     * @return True if the phase is a whole number of steps of the microstep number.
      */
-    void enable_motor ( int microstep_number, bool direction );
+    static bool microstep_aligned ( int phase, int microstep_number ) noexcept { return phase % ( indexer_resolution >> microstep_number ) == 0; }
+
 
 
+    /** @name  write_control_lines
+     * 
+     * @brief  Write any control lines which have changed, with a single update.
+     * @param  values: The values of the control lines, as a mask of control_bits.
+     * @return Nothing.
+     */
+    void write_control_lines ( std::uint32_t values );
 
-    /** @name  create_pwm
+    /** @name  asleep
      * 
-     * @brief  Create a PWM pin.
-     * @param  pin: The pin to create the PWM object on.
-     * @return The PWM object.
+     * @brief  Find out whether the motor is asleep.
+     * @return True if there is a sleep pin, and it is set.
      */
-    static mraa::Pwm create_pwm ( int pin );
+    bool asleep () const noexcept { return sleep_pin >= 0 && ( control_state & sleep_bit ); }
+
 
-    /** @name  create_output_gpio
+
+    /** @name  disable_motor
      * 
-     * @brief  Create an output GPIO pin.
-     * @param  pin: The pin to create the GPIO object on.
-     * @return The GPIO object.
+     * @brief  Put the motor to sleep and turn off all direction and microstepping and direction pins.
+     * @return Nothing.
      */
-    static mraa::Gpio create_output_gpio ( int pin );
+    void disable_motor ();
 
-    /** @name  create_input_gpio
+    /** @name  enable_motor
      * 
-     * @brief  Create an input GPIO pin.
-     * @param  pin: The pin to create the GPIO object on.
-     * @param  mode: False for pull down, True for pull up.
-     * @return The GPIO object.
+     * @brief  Take the motor out of sleep, and set up the microstepping and direction pins.
+     * @param  microstep_number: The microstep number to use.
+     * @param  direction: True for clockwise, false for anticlockwise.
+     * @return Nothing.
      */
-    static mraa::Gpio create_input_gpio ( int pin, bool mode = false );
+    void enable_motor ( int microstep_number, bool direction );
 
 };
 
@@ -191,8 +334,13 @@ protected:
 /** class pwm_stepper
  * 
  * Stepper motor controller, where the step pin is controlled by PWM.
+ * Velocity changes are not made instantly, but ramped by a thread which reprograms the PWM period at a fixed update rate, within an acceleration limit.
+ * The limit follows the torque curve of the motor, which falls with speed, so the motor accelerates hardest at low speed.
+ * Updates which would not change the period, direction or microstepping write nothing.
+ * As an axis of a coordinated movement, the PWM times its own steps, so each segment only sets the velocity, ramping to it over the first half of the segment.
+ * Whatever angle the ramps do not make, according to the odometry, is carried into later segments.
  */
-class watergun::pwm_stepper : public stepper_base
+class watergun::pwm_stepper : public stepper_base, public motion_axis
 {
 public:
 
@@ -201,14 +349,19 @@ public:
      * @brief Set the motor stepping angle, controlling GPIO pins and min step frequency.
      * @param _step_size: The number of radians per whole step of the motor.
      * @param _min_step_freq: The minimum step frequency before microstepping is increased.
+     * @param _max_velocity: The maximum motor velocity.
+     * @param _torque: The torque curve of the motor, giving the maximum acceleration at each velocity. A constant acceleration converts to a flat curve.
+     * @param _update_frequency: The frequency at which the PWM period is updated while ramping.
      * @param _step_pin: The pin number for the step control.
      * @param _dir_pin: The pin number for direction control.
      * @param _microstep_pin_0: The first pin for microstepping control, or -1 for always off, or -2 for always on.
      * @param _microstep_pin_1: The second pin for microstepping control, or -1 for always off, or -2 for always on.
      * @param _microstep_pin_2: The third pin for microstepping control, or -1 for always off, or -2 for always on.
      * @param _sleep_pin: The pin number for motor sleep control, or -1 for not present.
+     * @param _position_pin: The pin number which provides stepper positioning capabilities, or -1 for not present.
+     * @param _backend: The backend which provides the GPIO lines and PWM outputs. Defaults to default_gpio_backend.
      */
-    pwm_stepper ( double _step_size, double _min_step_freq, int _step_pin, int _dir_pin, int _microstep_pin_0, int _microstep_pin_1, int _microstep_pin_2, int _sleep_pin );
+    pwm_stepper ( double _step_size, double _min_step_freq, double _max_velocity, const torque_curve& _torque, double _update_frequency, int _step_pin, int _dir_pin, int _microstep_pin_0, int _microstep_pin_1, int _microstep_pin_2, int _sleep_pin, int _position_pin = -1, gpio_backend& _backend = default_gpio_backend () );
 
     /** @name deleted copy constructor
      * 
@@ -216,28 +369,160 @@ public:
      */
     pwm_stepper ( const pwm_stepper& other ) = delete;
 
-    /** @name default destructor */
-    ~pwm_stepper () = default;
+    /** @name destructor
+     * 
+     * @brief Close and join the ramp thread, and stop the PWM output.
+     */
+    ~pwm_stepper ();
 
 
 
     /** @name  set_velocity
      * 
-     * @brief  Set a new rotation velocity.
-     * @param  velocity: The new angular velocity in rad/sec, positive meaning clockwise and vice versa.
+     * @brief  Set a new rotation velocity, which the motor ramps to as fast as the acceleration limit allows.
+     * @param  velocity: The new angular velocity in rad/sec, positive meaning clockwise and vice versa, which is limited by the maximum velocity.
      * @return Nothing.
      */
     void set_velocity ( double velocity );
 
+    /** @name  calibrate_position
+     * 
+     * @brief  Use the position pin to calibrate the position of the stepper, by rotating slowly until the pin activates, then stopping.
+     *         If the pin does not activate within the maximum travel or the timeout of the settings, the motor is stopped uncalibrated.
+     * @param  angle: The angle at which the position pin will activate.
+     * @param  direction: The direction the motor should move in to hit the position pin. True for clockwise, false for anti-clockwise.
+     * @param  config: The homing settings, of which only the slow velocity, maximum travel and timeout are used.
+     * @throw  watergun_exception, if there is no position pin, the settings are invalid, or the pin does not activate within the maximum travel or the timeout.
+     * @return Nothing.
+     */
+    void calibrate_position ( double angle, bool direction, const homing_config& config = homing_config {} );
+
+    /** @name  begin_segment
+     * 
+     * @brief  Begin a segment of a coordinated movement. The angle is added to whatever previous segments did not make, according to the odometry.
+     *         The velocity ramps over the first half of the segment, then cruises at the velocity which makes the angle owed, limited by the maximum velocity.
+     *         If the acceleration limit makes the ramp take longer, or a segment is missed, the difference is carried into later segments. If no segment follows, the motor stops. Should not be mixed with set_velocity.
+     * @param  angle: The change in angle over the segment, positive meaning clockwise.
+     * @param  duration: The duration of the segment.
+     * @return Zero, since the PWM times its own steps.
+     */
+    std::uint64_t begin_segment ( double angle, clock::duration duration ) override;
+
+    /** @name  segment_step
+     * 
+     * @brief  Never called, since begin_segment never asks for steps to be clocked.
+     * @return Nothing.
+     */
+    void segment_step () override {}
+
+
+
+    /** @name  get_position
+     * 
+     * @brief  Estimate the angle of the motor at a point in time, from the step rates which have been commanded.
+     *         The estimate is relative to the last calibration, or the angle at construction if never calibrated.
+     * @param  timestamp: The point in time. Defaults to now.
+     * @return The angle in radians.
+     */
+    double get_position ( clock::time_point timestamp = clock::now () ) const;
+
+    /** @name  get_rotation
+     * 
+     * @brief  Estimate the change in angle of the motor between two points in time, from the step rates which have been commanded.
+     * @param  from: The first point in time.
+     * @param  to: The second point in time.
+     * @return The change in angle in radians, positive meaning clockwise.
+     */
+    double get_rotation ( clock::time_point from, clock::time_point to ) const;
+
 
 
 private:
 
-    /* Step PWM pin */
-    mraa::Pwm step_pwm;
+    /* Position pin */
+    const int position_pin;
+
+    /* Step PWM output */
+    std::unique_ptr<pwm_output> step_pwm;
+
+    /* Position line, or null if not present */
+    std::unique_ptr<gpio_input_line> position_line;
+
+    /* The current PWM period in seconds, signed by the direction of rotation, or 0 if stopped */
+    double step_state { 0. };
+
+
+
+    /* The maximum motor velocity in radians per second */
+    const double max_velocity;
+
+    /* The torque curve of the motor */
+    const torque_curve torque;
+
+    /* The time between updates of the PWM period while ramping */
+    const clock::duration update_period;
+
+    /* The velocity to ramp to, the acceleration to ramp at before the acceleration limit, and the velocity currently produced */
+    double target_velocity { 0. }, ramp_acceleration { 0. }, commanded_velocity { 0. };
+
+    /* The angle owed to a coordinated movement which previous segments did not make, and when the current segment began and ends */
+    double segment_residual { 0. };
+    clock::time_point segment_start {}, segment_end {};
+
+    /* Mutex and condition variable for protecting the ramp variables */
+    std::mutex ramp_mx;
+    std::condition_variable_any ramp_cv;
 
-    /* The current PWM period */
-    double step_state { 0. }; 
+    /* Thread for ramping the velocity */
+    std::jthread ramp_thread;
+
+
+
+    /* The time taken for the driver to wake from sleep, during which steps are ignored */
+    static constexpr clock::duration wake_up_time { std::chrono::microseconds { 1700 } };
+
+    /* The number of commanded rate changes to remember, which must cover the latency of the tracker */
+    static constexpr std::size_t odometry_size { 4096 };
+
+    /* The history of the angular velocities really produced by the PWM pin, the offset from the integrated angle to the calibrated angle, and a mutex to protect them */
+    rate_history<clock> odometry;
+    double position_offset { 0. };
+    mutable std::mutex odometry_mx;
+
+
+
+    /** @name  acceleration_limit
+     * 
+     * @brief  Find the acceleration which the torque of the motor allows at a velocity.
+     * @param  velocity: The angular velocity in rad/sec.
+     * @return The acceleration in rad/sec^2.
+     */
+    double acceleration_limit ( double velocity ) const noexcept;
+
+    /** @name  apply_velocity
+     * 
+     * @brief  Program the PWM output and control lines for a velocity, writing nothing if the period, direction and microstepping would not change.
+     *         The ramp mutex should already be locked before this function is called.
+     * @param  velocity: The angular velocity in rad/sec, positive meaning clockwise and vice versa.
+     * @return Nothing.
+     */
+    void apply_velocity ( double velocity );
+
+    /** @name  stop_after_segment
+     * 
+     * @brief  Set the target velocity to zero if the last segment of a coordinated movement has ended, since otherwise the motor would cruise on indefinitely.
+     *         The end of the segment is kept, so that a segment which begins shortly after still carries on the movement. The ramp mutex must be held.
+     * @return Nothing.
+     */
+    void stop_after_segment ();
+
+    /** @name  ramp_thread_function
+     * 
+     * @brief  The function which the ramp thread runs to ramp the velocity towards its target.
+     * @param  stoken: The stop token for the jthread.
+     * @return Nothing.
+     */
+    void ramp_thread_function ( std::stop_token stoken );
 
 };
 
@@ -250,8 +535,12 @@ private:
 /** class gpio_stepper
  * 
  * Stepper motor controller, where the step pin is controlled by GPIO.
+ * As an axis of a coordinated movement, the executor of the movement clocks each step, and the stepper thread stays idle.
+ * The acceleration ramps follow the torque curve of the motor, so are the same limits which the planner was given for the axis.
+ * Once calibrated, each time a step carries the motor past its position pin in the direction it was calibrated in, the angle is corrected without stopping,
+ * using the timestamp of the edge to find the step it activated at, which removes any steps missed since calibration.
  */
-class watergun::gpio_stepper : public stepper_base
+class watergun::gpio_stepper : public stepper_base, public motion_axis
 {
 public:
 
@@ -261,6 +550,8 @@ public:
      * @param _step_size: The number of radians per whole step of the motor.
      * @param _min_step_freq: The minimum step frequency before microstepping is increased.
      * @param _max_velocity: The maximum motor velocity.
+     * @param _torque: The torque curve of the motor, giving the maximum acceleration at each velocity. A constant acceleration converts to a flat curve.
+     * @param _max_jerk: The maximum motor jerk, or 0 for unlimited jerk.
      * @param _step_pin: The pin number for the step control.
      * @param _dir_pin: The pin number for direction control.
      * @param _microstep_pin_0: The first pin for microstepping control, or -1 for always off, or -2 for always on.
@@ -268,8 +559,9 @@ public:
      * @param _microstep_pin_2: The third pin for microstepping control, or -1 for always off, or -2 for always on.
      * @param _sleep_pin: The pin number for motor sleep control, or -1 for not present.
      * @param _position_pin: The pin number which provides stepper positioning capabilities, or -1 for not present.
+     * @param _backend: The backend which provides the GPIO lines and PWM outputs. Defaults to default_gpio_backend.
      */
-    gpio_stepper ( double _step_size, double _min_step_freq, double _max_velocity, int _step_pin, int _dir_pin, int _microstep_pin_0, int _microstep_pin_1, int _microstep_pin_2, int _sleep_pin, int _position_pin );
+    gpio_stepper ( double _step_size, double _min_step_freq, double _max_velocity, const torque_curve& _torque, double _max_jerk, int _step_pin, int _dir_pin, int _microstep_pin_0, int _microstep_pin_1, int _microstep_pin_2, int _sleep_pin, int _position_pin, gpio_backend& _backend = default_gpio_backend () );
 
     /** @name deleted copy constructor
      * 
@@ -289,20 +581,84 @@ public:
      * 
      * @brief  Set a desired position for the stepper, and a duration over which the transition to that position will be made.
      *         Note that if the transition period is deemed too small, it will be increased appropriately.
+     *         The motor accelerates and decelerates along a ramp, and may be given a new position mid-motion without stopping.
      * @param  angle: The desired finishing angle.
      * @param  duration: The duration of the transition.
      * @return Nothing.
      */
     void set_position ( double angle, clock::duration duration );
 
+    /** @name  render_segment
+     * 
+     * @brief  Render the next segment of a movement into a waveform ahead of time, which the stepper thread plays back immediately after the previous segment.
+     *         The movement carries on from where the last segment left off, so consecutive segments play as one continuous movement.
+     *         Should only be called by a single thread, and not mixed with set_position.
+     * @param  angle: The desired finishing angle.
+     * @param  duration: The duration of the segment.
+     * @return True if the segment was rendered, or false if the previous segment has not yet started playing, in which case it should be retried later.
+     */
+    bool render_segment ( double angle, clock::duration duration );
+
     /** @name  calibrate_position
      * 
-     * @brief  Use the position pin to calibrate the position of the stepper.
+     * @brief  Use the position pin to calibrate the position of the stepper, by homing in two phases on the stepper thread, which stays responsive throughout.
+     *         The motor approaches the pin quickly along its ramp, backs off, then approaches again slowly at the finest microstepping, calibrating the angle where the pin activates.
+     *         The motor is then returned to that angle. Targets set during homing are only followed once it has finished. Should not be mixed with render_segment or begin_segment.
      * @param  angle: The angle at which the position pin will activate.
      * @param  direction: The direction the motor should move in to hit the position pin. True for clockwise, false for anti-clockwise.
+     * @param  config: The homing settings.
+     * @throw  watergun_exception, if there is no position pin, the settings are invalid, or the pin does not activate within the maximum travel or the timeout.
+     * @return How repeatable homing was.
+     */
+    homing_result calibrate_position ( double angle, bool direction, const homing_config& config = homing_config {} );
+
+    /** @name  begin_segment
+     * 
+     * @brief  Begin a segment of a coordinated movement. The angle is added to whatever could not be made in whole steps in previous segments,
+     *         and is limited by the maximum velocity, with the remainder carried into later segments. The microstep number is chosen for the velocity of the segment,
+     *         with hysteresis, and only changed once the indexer is aligned for it. Should not be mixed with set_position or render_segment.
+     * @param  angle: The change in angle over the segment, positive meaning clockwise.
+     * @param  duration: The duration of the segment.
+     * @return The number of steps for the executor to clock over the segment.
+     */
+    std::uint64_t begin_segment ( double angle, clock::duration duration ) override;
+
+    /** @name  segment_step
+     * 
+     * @brief  Make the next step of the current segment.
      * @return Nothing.
      */
-    void calibrate_position ( double angle, bool direction );
+    void segment_step () override;
+
+    /** @name  get_position
+     * 
+     * @brief  Get the angle of the motor from the steps which have been made.
+     * @return The angle in radians.
+     */
+    double get_position () const;
+
+
+
+    /** @name  get_step_jitter
+     * 
+     * @brief  Get the histogram of how late each step has been made compared to when it was due.
+     * @return The histogram.
+     */
+    const jitter_histogram& get_step_jitter () const noexcept { return step_jitter; }
+
+    /** @name  get_index_corrections
+     * 
+     * @brief  Get the remembered corrections made when passing the position pin in normal operation, oldest first.
+     * @return Vector of corrections.
+     */
+    std::vector<index_correction> get_index_corrections () const;
+
+    /** @name  get_accumulated_index_error
+     * 
+     * @brief  Get the total of the corrections applied when passing the position pin since the last calibration, which is the net number of steps missed in radians.
+     * @return The angle in radians.
+     */
+    double get_accumulated_index_error () const;
 
 
 
@@ -311,17 +667,29 @@ private:
     /* Position pin */
     const int position_pin;
 
-    /* Step and position GPIO pins */
-    mraa::Gpio step_gpio, position_gpio;
+    /* Position line, or null if not present */
+    std::unique_ptr<gpio_input_line> position_line;
 
 
 
-    /* The maximum motor velocity in radians per second */
-    const double max_velocity;
+    /* The maximum motor velocity in radians per second, and jerk in radians per second cubed */
+    const double max_velocity, max_jerk;
+
+    /* The torque curve of the motor */
+    const torque_curve torque;
 
     /* The minumum step period */
     const double min_step_period { 100e-6 };
 
+    /* The width of a step pulse, which must be at least 1.9us for the DRV8825 */
+    static constexpr clock::duration pulse_width { std::chrono::microseconds { 2 } };
+
+    /* How long before a step is due to stop sleeping and start spinning, which must cover the wake up latency of the scheduler */
+    static constexpr clock::duration spin_window { std::chrono::microseconds { 150 } };
+
+    /* The precomputed acceleration ramp for each availible microstep number */
+    std::map<int, step_ramp> ramps;
+
 
 
     /* The current angle of the stepper motor */
@@ -336,8 +704,57 @@ private:
     /* Whether a new target has been set */
     bool new_target { false };
 
+    /* The generator of steps towards the target */
+    step_generator motion;
+
+    /* The lateness of each step made by the stepper thread */
+    jitter_histogram step_jitter;
+
+    /* Waveforms rendered by render_segment, which the stepper thread takes at segment boundaries */
+    triple_buffer<waveform> waveform_handoff;
+
+    /* The renderer of waveforms, and the angle and indexer phase at the end of the last rendered segment */
+    waveform_renderer renderer;
+    double rendered_angle { 0. };
+    int rendered_phase { 0 };
+
+    /* The angle of coordinated segments which could not yet be made in whole steps, the microstep number used for them, and the signed size of each step of the current segment */
+    double segment_residual { 0. };
+    int segment_microstep_number { availible_microstep_numbers.back () };
+    double segment_step_size { 0. };
+
+    /** enum class homing_phase
+     * 
+     * The phases of homing.
+     */
+    enum class homing_phase { idle, fast_approach, back_off, slow_approach };
+
+    /* The current phase of homing, whether homing has been requested or has finished, and the settings and start time of the current homing */
+    homing_phase homing { homing_phase::idle };
+    bool new_homing { false }, homing_finished { false };
+    double homing_angle { 0. };
+    bool homing_direction { true };
+    homing_config homing_settings;
+    clock::time_point homing_start;
+
+    /* The angle at which the fast approach activated the position pin, and the outcome of the last homing, which is an empty error if it succeeded */
+    double fast_trigger_angle { 0. };
+    homing_result homing_outcome {};
+    std::string homing_error;
+
+    /* Whether homing has ever succeeded, so that the angle at which the position pin activates is known */
+    bool calibrated { false };
+
+    /* When the last step was made, before which edges of the position pin are stale */
+    clock::time_point last_step_time;
+
+    /* The number of corrections to remember, the remembered corrections, and the total of the corrections applied since the last calibration */
+    static constexpr std::size_t index_log_size { 64 };
+    ring_buffer<index_correction> index_log { index_log_size };
+    double accumulated_index_error { 0. };
+
     /* Mutex and condition variable for protecting the stepper variables */
-    std::mutex stepper_mx;
+    mutable std::mutex stepper_mx;
     std::condition_variable_any stepper_cv;
 
     /* Thread for controlling stepper position */
@@ -347,12 +764,33 @@ private:
 
     /** @name  make_step
      * 
-     * @brief  Makes a single step assuming the motor has been previously enabled then modifies the current angle.
+     * @brief  Makes a single step pulse, spinning for the pulse width, assuming the motor has been previously enabled, then modifies the current angle.
+     *         If the position pin activated since the last step, the angle is corrected.
      *         The stepper mutex should already be locked before this function is called.
      * @param  microstep_size: The change in angle the step causes (negative for anti-clockwise)
+     * @return The correction made to the current angle, or 0 if none was made.
+     */
+    double make_step ( double microstep_size );
+
+    /** @name  correct_at_index
+     * 
+     * @brief  Take the edges of the position pin since the last step, and if the pin activated while moving in the direction it was calibrated in, correct the current angle.
+     *         The stepper mutex should already be locked before this function is called.
+     * @param  step_time: When the step which was just made started.
+     * @param  microstep_size: The change in angle the step caused.
+     * @return The correction made to the current angle, or 0 if none was made.
+     */
+    double correct_at_index ( clock::time_point step_time, double microstep_size );
+
+    /** @name  play_waveforms
+     * 
+     * @brief  Play rendered waveforms back to back, until there are none left pending.
+     *         The stepper mutex should already be locked before this function is called, and is unlocked during playback.
+     * @param  lock: The lock on the stepper mutex.
+     * @param  stoken: The stop token for the jthread.
      * @return Nothing.
      */
-    void make_step ( double microstep_size );
+    void play_waveforms ( std::unique_lock<std::mutex>& lock, std::stop_token stoken );
 
 
 
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * include/watergun/torque_curve.h
+ * 
+ * Header file for the torque-speed curve of a stepper axis, and the velocity dependent acceleration limits it implies.
+ * 
+ */
+
+
+
+/* HEADER GUARD */
+#ifndef WATERGUN_TORQUE_CURVE_H_INCLUDED
+#define WATERGUN_TORQUE_CURVE_H_INCLUDED
+
+
+
+/* INCLUDES */
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <watergun/watergun_exception.h>
+
+
+
+/* DECLARATIONS */
+
+namespace watergun
+{
+    /** class torque_curve
+     * 
+     * The torque-speed curve of a stepper axis, as the angular acceleration availible at each angular velocity.
+     */
+    class torque_curve;
+}
+
+
+
+/* TORQUE_CURVE DEFINITION */
+
+/** class torque_curve
+ * 
+ * The torque-speed curve of a stepper axis, as the angular acceleration availible at each angular velocity.
+ * The curve is given as points of torque against velocity, joined by straight lines, and divided by the inertia of the axis.
+ * Stepper torque falls with speed, and the curve must be concave, so that the acceleration availible is the minimum over the lines through consecutive points.
+ * This allows a planner to express the curve as a set of linear constraints of the form |a| + slope * |v| <= acceleration, one per line.
+ * A curve may also be constructed from a constant acceleration, which gives a single flat line.
+ */
+class watergun::torque_curve
+{
+public:
+
+    /** struct point
+     * 
+     * A point on the torque-speed curve.
+     */
+    struct point
+    {
+        /* The angular velocity in rad/sec */
+        double velocity;
+
+        /* The torque availible at that velocity, in any unit consistent with the inertia */
+        double torque;
+    };
+
+    /** struct line
+     * 
+     * A line through consecutive points of the curve, limiting acceleration by |a| + slope * |v| <= acceleration.
+     */
+    struct line
+    {
+        /* The acceleration at rest according to the line, in rad/sec^2 */
+        double acceleration;
+
+        /* The reduction in acceleration per unit velocity, in 1/sec */
+        double slope;
+    };
+
+
+
+    /** @name constructor
+     * 
+     * @brief Construct a flat curve from a constant acceleration.
+     * @param max_acceleration: The angular acceleration in rad/sec^2 at every velocity.
+     * @throw watergun_exception, if the acceleration is not positive.
+     */
+    torque_curve ( double max_acceleration );
+
+    /** @name constructor
+     * 
+     * @brief Construct a curve from points of torque against velocity.
+     * @param points: The points, in order of increasing velocity, starting at rest.
+     * @param inertia: The moment of inertia of the axis, in units consistent with the torque.
+     * @throw watergun_exception, if the points are not a positive, non-increasing and concave curve starting at rest, or the inertia is not positive.
+     */
+    torque_curve ( const std::vector<point>& points, double inertia );
+
+
+
+    /** @name  acceleration_at
+     * 
+     * @brief  Get the acceleration availible at a velocity.
+     * @param  velocity: The angular velocity in rad/sec, of either sign.
+     * @return The acceleration in rad/sec^2, which is negative if the velocity is beyond what the curve can reach.
+     */
+    double acceleration_at ( double velocity ) const noexcept;
+
+    /** @name  max_acceleration
+     * 
+     * @brief  Get the acceleration availible at rest, which is the largest acceleration on the curve.
+     * @return The acceleration in rad/sec^2.
+     */
+    double max_acceleration () const noexcept { return acceleration_at ( 0. ); }
+
+    /** @name  get_lines
+     * 
+     * @brief  Get the lines whose minimum forms the curve.
+     * @return Vector of lines, of which there is at least one.
+     */
+    const std::vector<line>& get_lines () const noexcept { return lines; }
+
+    /** @name  flat
+     * 
+     * @brief  Find out whether the curve is a constant acceleration.
+     * @return True if the curve is flat.
+     */
+    bool flat () const noexcept { return lines.size () == 1 && lines.front ().slope == 0.; }
+
+
+
+private:
+
+    /* The lines through consecutive points */
+    std::vector<line> lines;
+
+};
+
+
+
+/* HEADER GUARD */
+#endif /* #ifndef WATERGUN_TORQUE_CURVE_H_INCLUDED */
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * include/watergun/tracked_user.h
+ * 
+ * Header file for the description of a tracked user, independent of the sensor which tracks them.
+ * 
+ */
+
+
+
+/* HEADER GUARD */
+#ifndef WATERGUN_TRACKED_USER_H_INCLUDED
+#define WATERGUN_TRACKED_USER_H_INCLUDED
+
+
+
+/* INCLUDES */
+#include <chrono>
+#include <watergun/utility.h>
+#include <watergun/vector3d.h>
+
+
+
+/* DECLARATIONS */
+
+namespace watergun
+{
+    /* The clock used for tracking users and planning movements */
+    typedef std::chrono::system_clock tracking_clock;
+
+    /** struct tracked_user
+     * 
+     * A structure to store information about a single user, including their ID and position in many formats.
+     */
+    struct tracked_user;
+
+    /** @name  project_tracked_user
+     * 
+     * @brief  Update a user's position to match a new timestamp, given that they follow the same velocity.
+     * @param  user: The user to update.
+     * @param  timestamp: The new timestamp that their position should match.
+     * @return The updated tracked user.
+     */
+    inline tracked_user project_tracked_user ( const tracked_user& user, tracking_clock::time_point timestamp );
+}
+
+
+
+/* TRACKED_USER DEFINITION */
+
+/** struct tracked_user
+ * 
+ * A structure to store information about a single user, including their ID and position in many formats.
+ */
+struct watergun::tracked_user
+{
+    /* The user ID */
+    int id;
+
+    /* The point in time that the position was taken */
+    tracking_clock::time_point timestamp;
+
+    /* The user's center of mass in mixed polar coordinates.
+     * X is an angle from the center of the camera in radians, Y is the perpandicular height from the camera's center, Z is the distance from the camera.
+     */
+    vector3d com;
+
+    /* The rate of change of the COM */
+    vector3d com_rate;
+};
+
+
+
+/* METHOD DEFINITIONS */
+
+/** @name  project_tracked_user
+ * 
+ * @brief  Update a user's position to match a new timestamp, given that they follow the same velocity.
+ * @param  user: The user to update.
+ * @param  timestamp: The new timestamp that their position should match.
+ * @return The updated tracked user.
+ */
+inline watergun::tracked_user watergun::project_tracked_user ( const tracked_user& user, const tracking_clock::time_point timestamp )
+{
+    /* Return a tracked user with updated timestamp and position */
+    return tracked_user
+    {
+        user.id, timestamp,
+        user.com + user.com_rate * duration_to_seconds ( timestamp - user.timestamp ).count (),
+        user.com_rate,
+    };
+}
+
+
+
+/* HEADER GUARD */
+#endif /* #ifndef WATERGUN_TRACKED_USER_H_INCLUDED */
@@ -29,7 +29,10 @@
 #include <string>
 #include <thread>
 #include <vector>
+#include <watergun/realtime.h>
+#include <watergun/tracked_user.h>
 #include <watergun/utility.h>
+#include <watergun/vector3d.h>
 #include <watergun/watergun_exception.h>
 
 
@@ -38,12 +41,6 @@
 
 namespace watergun
 {
-    /** struct vector3d
-     * 
-     * 3D vector class.
-     */
-    struct vector3d;
-
     /** class tracker : nite::UserTracker::NewFrameListener
      * 
      * Creates a OpenNI/NITE context, and exposes human-tracking capabilities.
@@ -53,81 +50,6 @@ namespace watergun
 
 
 
-/* VECTOR3D DEFINITION */
-
-
-
-/** struct vector3d
- * 
- * 3D vector class.
- */
-struct watergun::vector3d
-{
-    /* X, Y and Z components */
-    double x, y, z;
-
-
-
-    /** @name default construction
-     * 
-     * @brief Initialize all components to 0.
-     */
-    constexpr vector3d () noexcept : x { 0. }, y { 0. }, z { 0. } {}
-
-    /** @name single components constructor
-     * 
-     * @brief Initialize all components to the same value.
-     * @param v: The value to initialize the components to.
-     */
-    explicit constexpr vector3d ( double v ) noexcept : x { v }, y { v }, z { v } {}
-
-    /** @name three component constructor
-     * 
-     * @brief Initialize all components to separate values.
-     * @param x: X value.
-     * @param y: Y value.
-     * @param z: Z value.
-     */
-    constexpr vector3d ( double _x, double _y, double _z ) noexcept : x { _x }, y { _y }, z { _z } {}
-
-    /** @name Point3f constructor
-     * 
-     * @brief Construct from nite::Point3f object.
-     * @param v: The Point3f object.
-     */
-    constexpr vector3d ( const nite::Point3f& v ) noexcept : x { v.x }, y { v.y }, z { v.z } {}
-
-    /** @name Point3f explicit conversion
-     * 
-     * @brief Construct from nite::Point3f object.
-     * @param v: The Point3f object.
-     */
-    explicit operator nite::Point3f () noexcept { return nite::Point3f { static_cast<float> ( x ), static_cast<float> ( y ), static_cast<float> ( z ) }; }
-
-
-
-    /* Simple arithmetic operations */
-    constexpr vector3d operator+ ( const vector3d& other ) const noexcept { return vector3d { x + other.x, y + other.y, z + other.z }; }
-    constexpr vector3d operator- ( const vector3d& other ) const noexcept { return vector3d { x - other.x, y - other.y, z - other.z }; }
-    constexpr vector3d operator* ( const vector3d& other ) const noexcept { return vector3d { x * other.x, y * other.y, z * other.z }; }
-    constexpr vector3d operator/ ( const vector3d& other ) const noexcept { return vector3d { x / other.x, y / other.y, z / other.z }; }
-    constexpr vector3d& operator+= ( const vector3d& other ) noexcept { return * this = * this + other; }
-    constexpr vector3d& operator-= ( const vector3d& other ) noexcept { return * this = * this - other; }
-    constexpr vector3d& operator*= ( const vector3d& other ) noexcept { return * this = * this * other; }
-    constexpr vector3d& operator/= ( const vector3d& other ) noexcept { return * this = * this / other; }
-    constexpr vector3d operator* ( double scalar ) const noexcept { return * this * vector3d { scalar }; }
-    constexpr vector3d operator/ ( double scalar ) const noexcept { return * this / vector3d { scalar }; }
-    constexpr vector3d& operator*= ( double scalar ) noexcept { return * this = * this * scalar; }
-    constexpr vector3d& operator/= ( double scalar ) noexcept { return * this = * this / scalar; }
-
-    /* Comparison operators */
-    constexpr bool operator== ( const vector3d& other ) const noexcept = default;
-    constexpr bool operator!= ( const vector3d& other ) const noexcept = default;
-
-};
-
-
-
 /* TRACKER DEFINITION */
 
 
@@ -141,28 +63,10 @@ class watergun::tracker : private nite::UserTracker::NewFrameListener
 public:
 
     /* Clock typedefs */
-    typedef std::chrono::system_clock clock;
-
-    /** struct tracked_users
-     * 
-     * A structure to store information about a single user, including their ID and position in many formats.
-     */
-    struct tracked_user
-    {
-        /* The user ID */
-        nite::UserId id;
+    typedef tracking_clock clock;
 
-        /* The point in time that the position was taken */
-        clock::time_point timestamp;
-
-        /* The user's center of mass in mixed polar coordinates.
-         * X is an angle from the center of the camera in radians, Y is the perpandicular height from the camera's center, Z is the distance from the camera. 
-         */
-        vector3d com;
-
-        /* The rate of change of the COM */
-        vector3d com_rate;
-    };
+    /* The tracked user structure */
+    typedef watergun::tracked_user tracked_user;
 
 
 
@@ -196,6 +100,14 @@ public:
      */
     std::vector<tracked_user> get_tracked_users () const;
 
+    /** @name  get_tracked_users
+     * 
+     * @brief  As above, but write the tracked users into a caller-provided vector, which does not allocate if it has the capacity for them.
+     * @param  users: The vector to write the tracked users into.
+     * @return Nothing.
+     */
+    void get_tracked_users ( std::vector<tracked_user>& users ) const;
+
     /** @name  get_average_generation_time
      * 
      * @brief  Get the average time taken to generate depth data.
@@ -238,7 +150,7 @@ public:
      * @param  timestamp: The new timestamp that their position should match. Defaults to now.
      * @return The updated tracked user.
      */
-    tracked_user project_tracked_user ( const tracked_user& user, clock::time_point timestamp = clock::now () ) const;
+    tracked_user project_tracked_user ( const tracked_user& user, clock::time_point timestamp = clock::now () ) const { return watergun::project_tracked_user ( user, timestamp ); }
 
     /** @name  dynamic_project_tracked_user
      * 
@@ -344,6 +256,16 @@ private:
 
 
 
+    /** @name  to_vector3d
+     * 
+     * @brief  Convert a NiTE point to a vector.
+     * @param  v: The Point3f object.
+     * @return The vector.
+     */
+    static constexpr vector3d to_vector3d ( const nite::Point3f& v ) noexcept { return vector3d { v.x, v.y, v.z }; }
+
+
+
     /** @name  check_status
      * 
      * @brief  Takes a OpenNI or NiTE status, and checks that is is okay. If not, throws with the supplied reason and status description after a colon.
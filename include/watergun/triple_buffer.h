@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * include/watergun/triple_buffer.h
+ * 
+ * Header file for lock-free handoff of the latest value from a single producer thread to a single consumer thread.
+ * 
+ */
+
+
+
+/* HEADER GUARD */
+#ifndef WATERGUN_TRIPLE_BUFFER_H_INCLUDED
+#define WATERGUN_TRIPLE_BUFFER_H_INCLUDED
+
+
+
+/* INCLUDES */
+#include <array>
+#include <atomic>
+
+
+
+/* DECLARATIONS */
+
+namespace watergun
+{
+    /** class triple_buffer
+     * 
+     * Lock-free single producer, single consumer handoff of the latest value.
+     */
+    template<class T> class triple_buffer;
+}
+
+
+
+/* TRIPLE_BUFFER DEFINITION */
+
+/** class triple_buffer
+ * 
+ * Lock-free single producer, single consumer handoff of the latest value.
+ * The producer writes into the back buffer and publishes it, which swaps it with the middle buffer.
+ * The consumer swaps the middle buffer with the front buffer when a new value has been published, and reads from the front buffer.
+ * Neither side ever waits for the other, and values published before the consumer swaps are dropped in favour of the latest.
+ * The buffers are reused, so values which hold storage (such as vectors) do not allocate once they have grown.
+ */
+template<class T> class watergun::triple_buffer
+{
+public:
+
+    /** @name constructor
+     * 
+     * @brief Initialize all three buffers to the same value.
+     * @param initial: The value to initialize the buffers to.
+     */
+    explicit triple_buffer ( const T& initial = T {} ) : buffers { initial, initial, initial } {}
+
+    /** @name deleted copy constructor
+     * 
+     * @brief Copying is not allowed, since the buffers are owned by the threads using them.
+     */
+    triple_buffer ( const triple_buffer& other ) = delete;
+
+
+
+    /** @name  back
+     * 
+     * @brief  Get the buffer to write the next value into. Only the producer may call this.
+     * @return The back buffer.
+     */
+    T& back () noexcept { return buffers [ back_index ]; }
+
+    /** @name  publish
+     * 
+     * @brief  Publish the back buffer to the consumer. Only the producer may call this.
+     * @return Nothing.
+     */
+    void publish () noexcept { back_index = middle.exchange ( back_index | dirty_bit, std::memory_order_acq_rel ) & index_mask; }
+
+
+
+    /** @name  pending
+     * 
+     * @brief  Find out whether a value has been published which the consumer has not yet taken.
+     * @return True if there is a new value.
+     */
+    bool pending () const noexcept { return middle.load ( std::memory_order_acquire ) & dirty_bit; }
+
+    /** @name  consume
+     * 
+     * @brief  Take the latest published value into the front buffer, if there is one. Only the consumer may call this.
+     * @return True if a new value was taken.
+     */
+    bool consume () noexcept
+    {
+        /* Return if there is nothing new, otherwise swap the front and middle buffers */
+        if ( !pending () ) return false;
+        front_index = middle.exchange ( front_index, std::memory_order_acq_rel ) & index_mask;
+        return true;
+    }
+
+    /** @name  front
+     * 
+     * @brief  Get the last value taken by the consumer. Only the consumer may call this.
+     * @return The front buffer.
+     */
+    T& front () noexcept { return buffers [ front_index ]; }
+
+
+
+private:
+
+    /* The bit which marks the middle buffer as newly published, and a mask for the index */
+    static constexpr unsigned dirty_bit { 4 }, index_mask { 3 };
+
+    /* The three buffers */
+    std::array<T, 3> buffers;
+
+    /* The index of the back buffer, owned by the producer, and the front buffer, owned by the consumer */
+    unsigned back_index { 0 }, front_index { 2 };
+
+    /* The index of the middle buffer, along with the dirty bit */
+    std::atomic<unsigned> middle { 1 };
+
+};
+
+
+
+/* HEADER GUARD */
+#endif /* #ifndef WATERGUN_TRIPLE_BUFFER_H_INCLUDED */
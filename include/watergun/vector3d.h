@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * include/watergun/vector3d.h
+ * 
+ * Header file for a simple 3D vector class.
+ * 
+ */
+
+
+
+/* HEADER GUARD */
+#ifndef WATERGUN_VECTOR3D_H_INCLUDED
+#define WATERGUN_VECTOR3D_H_INCLUDED
+
+
+
+/* DECLARATIONS */
+
+namespace watergun
+{
+    /** struct vector3d
+     * 
+     * 3D vector class.
+     */
+    struct vector3d;
+}
+
+
+
+/* VECTOR3D DEFINITION */
+
+
+
+/** struct vector3d
+ * 
+ * 3D vector class.
+ */
+struct watergun::vector3d
+{
+    /* X, Y and Z components */
+    double x, y, z;
+
+
+
+    /** @name default construction
+     * 
+     * @brief Initialize all components to 0.
+     */
+    constexpr vector3d () noexcept : x { 0. }, y { 0. }, z { 0. } {}
+
+    /** @name single components constructor
+     * 
+     * @brief Initialize all components to the same value.
+     * @param v: The value to initialize the components to.
+     */
+    explicit constexpr vector3d ( double v ) noexcept : x { v }, y { v }, z { v } {}
+
+    /** @name three component constructor
+     * 
+     * @brief Initialize all components to separate values.
+     * @param x: X value.
+     * @param y: Y value.
+     * @param z: Z value.
+     */
+    constexpr vector3d ( double _x, double _y, double _z ) noexcept : x { _x }, y { _y }, z { _z } {}
+
+
+
+    /* Simple arithmetic operations */
+    constexpr vector3d operator+ ( const vector3d& other ) const noexcept { return vector3d { x + other.x, y + other.y, z + other.z }; }
+    constexpr vector3d operator- ( const vector3d& other ) const noexcept { return vector3d { x - other.x, y - other.y, z - other.z }; }
+    constexpr vector3d operator* ( const vector3d& other ) const noexcept { return vector3d { x * other.x, y * other.y, z * other.z }; }
+    constexpr vector3d operator/ ( const vector3d& other ) const noexcept { return vector3d { x / other.x, y / other.y, z / other.z }; }
+    constexpr vector3d& operator+= ( const vector3d& other ) noexcept { return * this = * this + other; }
+    constexpr vector3d& operator-= ( const vector3d& other ) noexcept { return * this = * this - other; }
+    constexpr vector3d& operator*= ( const vector3d& other ) noexcept { return * this = * this * other; }
+    constexpr vector3d& operator/= ( const vector3d& other ) noexcept { return * this = * this / other; }
+    constexpr vector3d operator* ( double scalar ) const noexcept { return * this * vector3d { scalar }; }
+    constexpr vector3d operator/ ( double scalar ) const noexcept { return * this / vector3d { scalar }; }
+    constexpr vector3d& operator*= ( double scalar ) noexcept { return * this = * this * scalar; }
+    constexpr vector3d& operator/= ( double scalar ) noexcept { return * this = * this / scalar; }
+
+    /* Comparison operators */
+    constexpr bool operator== ( const vector3d& other ) const noexcept = default;
+    constexpr bool operator!= ( const vector3d& other ) const noexcept = default;
+
+};
+
+
+
+/* HEADER GUARD */
+#endif /* #ifndef WATERGUN_VECTOR3D_H_INCLUDED */
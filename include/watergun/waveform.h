@@ -0,0 +1,308 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * include/watergun/waveform.h
+ * 
+ * Header file for rendering stepper movements ahead of time into compact waveforms of pin states, and playing them back.
+ * 
+ */
+
+
+
+/* HEADER GUARD */
+#ifndef WATERGUN_WAVEFORM_H_INCLUDED
+#define WATERGUN_WAVEFORM_H_INCLUDED
+
+
+
+/* INCLUDES */
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stop_token>
+#include <vector>
+#include <watergun/realtime.h>
+#include <watergun/step_ramp.h>
+
+
+
+/* DECLARATIONS */
+
+namespace watergun
+{
+    /** class waveform
+     * 
+     * A compact buffer of pin states for the step, direction and microstep pins of a stepper driver, and the delay after each.
+     */
+    class waveform;
+
+    /** class waveform_renderer
+     * 
+     * Renders consecutive segments of a stepper movement into waveforms, carrying the state of the motion across segment boundaries.
+     */
+    class waveform_renderer;
+}
+
+
+
+/* WAVEFORM DEFINITION */
+
+/** class waveform
+ * 
+ * A compact buffer of pin states for the step, direction and microstep pins of a stepper driver, and the delay after each.
+ * Each entry is the state to write to all of the pins, followed by the number of nanoseconds to wait before the next entry, so playing a waveform
+ * is a tight loop of waiting and writing, with no step computation. Waveforms may be captured instead of played, which gives the time each state
+ * would be written without driving any pins.
+ */
+class watergun::waveform
+{
+public:
+
+    /* The clock waveforms are played against */
+    typedef monotonic_clock clock;
+
+    /** enum pin_bit
+     * 
+     * The bits of the pin mask for each pin.
+     */
+    enum pin_bit : std::uint8_t { step_bit = 1 << 0, dir_bit = 1 << 1, microstep_bit_0 = 1 << 2, microstep_bit_1 = 1 << 3, microstep_bit_2 = 1 << 4 };
+
+    /** struct entry
+     * 
+     * A state to write to the pins, and how long to hold it for.
+     */
+    struct entry
+    {
+        /* The pin states as a mask of pin_bits */
+        std::uint8_t pins;
+
+        /* The delay in nanoseconds before the next entry */
+        std::uint32_t delay;
+    };
+
+    /** struct edge
+     * 
+     * A state which would be written to the pins, and when.
+     */
+    struct edge
+    {
+        /* The time at which the pins would be written */
+        clock::time_point due;
+
+        /* The pin states as a mask of pin_bits */
+        std::uint8_t pins;
+    };
+
+
+
+    /** @name constructor
+     * 
+     * @brief Reserve space for entries.
+     * @param max_entries: The number of entries to reserve space for.
+     */
+    explicit waveform ( std::size_t max_entries = 0 ) { entries.reserve ( max_entries ); }
+
+
+
+    /** @name  clear
+     * 
+     * @brief  Remove all entries.
+     * @return Nothing.
+     */
+    void clear () noexcept { entries.clear (); duration = 0; net_angle = 0.; }
+
+    /** @name  append
+     * 
+     * @brief  Append a pin state, splitting delays too long for a single entry across several.
+     * @param  pins: The pin states as a mask of pin_bits.
+     * @param  delay: The delay in nanoseconds before the next entry.
+     * @return Nothing.
+     */
+    void append ( std::uint8_t pins, std::uint64_t delay );
+
+    /** @name  add_angle
+     * 
+     * @brief  Add to the net change in angle which playing the waveform causes.
+     * @param  angle: The angle to add.
+     * @return Nothing.
+     */
+    void add_angle ( double angle ) noexcept { net_angle += angle; }
+
+
+
+    /** @name  get_entries
+     * 
+     * @brief  Get the entries.
+     * @return Vector of entries.
+     */
+    const std::vector<entry>& get_entries () const noexcept { return entries; }
+
+    /** @name  get_duration
+     * 
+     * @brief  Get the total duration of the waveform.
+     * @return The duration in nanoseconds.
+     */
+    std::uint64_t get_duration () const noexcept { return duration; }
+
+    /** @name  get_net_angle
+     * 
+     * @brief  Get the net change in angle which playing the waveform causes.
+     * @return The angle in radians.
+     */
+    double get_net_angle () const noexcept { return net_angle; }
+
+
+
+    /** @name  play
+     * 
+     * @brief  Play the waveform, sleeping then spinning until each entry is due, then passing its pin states to an output.
+     * @param  start: The time at which to write the first entry.
+     * @param  spin_window: How long before each entry is due to stop sleeping and start spinning.
+     * @param  output: A function called with the pin states, the time they were due and the time they were written, which should write them to the pins.
+     * @param  stoken: A stop token, which stops playback between entries when a stop is requested.
+     * @return The time at which the waveform ends, which is when the next waveform should start.
+     */
+    template<class Output> clock::time_point play ( clock::time_point start, clock::duration spin_window, Output output, std::stop_token stoken ) const;
+
+    /** @name  capture
+     * 
+     * @brief  Find the time at which each entry would be written if played, without waiting or driving any pins.
+     * @param  start: The time at which the first entry would be written.
+     * @return Vector of edges, one per entry.
+     */
+    std::vector<edge> capture ( clock::time_point start ) const;
+
+
+
+private:
+
+    /* The entries */
+    std::vector<entry> entries;
+
+    /* The total duration in nanoseconds */
+    std::uint64_t duration { 0 };
+
+    /* The net change in angle */
+    double net_angle { 0. };
+
+};
+
+
+
+/* WAVEFORM_RENDERER DEFINITION */
+
+/** class waveform_renderer
+ * 
+ * Renders consecutive segments of a stepper movement into waveforms, carrying the state of the motion across segment boundaries.
+ * Segments are played back to back, so each is rendered to end at the requested duration, and a step due after the end of a segment is carried into the next.
+ * If a step pulse straddles the end of a segment, the segment is lengthened to finish the pulse, and the next segment is shortened to match, so that
+ * segments stay aligned with the plan they were rendered from.
+ * The microstep number can only be changed while at rest, and a change of direction or microstep number is given a setup time before the next step.
+ */
+class watergun::waveform_renderer
+{
+public:
+
+    /* The time the driver needs between a direction or microstep change and a step, which must be at least 650ns for the DRV8825 */
+    static constexpr std::uint32_t setup_time { 1000 };
+
+
+
+    /** @name  retarget
+     * 
+     * @brief  Change the target of the motion.
+     * @param  ramp: The ramp to follow, which is only changed if at rest, and must remain valid until the motion has finished.
+     * @param  _microstep_number: The microstep number which the ramp is for, which is only changed if at rest.
+     * @param  remaining: The signed number of steps to the new target from the end of the last rendered segment.
+     * @param  cruise_level: The level on the ramp to cruise at.
+     * @return Nothing.
+     */
+    void retarget ( const step_ramp& ramp, int _microstep_number, std::int64_t remaining, std::size_t cruise_level ) noexcept;
+
+    /** @name  render
+     * 
+     * @brief  Render the next segment of the motion.
+     * @param  output: The waveform to render into, which is cleared first.
+     * @param  segment_duration: The duration of the segment.
+     * @param  pulse_width: The width of each step pulse.
+     * @return Nothing.
+     */
+    void render ( waveform& output, std::chrono::nanoseconds segment_duration, std::chrono::nanoseconds pulse_width );
+
+
+
+    /** @name  at_rest
+     * 
+     * @brief  Find out whether the motion is at rest at the end of the last rendered segment.
+     * @return True if at rest.
+     */
+    bool at_rest () const noexcept { return motion.at_rest (); }
+
+    /** @name  get_microstep_number
+     * 
+     * @brief  Get the microstep number being rendered.
+     * @return The microstep number.
+     */
+    int get_microstep_number () const noexcept { return microstep_number; }
+
+
+
+private:
+
+    /* The motion being rendered, and the size of its steps */
+    step_generator motion;
+    double microstep_size { 0. };
+
+    /* The microstep number being rendered */
+    int microstep_number { 0 };
+
+    /* The pin states at the end of the last rendered segment */
+    std::uint8_t pins { 0 };
+
+    /* The time in nanoseconds from the start of the next segment until the next step is due */
+    std::uint64_t carry { 0 };
+
+    /* The time in nanoseconds by which the last segment was lengthened to finish a step pulse */
+    std::uint64_t overrun { 0 };
+
+};
+
+
+
+/* WAVEFORM IMPLEMENTATION */
+
+
+
+/** @name  play
+ * 
+ * @brief  Play the waveform, sleeping then spinning until each entry is due, then passing its pin states to an output.
+ * @param  start: The time at which to write the first entry.
+ * @param  spin_window: How long before each entry is due to stop sleeping and start spinning.
+ * @param  output: A function called with the pin states, the time they were due and the time they were written, which should write them to the pins.
+ * @param  stoken: A stop token, which stops playback between entries when a stop is requested.
+ * @return The time at which the waveform ends, which is when the next waveform should start.
+ */
+template<class Output> watergun::waveform::clock::time_point watergun::waveform::play ( const clock::time_point start, const clock::duration spin_window, Output output, const std::stop_token stoken ) const
+{
+    /* Wait for and write each entry in turn */
+    clock::time_point due = start;
+    for ( const entry& e : entries )
+    {
+        if ( stoken.stop_requested () ) break;
+        output ( e.pins, due, sleep_then_spin_until_monotonic ( due, spin_window ) );
+        due += std::chrono::nanoseconds { e.delay };
+    }
+
+    /* Return the end of the waveform */
+    return due;
+}
+
+
+
+/* HEADER GUARD */
+#endif /* #ifndef WATERGUN_WAVEFORM_H_INCLUDED */
@@ -13,6 +13,7 @@
 
 /* INCLUDES */
 #include <signal.h>
+#include <cstring>
 #include <iostream>
 #include <watergun/controller.h>
 
@@ -46,19 +47,29 @@ void wait_for_interrupt ()
 
 
 
-int main ()
+int main ( int argc, char ** argv )
 {
+    /* If requested, enable the real-time profile before anything else starts, and report what could be applied */
+    if ( argc > 1 && std::strcmp ( argv [ 1 ], "--realtime" ) == 0 ) std::cout << watergun::enable_realtime_profile ( watergun::realtime_profile {} ).description;
+
+    /* The torque curve of the stepper motors in Nm, and the curve of each axis given the inertia it drives. Both the steppers and the planner are limited by these curves. */
+    const std::vector<watergun::torque_curve::point> stepper_torque { { 0., 0.40 }, { 2 * M_PI, 0.35 }, { 3 * 2 * M_PI, 0.10 } };
+    const watergun::torque_curve yaw_torque { stepper_torque, 0.40 / ( 4 * 2 * M_PI ) }, pitch_torque { stepper_torque, 0.40 / ( 8 * 2 * M_PI ) };
+
     /* Set up the stepper motors */
-    watergun::pwm_stepper yaw_stepper { 1.8, 1000, 1, 2, 3, 4, 5, 6 };
-    watergun::gpio_stepper pitch_stepper { 0.9, 1000, 3 * 2 * M_PI, 1, 2, 3, 4, 5, 6, 7 };
+    watergun::pwm_stepper yaw_stepper { 1.8, 1000, 3 * 2 * M_PI, yaw_torque, 2000., 1, 2, 3, 4, 5, 6 };
+    watergun::gpio_stepper pitch_stepper { 0.9, 1000, 3 * 2 * M_PI, pitch_torque, 0., 1, 2, 3, 4, 5, 6, 7 };
 
     /* Set up the solenoid valve */
     watergun::solenoid solenoid_valve { 1 };
 
+    /* Model the reservoir, pumped to 300 kPa with 1 L of air above 2 L of water, firing through a 2 mm nozzle, and rationing water below 100 kPa */
+    watergun::pressure_model reservoir { 300e3, 1e-3, 2e-3, M_PI * 1e-3 * 1e-3, 0.9, 100e3 };
+
     /* Create the controller in a new block */
     {
         /* Create the controller */
-        watergun::controller controller { yaw_stepper, pitch_stepper, solenoid_valve, M_PI / 2., M_PI / 4., 10., 0., M_PI };
+        watergun::controller controller { yaw_stepper, pitch_stepper, solenoid_valve, M_PI / 2., reservoir, 10., 0., yaw_torque, M_PI, pitch_torque };
 
         /* Wait for interrupt signal */
         wait_for_interrupt ();
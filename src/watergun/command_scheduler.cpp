@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * src/watergun/command_scheduler.cpp
+ * 
+ * Implementation of include/watergun/command_scheduler.h
+ * 
+ */
+
+
+
+/* INCLUDES */
+#include <watergun/command_scheduler.h>
+
+
+
+/* COMMAND_SCHEDULER IMPLEMENTATION */
+
+
+
+/** @name constructor
+ * 
+ * @brief Set up the scheduler for the valve, and allocate the heap and execution log.
+ * @param _solenoid_valve: The solenoid valve to command.
+ * @param max_pending: The number of pending commands to reserve space for.
+ * @param log_size: The number of executed commands to remember.
+ * @throw watergun_exception, if the log size is zero.
+ */
+watergun::command_scheduler::command_scheduler ( solenoid& _solenoid_valve, const std::size_t max_pending, const std::size_t log_size )
+    : solenoid_valve { _solenoid_valve }
+    , executed_log { log_size }
+{
+    /* Throw if the log size is zero */
+    if ( log_size == 0 ) throw watergun_exception { "Command scheduler log size must be positive" };
+
+    /* Allocate the heap */
+    pending.reserve ( max_pending );
+}
+
+
+
+/** @name  schedule
+ * 
+ * @brief  Schedule a command. Only the executing thread may call this.
+ * @param  cmd: The command.
+ * @return Nothing.
+ */
+void watergun::command_scheduler::schedule ( const command& cmd )
+{
+    /* Push the command onto the heap */
+    pending.push_back ( pending_command { cmd, next_sequence++ } );
+    std::push_heap ( pending.begin (), pending.end (), later );
+}
+
+
+
+/** @name  get_executed_commands
+ * 
+ * @brief  Get the remembered executed commands, oldest first.
+ * @return Vector of executed commands.
+ */
+std::vector<watergun::command_scheduler::executed_command> watergun::command_scheduler::get_executed_commands () const
+{
+    /* Lock the mutex and copy out the log in order */
+    std::unique_lock<std::mutex> lock { log_mx };
+    std::vector<executed_command> executed; executed.reserve ( executed_log.size () );
+    for ( std::size_t i = 0; i < executed_log.size (); ++i ) executed.push_back ( executed_log [ i ] );
+    return executed;
+}
+
+
+
+/** @name  get_max_lateness
+ * 
+ * @brief  Get the largest time by which a command has been executed after it was due.
+ * @return The duration.
+ */
+watergun::command_scheduler::clock::duration watergun::command_scheduler::get_max_lateness () const
+{
+    /* Lock the mutex and return the lateness */
+    std::unique_lock<std::mutex> lock { log_mx };
+    return max_lateness;
+}
+
+
+
+/** @name  execute
+ * 
+ * @brief  Execute a single command on the valve.
+ * @param  cmd: The command.
+ * @return Nothing.
+ */
+void watergun::command_scheduler::execute ( const command& cmd )
+{
+    /* Open or close the valve */
+    if ( cmd.open ) solenoid_valve.power_on (); else solenoid_valve.power_off ();
+}
+
+
+
+/** @name  record
+ * 
+ * @brief  Record an executed command in the log.
+ * @param  executed: The executed command.
+ * @return Nothing.
+ */
+void watergun::command_scheduler::record ( const executed_command& executed )
+{
+    /* Lock the mutex */
+    std::unique_lock<std::mutex> lock { log_mx };
+
+    /* Store the record, dropping the oldest once the log is full */
+    executed_log.push_back ( executed );
+
+    /* Update the lateness */
+    max_lateness = std::max ( max_lateness, executed.executed_at - executed.cmd.due );
+}
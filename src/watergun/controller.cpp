@@ -28,35 +28,53 @@
  * @param _pitch_stepper: The pitch stepper motor to use.
  * @param _solenoid_valve: The solenoid valve to use.
  * @param _search_yaw_velocity: The yaw angular velocity in radians per second when searching for a user.
- * @param _water_rate: The velocity of the water leaving the watergun (depends on psi etc).
+ * @param _pressure: The model of the water pressure, which gives the velocity of the water leaving the watergun, and is told when the valve opens and closes.
  * @param _air_resistance: Horizontal deceleration of the water, to model small amounts of air resistance.
  * @param _max_yaw_velocity: Maximum yaw angular velocity in radians per second.
- * @param _max_yaw_acceleration: Maximum yaw angular acceleration in radians per second squared.
+ * @param _yaw_torque: The torque curve of the yaw axis, giving the maximum yaw angular acceleration in radians per second squared at each velocity.
+ * @param _max_pitch_velocity: Maximum pitch angular velocity in radians per second.
+ * @param _pitch_torque: The torque curve of the pitch axis, giving the maximum pitch angular acceleration in radians per second squared at each velocity.
  * @param _aim_period: The period of time in seconds with which to aspire to be correctly aimed within.
  * @param _camera_offset: The position of the camera relative to a custom origin. Defaults to the camera being the origin.
+ * @param _switching_penalty: The time penalty for switching away from the current target.
+ * @param _min_target_dwell: The minimum time to stay on a target once it has been chosen.
+ * @param _setpoint_frequency: The frequency in Hz at which the yaw velocity and pitch setpoints are updated between plan periods, typically 250 to 1000.
+ * @param _valve: The timing characteristics of the solenoid valve.
+ * @param _burst: The burst pattern to fire with. Defaults to firing continuously while on target.
+ * @param _max_fire_lead: The latest time after the start of a plan at which water may be predicted to land.
  * @throw watergun_exception, if configuration cannot be completed (e.g. config file or denice not found).
  */
-watergun::controller::controller ( pwm_stepper& _yaw_stepper, gpio_stepper& _pitch_stepper, solenoid& _solenoid_valve, const double _search_yaw_velocity, const double _water_rate, const double _air_resistance, const double _max_yaw_velocity, const double _max_yaw_acceleration, const clock::duration _aim_period, const vector3d _camera_offset )
-    : aimer ( _water_rate, _air_resistance, _max_yaw_velocity, _max_yaw_acceleration, _aim_period, _camera_offset )
+watergun::controller::controller ( pwm_stepper& _yaw_stepper, gpio_stepper& _pitch_stepper, solenoid& _solenoid_valve, const double _search_yaw_velocity, pressure_model& _pressure, const double _air_resistance, const double _max_yaw_velocity, const torque_curve& _yaw_torque, const double _max_pitch_velocity, const torque_curve& _pitch_torque, const clock::duration _aim_period, const vector3d _camera_offset, const clock::duration _switching_penalty, const clock::duration _min_target_dwell, const double _setpoint_frequency, const valve_dynamics& _valve, const burst_pattern& _burst, const clock::duration _max_fire_lead )
+    : aimer ( _pressure.get_water_rate (), _air_resistance, _max_yaw_velocity, _yaw_torque, _max_pitch_velocity, _pitch_torque, _aim_period, _camera_offset )
     , yaw_stepper { _yaw_stepper }
     , pitch_stepper { _pitch_stepper }
     , solenoid_valve { _solenoid_valve }
+    , pressure { _pressure }
     , search_yaw_velocity { _search_yaw_velocity }
-    , num_future_movements { static_cast<int> ( std::chrono::seconds { 1 } / _aim_period ) }
+    , current_movement_snapshot { single_movement { zero_duration, clock::now (), 0., 0., 0. } }
+    , plan_handoff { std::vector<single_movement> ( plan_horizon + 1 ) }
+    , fire_controller { _valve, _burst, std::chrono::duration_cast<monotonic_clock::duration> ( _max_fire_lead ) }
+    , actuator_scheduler { _solenoid_valve, fire_controller.max_commands ( plan_horizon + 1, std::chrono::seconds { 1 } ), command_log_size }
+    , axis_executor { std::vector<motion_axis *> { &_yaw_stepper, &_pitch_stepper } }
+    , setpoint_period { std::chrono::duration_cast<monotonic_clock::duration> ( std::chrono::duration<double> { 1. / _setpoint_frequency } ) }
+    , plan_setpoints { static_cast<std::size_t> ( plan_horizon + 1 ) }
+    , selection { _switching_penalty, _min_target_dwell }
+    , candidate_planner { get_planner (), num_candidate_plans }
 {
-    /* Push a non-movement from the beginning of all time to the movement plan. The duration will be updated on the movement planner thread's start.
-     * Also push a search movement for the rest of all time to the movement plan. It's start point will also be updated on the same thread's start.
-     */
-    movement_plan.push_back ( single_movement { zero_duration,  zero_time_point,  0., 0. } );
-    movement_plan.push_back ( single_movement { large_duration, large_time_point, search_yaw_velocity, 0. } );
+    /* Throw if the setpoint frequency is not positive */
+    if ( _setpoint_frequency <= 0. ) throw watergun_exception { "Setpoint frequency must be positive" };
+
+    /* Reserve space for the valve commands of a plan */
+    valve_commands.reserve ( fire_controller.max_commands ( plan_horizon + 1, std::chrono::seconds { 1 } ) );
 
-    /* Set the current movement */
-    current_movement = std::next ( movement_plan.begin () );
+    /* Reserve space for the published target scores, which are swapped with the planner thread's buffer */
+    target_scores.reserve ( max_planned_users );
 
     /* Sleep for a short time */
     std::this_thread::sleep_for ( std::chrono::milliseconds { 100 } );
 
-    /* Start the movement planner thread */
+    /* Start the actuator and movement planner threads */
+    actuator_thread   = std::jthread { [ this ] ( std::stop_token stoken ) { actuator_thread_function ( std::move ( stoken ) ); } };
     controller_thread = std::jthread { [ this ] ( std::stop_token stoken ) { movement_planner_thread_function ( std::move ( stoken ) ); } };
 }
 
@@ -68,8 +86,9 @@ watergun::controller::controller ( pwm_stepper& _yaw_stepper, gpio_stepper& _pit
  */
 watergun::controller::~controller ()
 {
-    /* Join the thread */
+    /* Join the threads */
     if ( controller_thread.joinable () ) { controller_thread.request_stop (); controller_thread.join (); }
+    if ( actuator_thread.joinable   () ) { actuator_thread.request_stop   (); actuator_thread.join   (); }
 }
 
 
@@ -81,9 +100,35 @@ watergun::controller::~controller ()
  */
 watergun::controller::single_movement watergun::controller::get_current_movement () const
 {
-    /* Lock the mutex and return the current movement */
-    std::unique_lock<std::mutex> lock { movement_mx };
-    return * current_movement;
+    /* Return the snapshot of the current movement */
+    return current_movement_snapshot.load ();
+}
+
+
+
+/** @name  get_executed_commands
+ * 
+ * @brief  Immediately returns the most recently executed valve commands, along with when they were really executed.
+ * @return Vector of executed commands, oldest first.
+ */
+std::vector<watergun::command_scheduler::executed_command> watergun::controller::get_executed_commands () const
+{
+    /* Return the scheduler's log */
+    return actuator_scheduler.get_executed_commands ();
+}
+
+
+
+/** @name  get_target_scores
+ * 
+ * @brief  Immediately returns the scores given to each user during the last target selection.
+ * @return Vector of target scores.
+ */
+std::vector<watergun::controller::target_score> watergun::controller::get_target_scores () const
+{
+    /* Lock the mutex and return the scores */
+    std::unique_lock<std::mutex> lock { target_scores_mx };
+    return target_scores;
 }
 
 
@@ -97,35 +142,16 @@ watergun::controller::single_movement watergun::controller::get_current_movement
  */
 watergun::controller::tracked_user watergun::controller::dynamic_project_tracked_user ( const tracked_user& user, const clock::time_point timestamp ) const
 {
-    /* Find the early and late timestamps */
-    const clock::time_point early_timestamp = std::min ( user.timestamp, timestamp ), late_timestamp = std::max ( user.timestamp, timestamp );
-
-    /* Lock the mutex */
-    std::unique_lock<std::mutex> lock { movement_mx };
-
-    /* Iterate backwards through the movement plan to find a movement that started before the early timestamp */
-    auto movement_it = current_movement; while ( movement_it->timestamp > early_timestamp ) --movement_it;
-
-    /* Iterate over the movements, adding up the change in yaw, until the late timestamp is met. */
-    double delta_yaw = 0.; do
-    {
-        /* Get the duration within the early and late times, that this movement occured */
-        const clock::duration movement_duration = 
-            watergun::clamp ( late_timestamp,  movement_it->timestamp, movement_it->timestamp + movement_it->duration ) - 
-            watergun::clamp ( early_timestamp, movement_it->timestamp, movement_it->timestamp + movement_it->duration );
-
-        /* Add to the delta yaw */
-        delta_yaw += movement_it->yaw_rate * duration_to_seconds ( movement_duration ).count ();
-    } while ( ( ++movement_it )->timestamp < late_timestamp );
-
-    /* Unlock the mutex */
-    lock.unlock ();
+    /* Find the change in yaw between the user's timestamp and the new timestamp, according to the yaw stepper's odometry, which is timestamped on the stepper's clock */
+    const clock::time_point now = clock::now (); const pwm_stepper::clock::time_point stepper_now = pwm_stepper::clock::now ();
+    auto to_stepper_clock = [ & ] ( const clock::time_point t ) { return stepper_now + std::chrono::duration_cast<pwm_stepper::clock::duration> ( t - now ); };
+    const double delta_yaw = yaw_stepper.get_rotation ( to_stepper_clock ( user.timestamp ), to_stepper_clock ( timestamp ) );
 
     /* Project the user */
     tracked_user proj_user = project_tracked_user ( user, timestamp );
 
     /* Make up for the delta yaw */
-    if ( timestamp == late_timestamp ) proj_user.com.x -= delta_yaw; else proj_user.com.x += delta_yaw;
+    proj_user.com.x -= delta_yaw;
 
     /* Return the projected user */
     return proj_user;
@@ -135,14 +161,30 @@ watergun::controller::tracked_user watergun::controller::dynamic_project_tracked
 
 /** @name  movement_planner_thread_function
  * 
- * @brief  Function run by controller_thread. Continuously updates movement_plan, and notifies the condition variable.
+ * @brief  Function run by controller_thread. Continuously plans future movements and publishes them to the actuator thread.
  * @param  stoken: The stop token for the jthread.
  * @return Nothing.
  */
 void watergun::controller::movement_planner_thread_function ( std::stop_token stoken )
 {
-    /* The last frameid */
+    /* Take on the planner real-time role */
+    enter_realtime_role ( thread_role::planner );
+
+    /* The last frameid, and the current target as of the last frame */
     int frameid = 0;
+    tracked_user last_target {};
+
+    /* The expected time from getting the tracked users to publishing a plan, averaged over frames, which is how long a nudge is spread over.
+     * A nudge is spread over at least two setpoint periods, so that it is never made in a single jump.
+     */
+    monotonic_clock::duration solve_latency = setpoint_period * 2;
+
+    /* The buffers used to plan each frame, which are allocated once here so that planning does not allocate in the steady state */
+    std::vector<tracked_user> users, candidates; users.reserve ( max_planned_users ); candidates.reserve ( num_candidate_plans );
+    std::vector<target_score> scores, published_scores; scores.reserve ( max_planned_users ); published_scores.reserve ( max_planned_users );
+    std::vector<engagement> sequence; sequence.reserve ( max_planned_users );
+    sequencing_workspace workspace = create_sequencing_workspace ( max_planned_users );
+    std::array<planning_pool<plan_horizon>::candidate_plan, num_candidate_plans> plans;
 
     /* Wait for detected tracked users */
     wait_for_detected_tracked_users ( stoken, &frameid );
@@ -150,46 +192,197 @@ void watergun::controller::movement_planner_thread_function ( std::stop_token st
     /* Loop while not signalled to end */
     while ( !stoken.stop_requested () )
     {
-        /* Get tracked users and choose a target. If there is no target, continue. */
-        tracked_user target = choose_target ( get_tracked_users () );
-        if ( target.com == vector3d {} ) continue;
-
-        /* Calculate future movements */
-        std::list<single_movement> future_movements = calculate_future_movements ( target, * current_movement, num_future_movements );
-
-        /* Lock the mutex then erase movements not yet started */
-        std::unique_lock<std::mutex> lock { movement_mx };
-        movement_plan.erase ( std::next ( current_movement ), movement_plan.end () );
-
-        /* Add new future movements */
-        movement_plan.splice ( movement_plan.end (), std::move ( future_movements ) );
+        /* Aim with the latest velocity of the water, keeping the last one if the reservoir has emptied, since nothing would be fired anyway */
+        if ( pressure.get_water_rate () > 0. ) set_water_rate ( pressure.get_water_rate () );
+
+        /* Get tracked users and sequence the engagement of them. The real selection is only updated once a plan has been chosen. */
+        const monotonic_clock::time_point frame_start = monotonic_clock::now ();
+        get_tracked_users ( users );
+        const single_movement current_movement = current_movement_snapshot.load ();
+
+        /* If the current target was also in the last frame, nudge the plan solved from the last frame, which is still running, to follow the target's deviation from where it was predicted to be.
+         * The nudge turns the gun by the deviation, so the plan for this frame is solved with every user moved back by it, as though the nudge has already been made.
+         */
+        const auto target = std::find_if ( users.begin (), users.end (), [ this ] ( const tracked_user& user ) { return user.id == selection.id; } );
+        const tracked_user observed_target = ( target != users.end () ? * target : tracked_user {} );
+        if ( target != users.end () && target->id == last_target.id )
+        {
+            const clock::time_point now = clock::now ();
+            const double deviation = dynamic_project_tracked_user ( * target, now ).com.x - dynamic_project_tracked_user ( last_target, now ).com.x;
+            setpoint_nudge_snapshot.store ( setpoint_nudge { deviation, std::max ( solve_latency, setpoint_period * 2 ), monotonic_clock::now () } );
+            for ( tracked_user& user : users ) user.com.x -= deviation;
+        }
+        last_target = observed_target;
+
+        target_selection trial_selection = selection;
+        sequence_targets ( users, current_movement, trial_selection, workspace, sequence, &scores );
+
+        /* If there is no one to engage, publish the empty scores, wait for the next frame and continue */
+        if ( sequence.empty () ) 
+        {
+            std::unique_lock<std::mutex> scores_lock { target_scores_mx }; target_scores.clear (); scores_lock.unlock ();
+            wait_for_detected_tracked_users ( stoken, &frameid ); continue;
+        }
+
+        /* Choose the candidates to plan for: the first user in the sequence, followed by the best scoring other users */
+        std::sort ( scores.begin (), scores.end (), [] ( const target_score& lhs, const target_score& rhs ) { return lhs.score > rhs.score; } );
+        candidates.assign ( 1, sequence.front ().user );
+        for ( const target_score& score : scores ) if ( candidates.size () < static_cast<std::size_t> ( num_candidate_plans ) && score.id != candidates.front ().id )
+            candidates.push_back ( * std::find_if ( users.begin (), users.end (), [ &score ] ( const tracked_user& user ) { return user.id == score.id; } ) );
+
+        /* Plan movements for all of the candidates concurrently */
+        candidate_planner.plan ( candidates, current_movement, plans );
+
+        /* Choose the plan which gets on target soonest, including any switching penalty, breaking ties by the fraction of time spent on target.
+         * Getting on target 0s from now scores 0, while each second later scores -2. Being on target for the whole plan scores 1.
+         */
+        auto plan_score = [ this ] ( const planning_pool<plan_horizon>::candidate_plan& plan )
+        {
+            if ( plan.time_to_target == clock::duration::max () ) return -100.;
+            const clock::duration penalty = ( selection.id != 0 && plan.user.id != selection.id ? selection.switching_penalty : zero_duration );
+            return duration_to_seconds ( plan.time_to_target + penalty ).count () * -2. + plan.on_target_fraction;
+        };
+        auto best_plan = std::max_element ( plans.begin (), plans.begin () + candidates.size (), [ & ] ( const auto& lhs, const auto& rhs ) { return plan_score ( lhs ) < plan_score ( rhs ); } );
+
+        /* Update the target selection with the chosen plan's target */
+        selection.update ( best_plan->user.id, clock::now () );
+
+        /* Publish the planned time to target of each candidate alongside the sequencer scores */
+        for ( std::size_t i = 0; i < candidates.size (); ++i ) for ( target_score& score : scores ) if ( score.id == plans [ i ].user.id ) score.time_to_target = plans [ i ].time_to_target;
+        std::unique_lock<std::mutex> scores_lock { target_scores_mx };
+        published_scores.assign ( scores.begin (), scores.end () ); std::swap ( target_scores, published_scores );
+        scores_lock.unlock ();
+
+        /* Write the chosen plan into the back buffer, followed by a search movement */
+        std::vector<single_movement>& plan_buffer = plan_handoff.back ();
+        plan_buffer.assign ( best_plan->movements.begin (), best_plan->movements.end () );
+        const single_movement last_movement = ( plan_buffer.empty () ? current_movement : plan_buffer.back () );
+        plan_buffer.push_back ( single_movement { large_duration, large_time_point, std::copysign ( search_yaw_velocity, last_movement.yaw_rate ), 0., last_movement.ending_pitch } );
+
+        /* Publish the plan to the actuator thread, and wake it */
+        plan_handoff.publish ();
+        std::unique_lock<std::mutex> actuator_lock { actuator_mx }; actuator_lock.unlock ();
+        actuator_cv.notify_one ();
+
+        /* Update the expected time to solve and publish a plan */
+        solve_latency += ( monotonic_clock::now () - frame_start - solve_latency ) / 8;
+
+        /* Wait for new tracked user data */
+        wait_for_detected_tracked_users ( stoken, &frameid );
+    }
+}
 
-        /* Add a search movement to the end of the plan */
-        movement_plan.push_back ( single_movement { large_duration, large_time_point, std::copysign ( search_yaw_velocity, movement_plan.back ().yaw_rate ), 0. } );
 
-        /* Update the motors for every new movement */
-        do {
-            /* Lock the mutex if not already locked */
-            if ( !lock.owns_lock () ) lock.lock ();
 
-            /* Increment the current movement */
-            std::advance ( current_movement, 1 );
+/** @name  actuator_thread_function
+ * 
+ * @brief  Function run by actuator_thread. Generates setpoints from the latest published plan at the setpoint frequency, queues them as coordinated segments of both axes, and executes the valve commands when due.
+ *         Valve commands are computed by fire control from the on-target windows of the plan, and waited for by spinning, so that they are executed with sub-millisecond precision.
+ * @param  stoken: The stop token for the jthread.
+ * @return Nothing.
+ */
+void watergun::controller::actuator_thread_function ( std::stop_token stoken )
+{
+    /* Take on the actuator real-time role */
+    enter_realtime_role ( thread_role::actuator );
 
-            /* Set the start time and duration of previous movement */
-            current_movement->timestamp = clock::now ();
-            std::prev ( current_movement )->duration = current_movement->timestamp - std::prev ( current_movement )->timestamp;
+    /* The plan being applied, and when it started */
+    const std::vector<single_movement> * plan = nullptr;
+    command_scheduler::clock::time_point plan_start;
 
-            /* Set stepper velocities and positions */
-            yaw_stepper.set_velocity ( current_movement->yaw_rate );
-            pitch_stepper.set_position ( current_movement->ending_pitch, current_movement->duration );
+    /* The time of the next setpoint update, the last yaw velocity and pitch setpoints, and the pitch at the end of the last queued segment */
+    command_scheduler::clock::time_point next_tick = command_scheduler::clock::time_point::max ();
+    double yaw_rate = 0., pitch = 0., queued_pitch = pitch_stepper.get_position ();
 
-            /* Possibly open/close the valve */
-            if ( current_movement->ends_on_target ) solenoid_valve.power_on (); else solenoid_valve.power_off ();
+    /* Whether the valve was last commanded open, when it was last commanded, and whether the gun is on target according to the plan being applied, and was when it started */
+    bool valve_open = false, on_target = false, plan_started_on_target = false;
+    command_scheduler::clock::time_point valve_commanded = command_scheduler::clock::time_point::min ();
 
-            /* Unlock the mutex */
-            lock.unlock ();
+    /* When the last nudge was issued, the change in yaw still to be made by nudges, and the most to make each setpoint period */
+    monotonic_clock::time_point nudge_issued {};
+    double nudge_remaining = 0., nudge_step = 0.;
 
-            /* Break if new tracked user data is availible */
-        } while ( !wait_for_detected_tracked_users ( current_movement->duration, stoken, &frameid ) && !stoken.stop_requested () );
+    /* Loop while not signalled to end */
+    while ( !stoken.stop_requested () )
+    {
+        /* If a new plan has been published, load it into the setpoint generator, starting immediately from the current setpoints.
+         * Replace the pending commands with the valve commands fire control computes for the plan, rationing water while the pressure is low.
+         * Fire control carries on from the state the valve was left in, so an open flow continues if the new plan is still on target, and is otherwise closed once it has been open for the minimum time.
+         */
+        if ( plan_handoff.consume () )
+        {
+            plan = &plan_handoff.front ();
+            plan_setpoints.load ( * plan, yaw_rate, pitch );
+            actuator_scheduler.cancel ();
+            plan_start = next_tick = command_scheduler::clock::now ();
+            const fire_control::valve_state state { valve_open, valve_commanded == command_scheduler::clock::time_point::min () ? fire_control::clock::duration::max () : plan_start - valve_commanded, on_target };
+            fire_controller.schedule ( * plan, valve_commands, state, pressure.is_low () );
+            plan_started_on_target = on_target;
+            for ( const fire_control::valve_command& cmd : valve_commands ) actuator_scheduler.schedule ( { plan_start + cmd.due, cmd.open, cmd.movement } );
+        }
+
+        /* Update the setpoints if due. The pitch is sent as a target for the end of the next setpoint period. */
+        const command_scheduler::clock::time_point now = command_scheduler::clock::now ();
+        if ( now >= next_tick )
+        {
+            /* If a new nudge has been issued, add it to what is left of the last, and spread the total over the new nudge's duration.
+             * Nudges are applied on top of whichever plan is running until they are used up, since the plan solved from the same frame assumes they have been made.
+             */
+            const setpoint_nudge nudge = setpoint_nudge_snapshot.load ();
+            if ( nudge.issued != nudge_issued )
+            {
+                nudge_issued = nudge.issued; nudge_remaining += nudge.yaw;
+                nudge_step = std::abs ( nudge_remaining ) * ( std::chrono::duration<double> { setpoint_period } / std::chrono::duration<double> { nudge.duration } );
+            }
+
+            /* Find the setpoints, adding on as much of the nudge as the axis allows.
+             * The nudge may not take the yaw rate beyond the maximum velocity, or change it by more than the torque allows over a setpoint period, though it never holds back the plan itself.
+             * Whatever the limits hold back is kept for later setpoint periods.
+             */
+            const setpoint_generator::setpoint current_setpoint = plan_setpoints.at ( std::chrono::duration_cast<clock::duration> ( now - plan_start ) );
+            const double period_s = std::chrono::duration<double> { setpoint_period }.count (), max_yaw_velocity = get_planner ().get_max_yaw_velocity ();
+            const double max_change = std::max ( get_planner ().get_yaw_torque ().acceleration_at ( std::abs ( yaw_rate ) ), 0. ) * period_s;
+            const double min_rate = std::min ( std::max ( -max_yaw_velocity, yaw_rate - max_change ), current_setpoint.yaw_rate );
+            const double max_rate = std::max ( std::min (  max_yaw_velocity, yaw_rate + max_change ), current_setpoint.yaw_rate );
+            yaw_rate = std::clamp ( current_setpoint.yaw_rate + std::clamp ( nudge_remaining, -nudge_step, nudge_step ) / period_s, min_rate, max_rate );
+            nudge_remaining -= ( yaw_rate - current_setpoint.yaw_rate ) * period_s;
+            pitch = plan_setpoints.at ( std::chrono::duration_cast<clock::duration> ( now + setpoint_period - plan_start ) ).pitch;
+
+            /* Queue a segment which moves both axes to the setpoints over the next setpoint period, so that they start and finish it together.
+             * The pitch is sent as the change from the last queued pitch, so if the queue is full, the next segment makes up for the missing one.
+             */
+            if ( axis_executor.queue_segment ( { setpoint_period, { yaw_rate * std::chrono::duration<double> { setpoint_period }.count (), pitch - queued_pitch } } ) ) queued_pitch = pitch;
+
+            /* The gun is on target if it was at the start of the current movement, which is when the previous movement ended on target or when the plan started on target, and the current movement stays on target */
+            on_target = ( current_setpoint.movement > 0 ? ( * plan ) [ current_setpoint.movement - 1 ].ends_on_target : plan_started_on_target ) && ( * plan ) [ current_setpoint.movement ].ends_on_target;
+
+            /* Publish the movement being made as the current movement, lasting one setpoint period */
+            single_movement movement = ( * plan ) [ current_setpoint.movement ];
+            movement.timestamp = clock::now ();
+            movement.duration = std::chrono::duration_cast<clock::duration> ( setpoint_period );
+            movement.yaw_rate = yaw_rate;
+            current_movement_snapshot.store ( movement );
+
+            /* Bring the pressure model up to date */
+            pressure.update ( now );
+
+            /* Find the next tick, skipping any which have been missed */
+            next_tick += setpoint_period; if ( next_tick <= now ) next_tick = now + setpoint_period;
+        }
+
+        /* If a valve command is due within the spin window, spin until it is due, then execute any valve commands which are due.
+         * Remember the state the valve was left in for the next plan, and tell the pressure model when water starts or stops leaving the nozzle, which is the latency of the valve after each command.
+         */
+        if ( actuator_scheduler.next_due () <= command_scheduler::clock::now () + valve_spin_window ) sleep_then_spin_until_monotonic ( actuator_scheduler.next_due (), valve_spin_window );
+        actuator_scheduler.execute_due ( [ this, &valve_open, &valve_commanded ] ( const command_scheduler::executed_command& e )
+        {
+            valve_open = e.cmd.open; valve_commanded = e.executed_at;
+            const valve_dynamics& valve = fire_controller.get_valve_dynamics ();
+            pressure.set_valve ( e.cmd.open, e.executed_at + ( e.cmd.open ? valve.open_latency : valve.close_latency ) );
+        } );
+
+        /* Wait until the spin window of the next command, or the next setpoint update is due, or a new plan is published */
+        std::unique_lock<std::mutex> actuator_lock { actuator_mx };
+        actuator_cv.wait_until ( actuator_lock, stoken, std::min ( actuator_scheduler.next_due () - valve_spin_window, next_tick ), [ this ] { return plan_handoff.pending (); } );
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * src/watergun/fire_control.cpp
+ * 
+ * Implementation of include/watergun/fire_control.h
+ * 
+ */
+
+
+
+/* INCLUDES */
+#include <watergun/fire_control.h>
+
+
+
+/* FIRE_CONTROL IMPLEMENTATION */
+
+
+
+/** @name constructor
+ * 
+ * @brief Set up fire control for a valve and burst pattern.
+ * @param _valve: The timing characteristics of the valve.
+ * @param _pattern: The burst pattern to fire with.
+ * @param _max_lead: The latest time after the start of a plan at which water may be predicted to land.
+ * @throw watergun_exception, if any duration is negative, or the pattern has a pulse length but no gap.
+ */
+watergun::fire_control::fire_control ( const valve_dynamics& _valve, const burst_pattern& _pattern, const clock::duration _max_lead )
+    : valve { _valve }
+    , pattern { _pattern }
+    , max_lead { _max_lead }
+{
+    /* Throw if any duration is negative */
+    const clock::duration zero { 0 };
+    if ( valve.open_latency < zero || valve.close_latency < zero || valve.min_open < zero || valve.min_closed < zero ) throw watergun_exception { "Valve latencies and minimum times cannot be negative" };
+    if ( pattern.pulse_on < zero || pattern.pulse_off < zero || pattern.max_pulses < 0 || max_lead < zero ) throw watergun_exception { "Burst pattern and maximum lead cannot be negative" };
+
+    /* Pulses with no gap between them would never close the valve */
+    if ( pattern.pulse_on > zero && pattern.pulse_off == zero ) throw watergun_exception { "Burst pattern pulses must have a gap between them" };
+}
+
+
+
+/** @name  schedule
+ * 
+ * @brief  Compute the valve commands for a plan. Commands are produced in order of time, alternating between open and close.
+ *         They start with an open, unless the valve is already open, in which case they start with the close which ends the flow carried on from earlier plans.
+ * @param  plan: The movements of the plan, starting from the start of the plan.
+ * @param  commands: Cleared, then set to the valve commands. Reserve max_commands elements to avoid allocating.
+ * @param  state: The state of the valve and the gun at the start of the plan. A default constructed state is a valve closed long ago, with the gun off target.
+ * @param  ration: True to save water, such as when the pressure is low, by firing only a single shortest useful flow at the start of each window. Defaults to false.
+ * @return The total time from the start of the plan for which water will leave the nozzle, which is proportional to the water used.
+ */
+watergun::fire_control::clock::duration watergun::fire_control::schedule ( const std::span<const planner::single_movement> plan, std::vector<valve_command>& commands, const valve_state& state, const bool ration ) const
+{
+    /* Clear the commands */
+    commands.clear ();
+
+    /* How long ago the valve was last commanded only matters up to the minimum open and closed times, so limit it to keep the arithmetic in range */
+    const clock::duration zero { 0 }, since = std::min ( state.since, valve.open_latency + valve.close_latency + valve.min_open + valve.min_closed );
+
+    /* The earliest water may start leaving the nozzle, which is once the valve can be commanded at the start of the plan, and it has been closed for the minimum time since an earlier plan closed it */
+    const clock::duration earliest_start = std::max ( valve.open_latency, state.open ? zero : valve.close_latency + valve.min_closed - since );
+
+    /* The flow being built, which is only emitted once the next flow is known not to be bridged to it, and the total flow time.
+     * If the valve is open, the flow an earlier plan opened is carried on: it is kept open for at least the minimum time, and otherwise closed as soon as possible, unless a flow of this plan is bridged to it.
+     */
+    clock::duration flow_start { 0 }, flow_end { 0 }, total { 0 }; std::size_t flow_movement = 0; bool flow_open = false, flow_carried = false;
+    if ( state.open ) { flow_start = valve.open_latency - since; flow_end = std::max ( valve.close_latency, flow_start + valve.min_open ); flow_open = flow_carried = true; }
+
+    /* Emit the open flow as a pair of commands, brought forward by the valve latencies. A carried flow is already open, so only needs closing. */
+    auto emit_flow = [ & ] ()
+    {
+        if ( !flow_open ) return;
+        const clock::duration open_due = std::max ( flow_start - valve.open_latency, zero );
+        if ( !flow_carried ) commands.push_back ( valve_command { open_due, true, flow_movement } );
+        commands.push_back ( valve_command { std::max ( flow_end - valve.close_latency, open_due ), false, flow_movement } );
+        total += flow_end - std::max ( flow_start, zero ); flow_open = flow_carried = false;
+    };
+
+    /* Add a flow of water, lengthening it if too short, and bridging it to the open flow if the gap between them is too short */
+    auto add_flow = [ & ] ( clock::duration start, clock::duration end, const std::size_t movement )
+    {
+        if ( end - start < valve.min_open ) { start = std::max ( ( start + end - valve.min_open ) / 2, earliest_start ); end = start + valve.min_open; }
+        if ( flow_open && start - flow_end < valve.min_closed ) { flow_end = std::max ( flow_end, end ); return; }
+        emit_flow ();
+        flow_start = std::max ( start, earliest_start ); flow_end = std::max ( end, flow_start ); flow_movement = movement; flow_open = true;
+    };
+
+    /* Walk the plan, finding each run of movements which end on target */
+    clock::duration movement_end { 0 };
+    for ( std::size_t i = 0; i < plan.size (); )
+    {
+        /* Skip movements which do not end on target */
+        movement_end += std::chrono::duration_cast<clock::duration> ( plan [ i ].duration );
+        if ( !plan [ i ].ends_on_target ) { ++i; continue; }
+
+        /* The window starts at the end of the first movement of the run, or at the start of the plan if the gun is already on target, and lasts until the end of the last movement whose water lands within the maximum lead */
+        const std::size_t first = i; const clock::duration window_start = ( first == 0 && state.on_target ? zero : movement_end );
+        clock::duration window_end = window_start; bool window_valid = false;
+        for ( ; i < plan.size () && plan [ i ].ends_on_target; ++i )
+        {
+            if ( i > first ) movement_end += std::chrono::duration_cast<clock::duration> ( plan [ i ].duration );
+            if ( movement_end + std::chrono::duration_cast<clock::duration> ( std::chrono::duration<double> { plan [ i ].flight_time } ) <= max_lead ) { window_end = movement_end; window_valid = true; }
+        }
+        if ( !window_valid ) continue;
+
+        /* When rationing, fire a single shortest flow at the start of the window. Otherwise fire continuously through the window, or break it into pulses. */
+        if ( ration ) { add_flow ( window_start, window_start + valve.min_open, first ); continue; }
+        if ( pattern.pulse_on == zero ) { add_flow ( window_start, window_end, first ); continue; }
+        for ( int pulse = 0; pattern.max_pulses == 0 || pulse < pattern.max_pulses; ++pulse )
+        {
+            const clock::duration pulse_start = window_start + ( pattern.pulse_on + pattern.pulse_off ) * pulse;
+            if ( pulse > 0 && pulse_start >= window_end ) break;
+            add_flow ( pulse_start, std::min ( pulse_start + pattern.pulse_on, window_end ), first );
+        }
+    }
+
+    /* Emit the last flow, and return the total flow time */
+    emit_flow ();
+    return total;
+}
+
+
+
+/** @name  max_commands
+ * 
+ * @brief  Find the largest number of commands which schedule may produce for a plan.
+ * @param  movements: The number of movements in the plan.
+ * @param  on_target_time: The longest time for which a plan may be on target.
+ * @return The number of commands.
+ */
+std::size_t watergun::fire_control::max_commands ( const std::size_t movements, const clock::duration on_target_time ) const noexcept
+{
+    /* Each window gives at most one flow, plus one for every complete pulse period that fits in the time on target, and a flow carried on from an earlier plan may need closing */
+    const std::size_t pulses = ( pattern.pulse_on > clock::duration { 0 } ? static_cast<std::size_t> ( on_target_time / ( pattern.pulse_on + pattern.pulse_off ) ) : 0 );
+    return ( movements + pulses ) * 2 + 1;
+}
@@ -0,0 +1,24 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * src/watergun/fixed_planner.cpp
+ * 
+ * Explicit instantiations of include/watergun/fixed_planner.h
+ * 
+ */
+
+
+
+/* INCLUDES */
+#include <watergun/fixed_planner.h>
+
+
+
+/* EXPLICIT INSTANTIATIONS */
+
+template class watergun::fixed_planner<15>;
+template class watergun::fixed_planner<30>;
+template class watergun::fixed_planner<60>;
@@ -0,0 +1,347 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * src/watergun/gpio_cdev_backend.cpp
+ * 
+ * Implementation of include/watergun/gpio_cdev_backend.h
+ * 
+ */
+
+
+
+/* INCLUDES */
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/gpio.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <watergun/gpio_cdev_backend.h>
+
+
+
+/* GPIO_CDEV_BACKEND IMPLEMENTATION */
+
+
+
+/** @name constructor
+ * 
+ * @brief Open the GPIO chip.
+ * @param chip_path: The path of the chip's character device.
+ * @param _pwm_chip_path: The sysfs directory of the PWM chip.
+ * @param _hardware_timestamps: True to timestamp edges with the hardware timestamp engine, false for kernel timestamps on the monotonic clock.
+ * @throw watergun_exception, if the chip cannot be opened.
+ */
+watergun::gpio_cdev_backend::gpio_cdev_backend ( const std::string& chip_path, std::string _pwm_chip_path, const bool _hardware_timestamps )
+    : chip_fd { ::open ( chip_path.c_str (), O_RDWR | O_CLOEXEC ) }
+    , pwm_chip_path { std::move ( _pwm_chip_path ) }
+    , hardware_timestamps { _hardware_timestamps }
+{
+    /* Throw if the chip could not be opened */
+    if ( chip_fd < 0 ) throw watergun_exception { "Failed to open GPIO chip " + chip_path + ": " + std::strerror ( errno ) };
+}
+
+
+
+/** @name destructor
+ * 
+ * @brief Close the chip. Lines which have been requested stay requested until they are destroyed.
+ */
+watergun::gpio_cdev_backend::~gpio_cdev_backend ()
+{
+    /* Close the chip */
+    ::close ( chip_fd );
+}
+
+
+
+/** @name  request_outputs
+ * 
+ * @brief  Request a group of output lines, all initially low.
+ * @param  pins: The line offset of each line in the group, or -1 for a line which is not present.
+ * @throw  watergun_exception, if the lines cannot be requested.
+ * @return The group.
+ */
+std::unique_ptr<watergun::gpio_output_group> watergun::gpio_cdev_backend::request_outputs ( const std::vector<int>& pins )
+{
+    /* Throw if there are more lines than bits */
+    if ( pins.size () > 32 ) throw watergun_exception { "GPIO output groups cannot have more than 32 lines" };
+
+    /* Add the offset of each present line to the request, remembering which bit of the group it is */
+    gpio_v2_line_request request {};
+    std::vector<unsigned> group_bits;
+    for ( std::size_t i = 0; i < pins.size (); ++i ) if ( pins [ i ] >= 0 ) { request.offsets [ request.num_lines++ ] = pins [ i ]; group_bits.push_back ( i ); }
+
+    /* Request the lines as outputs, all initially low */
+    std::strncpy ( request.consumer, "watergun", sizeof ( request.consumer ) - 1 );
+    request.config.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+    request.config.num_attrs = 1;
+    request.config.attrs [ 0 ].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+    request.config.attrs [ 0 ].attr.values = 0;
+    request.config.attrs [ 0 ].mask = ( request.num_lines == 64 ? ~std::uint64_t { 0 } : ( std::uint64_t { 1 } << request.num_lines ) - 1 );
+    if ( ::ioctl ( chip_fd, GPIO_V2_GET_LINE_IOCTL, &request ) < 0 ) throw watergun_exception { std::string { "GPIO output request failed: " } + std::strerror ( errno ) };
+
+    /* Return the group */
+    return std::make_unique<output_group> ( request.fd, std::move ( group_bits ) );
+}
+
+
+
+/** @name  request_input
+ * 
+ * @brief  Request an input line, which detects edges from when it is requested.
+ * @param  pin: The line offset.
+ * @param  pull_up: True for pull up, false for pull down.
+ * @throw  watergun_exception, if the line cannot be requested.
+ * @return The line.
+ */
+std::unique_ptr<watergun::gpio_input_line> watergun::gpio_cdev_backend::request_input ( const int pin, const bool pull_up )
+{
+    /* Throw if the line is not present */
+    if ( pin < 0 ) throw watergun_exception { "GPIO input line must be present" };
+
+    /* Request the line as an input, detecting both edges, timestamped on the monotonic clock or by the hardware */
+    gpio_v2_line_request request {};
+    request.offsets [ 0 ] = pin; request.num_lines = 1;
+    std::strncpy ( request.consumer, "watergun", sizeof ( request.consumer ) - 1 );
+    request.config.flags = GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING
+        | ( pull_up ? GPIO_V2_LINE_FLAG_BIAS_PULL_UP : GPIO_V2_LINE_FLAG_BIAS_PULL_DOWN ) | ( hardware_timestamps ? GPIO_V2_LINE_FLAG_EVENT_CLOCK_HTE : 0 );
+    if ( ::ioctl ( chip_fd, GPIO_V2_GET_LINE_IOCTL, &request ) < 0 ) throw watergun_exception { std::string { "GPIO input request failed: " } + std::strerror ( errno ) };
+
+    /* Return the line */
+    return std::make_unique<input_line> ( request.fd );
+}
+
+
+
+/** @name  request_pwm
+ * 
+ * @brief  Request a PWM output, initially stopped, exporting the channel if it is not already.
+ * @param  pin: The channel of the PWM chip.
+ * @throw  watergun_exception, if the output cannot be requested.
+ * @return The output.
+ */
+std::unique_ptr<watergun::pwm_output> watergun::gpio_cdev_backend::request_pwm ( const int pin )
+{
+    /* Export the channel if its directory does not yet exist */
+    const std::string channel_path = pwm_chip_path + "/pwm" + std::to_string ( pin );
+    if ( ::access ( channel_path.c_str (), F_OK ) != 0 )
+    {
+        const int export_fd = ::open ( ( pwm_chip_path + "/export" ).c_str (), O_WRONLY | O_CLOEXEC );
+        const std::string channel = std::to_string ( pin );
+        const bool exported = ( export_fd >= 0 && ::write ( export_fd, channel.c_str (), channel.size () ) == static_cast<ssize_t> ( channel.size () ) );
+        if ( export_fd >= 0 ) ::close ( export_fd );
+        if ( !exported ) throw watergun_exception { "Failed to export PWM channel " + channel_path + ": " + std::strerror ( errno ) };
+    }
+
+    /* Return the output */
+    return std::make_unique<pwm_output> ( channel_path );
+}
+
+
+
+/** @name  request_analog
+ * 
+ * @brief  The character device has no analog inputs, so this always throws.
+ * @param  pin: The pin number.
+ * @throw  watergun_exception, always.
+ * @return Nothing.
+ */
+std::unique_ptr<watergun::analog_input> watergun::gpio_cdev_backend::request_analog ( const int pin )
+{
+    /* Throw, since there are no analog inputs */
+    throw watergun_exception { "GPIO character device has no analog input " + std::to_string ( pin ) };
+}
+
+
+
+/* GPIO_CDEV_BACKEND::OUTPUT_GROUP IMPLEMENTATION */
+
+
+
+/** @name destructor
+ * 
+ * @brief Release the lines.
+ */
+watergun::gpio_cdev_backend::output_group::~output_group ()
+{
+    /* Close the request */
+    ::close ( request_fd );
+}
+
+
+
+/** @name  write
+ * 
+ * @brief  Set the values of some of the lines in the group with a single ioctl.
+ * @param  values: The values of the lines, one bit per line.
+ * @param  mask: Which lines to set, one bit per line.
+ * @throw  watergun_exception, if the lines cannot be set.
+ * @return Nothing.
+ */
+void watergun::gpio_cdev_backend::output_group::write ( const std::uint32_t values, const std::uint32_t mask )
+{
+    /* Move each bit of the group to the bit of its line in the request */
+    gpio_v2_line_values line_values {};
+    for ( std::size_t i = 0; i < group_bits.size (); ++i ) if ( mask >> group_bits [ i ] & 1 )
+    {
+        line_values.mask |= std::uint64_t { 1 } << i;
+        line_values.bits |= std::uint64_t { values >> group_bits [ i ] & 1 } << i;
+    }
+
+    /* Set all of the lines at once */
+    if ( line_values.mask != 0 && ::ioctl ( request_fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &line_values ) < 0 ) throw watergun_exception { std::string { "GPIO output write failed: " } + std::strerror ( errno ) };
+}
+
+
+
+/* GPIO_CDEV_BACKEND::INPUT_LINE IMPLEMENTATION */
+
+
+
+/** @name destructor
+ * 
+ * @brief Release the line.
+ */
+watergun::gpio_cdev_backend::input_line::~input_line ()
+{
+    /* Close the request */
+    ::close ( request_fd );
+}
+
+
+
+/** @name  read
+ * 
+ * @brief  Read the current value of the line.
+ * @throw  watergun_exception, if the line cannot be read.
+ * @return 1 if high, 0 if low.
+ */
+int watergun::gpio_cdev_backend::input_line::read ()
+{
+    /* Get the value of the only line */
+    gpio_v2_line_values line_values {}; line_values.mask = 1;
+    if ( ::ioctl ( request_fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &line_values ) < 0 ) throw watergun_exception { std::string { "GPIO input read failed: " } + std::strerror ( errno ) };
+    return line_values.bits & 1;
+}
+
+
+
+/** @name  wait_edge
+ * 
+ * @brief  Wait for the next edge event from the kernel.
+ * @param  timeout: The longest time to wait.
+ * @param  event: Set to the edge, if there was one.
+ * @throw  watergun_exception, if the events cannot be read.
+ * @return True if there was an edge, false if the wait timed out.
+ */
+bool watergun::gpio_cdev_backend::input_line::wait_edge ( const clock::duration timeout, edge_event& event )
+{
+    /* Wait for an event to be queued, rounding the timeout up to whole milliseconds */
+    pollfd request_poll { request_fd, POLLIN, 0 };
+    const int timeout_ms = static_cast<int> ( std::chrono::ceil<std::chrono::milliseconds> ( std::max ( timeout, clock::duration::zero () ) ).count () );
+    const int ready = ::poll ( &request_poll, 1, timeout_ms );
+    if ( ready < 0 && errno != EINTR ) throw watergun_exception { std::string { "GPIO edge wait failed: " } + std::strerror ( errno ) };
+    if ( ready <= 0 ) return false;
+
+    /* Read the event, whose timestamp was taken by the kernel or the hardware when the edge happened */
+    gpio_v2_line_event line_event {};
+    if ( ::read ( request_fd, &line_event, sizeof ( line_event ) ) != sizeof ( line_event ) ) throw watergun_exception { std::string { "GPIO edge read failed: " } + std::strerror ( errno ) };
+    event = edge_event { clock::time_point { std::chrono::duration_cast<clock::duration> ( std::chrono::nanoseconds { line_event.timestamp_ns } ) }, line_event.id == GPIO_V2_LINE_EVENT_RISING_EDGE };
+    return true;
+}
+
+
+
+/* GPIO_CDEV_BACKEND::PWM_OUTPUT IMPLEMENTATION */
+
+
+
+/** @name constructor
+ * 
+ * @brief Open the channel's attributes, and stop it.
+ * @param channel_path: The sysfs directory of the channel.
+ */
+watergun::gpio_cdev_backend::pwm_output::pwm_output ( const std::string& channel_path )
+    : period_fd { ::open ( ( channel_path + "/period" ).c_str (), O_WRONLY | O_CLOEXEC ) }
+    , duty_cycle_fd { ::open ( ( channel_path + "/duty_cycle" ).c_str (), O_WRONLY | O_CLOEXEC ) }
+    , enable_fd { ::open ( ( channel_path + "/enable" ).c_str (), O_WRONLY | O_CLOEXEC ) }
+{
+    /* Throw if any attribute could not be opened, closing those which were */
+    if ( period_fd < 0 || duty_cycle_fd < 0 || enable_fd < 0 )
+    {
+        const int error = errno;
+        for ( const int fd : { period_fd, duty_cycle_fd, enable_fd } ) if ( fd >= 0 ) ::close ( fd );
+        throw watergun_exception { "Failed to open PWM channel " + channel_path + ": " + std::strerror ( error ) };
+    }
+
+    /* Stop the channel */
+    enable ( false );
+}
+
+
+
+/** @name destructor
+ * 
+ * @brief Stop the channel, and close its attributes.
+ */
+watergun::gpio_cdev_backend::pwm_output::~pwm_output ()
+{
+    /* Stop the channel, ignoring failure, then close the attributes */
+    try { enable ( false ); } catch ( const watergun_exception& ) {}
+    ::close ( period_fd ); ::close ( duty_cycle_fd ); ::close ( enable_fd );
+}
+
+
+
+/** @name  set_period_us
+ * 
+ * @brief  Set the period of the output, keeping the duty cycle at a half.
+ * @param  period_us: The period in whole microseconds.
+ * @throw  watergun_exception, if the period cannot be set.
+ * @return Nothing.
+ */
+void watergun::gpio_cdev_backend::pwm_output::set_period_us ( const int period_us )
+{
+    /* The duty cycle can never exceed the period, so when lengthening the period set it first, and when shortening it set the duty cycle first */
+    const long new_period_ns = period_us * 1000l;
+    if ( new_period_ns >= period_ns ) { write_attribute ( period_fd, new_period_ns ); write_attribute ( duty_cycle_fd, new_period_ns / 2 ); }
+    else { write_attribute ( duty_cycle_fd, new_period_ns / 2 ); write_attribute ( period_fd, new_period_ns ); }
+    period_ns = new_period_ns;
+}
+
+
+
+/** @name  enable
+ * 
+ * @brief  Start or stop the output.
+ * @param  enabled: True to start, false to stop.
+ * @throw  watergun_exception, if the output cannot be started or stopped.
+ * @return Nothing.
+ */
+void watergun::gpio_cdev_backend::pwm_output::enable ( const bool enabled )
+{
+    /* Write the enable attribute */
+    write_attribute ( enable_fd, enabled ? 1 : 0 );
+}
+
+
+
+/** @name  write_attribute
+ * 
+ * @brief  Write a number to an attribute.
+ * @param  fd: The file descriptor of the attribute.
+ * @param  value: The number to write.
+ * @throw  watergun_exception, if the write fails.
+ * @return Nothing.
+ */
+void watergun::gpio_cdev_backend::pwm_output::write_attribute ( const int fd, const long value )
+{
+    /* Write the number as text from the start of the attribute */
+    const std::string text = std::to_string ( value );
+    if ( ::pwrite ( fd, text.c_str (), text.size (), 0 ) != static_cast<ssize_t> ( text.size () ) ) throw watergun_exception { std::string { "PWM attribute write failed: " } + std::strerror ( errno ) };
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * src/watergun/jitter_histogram.cpp
+ * 
+ * Implementation of include/watergun/jitter_histogram.h
+ * 
+ */
+
+
+
+/* INCLUDES */
+#include <watergun/jitter_histogram.h>
+
+
+
+/* JITTER_HISTOGRAM IMPLEMENTATION */
+
+
+
+/** @name  record
+ * 
+ * @brief  Record the lateness of an event. Only one thread may record events.
+ * @param  lateness: How late the event happened compared to its ideal time.
+ * @return Nothing.
+ */
+void watergun::jitter_histogram::record ( const std::chrono::nanoseconds lateness ) noexcept
+{
+    /* Find the bin, clamping early events to the first bin and late events to the overflow bin */
+    const std::int64_t micros = std::chrono::duration_cast<std::chrono::microseconds> ( lateness ).count ();
+    const std::size_t bin = ( micros <= 0 ? 0 : micros >= static_cast<std::int64_t> ( num_bins ) ? num_bins : static_cast<std::size_t> ( micros ) );
+
+    /* Increment the bin and count. Since only one thread records, the maximum can be updated without a compare-exchange. */
+    bins [ bin ].fetch_add ( 1, std::memory_order_relaxed );
+    count.fetch_add ( 1, std::memory_order_relaxed );
+    if ( lateness.count () > max.load ( std::memory_order_relaxed ) ) max.store ( lateness.count (), std::memory_order_relaxed );
+}
+
+
+
+/** @name  reset
+ * 
+ * @brief  Clear the histogram. Should only be called by the recording thread, or while nothing is being recorded.
+ * @return Nothing.
+ */
+void watergun::jitter_histogram::reset () noexcept
+{
+    /* Zero everything */
+    for ( auto& bin : bins ) bin.store ( 0, std::memory_order_relaxed );
+    count.store ( 0, std::memory_order_relaxed );
+    max.store ( 0, std::memory_order_relaxed );
+}
+
+
+
+/** @name  get_counts
+ * 
+ * @brief  Get the number of events in each microsecond bin, followed by the overflow bin.
+ * @return Vector of num_bins + 1 counts.
+ */
+std::vector<std::uint64_t> watergun::jitter_histogram::get_counts () const
+{
+    /* Copy out the bins */
+    std::vector<std::uint64_t> counts; counts.reserve ( bins.size () );
+    for ( const auto& bin : bins ) counts.push_back ( bin.load ( std::memory_order_relaxed ) );
+    return counts;
+}
+
+
+
+/** @name  get_percentile
+ * 
+ * @brief  Get an upper bound on the lateness of a fraction of events, to the resolution of the bins.
+ * @param  fraction: The fraction of events, between 0 and 1.
+ * @return The upper edge of the bin which the percentile lies in, or the maximum lateness if it lies in the overflow bin.
+ */
+std::chrono::nanoseconds watergun::jitter_histogram::get_percentile ( const double fraction ) const
+{
+    /* Get the counts, and the number of events which must be covered */
+    const std::vector<std::uint64_t> counts = get_counts ();
+    std::uint64_t total = 0; for ( const std::uint64_t c : counts ) total += c;
+    const std::uint64_t target = static_cast<std::uint64_t> ( fraction * total );
+
+    /* Accumulate bins until the target is covered */
+    std::uint64_t covered = 0;
+    for ( std::size_t i = 0; i < num_bins; ++i ) if ( ( covered += counts [ i ] ) >= target && covered > 0 ) return std::chrono::microseconds { i + 1 };
+
+    /* The percentile lies in the overflow bin */
+    return get_max ();
+}
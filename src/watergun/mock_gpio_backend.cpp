@@ -0,0 +1,514 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * src/watergun/mock_gpio_backend.cpp
+ * 
+ * Implementation of include/watergun/mock_gpio_backend.h
+ * 
+ */
+
+
+
+/* INCLUDES */
+#include <watergun/mock_gpio_backend.h>
+
+
+
+/* MOCK_GPIO_BACKEND IMPLEMENTATION */
+
+
+
+/** @name constructor
+ * 
+ * @brief Start the timeline of the mock at the current time.
+ */
+watergun::mock_gpio_backend::mock_gpio_backend ()
+    : start { clock::now () }
+{}
+
+
+
+/** @name  request_outputs
+ * 
+ * @brief  Request a group of output lines, all initially low.
+ * @param  pins: The pin number of each line in the group, or -1 for a line which is not present.
+ * @throw  watergun_exception, if a pin has already been requested.
+ * @return The group.
+ */
+std::unique_ptr<watergun::gpio_output_group> watergun::mock_gpio_backend::request_outputs ( const std::vector<int>& pins )
+{
+    /* Aquire lock */
+    std::unique_lock<std::mutex> lock { mock_mx };
+
+    /* Add a signal for each line which is present */
+    for ( const int pin : pins ) if ( pin >= 0 ) add_signal ( pin, signal_kind::output, 0 );
+
+    /* Return the group */
+    return std::make_unique<output_group> ( * this, pins );
+}
+
+
+
+/** @name  request_input
+ * 
+ * @brief  Request an input line, which is initially high if pulled up, and low if pulled down.
+ * @param  pin: The pin number.
+ * @param  pull_up: True for pull up, false for pull down.
+ * @throw  watergun_exception, if the pin has already been requested.
+ * @return The line.
+ */
+std::unique_ptr<watergun::gpio_input_line> watergun::mock_gpio_backend::request_input ( const int pin, const bool pull_up )
+{
+    /* Aquire lock */
+    std::unique_lock<std::mutex> lock { mock_mx };
+
+    /* Add the signal and return the line */
+    add_signal ( pin, signal_kind::input, pull_up ? 1 : 0 );
+    return std::make_unique<input_line> ( * this, pin );
+}
+
+
+
+/** @name  request_pwm
+ * 
+ * @brief  Request a PWM output, initially stopped.
+ * @param  pin: The pin number.
+ * @throw  watergun_exception, if the pin has already been requested.
+ * @return The output.
+ */
+std::unique_ptr<watergun::pwm_output> watergun::mock_gpio_backend::request_pwm ( const int pin )
+{
+    /* Aquire lock */
+    std::unique_lock<std::mutex> lock { mock_mx };
+
+    /* Add the signal and return the output */
+    add_signal ( pin, signal_kind::pwm, 0 );
+    return std::make_unique<pwm_output> ( * this, pin );
+}
+
+
+
+/** @name  request_analog
+ * 
+ * @brief  Request an analog input, initially reading 0.
+ * @param  pin: The pin number.
+ * @throw  watergun_exception, if the pin has already been requested.
+ * @return The input.
+ */
+std::unique_ptr<watergun::analog_input> watergun::mock_gpio_backend::request_analog ( const int pin )
+{
+    /* Aquire lock */
+    std::unique_lock<std::mutex> lock { mock_mx };
+
+    /* Add the reading, throwing if the pin is taken by a signal or another analog input */
+    if ( signals.contains ( pin ) || !analog_readings.emplace ( pin, 0. ).second ) throw watergun_exception { "Pin " + std::to_string ( pin ) + " has already been requested" };
+    return std::make_unique<analog_input> ( * this, pin );
+}
+
+
+
+/** @name  set_input
+ * 
+ * @brief  Drive an input line, as though its pin changed now.
+ * @param  pin: The pin number of the input line.
+ * @param  value: The new value, 0 or 1.
+ * @throw  watergun_exception, if the pin is not an input line.
+ * @return Nothing.
+ */
+void watergun::mock_gpio_backend::set_input ( const int pin, const int value )
+{
+    /* Aquire lock */
+    std::unique_lock<std::mutex> lock { mock_mx };
+
+    /* Check the pin is an input line */
+    if ( find_signal ( pin ).kind != signal_kind::input ) throw watergun_exception { "Pin " + std::to_string ( pin ) + " is not an input line" };
+
+    /* Record the value, and if it changed, queue an edge and wake any waiting thread */
+    const clock::time_point now = clock::now ();
+    if ( record ( pin, value != 0, now ) )
+    {
+        signals.at ( pin ).pending_edges.push_back ( gpio_input_line::edge_event { now, value != 0 } );
+        edge_cv.notify_all ();
+    }
+}
+
+
+
+/** @name  set_analog
+ * 
+ * @brief  Drive an analog input.
+ * @param  pin: The pin number of the analog input.
+ * @param  value: The new reading, as a fraction of full scale.
+ * @throw  watergun_exception, if the pin is not an analog input.
+ * @return Nothing.
+ */
+void watergun::mock_gpio_backend::set_analog ( const int pin, const double value )
+{
+    /* Aquire lock */
+    std::unique_lock<std::mutex> lock { mock_mx };
+
+    /* Check the pin is an analog input, and set the reading */
+    const auto it = analog_readings.find ( pin );
+    if ( it == analog_readings.end () ) throw watergun_exception { "Pin " + std::to_string ( pin ) + " is not an analog input" };
+    it->second = value;
+}
+
+
+
+/** @name  get_transitions
+ * 
+ * @brief  Get the transitions of a signal, oldest first.
+ * @param  pin: The pin number.
+ * @throw  watergun_exception, if the pin has not been requested.
+ * @return Vector of transitions.
+ */
+std::vector<watergun::mock_gpio_backend::transition> watergun::mock_gpio_backend::get_transitions ( const int pin ) const
+{
+    /* Aquire lock */
+    std::unique_lock<std::mutex> lock { mock_mx };
+
+    /* Copy out the transitions */
+    return find_signal ( pin ).transitions;
+}
+
+
+
+/** @name  analyse_pulses
+ * 
+ * @brief  Find the statistics of the pulses of a signal, such as the step pin of a stepper.
+ * @param  pin: The pin number.
+ * @throw  watergun_exception, if the pin has not been requested.
+ * @return The statistics.
+ */
+watergun::mock_gpio_backend::pulse_statistics watergun::mock_gpio_backend::analyse_pulses ( const int pin ) const
+{
+    /* Get the logic levels of the signal, under the lock */
+    std::vector<transition> edges;
+    {
+        std::unique_lock<std::mutex> lock { mock_mx };
+        edges = levels ( find_signal ( pin ), clock::now () );
+    }
+
+    /* Find the time of each rising edge, and the width of each pulse which has ended */
+    std::vector<clock::time_point> rises;
+    std::vector<clock::duration> widths;
+    for ( std::size_t i = 0; i < edges.size (); ++i ) if ( edges [ i ].value )
+    {
+        rises.push_back ( edges [ i ].time );
+        if ( i + 1 < edges.size () ) widths.push_back ( edges [ i + 1 ].time - edges [ i ].time );
+    }
+
+    /* Fill in the pulse count and widths */
+    pulse_statistics stats;
+    stats.pulses = rises.size ();
+    if ( !widths.empty () )
+    {
+        stats.min_width = * std::min_element ( widths.begin (), widths.end () );
+        stats.max_width = * std::max_element ( widths.begin (), widths.end () );
+    }
+
+    /* The remaining statistics need at least two pulses */
+    if ( rises.size () < 2 ) return stats;
+
+    /* Fill in the rate and intervals */
+    const clock::duration span = rises.back () - rises.front ();
+    stats.mean_rate = ( rises.size () - 1 ) / std::chrono::duration<double> { span }.count ();
+    stats.mean_interval = span / static_cast<clock::rep> ( rises.size () - 1 );
+    stats.min_interval = stats.max_interval = rises [ 1 ] - rises [ 0 ];
+    for ( std::size_t i = 2; i < rises.size (); ++i )
+    {
+        const clock::duration interval = rises [ i ] - rises [ i - 1 ], last_interval = rises [ i - 1 ] - rises [ i - 2 ];
+        stats.min_interval = std::min ( stats.min_interval, interval );
+        stats.max_interval = std::max ( stats.max_interval, interval );
+        stats.max_interval_change = std::max ( stats.max_interval_change, interval > last_interval ? interval - last_interval : last_interval - interval );
+    }
+
+    /* Return the statistics */
+    return stats;
+}
+
+
+
+/** @name  write_vcd
+ * 
+ * @brief  Write every signal as a value change dump, with nanosecond resolution, starting at the construction of the mock.
+ * @param  out: The stream to write to.
+ * @return Nothing.
+ */
+void watergun::mock_gpio_backend::write_vcd ( std::ostream& out ) const
+{
+    /** struct change
+     * 
+     * A change of the logic level of one of the signals being dumped.
+     */
+    struct change { std::int64_t time; std::size_t index; std::uint64_t value; };
+
+    /* Aquire lock */
+    std::unique_lock<std::mutex> lock { mock_mx };
+
+    /* Write the header, declaring a wire for each signal. Identifiers are printable characters from '!', in base 94. */
+    const clock::time_point end = clock::now ();
+    std::vector<std::string> ids;
+    std::vector<change> changes;
+    out << "$version watergun mock_gpio_backend $end\n$timescale 1ns $end\n$scope module watergun $end\n";
+    for ( const auto& [ pin, sig ] : signals )
+    {
+        /* Generate the identifier and declare the wire */
+        std::string id; std::size_t n = ids.size ();
+        do { id += static_cast<char> ( '!' + n % 94 ); n /= 94; } while ( n > 0 );
+        const char * prefix = ( sig.kind == signal_kind::output ? "out_" : sig.kind == signal_kind::input ? "in_" : "pwm_" );
+        out << "$var wire 1 " << id << ' ' << prefix << pin << " $end\n";
+
+        /* Add the changes of the signal */
+        for ( const transition& t : levels ( sig, end ) )
+            changes.push_back ( change { std::chrono::duration_cast<std::chrono::nanoseconds> ( t.time - start ).count (), ids.size (), t.value } );
+        ids.push_back ( std::move ( id ) );
+    }
+    out << "$upscope $end\n$enddefinitions $end\n";
+
+    /* Dump the initial values. A PWM output always starts low. */
+    out << "#0\n$dumpvars\n";
+    std::size_t index = 0;
+    for ( const auto& [ pin, sig ] : signals ) out << ( sig.kind != signal_kind::pwm && sig.initial ? '1' : '0' ) << ids [ index++ ] << '\n';
+    out << "$end\n";
+
+    /* Sort the changes by time, keeping changes at the same time in order, then write them */
+    std::stable_sort ( changes.begin (), changes.end (), [] ( const change& lhs, const change& rhs ) { return lhs.time < rhs.time; } );
+    std::int64_t last_time = 0;
+    for ( const change& c : changes )
+    {
+        if ( c.time != last_time ) out << '#' << ( last_time = c.time ) << '\n';
+        out << ( c.value ? '1' : '0' ) << ids [ c.index ] << '\n';
+    }
+    out << '#' << std::max<std::int64_t> ( std::chrono::duration_cast<std::chrono::nanoseconds> ( end - start ).count (), last_time ) << '\n';
+}
+
+/** @name  write_vcd
+ * 
+ * @brief  Write every signal as a value change dump file, with nanosecond resolution, starting at the construction of the mock.
+ * @param  path: The path of the file.
+ * @throw  watergun_exception, if the file cannot be written.
+ * @return Nothing.
+ */
+void watergun::mock_gpio_backend::write_vcd ( const std::string& path ) const
+{
+    /* Open the file, write to it, then check for errors */
+    std::ofstream out { path };
+    if ( !out ) throw watergun_exception { "Failed to open VCD file " + path };
+    write_vcd ( out );
+    if ( !out.flush () ) throw watergun_exception { "Failed to write VCD file " + path };
+}
+
+
+
+/** @name  add_signal
+ * 
+ * @brief  Add a signal for a newly requested pin. The mock mutex should already be locked.
+ * @param  pin: The pin number.
+ * @param  kind: The kind of signal.
+ * @param  value: The initial value.
+ * @throw  watergun_exception, if the pin has already been requested.
+ * @return Nothing.
+ */
+void watergun::mock_gpio_backend::add_signal ( const int pin, const signal_kind kind, const std::uint64_t value )
+{
+    /* Insert the signal, throwing if the pin is taken by another signal or an analog input */
+    if ( analog_readings.contains ( pin ) || !signals.emplace ( pin, signal { kind, value, value, {}, {} } ).second ) throw watergun_exception { "Pin " + std::to_string ( pin ) + " has already been requested" };
+}
+
+/** @name  record
+ * 
+ * @brief  Record a new value of a signal, if it has changed. The mock mutex should already be locked.
+ * @param  pin: The pin number.
+ * @param  value: The new value.
+ * @param  time: When the value changed.
+ * @return True if the value changed.
+ */
+bool watergun::mock_gpio_backend::record ( const int pin, const std::uint64_t value, const clock::time_point time )
+{
+    /* Ignore writes which change nothing */
+    signal& sig = signals.at ( pin );
+    if ( sig.value == value ) return false;
+
+    /* Record the transition */
+    sig.value = value;
+    sig.transitions.push_back ( transition { time, value } );
+    return true;
+}
+
+/** @name  find_signal
+ * 
+ * @brief  Find the signal of a pin. The mock mutex should already be locked.
+ * @param  pin: The pin number.
+ * @throw  watergun_exception, if the pin has not been requested.
+ * @return The signal.
+ */
+const watergun::mock_gpio_backend::signal& watergun::mock_gpio_backend::find_signal ( const int pin ) const
+{
+    /* Look up the pin */
+    const auto it = signals.find ( pin );
+    if ( it == signals.end () ) throw watergun_exception { "Pin " + std::to_string ( pin ) + " has not been requested" };
+    return it->second;
+}
+
+/** @name  levels
+ * 
+ * @brief  Find the changes of the logic level of a signal, generating the square waves of a PWM output. The mock mutex should already be locked.
+ * @param  sig: The signal.
+ * @param  end: The time at which a running PWM output is considered to stop.
+ * @return Vector of transitions, with values of 0 or 1.
+ */
+std::vector<watergun::mock_gpio_backend::transition> watergun::mock_gpio_backend::levels ( const signal& sig, const clock::time_point end )
+{
+    /* The transitions of a GPIO line are already logic levels */
+    if ( sig.kind != signal_kind::pwm ) return sig.transitions;
+
+    /* Generate a square wave with a 50% duty cycle while the PWM output runs, restarting the cycle whenever the period changes */
+    std::vector<transition> result;
+    for ( std::size_t i = 0; i < sig.transitions.size (); ++i )
+    {
+        /* Find when this period stops applying */
+        const transition& t = sig.transitions [ i ];
+        const clock::time_point stop = ( i + 1 < sig.transitions.size () ? sig.transitions [ i + 1 ].time : std::max ( end, t.time ) );
+
+        /* If the output stops, end any pulse in progress */
+        if ( t.value == 0 ) { if ( !result.empty () && result.back ().value ) result.push_back ( transition { t.time, 0 } ); continue; }
+
+        /* Generate the pulses, extending a pulse in progress rather than pulsing for no time */
+        const std::chrono::nanoseconds period { t.value };
+        for ( clock::time_point rise = t.time; rise < stop; rise += period )
+        {
+            if ( result.empty () || !result.back ().value ) result.push_back ( transition { rise, 1 } );
+            if ( rise + period / 2 < stop ) result.push_back ( transition { rise + period / 2, 0 } );
+        }
+    }
+
+    /* Return the levels */
+    return result;
+}
+
+
+
+/* OUTPUT_GROUP IMPLEMENTATION */
+
+
+
+/** @name  write
+ * 
+ * @brief  Set the values of some of the lines in the group, recording a transition for each line which changes, all at the same time.
+ * @param  values: The values of the lines, one bit per line.
+ * @param  mask: Which lines to set, one bit per line.
+ * @return Nothing.
+ */
+void watergun::mock_gpio_backend::output_group::write ( const std::uint32_t values, const std::uint32_t mask )
+{
+    /* Aquire lock */
+    std::unique_lock<std::mutex> lock { backend.mock_mx };
+
+    /* Record each masked line which is present */
+    const clock::time_point now = clock::now ();
+    for ( std::size_t i = 0; i < pins.size (); ++i ) if ( pins [ i ] >= 0 && ( mask >> i & 1 ) ) backend.record ( pins [ i ], values >> i & 1, now );
+}
+
+
+
+/* INPUT_LINE IMPLEMENTATION */
+
+
+
+/** @name  read
+ * 
+ * @brief  Read the current value of the line.
+ * @return 1 if high, 0 if low.
+ */
+int watergun::mock_gpio_backend::input_line::read ()
+{
+    /* Aquire lock */
+    std::unique_lock<std::mutex> lock { backend.mock_mx };
+
+    /* Return the current value */
+    return backend.signals.at ( pin ).value;
+}
+
+/** @name  wait_edge
+ * 
+ * @brief  Wait for the next edge driven by set_input.
+ * @param  timeout: The longest time to wait.
+ * @param  event: Set to the edge, if there was one.
+ * @return True if there was an edge, false if the wait timed out.
+ */
+bool watergun::mock_gpio_backend::input_line::wait_edge ( const clock::duration timeout, edge_event& event )
+{
+    /* Aquire lock */
+    std::unique_lock<std::mutex> lock { backend.mock_mx };
+
+    /* Wait for an edge to be queued */
+    std::deque<edge_event>& pending_edges = backend.signals.at ( pin ).pending_edges;
+    if ( !backend.edge_cv.wait_for ( lock, timeout, [ & ] { return !pending_edges.empty (); } ) ) return false;
+
+    /* Take the edge */
+    event = pending_edges.front ();
+    pending_edges.pop_front ();
+    return true;
+}
+
+
+
+/* ANALOG_INPUT IMPLEMENTATION */
+
+
+
+/** @name  read
+ * 
+ * @brief  Read the input.
+ * @return The reading last set by set_analog.
+ */
+double watergun::mock_gpio_backend::analog_input::read ()
+{
+    /* Aquire lock */
+    std::unique_lock<std::mutex> lock { backend.mock_mx };
+
+    /* Return the reading */
+    return backend.analog_readings.at ( pin );
+}
+
+
+
+/* PWM_OUTPUT IMPLEMENTATION */
+
+
+
+/** @name  set_period_us
+ * 
+ * @brief  Set the period of the output, recording a transition if it is running.
+ * @param  period_us: The period in whole microseconds.
+ * @return Nothing.
+ */
+void watergun::mock_gpio_backend::pwm_output::set_period_us ( const int period_us )
+{
+    /* Aquire lock */
+    std::unique_lock<std::mutex> lock { backend.mock_mx };
+
+    /* Set the period, and record it if running */
+    period_ns = static_cast<std::uint64_t> ( std::max ( period_us, 0 ) ) * 1000;
+    if ( running ) backend.record ( pin, period_ns, clock::now () );
+}
+
+/** @name  enable
+ * 
+ * @brief  Start or stop the output, recording a transition if it changes.
+ * @param  enabled: True to start, false to stop.
+ * @return Nothing.
+ */
+void watergun::mock_gpio_backend::pwm_output::enable ( const bool enabled )
+{
+    /* Aquire lock */
+    std::unique_lock<std::mutex> lock { backend.mock_mx };
+
+    /* Start or stop the output */
+    running = enabled;
+    backend.record ( pin, running ? period_ns : 0, clock::now () );
+}
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * src/watergun/motion_executor.cpp
+ * 
+ * Implementation of include/watergun/motion_executor.h
+ * 
+ */
+
+
+
+/* INCLUDES */
+#include <watergun/motion_executor.h>
+
+
+
+/* MOTION_EXECUTOR IMPLEMENTATION */
+
+
+
+/** @name constructor
+ * 
+ * @brief Start the timing thread.
+ * @param _axes: The axes to move, which must remain valid for the lifetime of the executor.
+ * @throw watergun_exception, if there are no axes, too many axes, or an axis is null.
+ */
+watergun::motion_executor::motion_executor ( std::vector<motion_axis *> _axes )
+    : axes { std::move ( _axes ) }
+{
+    /* Check the axes */
+    if ( axes.empty () || axes.size () > max_axes ) throw watergun_exception { "Motion executor must have between one and four axes" };
+    if ( std::find ( axes.begin (), axes.end (), nullptr ) != axes.end () ) throw watergun_exception { "Motion executor axes cannot be null" };
+
+    /* Start the thread */
+    executor_thread = std::jthread { [ this ] ( std::stop_token stoken ) { executor_thread_function ( stoken ); } };
+}
+
+
+
+/** @name destructor
+ * 
+ * @brief Stop and join the timing thread.
+ */
+watergun::motion_executor::~motion_executor ()
+{
+    /* Join the thread */
+    if ( executor_thread.joinable () ) { executor_thread.request_stop (); executor_thread.join (); }
+}
+
+
+
+/** @name  queue_segment
+ * 
+ * @brief  Queue a segment, to be played immediately after the segments before it, or immediately if there are none.
+ * @param  seg: The segment.
+ * @throw  watergun_exception, if the duration is negative.
+ * @return True if the segment was queued, or false if the queue is full.
+ */
+bool watergun::motion_executor::queue_segment ( const segment& seg )
+{
+    /* If duration is negative, throw */
+    if ( seg.duration.count () < 0 ) throw watergun_exception { "Motion executor segment duration cannot be negative" };
+
+    /* Aquire lock, and fail if the queue is full */
+    std::unique_lock<std::mutex> lock { executor_mx };
+    if ( queue_count == queue_size ) return false;
+
+    /* Add the segment to the back of the queue */
+    queue [ ( queue_head + queue_count++ ) % queue_size ] = seg;
+
+    /* Notify and return */
+    executor_cv.notify_all ();
+    return true;
+}
+
+
+
+/** @name  clear
+ * 
+ * @brief  Remove all queued segments which have not yet started.
+ * @return Nothing.
+ */
+void watergun::motion_executor::clear ()
+{
+    /* Aquire lock and empty the queue */
+    std::unique_lock<std::mutex> lock { executor_mx };
+    queue_count = 0;
+}
+
+
+
+/** @name  play_segment
+ * 
+ * @brief  Play a single segment on all of the axes.
+ * @param  seg: The segment.
+ * @param  start: The time at which to start the segment.
+ * @param  stoken: The stop token for the jthread, which stops playback between ticks.
+ * @return Nothing.
+ */
+void watergun::motion_executor::play_segment ( const segment& seg, const clock::time_point start, const std::stop_token& stoken )
+{
+    /* Wait until the segment is due, then begin it on every axis, finding the number of steps to clock for each, and the most steps of any axis */
+    sleep_then_spin_until_monotonic ( start, spin_window );
+    std::array<std::uint64_t, max_axes> steps {};
+    std::uint64_t max_steps = 0;
+    for ( std::size_t i = 0; i < axes.size (); ++i ) max_steps = std::max ( max_steps, steps [ i ] = axes [ i ]->begin_segment ( seg.angles [ i ], seg.duration ) );
+
+    /* If there are no steps to clock, the axes time themselves */
+    if ( max_steps == 0 ) return;
+
+    /* The accumulated share of steps of each axis, starting half way so that the steps of each axis are centred in the segment */
+    std::array<std::uint64_t, max_axes> accumulators; accumulators.fill ( max_steps / 2 );
+
+    /* Clock each tick, which is in the middle of one of max_steps equal divisions of the segment */
+    const std::int64_t duration = std::chrono::duration_cast<std::chrono::nanoseconds> ( seg.duration ).count ();
+    for ( std::uint64_t tick = 0; tick < max_steps && !stoken.stop_requested (); ++tick )
+    {
+        /* Wait until the tick is due, and record how late it is */
+        const clock::time_point due = start + std::chrono::nanoseconds { duration * static_cast<std::int64_t> ( 2 * tick + 1 ) / static_cast<std::int64_t> ( 2 * max_steps ) };
+        tick_jitter.record ( sleep_then_spin_until_monotonic ( due, spin_window ) - due );
+
+        /* Step each axis whose share of steps has passed a whole step */
+        for ( std::size_t i = 0; i < axes.size (); ++i ) if ( ( accumulators [ i ] += steps [ i ] ) >= max_steps ) { accumulators [ i ] -= max_steps; axes [ i ]->segment_step (); }
+    }
+}
+
+
+
+/** @name  executor_thread_function
+ * 
+ * @brief  Function run by executor_thread. Plays queued segments back to back.
+ * @param  stoken: The stop token for the jthread.
+ * @return Nothing.
+ */
+void watergun::motion_executor::executor_thread_function ( std::stop_token stoken )
+{
+    /* Take on the stepper real-time role */
+    enter_realtime_role ( thread_role::stepper );
+
+    /* Create a lock on the mutex */
+    std::unique_lock<std::mutex> lock { executor_mx };
+
+    /* The time at which the last segment ended */
+    clock::time_point segment_end = clock::now ();
+
+    /* Loop while the stop token is unset */
+    while ( !stoken.stop_requested () )
+    {
+        /* Wait for a segment to be queued */
+        if ( !executor_cv.wait ( lock, stoken, [ this ] { return queue_count > 0; } ) ) break;
+
+        /* Take the oldest segment */
+        const segment seg = queue [ queue_head ];
+        queue_head = ( queue_head + 1 ) % queue_size; --queue_count;
+
+        /* Play the segment without holding the lock, starting when the last segment ended, or now if the queue ran dry, so that lateness does not accumulate */
+        lock.unlock ();
+        const clock::time_point segment_start = std::max ( segment_end, clock::now () );
+        play_segment ( seg, segment_start, stoken );
+        segment_end = segment_start + seg.duration;
+        lock.lock ();
+    }
+}
@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * src/watergun/mraa_gpio_backend.cpp
+ * 
+ * Implementation of include/watergun/mraa_gpio_backend.h
+ * 
+ */
+
+
+
+/* INCLUDES */
+#include <watergun/mraa_gpio_backend.h>
+
+
+
+/* DEFAULT_GPIO_BACKEND IMPLEMENTATION */
+
+
+
+/** @name  default_gpio_backend
+ * 
+ * @brief  Get the backend used by devices which are not given another, which is provided by mraa_gpio_backend.cpp.
+ *         Builds without mraa must give every device a backend.
+ * @return The backend.
+ */
+watergun::gpio_backend& watergun::default_gpio_backend ()
+{
+    /* Return a static mraa backend, which holds no state of its own */
+    static mraa_gpio_backend backend;
+    return backend;
+}
+
+
+
+/* MRAA_GPIO_BACKEND IMPLEMENTATION */
+
+
+
+/** @name  request_outputs
+ * 
+ * @brief  Request a group of output lines, all initially low.
+ * @param  pins: The pin number of each line in the group, or -1 for a line which is not present.
+ * @throw  watergun_exception, if the lines cannot be requested.
+ * @return The group.
+ */
+std::unique_ptr<watergun::gpio_output_group> watergun::mraa_gpio_backend::request_outputs ( const std::vector<int>& pins ) try
+{
+    /* Create the group */
+    return std::make_unique<output_group> ( pins );
+} catch ( const std::exception& e )
+{
+    /* Rethrow, stating that the request failed */
+    throw watergun_exception { std::string { "mraa GPIO output request failed: " } + e.what () };
+}
+
+
+
+/** @name  request_input
+ * 
+ * @brief  Request an input line, which detects edges from when it is requested.
+ * @param  pin: The pin number.
+ * @param  pull_up: True for pull up, false for pull down.
+ * @throw  watergun_exception, if the line cannot be requested.
+ * @return The line.
+ */
+std::unique_ptr<watergun::gpio_input_line> watergun::mraa_gpio_backend::request_input ( const int pin, const bool pull_up ) try
+{
+    /* Create the line */
+    return std::make_unique<input_line> ( pin, pull_up );
+} catch ( const std::exception& e )
+{
+    /* Rethrow, stating that the request failed */
+    throw watergun_exception { std::string { "mraa GPIO input request failed: " } + e.what () };
+}
+
+
+
+/** @name  request_pwm
+ * 
+ * @brief  Request a PWM output, initially stopped.
+ * @param  pin: The pin number.
+ * @throw  watergun_exception, if the output cannot be requested.
+ * @return The output.
+ */
+std::unique_ptr<watergun::pwm_output> watergun::mraa_gpio_backend::request_pwm ( const int pin ) try
+{
+    /* Create the output */
+    return std::make_unique<pwm_output> ( pin );
+} catch ( const std::exception& e )
+{
+    /* Rethrow, stating that the request failed */
+    throw watergun_exception { std::string { "mraa PWM request failed: " } + e.what () };
+}
+
+
+
+/** @name  request_analog
+ * 
+ * @brief  Request an analog input.
+ * @param  pin: The mraa AIO pin number.
+ * @throw  watergun_exception, if the input cannot be requested.
+ * @return The input.
+ */
+std::unique_ptr<watergun::analog_input> watergun::mraa_gpio_backend::request_analog ( const int pin ) try
+{
+    /* Create the input */
+    return std::make_unique<analog_input> ( pin );
+} catch ( const std::exception& e )
+{
+    /* Rethrow, stating that the request failed */
+    throw watergun_exception { std::string { "mraa AIO request failed: " } + e.what () };
+}
+
+
+
+/* MRAA_GPIO_BACKEND::OUTPUT_GROUP IMPLEMENTATION */
+
+
+
+/** @name constructor
+ * 
+ * @brief Open each present pin as an output, and write a 0.
+ * @param pins: The pin number of each line, or -1 for a line which is not present.
+ */
+watergun::mraa_gpio_backend::output_group::output_group ( const std::vector<int>& pins )
+{
+    /* Throw if there are more lines than bits */
+    if ( pins.size () > 32 ) throw watergun_exception { "GPIO output groups cannot have more than 32 lines" };
+
+    /* Open each present pin, leaving absent lines as null */
+    lines.resize ( pins.size () );
+    for ( std::size_t i = 0; i < pins.size (); ++i ) if ( pins [ i ] >= 0 )
+    {
+        lines [ i ] = std::make_unique<mraa::Gpio> ( pins [ i ] );
+        lines [ i ]->dir ( mraa::DIR_OUT );
+        lines [ i ]->write ( 0 );
+        present |= std::uint32_t { 1 } << i;
+    }
+}
+
+
+
+/** @name  write
+ * 
+ * @brief  Set the values of some of the lines in the group, writing each line which changes.
+ * @param  values: The values of the lines, one bit per line.
+ * @param  mask: Which lines to set, one bit per line.
+ * @return Nothing.
+ */
+void watergun::mraa_gpio_backend::output_group::write ( const std::uint32_t values, const std::uint32_t mask )
+{
+    /* Write each present line whose value changes */
+    const std::uint32_t changed = ( values ^ state ) & mask & present;
+    for ( std::size_t i = 0; i < lines.size (); ++i ) if ( changed & ( std::uint32_t { 1 } << i ) ) lines [ i ]->write ( values >> i & 1 );
+    state ^= changed;
+}
+
+
+
+/* MRAA_GPIO_BACKEND::INPUT_LINE IMPLEMENTATION */
+
+
+
+/** @name constructor
+ * 
+ * @brief Open the pin as an input.
+ * @param pin: The pin number.
+ * @param pull_up: True for pull up, false for pull down.
+ */
+watergun::mraa_gpio_backend::input_line::input_line ( const int pin, const bool pull_up )
+    : gpio { pin }
+{
+    /* Set to input and set pull up/down mode, then remember the starting value */
+    gpio.dir ( mraa::DIR_IN );
+    gpio.mode ( pull_up ? mraa::MODE_PULLUP : mraa::MODE_PULLDOWN );
+    last_value = read ();
+}
+
+
+
+/** @name  wait_edge
+ * 
+ * @brief  Poll the line until its value differs from the last value seen.
+ * @param  timeout: The longest time to wait.
+ * @param  event: Set to the edge, if there was one.
+ * @return True if there was an edge, false if the wait timed out.
+ */
+bool watergun::mraa_gpio_backend::input_line::wait_edge ( const clock::duration timeout, edge_event& event )
+{
+    /* Poll until the value changes or the timeout passes */
+    const clock::time_point deadline = clock::now () + timeout;
+    for ( clock::time_point now = clock::now (); ; now = clock::now () )
+    {
+        if ( const int value = read (); value != last_value ) { last_value = value; event = edge_event { now, value == 1 }; return true; }
+        if ( now >= deadline ) return false;
+        std::this_thread::sleep_for ( std::min<clock::duration> ( poll_period, deadline - now ) );
+    }
+}
+
+
+
+/* MRAA_GPIO_BACKEND::PWM_OUTPUT IMPLEMENTATION */
+
+
+
+/** @name constructor
+ * 
+ * @brief Open the pin, stopped with a duty cycle of a half.
+ * @param pin: The pin number.
+ */
+watergun::mraa_gpio_backend::pwm_output::pwm_output ( const int pin )
+    : pwm { pin }
+{
+    /* Disable the pin, and set the duty cycle to a half */
+    pwm.enable ( false );
+    pwm.write ( 0.5 );
+}
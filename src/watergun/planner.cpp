@@ -0,0 +1,740 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * src/watergun/planner.cpp
+ * 
+ * Implementation of include/watergun/planner.h
+ * 
+ */
+
+
+
+/* INCLUDES */
+#include <watergun/planner.h>
+
+
+
+/* PLANNER IMPLEMENTATION */
+
+
+
+/** @name constructor
+ * 
+ * @brief Sets up the planner with the ballistic and motion parameters of the watergun.
+ * @param _water_rate: The velocity of the water leaving the watergun (depends on psi etc).
+ * @param _air_resistance: Horizontal deceleration of the water, to model small amounts of air resistance.
+ * @param _max_yaw_velocity: Maximum yaw angular velocity in radians per second.
+ * @param _yaw_torque: The torque curve of the yaw axis, giving the maximum yaw angular acceleration in radians per second squared at each velocity.
+ * @param _max_pitch_velocity: Maximum pitch angular velocity in radians per second.
+ * @param _pitch_torque: The torque curve of the pitch axis, giving the maximum pitch angular acceleration in radians per second squared at each velocity.
+ * @param _aim_period: The period of time with which to aspire to be correctly aimed within.
+ * @param _max_depth: The maximum distance at which a user can be tracked.
+ * @throw watergun_exception, if the aim period is not positive, or either axis cannot accelerate at its maximum velocity.
+ */
+watergun::planner::planner ( const double _water_rate, const double _air_resistance, const double _max_yaw_velocity, const torque_curve& _yaw_torque, const double _max_pitch_velocity, const torque_curve& _pitch_torque, const clock::duration _aim_period, const double _max_depth )
+    : water_rate { _water_rate }
+    , air_resistance { _air_resistance }
+    , max_yaw_velocity { _max_yaw_velocity }
+    , yaw_torque { _yaw_torque }
+    , max_pitch_velocity { _max_pitch_velocity }
+    , pitch_torque { _pitch_torque }
+    , aim_period { _aim_period }
+    , aim_period_s { duration_to_seconds ( aim_period ).count () }
+    , max_depth { _max_depth }
+{
+    /* The aim period must be positive */
+    if ( aim_period <= clock::duration { 0 } ) throw watergun_exception { "Planner aim period must be positive" };
+
+    /* Each axis must be able to accelerate at its maximum velocity, otherwise the acceleration constraints cannot be met at speed */
+    if ( !( yaw_torque.acceleration_at ( max_yaw_velocity ) > 0. && pitch_torque.acceleration_at ( max_pitch_velocity ) > 0. ) ) throw watergun_exception { "Planner torque curves must be able to accelerate at the maximum velocities" };
+}
+
+
+
+/** @name  calculate_aim
+ * 
+ * @brief  From a tracked user, find the yaw and pitch the watergun must shoot to hit the user for a given water velocity.
+ * @param  user: The user to aim at.
+ * @param  rate: The water velocity.
+ * @return A gun position. If the user cannot be hit, yaw is set to the user's angle, and pitch is set to 45 degrees.
+ */
+watergun::planner::gun_position watergun::planner::calculate_aim ( const tracked_user& user, const double rate ) const
+{
+    /* If the user is at the camera, return their angle for the yaw, and 0 degrees for the pitch */
+    if ( ( user.com.z * user.com.z ) + ( user.com.y * user.com.y ) == 0. ) return { user.com.x, 0. };
+
+    /* Solve the time quartic to test whether it is possible to hit the user */
+    auto roots = solve_quartic
+    (
+        ( air_resistance * air_resistance * 0.25 ) + ( 9.81 * 9.81 * 0.25 ),
+        ( air_resistance * user.com_rate.z ) + ( 9.81 * user.com_rate.y ),
+        ( air_resistance * user.com.z ) + ( user.com_rate.z * user.com_rate.z ) + ( 9.81 * user.com.y ) + ( user.com_rate.y * user.com_rate.y ) - ( rate * rate ),
+        ( user.com.z * user.com_rate.z * 2. ) + ( user.com.y * user.com_rate.y * 2. ),
+        ( user.com.z * user.com.z ) + ( user.com.y * user.com.y )
+    );
+
+    /* Look for two real positive roots */
+    double time = INFINITY;
+    for ( const auto& root : roots ) if ( std::abs ( root.imag () ) < 1e-6 && root.real () > 0. && root.real () < time ) time = root.real ();
+
+    /* If time is still infinity, there are no solutions, so return the user's position and 45 degrees */
+    if ( time == INFINITY ) return { user.com.x, M_PI / 4., true };
+
+    /* Else produce the angles, along with the time of flight */
+    return { user.com.x + user.com_rate.x * time, std::asin ( std::clamp ( ( user.com.y + user.com_rate.y * time + 4.905 * time * time ) / ( rate * time ), -1., 1. ) ), false, time };
+}
+
+
+
+/** @name  choose_target
+ * 
+ * @brief  Choose a user to aim at from the given list, based on the estimated time for the gun to get on target from its current movement.
+ *         Switching away from the current target is penalised, and is not allowed at all until the minimum dwell has passed.
+ * @param  users: The users to aim at.
+ * @param  current_movement: The current movement of the gun.
+ * @param  selection: The current target selection, which will be updated with the chosen target.
+ * @param  scores: If not null, will be set to the scores of each user which can be hit.
+ * @return The tracked user the gun has chosen to aim for, or a user with a zero COM if no user can be hit.
+ */
+watergun::planner::tracked_user watergun::planner::choose_target ( const std::vector<tracked_user>& users, const single_movement& current_movement, target_selection& selection, std::vector<target_score> * scores ) const
+{
+    /* Score which user to hit, the user with the highest score is chosen.
+     * Taking 0s to get on target scores 1, taking 1s scores -1. Any user other than the current target has the switching penalty added to their time.
+     * Being 0m away from the camera scores 1, being the maximum distance away scores -1.
+     * Moving towards the camera at 7m/s scores 1, while away scores -1.
+     */
+
+    /* Get the current time, and whether the current target must be kept */
+    const clock::time_point now = clock::now (); const bool locked = selection.locked ( now );
+
+    /* Set a minimum best score and store the best user to aim for */
+    double best_score = -100; tracked_user best_user {}; bool best_locked = false;
+
+    /* Clear the scores */
+    if ( scores ) scores->clear ();
+
+    /* Loop through the users */
+    for ( const tracked_user& user : users )
+    {
+        /* Estimate the time to get on target from the current movement, and continue if it is not possible to hit the user */
+        gun_position aim, aim_rate;
+        clock::duration time_to_target = estimate_slew_time ( gun_position { 0., current_movement.ending_pitch }, current_movement.yaw_rate, current_movement.pitch_rate, user, user.timestamp, aim, aim_rate );
+        if ( time_to_target == clock::duration::max () ) continue;
+
+        /* Add the switching penalty if this user is not the current target */
+        if ( selection.id != 0 && user.id != selection.id ) time_to_target += selection.switching_penalty;
+
+        /* Get their score */
+        double score = duration_to_seconds ( time_to_target ).count () * -2. + 1. + ( user.com.z / max_depth ) * -2. + 1. + ( user.com_rate.z / 7. ) * -1.;
+
+        /* Record the score */
+        if ( scores ) scores->push_back ( target_score { user.id, time_to_target, score } );
+
+        /* If the current target is locked, they must be chosen */
+        if ( best_locked ) continue;
+        if ( locked && user.id == selection.id ) { best_score = score; best_user = user; best_locked = true; continue; }
+
+        /* If they have a new best score, update the best score and best user */
+        if ( score > best_score ) { best_score = score; best_user = user; }
+    }
+
+    /* Update the selection */
+    if ( best_user.com != vector3d {} ) selection.update ( best_user.id, now );
+
+    /* Return the best user to aim for */
+    return best_user;
+}
+
+
+
+/** @name  sequence_targets
+ * 
+ * @brief  Plan an ordered engagement of several users, choosing the order and dwell times to maximise the expected hits per second.
+ *         This is solved as a small orienteering problem. Every user who can be hit is first scored as the head of a sequence by their best single engagement,
+ *         then sequences are deepened best first under each head, pruning those which cannot beat the best found so far, until the sequencing budget is exhausted.
+ *         The first engagement is subject to the same hysteresis as choose_target, and the selection will be updated with it.
+ * @param  users: The users to aim at.
+ * @param  current_movement: The current movement of the gun.
+ * @param  selection: The current target selection, which will be updated with the first engagement.
+ * @param  scores: If not null, will be set to the best hits per second of a sequence starting with each user which can be hit.
+ * @return The best engagement sequence found, which is empty if no user can be hit.
+ */
+std::vector<watergun::planner::engagement> watergun::planner::sequence_targets ( const std::span<const tracked_user> users, const single_movement& current_movement, target_selection& selection, std::vector<target_score> * scores ) const
+{
+    /* Sequence in a new workspace, and return the best sequence */
+    sequencing_workspace workspace = create_sequencing_workspace ( users.size () ); std::vector<engagement> best_sequence;
+    sequence_targets ( users, current_movement, selection, workspace, best_sequence, scores );
+    return best_sequence;
+}
+
+
+
+/** @name  sequence_targets
+ * 
+ * @brief  As above, but using the buffers of a workspace and writing the best sequence into a caller-provided vector, so that nothing is allocated
+ *         so long as the workspace, sequence and scores have the capacity for the number of users.
+ * @param  users: The users to aim at.
+ * @param  current_movement: The current movement of the gun.
+ * @param  selection: The current target selection, which will be updated with the first engagement.
+ * @param  workspace: The workspace to sequence in, which must not be in use by any other thread.
+ * @param  best_sequence: Will be set to the best engagement sequence found, which is empty if no user can be hit.
+ * @param  scores: If not null, will be set to the best hits per second of a sequence starting with each user which can be hit.
+ * @return Nothing.
+ */
+void watergun::planner::sequence_targets ( const std::span<const tracked_user> users, const single_movement& current_movement, target_selection& selection, sequencing_workspace& workspace, std::vector<engagement>& best_sequence, std::vector<target_score> * scores ) const
+{
+    /* Get the time the sequence starts and the time by which the search must finish */
+    const clock::time_point start = clock::now (), deadline = start + sequencing_budget;
+
+    /* The best sequence found so far and its hits per second, and the sequence currently being explored */
+    std::vector<engagement>& sequence = workspace.sequence; best_sequence.clear (); sequence.clear (); double best_rate = 0.;
+
+    /* Which users have already been visited in the current sequence */
+    std::vector<bool>& visited = workspace.visited; visited.assign ( users.size (), false );
+
+    /* The best hits per second and time to target of sequences starting with each user, for scoring */
+    std::vector<double>& head_rates = workspace.head_rates; head_rates.assign ( users.size (), -1. );
+    std::vector<clock::duration>& head_times = workspace.head_times; head_times.assign ( users.size (), clock::duration::max () );
+
+    /* If the current target is locked and still present, only sequences starting with them are allowed */
+    const bool locked = selection.locked ( start ) && std::any_of ( users.begin (), users.end (), [ & ] ( const tracked_user& user ) { return user.id == selection.id; } );
+
+    /* The most hit value a single engagement can add, and the dwell time of a single hit in seconds */
+    double max_engagement_value = 0.; for ( int hits = 0; hits < max_hits_per_engagement; ++hits ) max_engagement_value += std::pow ( repeat_hit_value, hits );
+    const double hit_dwell_s = duration_to_seconds ( hit_dwell_time ).count ();
+
+    /* The options at each depth of the sequence, and the index of the user at the head of the current sequence */
+    typedef sequencing_workspace::option option;
+    std::vector<option>& options = workspace.options; options.resize ( users.size () * max_sequence_length ); std::size_t head = 0;
+
+    /* Find the options for extending a sequence at a depth, ordered best first, returning the number of options.
+     * The parameters are the depth, the time offset into the sequence, the state of the gun at that time, and the total hit value so far.
+     */
+    auto find_options = [ & ] ( const std::size_t depth, const clock::duration offset, const gun_position& gun, const double yaw_rate, const double pitch_rate, const double value ) -> std::size_t
+    {
+        /* Try each unvisited user */
+        option * const level = options.data () + depth * users.size (); std::size_t count = 0;
+        for ( std::size_t i = 0; i < users.size (); ++i ) if ( !visited.at ( i ) )
+        {
+            /* If this is the head of the sequence and the current target is locked, skip any other user */
+            if ( depth == 0 && locked && users [ i ].id != selection.id ) continue;
+
+            /* Estimate the time to get on target, and skip the user if they cannot be hit */
+            option opt { i };
+            opt.slew_time = estimate_slew_time ( gun, yaw_rate, pitch_rate, users [ i ], start + offset, opt.aim, opt.aim_rate );
+            if ( opt.slew_time == clock::duration::max () ) continue;
+
+            /* If this is the head of the sequence, add the switching penalty for users other than the current target, and record the time to target */
+            if ( depth == 0 && selection.id != 0 && users [ i ].id != selection.id ) opt.slew_time += selection.switching_penalty;
+            if ( depth == 0 ) head_times.at ( i ) = opt.slew_time;
+
+            /* Skip the user if they would be reached beyond the horizon, else add the option */
+            if ( offset + opt.slew_time + hit_dwell_time > sequence_horizon ) continue;
+            opt.rate = ( value + 1. ) / duration_to_seconds ( offset + opt.slew_time + hit_dwell_time ).count ();
+            level [ count++ ] = opt;
+        }
+
+        /* Order the options best first */
+        std::sort ( level, level + count, [] ( const option& lhs, const option& rhs ) { return lhs.rate > rhs.rate; } );
+        return count;
+    };
+
+    /* Find an optimistic bound on the hits per second of any extension of a sequence.
+     * Each further hit is worth at most 1 and takes at least the hit dwell time, and the value added is limited by the users remaining and the time left before the horizon.
+     * The rate of a sequence extended by value a is then at most ( value + a ) / ( offset + a * hit dwell ), which is greatest at either no extension or the largest extension.
+     */
+    auto bound = [ & ] ( const std::size_t depth, const clock::duration offset, const double value )
+    {
+        const double offset_s = duration_to_seconds ( offset ).count ();
+        const double users_left = static_cast<double> ( std::min ( users.size (), static_cast<std::size_t> ( max_sequence_length ) ) - depth );
+        const double extension = std::min ( users_left * max_engagement_value, duration_to_seconds ( sequence_horizon - offset ).count () / hit_dwell_s );
+        return std::max ( value / offset_s, ( value + extension ) / ( offset_s + extension * hit_dwell_s ) );
+    };
+
+    /* Recursively explore sequences, deepening best first and pruning sequences which cannot beat the best found so far.
+     * The parameters are the depth, the time offset into the sequence, the state of the gun at that time, and the total hit value so far.
+     */
+    auto search = [ & ] ( auto& self, const std::size_t depth, const clock::duration offset, const gun_position& gun, const double yaw_rate, const double pitch_rate, const double value ) -> void
+    {
+        /* Stop if the sequence is long enough, the budget is exhausted, or no extension could beat the best sequence */
+        if ( depth >= users.size () || depth >= static_cast<std::size_t> ( max_sequence_length ) || clock::now () > deadline ) return;
+        if ( bound ( depth, offset, value ) <= best_rate ) return;
+
+        /* Try extending the sequence with each option, best first */
+        const std::size_t count = find_options ( depth, offset, gun, yaw_rate, pitch_rate, value );
+        for ( std::size_t k = 0; k < count && clock::now () <= deadline; ++k )
+        {
+            /* Get the option and mark the user as visited */
+            const option opt = options.at ( depth * users.size () + k );
+            visited.at ( opt.user ) = true;
+
+            /* Try each number of hits on the user */
+            double hit_value = 1., engagement_value = value;
+            for ( int hits = 1; hits <= max_hits_per_engagement; ++hits, hit_value *= repeat_hit_value )
+            {
+                /* Get the time the engagement ends, and stop if it is beyond the horizon */
+                const clock::duration end = offset + opt.slew_time + hit_dwell_time * hits;
+                if ( end > sequence_horizon ) break;
+
+                /* Add the engagement */
+                engagement_value += hit_value;
+                sequence.push_back ( engagement { users [ opt.user ], opt.slew_time, hit_dwell_time * hits, hits } );
+
+                /* If this sequence has a better rate of hits, store it */
+                const double rate = engagement_value / duration_to_seconds ( end ).count ();
+                if ( rate > best_rate ) { best_rate = rate; best_sequence = sequence; }
+                head_rates.at ( head ) = std::max ( head_rates.at ( head ), rate );
+
+                /* Find the gun position at the end of the dwell, following the user, and extend the sequence further */
+                const double dwell_s = duration_to_seconds ( hit_dwell_time * hits ).count ();
+                self ( self, depth + 1, end, gun_position { opt.aim.yaw + opt.aim_rate.yaw * dwell_s, opt.aim.pitch + opt.aim_rate.pitch * dwell_s }, opt.aim_rate.yaw, opt.aim_rate.pitch, engagement_value );
+
+                /* Remove the engagement */
+                sequence.pop_back ();
+            }
+
+            /* Unmark the user */
+            visited.at ( opt.user ) = false;
+        }
+    };
+
+    /* The gun starts relative to the camera at 0 yaw, with the pitch the current movement ends at */
+    const gun_position start_gun { 0., current_movement.ending_pitch };
+
+    /* First score every user who can be hit as the head of a sequence by their best single engagement, which also seeds the best sequence.
+     * This keeps the scores complete, however little of the budget remains for deepening.
+     */
+    const std::size_t heads = find_options ( 0, clock::duration::zero (), start_gun, current_movement.yaw_rate, current_movement.pitch_rate, 0. );
+    for ( std::size_t k = 0; k < heads; ++k )
+    {
+        const option& opt = options.at ( k ); double hit_value = 1., engagement_value = 0.;
+        for ( int hits = 1; hits <= max_hits_per_engagement && opt.slew_time + hit_dwell_time * hits <= sequence_horizon; ++hits, hit_value *= repeat_hit_value )
+        {
+            engagement_value += hit_value;
+            const double rate = engagement_value / duration_to_seconds ( opt.slew_time + hit_dwell_time * hits ).count ();
+            head_rates.at ( opt.user ) = std::max ( head_rates.at ( opt.user ), rate );
+            if ( rate > best_rate ) { best_rate = rate; best_sequence.assign ( 1, engagement { users [ opt.user ], opt.slew_time, hit_dwell_time * hits, hits } ); }
+        }
+    }
+
+    /* Then deepen the sequences under each head in turn, best first. Deeper searches only overwrite the options at greater depths. */
+    for ( std::size_t k = 0; k < heads && clock::now () <= deadline; ++k )
+    {
+        /* Mark the head as visited, and search for the best sequences following each number of hits on them */
+        const option& opt = options.at ( k ); head = opt.user; visited.at ( head ) = true;
+        double hit_value = 1., engagement_value = 0.;
+        for ( int hits = 1; hits <= max_hits_per_engagement && opt.slew_time + hit_dwell_time * hits <= sequence_horizon; ++hits, hit_value *= repeat_hit_value )
+        {
+            engagement_value += hit_value;
+            const double dwell_s = duration_to_seconds ( hit_dwell_time * hits ).count ();
+            sequence.assign ( 1, engagement { users [ head ], opt.slew_time, hit_dwell_time * hits, hits } );
+            search ( search, 1, opt.slew_time + hit_dwell_time * hits, gun_position { opt.aim.yaw + opt.aim_rate.yaw * dwell_s, opt.aim.pitch + opt.aim_rate.pitch * dwell_s }, opt.aim_rate.yaw, opt.aim_rate.pitch, engagement_value );
+        }
+        visited.at ( head ) = false;
+    }
+
+    /* Set the scores of each user which can be hit */
+    if ( scores )
+    {
+        scores->clear ();
+        for ( std::size_t i = 0; i < users.size (); ++i ) if ( head_rates.at ( i ) >= 0. ) scores->push_back ( target_score { users [ i ].id, head_times.at ( i ), head_rates.at ( i ) } );
+    }
+
+    /* Update the selection with the first engagement */
+    if ( !best_sequence.empty () ) selection.update ( best_sequence.front ().user.id, start );
+}
+
+
+
+/** @name  create_sequencing_workspace
+ * 
+ * @brief  Create a workspace for sequencing targets, with the capacity to sequence a number of users without allocating.
+ * @param  max_users: The number of users to reserve space for.
+ * @return The sequencing workspace.
+ */
+watergun::planner::sequencing_workspace watergun::planner::create_sequencing_workspace ( const std::size_t max_users ) const
+{
+    /* Reserve space in each buffer */
+    sequencing_workspace workspace;
+    workspace.sequence.reserve ( max_sequence_length ); workspace.visited.reserve ( max_users );
+    workspace.head_rates.reserve ( max_users ); workspace.head_times.reserve ( max_users );
+    workspace.options.reserve ( max_users * max_sequence_length );
+    return workspace;
+}
+
+
+
+/** @name  create_solver_context
+ * 
+ * @brief  Create a new solver context for planning movements.
+ * @return The solver context.
+ */
+watergun::planner::solver_context watergun::planner::create_solver_context () const
+{
+    /* Create the context with the initial basic movement model */
+    return solver_context { create_basic_movement_model ( movement_model_size_multiple ) };
+}
+
+
+
+/** @name  calculate_future_movements
+ * 
+ * @brief  Over the next n lots of aim periods, create a list of single movements to follow to keep on track with hitting a tracked user.
+ *         Both the yaw and pitch axes are planned, each subject to its own velocity and acceleration limits.
+ *         The output list will be shorter than n elements, if it becomes not possible to hit the targeted user.
+ * @param  user: The tracked user to aim for.
+ * @param  current_movement: The current movement of the gun.
+ * @param  n: The number of aim periods to single movements plans for.
+ * @param  context: The solver context to plan with, which must not be in use by any other thread.
+ * @return The list of single movements forming a movement plan.
+ */
+std::list<watergun::planner::single_movement> watergun::planner::calculate_future_movements ( const tracked_user& user, const single_movement& current_movement, int n, solver_context& context ) const
+{
+    /* Get the movement model from the context */
+    ClpSimplex& movement_model = context.movement_model;
+
+    /* If n is larger than the current model size, increase the current model size */
+    if ( n > movement_model.getNumCols () / 4 ) movement_model = create_basic_movement_model ( n );
+
+    /* Specialize the model */
+    std::vector<gun_position> gun_positions ( movement_model.getNumCols () / 4 );
+    specialize_movement_model ( movement_model, user, current_movement, gun_positions );
+
+    /* Attempt to solve the problem */
+    movement_model.dual ();
+
+    /* If it failed, increase the model size and try again */
+    while ( movement_model.isProvenPrimalInfeasible () )
+    {
+        /* Increase the model size */
+        movement_model = create_basic_movement_model ( movement_model.getNumCols () / 4 + movement_model_size_multiple );
+
+        /* Respecialize the model */
+        gun_positions.resize ( movement_model.getNumCols () / 4 );
+        specialize_movement_model ( movement_model, user, current_movement, gun_positions );
+
+        /* Attempt to solve again */
+        movement_model.dual ();
+    }
+
+    /* Read the solution into the future movements, and return them as a list */
+    std::vector<single_movement> future_movements ( n );
+    read_movement_solution ( movement_model, user, current_movement, gun_positions, future_movements );
+    return std::list<single_movement> ( future_movements.begin (), future_movements.end () );
+}
+
+
+
+/** @name  create_basic_movement_model
+ * 
+ * @brief  Create a linear programming model for n future movements into the future. The constraint bounds will need to be modified later for the model to work.
+ *         The model contains a yaw block followed by a pitch block, each with 2n variables and 2n + 2k(n+1) constraints, where k is the number of lines in the torque curve of the axis.
+ * @param  n: The number of movements in the model.
+ * @param  objective_row: The objective coefficients for all 4n variables, or null to generate them using objective_weight.
+ * @return ClpModel object.
+ */
+ClpModel watergun::planner::create_basic_movement_model ( const int n, const double * const objective_row ) const
+{
+    /* For each axis, the tableaux contains variables x[n] and t[n], where x[i] is the velocity at the i'th period,
+     * and t[i] is at least the absolute difference between x[i] and the on-target angle at that period.
+     * The acceleration between periods, as well as the finishing angle are constrained.
+     * The acceleration is constrained by each line of the torque curve of the axis, as |a| + slope * |v| <= acceleration, where v is the mean velocity of the two periods.
+     * Each line is split into a pair of two-sided constraints, one for each relative sign of a and v, so that the constraints stay linear.
+     * The model is optimal, when t[0...n) are minimised, where t[i+1] is more desireable to minimise than t[i].
+     * The yaw axis occupies columns [0, 2n) and the first movement_model_rows rows, the pitch axis columns [2n, 4n) and the remaining rows.
+     */
+
+    /* Get the number of rows */
+    const int rows = movement_model_rows ( yaw_torque, n ) + movement_model_rows ( pitch_torque, n );
+
+    /* Create the tableaux */
+    CoinPackedMatrix tableaux;
+
+    /* Set the initial tableux size */
+    tableaux.setDimensions ( rows, n * 4 );
+
+    /* Create the constraint bounds */
+    std::vector<double> constraint_lb ( rows ), constraint_ub ( rows );
+
+    /* Create the variable bounds */
+    std::vector<double> variable_lb ( n * 4 ), variable_ub ( n * 4 );
+
+    /* Create the objective row, if one was not given */
+    std::vector<double> default_objective_row ( objective_row ? 0 : n * 4, 0. );
+
+    /* Set up each axis in turn */
+    for ( int axis = 0; axis < 2; ++axis )
+    {
+        /* Get the row and column offsets, and the limits of the axis */
+        const int r = axis * movement_model_rows ( yaw_torque, n ), c = axis * n * 2;
+        const double max_velocity = ( axis == 0 ? max_yaw_velocity : max_pitch_velocity );
+        const torque_curve& torque = ( axis == 0 ? yaw_torque : pitch_torque );
+
+        /* Set up the constraints which force t[i] >= | aim_period * x[i] - target angle | */
+        for ( int i = 0; i < n; ++i ) for ( int j = 0; j < n * 2; ++j ) 
+        {
+            /* Set the 1st constraint: t[i] >= aim_period *  SUM x[0...i] - target angle    <=>   aim_period * -SUM x[0...i] + t[i] >= -target angle */
+            tableaux.modifyCoefficient ( r + i * 2 + 0, c + j, j < n && j <= i ? -aim_period_s : ( j - n == i ? 1. : 0. ) );
+                
+            /* Set the 2nd constraint: t[i] >= aim_period * -SUM x[0...i] + target angle    <=>   aim_period *  SUM x[0...i] + t[i] >=  target angle */
+            tableaux.modifyCoefficient ( r + i * 2 + 1, c + j, j < n && j <= i ?  aim_period_s : ( j - n == i ? 1. : 0. )  );
+
+            /* Set the upper bounds to the maximum. Lower bound is set during specialization. */
+            constraint_ub.at ( r + i * 2 ) = COIN_DBL_MAX; constraint_ub.at ( r + i * 2 + 1 ) = COIN_DBL_MAX;
+        }
+
+        /* Set up the constraints which enforce the maximum acceleration, for each line of the torque curve and sign of the velocity term */
+        for ( std::size_t k = 0; k < torque.get_lines ().size (); ++k ) for ( int sign = 0; sign < 2; ++sign ) for ( int i = 0; i < n + 1; ++i )
+        {
+            /* Get the row of the constraint, and the coefficient of the velocity term */
+            const int row = r + n * 2 + ( static_cast<int> ( k ) * 2 + sign ) * ( n + 1 ) + i;
+            const double slope = ( sign == 0 ? 0.5 : -0.5 ) * torque.get_lines () [ k ].slope;
+
+            /* Set up the constraint: -acceleration <= ( x[i-1] - x[i] ) / aim_period +- slope * ( x[i-1] + x[i] ) / 2 <= acceleration.
+             * x[-1] and x[n] are the current and aim rates, which are moved into the bounds during specialization.
+             */
+            if ( i > 0 ) tableaux.modifyCoefficient ( row, c + i - 1,  1. / aim_period_s + slope );
+            if ( i < n ) tableaux.modifyCoefficient ( row, c + i,     -1. / aim_period_s + slope );
+
+            /* Set the bounds */
+            constraint_lb.at ( row ) = -torque.get_lines () [ k ].acceleration; constraint_ub.at ( row ) = torque.get_lines () [ k ].acceleration;
+        }
+
+        /* Set the variable bounds */
+        std::fill_n ( variable_lb.begin () + c, n, -max_velocity ); std::fill_n ( variable_lb.begin () + c + n, n, 0. );
+        std::fill_n ( variable_ub.begin () + c, n, +max_velocity ); std::fill_n ( variable_ub.begin () + c + n, n, COIN_DBL_MAX );
+        variable_ub.at ( c + n * 2 - 1 ) = 0.; /* t[n-1] should only be 0, as this will force the gun to be aimed at the user by the end of the last period */
+
+        /* Set the default objective row */
+        if ( !objective_row ) for ( int i = 0; i < n; ++i ) default_objective_row.at ( c + i + n ) = objective_weight ( i );
+    }
+
+    /* Create the model, silence its logging and populate it */
+    ClpModel clp_model; clp_model.setLogLevel ( 0 ); clp_model.loadProblem ( tableaux, variable_lb.data (), variable_ub.data (), ( objective_row ? objective_row : default_objective_row.data () ), constraint_lb.data (), constraint_ub.data () );
+
+    /* Return the model */
+    return clp_model;
+}
+
+
+
+/** @name  specialize_movement_model
+ * 
+ * @brief  Make a basic movement model specific to a given tracked user.
+ * @param  clp_model: A reference to the model to refine.
+ * @param  user: The tracked user to aim for.
+ * @param  current_movement: The current movement of the gun.
+ * @param  gun_positions: Set to the gun positions at the end of each period of the model. Must be the same size as the model.
+ * @return Nothing.
+ */
+void watergun::planner::specialize_movement_model ( ClpModel& clp_model, const tracked_user& user, const single_movement& current_movement, const std::span<gun_position> gun_positions ) const
+{
+    /* Get the number of variables in each axis of the model, and the row offset of the pitch axis */
+    const int n = clp_model.getNumCols () / 4, r = movement_model_rows ( yaw_torque, n );
+
+    /* Take a single water velocity for the whole model */
+    const double rate = get_water_rate ();
+
+    /* Modify the lower bounds on all the constraints defining all t[0...n).
+     * Yaw is relative to the camera, so starts at 0, whereas pitch is absolute, so starts from the end of the current movement.
+     */
+    for ( int i = 0; i < n; ++i )
+    {
+        /* Project the user and get the aim */
+        tracked_user proj_user = project_tracked_user ( user, user.timestamp + aim_period * ( i + 1 ) );
+        gun_positions [ i ] = calculate_aim ( proj_user, rate );
+
+        /* Set the bounds for the constraints */
+        clp_model.setRowLower ( i * 2,         -gun_positions [ i ].yaw ); clp_model.setRowLower ( i * 2 + 1,     +gun_positions [ i ].yaw );
+        clp_model.setRowLower ( r + i * 2,     -gun_positions [ i ].pitch + current_movement.ending_pitch );
+        clp_model.setRowLower ( r + i * 2 + 1, +gun_positions [ i ].pitch - current_movement.ending_pitch );
+    }
+
+    /* Calculate the rate of change of the aiming yaw and pitch at the end of the periods. Correct for the off-chance that the user becomes unhittable between the two aimings. */
+    gun_position aim_ext = calculate_aim ( project_tracked_user ( user, user.timestamp + aim_period * ( n + 1 ) ), rate );
+    double aim_yaw_rate, aim_pitch_rate; if ( gun_positions.back ().out_of_range || aim_ext.out_of_range ) { aim_yaw_rate = user.com_rate.x; aim_pitch_rate = 0.; } else
+    {
+        aim_yaw_rate   = rate_of_change ( aim_ext.yaw   - gun_positions.back ().yaw,   aim_period );
+        aim_pitch_rate = rate_of_change ( aim_ext.pitch - gun_positions.back ().pitch, aim_period );
+    }
+
+    /* Modify the bounds on the first and last constraints of each axis that enforce the maximum acceleration, for each line of the torque curve and sign of the velocity term.
+     * The first constraint contains the current rate as x[-1], and the last contains the aim rate as x[n], so their terms are moved into the bounds.
+     */
+    for ( int axis = 0; axis < 2; ++axis )
+    {
+        const torque_curve& torque = ( axis == 0 ? yaw_torque : pitch_torque );
+        const double current_rate = ( axis == 0 ? current_movement.yaw_rate : current_movement.pitch_rate ), aim_rate = ( axis == 0 ? aim_yaw_rate : aim_pitch_rate );
+        for ( std::size_t k = 0; k < torque.get_lines ().size (); ++k ) for ( int sign = 0; sign < 2; ++sign )
+        {
+            const int row = axis * r + n * 2 + ( static_cast<int> ( k ) * 2 + sign ) * ( n + 1 );
+            const double slope = ( sign == 0 ? 0.5 : -0.5 ) * torque.get_lines () [ k ].slope, acceleration = torque.get_lines () [ k ].acceleration;
+            const double first_offset = ( 1. / aim_period_s + slope ) * current_rate, last_offset = ( -1. / aim_period_s + slope ) * aim_rate;
+            clp_model.setRowBounds ( row,     -acceleration - first_offset, +acceleration - first_offset );
+            clp_model.setRowBounds ( row + n, -acceleration - last_offset,  +acceleration - last_offset  );
+        }
+    }
+}
+
+
+
+/** @name  read_movement_solution
+ * 
+ * @brief  Read the solution of a solved movement model into single movements.
+ * @param  clp_model: The solved model.
+ * @param  user: The tracked user the model was specialized for.
+ * @param  current_movement: The current movement of the gun.
+ * @param  gun_positions: The gun positions produced by specializing the model.
+ * @param  future_movements: Set to the future movements. No more movements than are in the model may be read.
+ * @return Nothing.
+ */
+void watergun::planner::read_movement_solution ( const ClpModel& clp_model, const tracked_user& user, const single_movement& current_movement, const std::span<const gun_position> gun_positions, const std::span<single_movement> future_movements ) const
+{
+    /* Get the model size and solution */
+    const int m = clp_model.getNumCols () / 4;
+    const double * solution = clp_model.getColSolution ();
+
+    /* The pitch the gun will have at the end of each movement */
+    double pitch = current_movement.ending_pitch;
+
+    /* Populate the future movements */
+    for ( std::size_t i = 0; i < future_movements.size (); ++i ) future_movements [ i ] = single_movement 
+    { 
+        aim_period, user.timestamp + aim_period * i, 
+        solution [ i ], solution [ i + m * 2 ],
+        pitch += solution [ i + m * 2 ] * aim_period_s,
+        solution [ i + m ] < on_target_threshold && solution [ i + m * 3 ] < on_target_threshold && !gun_positions [ i ].out_of_range,
+        gun_positions [ i ].flight_time
+    };
+}
+
+
+
+/** @name  estimate_slew_time
+ * 
+ * @brief  Estimate the time taken for the gun to move from its current position onto a user, using time-optimal bang-bang movement on each axis.
+ * @param  from: The current position of the gun.
+ * @param  yaw_rate: The current yaw velocity of the gun.
+ * @param  pitch_rate: The current pitch velocity of the gun.
+ * @param  user: The tracked user to slew onto.
+ * @param  start: The time at which the slew starts.
+ * @param  aim: Set to the position of the gun once on target.
+ * @param  aim_rate: Set to the rate of change of the aim once on target.
+ * @return The estimated slew time, or the maximum duration if the user cannot be hit.
+ */
+watergun::planner::clock::duration watergun::planner::estimate_slew_time ( const gun_position& from, const double yaw_rate, const double pitch_rate, const tracked_user& user, const clock::time_point start, gun_position& aim, gun_position& aim_rate ) const
+{
+    /* Get the aim at the start of the slew, and one aim period later with the same water velocity, to find the rate of change of the aim */
+    const double rate = get_water_rate ();
+    aim = calculate_aim ( project_tracked_user ( user, start ), rate );
+    const gun_position aim_ext = calculate_aim ( project_tracked_user ( user, start + aim_period ), rate );
+
+    /* If the user cannot be hit, return the maximum duration */
+    if ( aim.out_of_range || aim_ext.out_of_range || std::isnan ( aim.yaw ) ) return clock::duration::max ();
+
+    /* Get the aim rate */
+    aim_rate = gun_position { rate_of_change ( aim_ext.yaw - aim.yaw, aim_period ), rate_of_change ( aim_ext.pitch - aim.pitch, aim_period ) };
+
+    /* Work in the frame of the moving aim, so that the gun must come to rest relative to it. The velocity available in that frame is reduced by the aim rate.
+     * The acceleration varies with velocity, so estimate with the acceleration at half the maximum velocity.
+     */
+    const double yaw_time   = min_axis_time ( aim.yaw   - from.yaw,   yaw_rate   - aim_rate.yaw,   std::max ( max_yaw_velocity   - std::abs ( aim_rate.yaw   ), max_yaw_velocity   * 0.1 ), yaw_torque.acceleration_at   ( max_yaw_velocity   / 2. ) );
+    const double pitch_time = min_axis_time ( aim.pitch - from.pitch, pitch_rate - aim_rate.pitch, std::max ( max_pitch_velocity - std::abs ( aim_rate.pitch ), max_pitch_velocity * 0.1 ), pitch_torque.acceleration_at ( max_pitch_velocity / 2. ) );
+
+    /* The slew is complete once both axes are on target */
+    const double slew_time = std::max ( yaw_time, pitch_time );
+
+    /* Move the aim on to the end of the slew */
+    aim = gun_position { aim.yaw + aim_rate.yaw * slew_time, aim.pitch + aim_rate.pitch * slew_time };
+
+    /* Return the slew time */
+    return std::chrono::duration_cast<clock::duration> ( std::chrono::duration<double> { slew_time } );
+}
+
+
+
+/** @name  min_axis_time
+ * 
+ * @brief  Find the minimum time for a single axis to travel a displacement and come to rest, given velocity and acceleration limits.
+ * @param  displacement: The displacement to travel.
+ * @param  initial_rate: The initial velocity of the axis.
+ * @param  max_velocity: The maximum velocity of the axis.
+ * @param  max_acceleration: The maximum acceleration of the axis.
+ * @return The minimum time in seconds.
+ */
+double watergun::planner::min_axis_time ( double displacement, double initial_rate, const double max_velocity, const double max_acceleration ) noexcept
+{
+    /* Flip the problem so that the displacement is positive, and clamp the initial rate to the velocity limit */
+    if ( displacement < 0. ) { displacement = -displacement; initial_rate = -initial_rate; }
+    initial_rate = watergun::clamp ( initial_rate, -max_velocity, max_velocity );
+
+    /* If moving away from the target, or unable to stop before it, first come to rest and then solve from rest */
+    const double stopping_distance = initial_rate * std::abs ( initial_rate ) / ( 2. * max_acceleration );
+    if ( stopping_distance < 0. || stopping_distance > displacement ) return std::abs ( initial_rate ) / max_acceleration + min_axis_time ( displacement - stopping_distance, 0., max_velocity, max_acceleration );
+
+    /* Find the peak velocity of an accelerate-decelerate movement */
+    const double peak_rate = std::sqrt ( max_acceleration * displacement + initial_rate * initial_rate / 2. );
+
+    /* If the peak is within the velocity limit, there is no cruising phase */
+    if ( peak_rate <= max_velocity ) return ( 2. * peak_rate - initial_rate ) / max_acceleration;
+
+    /* Else accelerate to the velocity limit, cruise, then decelerate */
+    const double ramp_distance = ( max_velocity * max_velocity - initial_rate * initial_rate ) / ( 2. * max_acceleration ) + ( max_velocity * max_velocity ) / ( 2. * max_acceleration );
+    return ( 2. * max_velocity - initial_rate ) / max_acceleration + ( displacement - ramp_distance ) / max_velocity;
+}
+
+
+
+/** @name  solve_quadratic
+ * 
+ * @brief  Solves a quadratic equation with given coeficients in decreasing power order.
+ * @param  c0: The first coeficient (x^2).
+ * @param  c1: The first coeficient (x^1).
+ * @param  c2: The first coeficient (x^0).
+ * @return An array of two (possibly complex) solutions.
+ */
+std::array<std::complex<double>, 2> watergun::planner::solve_quadratic ( const std::complex<double>& c0, const std::complex<double>& c1, const std::complex<double>& c2 )
+{
+    const std::complex<double> sqrt_part = std::sqrt ( c1 * c1 - 4. * c0 * c2 );
+
+    return { ( -c1 + sqrt_part ) / ( 2. * c0 ), ( -c1 - sqrt_part ) / ( 2. * c0 ) };
+}
+
+
+
+/** @name  solve_quartic
+ * 
+ * @brief  Solves a quartic equation with given coeficients in decreasing power order.
+ *         Special thanks to Sidney Cadot (https://github.com/sidneycadot) for the function implementation.
+ * @param  c0: The first coeficient (x^4)...
+ * @param  c4: The last coeficient (x^0).
+ * @return Array of four (possibly complex) solutions.
+ */
+std::array<std::complex<double>, 4> watergun::planner::solve_quartic ( const std::complex<double>& c0, const std::complex<double>& c1, const std::complex<double>& c2, const std::complex<double>& c3, const std::complex<double>& c4 ) noexcept
+{
+    const std::complex<double> a = c0;
+    const std::complex<double> b = c1 / a;
+    const std::complex<double> c = c2 / a;
+    const std::complex<double> d = c3 / a;
+    const std::complex<double> e = c4 / a;
+
+    const std::complex<double> Q1 = c * c - 3. * b * d + 12. * e;
+    const std::complex<double> Q2 = 2. * c * c * c - 9. * b * c * d + 27. * d * d + 27. * b * b * e - 72. * c * e;
+    const std::complex<double> Q3 = 8. * b * c - 16. * d - 2. * b * b * b;
+    const std::complex<double> Q4 = 3. * b * b - 8. * c;
+
+    const std::complex<double> Q5 = std::pow ( Q2 / 2. + std::sqrt ( Q2 * Q2 / 4. - Q1 * Q1 * Q1 ), 1. / 3. );
+    const std::complex<double> Q6 = ( Q1 / Q5 + Q5 ) / 3.;
+    const std::complex<double> Q7 = 2. * std::sqrt ( Q4 / 12. + Q6 );
+
+    return
+    {
+        ( -b - Q7 - std::sqrt ( 4. * Q4 / 6. - 4. * Q6 - Q3 / Q7 ) ) / 4.,
+        ( -b - Q7 + std::sqrt ( 4. * Q4 / 6. - 4. * Q6 - Q3 / Q7 ) ) / 4.,
+        ( -b + Q7 - std::sqrt ( 4. * Q4 / 6. - 4. * Q6 + Q3 / Q7 ) ) / 4.,
+        ( -b + Q7 + std::sqrt ( 4. * Q4 / 6. - 4. * Q6 + Q3 / Q7 ) ) / 4.
+    };
+}
@@ -0,0 +1,24 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * src/watergun/planning_pool.cpp
+ * 
+ * Explicit instantiations of include/watergun/planning_pool.h
+ * 
+ */
+
+
+
+/* INCLUDES */
+#include <watergun/planning_pool.h>
+
+
+
+/* EXPLICIT INSTANTIATIONS */
+
+template class watergun::planning_pool<15>;
+template class watergun::planning_pool<30>;
+template class watergun::planning_pool<60>;
@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * src/watergun/pressure_model.cpp
+ * 
+ * Implementation of include/watergun/pressure_model.h
+ * 
+ */
+
+
+
+/* INCLUDES */
+#include <watergun/pressure_model.h>
+
+
+
+/* PRESSURE_MODEL IMPLEMENTATION */
+
+
+
+/** @name constructor
+ * 
+ * @brief Set up the model of a freshly filled reservoir, and start polling the pressure sensor if there is one.
+ * @param _pressure: The gauge pressure of the full reservoir in Pa.
+ * @param _air_volume: The volume of air in the full reservoir in m^3.
+ * @param _water_volume: The volume of water in the full reservoir in m^3.
+ * @param _nozzle_area: The cross-sectional area of the nozzle in m^2.
+ * @param _velocity_coefficient: The ratio of the real velocity of the water to that given by Bernoulli's equation, between 0 and 1.
+ * @param _low_pressure: The gauge pressure in Pa below which the pressure is considered low.
+ * @param _sensor_pin: The analog input pin of the pressure sensor, or -1 for not present.
+ * @param _sensor_scale: The gauge pressure in Pa per unit of sensor reading, where the reading is a fraction of full scale.
+ * @param _sensor_offset: The gauge pressure in Pa at a sensor reading of 0.
+ * @param _backend: The backend which provides the analog input. Defaults to default_gpio_backend.
+ * @throw watergun_exception, if a volume, area or coefficient is not positive, the pressure is negative, or the sensor cannot be set up.
+ */
+watergun::pressure_model::pressure_model ( const double _pressure, const double _air_volume, const double _water_volume, const double _nozzle_area, const double _velocity_coefficient, const double _low_pressure, const int _sensor_pin, const double _sensor_scale, const double _sensor_offset, gpio_backend& _backend ) try
+    : initial_pressure { _pressure }
+    , initial_air_volume { _air_volume }
+    , initial_water_volume { _water_volume }
+    , nozzle_area { _nozzle_area }
+    , velocity_coefficient { _velocity_coefficient }
+    , low_pressure { _low_pressure }
+    , sensor_scale { _sensor_scale }
+    , sensor_offset { _sensor_offset }
+{
+    /* Throw if the reservoir or nozzle is not physical */
+    if ( !( initial_pressure >= 0. ) ) throw watergun_exception { "Pressure model pressure cannot be negative" };
+    if ( !( initial_air_volume > 0. && initial_water_volume > 0. && nozzle_area > 0. ) ) throw watergun_exception { "Pressure model volumes and nozzle area must be positive" };
+    if ( !( velocity_coefficient > 0. && velocity_coefficient <= 1. ) ) throw watergun_exception { "Pressure model velocity coefficient must be between 0 and 1" };
+
+    /* Fill the reservoir */
+    refill ();
+
+    /* Initialize the sensor and start the thread, if there is a sensor */
+    if ( _sensor_pin >= 0 )
+    {
+        sensor = _backend.request_analog ( _sensor_pin );
+        sensor_thread = std::jthread { [ this ] ( std::stop_token stoken ) { sensor_thread_function ( std::move ( stoken ) ); } };
+    }
+} catch ( const std::exception& e )
+{
+    /* Rethrow, stating that pressure model setup failed */
+    throw watergun_exception { std::string { "Pressure model setup failed: " } + e.what () };
+}
+
+
+
+/** @name destructor
+ * 
+ * @brief Close and join the sensor thread.
+ */
+watergun::pressure_model::~pressure_model ()
+{
+    /* Join the thread */
+    if ( sensor_thread.joinable () ) { sensor_thread.request_stop (); sensor_thread.join (); }
+}
+
+
+
+/** @name  set_valve
+ * 
+ * @brief  Record that the valve opened or closed, integrating the model up to that time first.
+ * @param  open: True if the valve opened, false if it closed.
+ * @param  at: When water started or stopped leaving the nozzle.
+ * @return Nothing.
+ */
+void watergun::pressure_model::set_valve ( const bool open, const clock::time_point at )
+{
+    /* Aquire lock */
+    std::unique_lock<std::mutex> lock { model_mx };
+
+    /* Integrate with the valve as it was, then switch it */
+    integrate ( at );
+    valve_open = open;
+}
+
+
+
+/** @name  update
+ * 
+ * @brief  Integrate the model up to a time, publishing the new water rate and pressure. Times before the last update are ignored.
+ * @param  now: The time to integrate to. Defaults to now.
+ * @return Nothing.
+ */
+void watergun::pressure_model::update ( const clock::time_point now )
+{
+    /* Aquire lock */
+    std::unique_lock<std::mutex> lock { model_mx };
+
+    /* Integrate */
+    integrate ( now );
+}
+
+
+
+/** @name  refill
+ * 
+ * @brief  Reset the model to a freshly filled reservoir.
+ * @return Nothing.
+ */
+void watergun::pressure_model::refill ()
+{
+    /* Aquire lock */
+    std::unique_lock<std::mutex> lock { model_mx };
+
+    /* Restore the volumes and pressure of the full reservoir, and publish them */
+    air_volume = initial_air_volume; water_volume = initial_water_volume;
+    pressure_volume = ( initial_pressure + atmospheric_pressure ) * air_volume;
+    last_update = clock::now ();
+    publish ();
+}
+
+
+
+/** @name  get_state
+ * 
+ * @brief  Get a consistent snapshot of the model, as of the last update.
+ * @return The state.
+ */
+watergun::pressure_model::state watergun::pressure_model::get_state () const
+{
+    /* Aquire lock */
+    std::unique_lock<std::mutex> lock { model_mx };
+
+    /* Return the state */
+    return state { get_pressure (), get_water_rate (), water_volume, is_low () };
+}
+
+
+
+/** @name  integrate
+ * 
+ * @brief  Integrate the model up to a time. The model mutex should already be locked before this function is called.
+ * @param  now: The time to integrate to.
+ * @return Nothing.
+ */
+void watergun::pressure_model::integrate ( const clock::time_point now ) noexcept
+{
+    /* Ignore times before the last update */
+    if ( now <= last_update ) return;
+
+    /* While the valve is open, let water out through the nozzle one step at a time, so the air expands and the pressure falls */
+    if ( valve_open ) for ( clock::time_point t = last_update; t < now && water_volume > 0.; t += max_step )
+    {
+        const double gauge = pressure_volume / air_volume - atmospheric_pressure;
+        if ( gauge <= 0. ) break;
+        const double flow = std::min ( nozzle_area * velocity_coefficient * std::sqrt ( 2. * gauge / water_density ) * std::chrono::duration<double> { std::min ( max_step, now - t ) }.count (), water_volume );
+        air_volume += flow; water_volume -= flow;
+    }
+
+    /* Record the update and publish the new state */
+    last_update = now;
+    publish ();
+}
+
+
+
+/** @name  publish
+ * 
+ * @brief  Publish the water rate, pressure and low flag of the model. The model mutex should already be locked before this function is called.
+ * @return Nothing.
+ */
+void watergun::pressure_model::publish () noexcept
+{
+    /* Find the gauge pressure, which water only leaves the nozzle above */
+    const double gauge = std::max ( pressure_volume / air_volume - atmospheric_pressure, 0. );
+
+    /* Publish the pressure, the velocity of the water given by Bernoulli's equation, and whether firing should be rationed */
+    pressure.store ( gauge, std::memory_order_relaxed );
+    water_rate.store ( water_volume > 0. ? velocity_coefficient * std::sqrt ( 2. * gauge / water_density ) : 0., std::memory_order_relaxed );
+    low.store ( gauge < low_pressure || water_volume <= 0., std::memory_order_relaxed );
+}
+
+
+
+/** @name  sensor_thread_function
+ * 
+ * @brief  The function which the sensor thread runs to correct the modelled pressure to the sensor readings.
+ * @param  stoken: The stop token for the jthread.
+ * @return Nothing.
+ */
+void watergun::pressure_model::sensor_thread_function ( std::stop_token stoken )
+{
+    /* Loop while the stop token is unset, reading the sensor every sensor period */
+    for ( clock::time_point read_time = clock::now (); !stoken.stop_requested (); read_time += sensor_period )
+    {
+        /* Read the sensor without the lock, since it may be slow */
+        const double reading = std::max ( sensor_offset + sensor_scale * sensor->read (), 0. );
+
+        /* Aquire lock */
+        std::unique_lock<std::mutex> lock { model_mx };
+
+        /* Bring the model up to date, then correct the pressure to the reading, keeping the volume of air */
+        integrate ( clock::now () );
+        pressure_volume = ( reading + atmospheric_pressure ) * air_volume;
+        publish ();
+
+        /* Wait until the next reading, waking only to stop */
+        sensor_cv.wait_until ( lock, stoken, read_time + sensor_period, [] { return false; } );
+    }
+}
@@ -0,0 +1,222 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * src/watergun/realtime.cpp
+ * 
+ * Implementation of include/watergun/realtime.h
+ * 
+ */
+
+
+
+/* INCLUDES */
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+#include <watergun/realtime.h>
+
+
+
+/* PROFILE STORAGE */
+
+namespace
+{
+    /* The enabled profile, and whether it has been enabled */
+    watergun::realtime_profile enabled_profile;
+    std::atomic<bool> profile_enabled { false };
+
+    /** @name  apply_role_settings
+     * 
+     * @brief  Apply scheduling settings to the calling thread.
+     * @param  settings: The settings to apply.
+     * @return Zero on success, or the error number of the first failure.
+     */
+    int apply_role_settings ( const watergun::realtime_profile::role_settings& settings ) noexcept
+    {
+        /* Set the scheduling policy and priority */
+        if ( settings.priority > 0 )
+        {
+            sched_param param {}; param.sched_priority = settings.priority;
+            if ( const int error = pthread_setschedparam ( pthread_self (), SCHED_FIFO, &param ) ) return error;
+        }
+
+        /* Pin to a CPU */
+        if ( settings.cpu >= 0 )
+        {
+            cpu_set_t cpus; CPU_ZERO ( &cpus ); CPU_SET ( settings.cpu, &cpus );
+            if ( const int error = pthread_setaffinity_np ( pthread_self (), sizeof ( cpus ), &cpus ) ) return error;
+        }
+
+        /* Success */
+        return 0;
+    }
+
+    /** @name  prefault_stack
+     * 
+     * @brief  Touch each page of a block of stack so that it is mapped, and so locked if memory is locked, recursing to reach deeper blocks.
+     * @param  size: The number of bytes of stack to touch.
+     * @return The value of the touched bytes, so that they are not optimized away.
+     */
+    [[gnu::noinline]] int prefault_stack ( const std::size_t size ) noexcept
+    {
+        /* Touch each page of this block */
+        constexpr std::size_t block_size = 16 * 1024;
+        volatile unsigned char block [ block_size ];
+        for ( std::size_t i = 0; i < block_size; i += 4096 ) block [ i ] = 0;
+
+        /* Recurse for the rest of the stack */
+        return block [ 0 ] + ( size > block_size ? prefault_stack ( size - block_size ) : 0 );
+    }
+}
+
+
+
+/* REALTIME_PROFILE IMPLEMENTATION */
+
+
+
+/** @name  settings
+ * 
+ * @brief  Get the settings for a role.
+ * @param  role: The role.
+ * @return The settings.
+ */
+const watergun::realtime_profile::role_settings& watergun::realtime_profile::settings ( const thread_role role ) const noexcept
+{
+    /* Switch on the role */
+    switch ( role )
+    {
+        case thread_role::stepper:         return stepper;
+        case thread_role::actuator:        return actuator;
+        case thread_role::tracker:         return tracker;
+        case thread_role::planner:         return planner;
+        case thread_role::planning_worker: default: return planning_worker;
+    }
+}
+
+
+
+/* REALTIME FUNCTION IMPLEMENTATIONS */
+
+
+
+/** @name  enable_realtime_profile
+ * 
+ * @brief  Enable a real-time profile for the process, then check which parts of it can be applied.
+ *         This should be called before any watergun objects are constructed, since threads only take on the profile as they start.
+ *         Without calling this function, all threads run with default scheduling.
+ * @param  profile: The profile to enable.
+ * @return A report of which parts of the profile could be applied.
+ */
+watergun::realtime_report watergun::enable_realtime_profile ( const realtime_profile& profile )
+{
+    /* Store the profile */
+    enabled_profile = profile;
+    profile_enabled.store ( true, std::memory_order_release );
+
+    /* The report */
+    realtime_report report { false, false, false, {} };
+
+    /* Lock memory */
+    if ( !profile.lock_memory ) report.description += "Memory locking: not requested\n";
+    else if ( mlockall ( MCL_CURRENT | MCL_FUTURE ) == 0 ) { report.memory_locked = true; report.description += "Memory locking: applied\n"; }
+    else report.description += std::string { "Memory locking: failed (" } + std::strerror ( errno ) + ")\n";
+
+    /* Find the highest requested priority and check that it is in range */
+    int max_priority = 0;
+    for ( const thread_role role : { thread_role::stepper, thread_role::actuator, thread_role::tracker, thread_role::planner, thread_role::planning_worker } )
+        max_priority = std::max ( max_priority, profile.settings ( role ).priority );
+    if ( max_priority == 0 ) report.description += "SCHED_FIFO: not requested\n";
+    else if ( max_priority > sched_get_priority_max ( SCHED_FIFO ) ) report.description += "SCHED_FIFO: failed (priority " + std::to_string ( max_priority ) + " out of range)\n";
+    else
+    {
+        /* Probe whether the priority is permitted on a short lived thread */
+        int error = 0; std::thread { [ & ] { error = apply_role_settings ( { max_priority, -1 } ); } }.join ();
+        report.fifo_scheduling = ( error == 0 );
+        report.description += ( error == 0 ? std::string { "SCHED_FIFO: applied\n" } : std::string { "SCHED_FIFO: failed (" } + std::strerror ( error ) + ")\n" );
+    }
+
+    /* Check that every requested CPU exists */
+    const int num_cpus = static_cast<int> ( std::thread::hardware_concurrency () );
+    bool any_pinned = false; report.cpu_affinity = true;
+    for ( const thread_role role : { thread_role::stepper, thread_role::actuator, thread_role::tracker, thread_role::planner, thread_role::planning_worker } )
+    {
+        const int cpu = profile.settings ( role ).cpu;
+        any_pinned |= ( cpu >= 0 );
+        if ( cpu >= num_cpus ) report.cpu_affinity = false;
+    }
+    if ( !any_pinned ) report.description += "CPU affinity: not requested\n";
+    else report.description += ( report.cpu_affinity ? std::string { "CPU affinity: applied\n" } : "CPU affinity: failed (only " + std::to_string ( num_cpus ) + " CPUs)\n" );
+
+    /* Return the report */
+    return report;
+}
+
+
+
+/** @name  enter_realtime_role
+ * 
+ * @brief  Apply the scheduling settings of a role to the calling thread, and prefault its stack.
+ *         Does nothing if no real-time profile has been enabled.
+ * @param  role: The role of the calling thread.
+ * @return True if the settings were applied, or there is no profile to apply, false otherwise.
+ */
+bool watergun::enter_realtime_role ( const thread_role role ) noexcept
+{
+    /* Do nothing if there is no profile */
+    if ( !profile_enabled.load ( std::memory_order_acquire ) ) return true;
+
+    /* Prefault the stack */
+    prefault_stack ( enabled_profile.prefault_stack_size );
+
+    /* Apply the settings */
+    return apply_role_settings ( enabled_profile.settings ( role ) ) == 0;
+}
+
+
+
+/** @name  sleep_until_monotonic
+ * 
+ * @brief  Sleep until an absolute time on the monotonic clock, using clock_nanosleep, so that periodic work does not drift.
+ * @param  deadline: The time to sleep until.
+ * @return Nothing.
+ */
+void watergun::sleep_until_monotonic ( const monotonic_clock::time_point deadline ) noexcept
+{
+    /* Convert the deadline to a timespec */
+    const auto since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds> ( deadline.time_since_epoch () ).count ();
+    const timespec deadline_ts { static_cast<time_t> ( since_epoch / 1000000000 ), static_cast<long> ( since_epoch % 1000000000 ) };
+
+    /* Sleep, resuming if interrupted by a signal */
+    while ( clock_nanosleep ( CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline_ts, nullptr ) == EINTR );
+}
+
+
+
+/** @name  sleep_then_spin_until_monotonic
+ * 
+ * @brief  Wait until an absolute time on the monotonic clock, sleeping with clock_nanosleep until shortly before, then spinning on the clock.
+ *         Spinning avoids the wake up latency of the scheduler, which is far larger than the precision needed to time step pulses.
+ * @param  deadline: The time to wait until.
+ * @param  spin_window: How long before the deadline to stop sleeping and start spinning. Waits shorter than this do not sleep at all.
+ * @return The time at which the deadline was seen to have passed.
+ */
+watergun::monotonic_clock::time_point watergun::sleep_then_spin_until_monotonic ( const monotonic_clock::time_point deadline, const monotonic_clock::duration spin_window ) noexcept
+{
+    /* Sleep until the start of the spin window, if it is in the future */
+    monotonic_clock::time_point now = monotonic_clock::now ();
+    if ( deadline - now > spin_window ) { sleep_until_monotonic ( deadline - spin_window ); now = monotonic_clock::now (); }
+
+    /* Spin until the deadline has passed */
+    while ( now < deadline ) now = monotonic_clock::now ();
+    return now;
+}
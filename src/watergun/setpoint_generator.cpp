@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * src/watergun/setpoint_generator.cpp
+ * 
+ * Implementation of include/watergun/setpoint_generator.h
+ * 
+ */
+
+
+
+/* INCLUDES */
+#include <watergun/setpoint_generator.h>
+
+
+
+/* SETPOINT_GENERATOR IMPLEMENTATION */
+
+
+
+/** @name constructor
+ * 
+ * @brief Reserve space for plans.
+ * @param max_movements: The largest number of movements in a plan to reserve space for.
+ */
+watergun::setpoint_generator::setpoint_generator ( const std::size_t max_movements )
+{
+    /* Reserve the start offsets */
+    starts.reserve ( max_movements );
+}
+
+
+
+/** @name  load
+ * 
+ * @brief  Load a new plan, which starts at offset zero.
+ * @param  plan: The plan of movements. The reference must remain valid until another plan is loaded.
+ * @param  start_yaw_rate: The yaw velocity at the start of the plan, which is ramped from into the first movement.
+ * @param  start_pitch: The pitch at the start of the plan.
+ * @return Nothing.
+ */
+void watergun::setpoint_generator::load ( const std::vector<single_movement>& _plan, const double _start_yaw_rate, const double _start_pitch )
+{
+    /* Store the plan and starting state */
+    plan = &_plan; start_yaw_rate = _start_yaw_rate; start_pitch = _start_pitch;
+
+    /* Find the start offset of each movement */
+    starts.clear (); clock::duration start = clock::duration::zero ();
+    for ( const single_movement& movement : _plan ) { starts.push_back ( start ); start += movement.duration; }
+}
+
+
+
+/** @name  at
+ * 
+ * @brief  Get the setpoints at an offset from the start of the plan.
+ * @param  offset: The time since the start of the plan.
+ * @return The setpoints.
+ */
+watergun::setpoint_generator::setpoint watergun::setpoint_generator::at ( const clock::duration offset ) const noexcept
+{
+    /* If there is no plan, hold the starting state */
+    if ( empty () ) return setpoint { start_yaw_rate, start_pitch, 0 };
+
+    /* Find the movement which the offset lies in, holding the last movement past the end of the plan */
+    const std::size_t i = std::max<std::ptrdiff_t> ( std::upper_bound ( starts.begin (), starts.end (), offset ) - starts.begin () - 1, 0 );
+    const single_movement& movement = ( * plan ) [ i ];
+    const double elapsed = duration_to_seconds ( offset - starts [ i ] ).count (), duration = duration_to_seconds ( movement.duration ).count ();
+
+    /* Interpolate the pitch across the movement */
+    const double previous_pitch = ( i == 0 ? start_pitch : ( * plan ) [ i - 1 ].ending_pitch );
+    const double pitch = ( duration > 0. ? previous_pitch + ( movement.ending_pitch - previous_pitch ) * std::clamp ( elapsed / duration, 0., 1. ) : movement.ending_pitch );
+
+    /* The first movement ramps from the starting rate, reaching its own rate half way through, so that the velocity is continuous from the start of the plan */
+    const bool first_half = ( elapsed < duration / 2. );
+    if ( i == 0 && first_half ) return setpoint { start_yaw_rate + ( movement.yaw_rate - start_yaw_rate ) * elapsed / ( duration / 2. ), pitch, i };
+
+    /* Find the yaw rates and durations either side of the nearest boundary */
+    double before_rate, after_rate, before_duration, after_duration, boundary_offset;
+    if ( first_half )
+    {
+        before_rate = ( * plan ) [ i - 1 ].yaw_rate; before_duration = duration_to_seconds ( ( * plan ) [ i - 1 ].duration ).count ();
+        after_rate = movement.yaw_rate; after_duration = duration;
+        boundary_offset = elapsed;
+    } else if ( i + 1 < plan->size () )
+    {
+        before_rate = movement.yaw_rate; before_duration = duration;
+        after_rate = ( * plan ) [ i + 1 ].yaw_rate; after_duration = duration_to_seconds ( ( * plan ) [ i + 1 ].duration ).count ();
+        boundary_offset = elapsed - duration;
+    } else return setpoint { movement.yaw_rate, pitch, i };
+
+    /* Ramp linearly across a window centred on the boundary, which is the shorter of the two movements long */
+    const double half_window = std::min ( before_duration, after_duration ) / 2.;
+    const double fraction = ( half_window > 0. ? std::clamp ( ( boundary_offset + half_window ) / ( half_window * 2. ), 0., 1. ) : 1. );
+    return setpoint { before_rate + ( after_rate - before_rate ) * fraction, pitch, i };
+}
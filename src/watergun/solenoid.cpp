@@ -25,15 +25,12 @@
  * 
  * @brief Give a pin number to set up the solenoid
  * @param _solenoid_pin: The pin number to use for the solenoid.
+ * @param backend: The backend which provides the GPIO line. Defaults to default_gpio_backend.
  */
-watergun::solenoid::solenoid ( const int _solenoid_pin ) try
+watergun::solenoid::solenoid ( const int _solenoid_pin, gpio_backend& backend ) try
     : solenoid_pin { _solenoid_pin }
-    , solenoid_gpio { solenoid_pin }
-{
-    /* Set the pin to output, and off */
-    solenoid_gpio.dir ( mraa::DIR_OUT );
-    solenoid_gpio.write ( 0 );
-} catch ( const std::exception& e )
+    , solenoid_line { backend.request_outputs ( { solenoid_pin } ) }
+{} catch ( const std::exception& e )
 {
     /* Rethrow, stating that solenoid setup failed */
     throw watergun_exception { std::string { "Solenoid setup failed: " } + e.what () };
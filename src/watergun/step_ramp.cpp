@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * src/watergun/step_ramp.cpp
+ * 
+ * Implementation of include/watergun/step_ramp.h
+ * 
+ */
+
+
+
+/* INCLUDES */
+#include <watergun/step_ramp.h>
+
+
+
+/* STEP_RAMP IMPLEMENTATION */
+
+
+
+/** @name constructor
+ * 
+ * @brief Precompute the table of step intervals.
+ * @param _microstep_size: The angle of a single step in radians.
+ * @param max_velocity: The maximum angular velocity in rad/sec.
+ * @param torque: The torque curve, giving the maximum angular acceleration in rad/sec^2 at each velocity.
+ * @param max_jerk: The maximum angular jerk in rad/sec^3, or 0 for unlimited jerk.
+ * @param min_interval: The minimum interval between steps.
+ * @throw watergun_exception, if the step size or velocity is not positive, the torque curve cannot accelerate at the maximum velocity, or the jerk is negative.
+ */
+watergun::step_ramp::step_ramp ( const double _microstep_size, const double max_velocity, const torque_curve& torque, const double max_jerk, const std::chrono::nanoseconds min_interval )
+    : step_angle { _microstep_size }
+{
+    /* Throw if the parameters are out of range */
+    if ( !( step_angle > 0. ) || !( max_velocity > 0. ) ) throw watergun_exception { "Step ramp step size and velocity must be positive" };
+    if ( !( torque.acceleration_at ( max_velocity ) > 0. ) ) throw watergun_exception { "Step ramp torque curve must be able to accelerate at the maximum velocity" };
+    if ( !( max_jerk >= 0. ) ) throw watergun_exception { "Step ramp jerk cannot be negative" };
+
+    /* Convert a time in seconds to an interval in nanoseconds, saturating at the largest interval */
+    auto to_interval = [] ( const double seconds ) -> std::uint64_t
+        { return std::llround ( std::min ( seconds * 1e9, static_cast<double> ( std::numeric_limits<interval_type>::max () ) ) ); };
+
+    /* Get the cruising interval, which is the shortest in the table */
+    const std::uint64_t cruise_interval = std::max<std::uint64_t> ( { to_interval ( step_angle / max_velocity ), static_cast<std::uint64_t> ( min_interval.count () ), 1 } );
+
+    /* If the torque falls with velocity, integrate the motion one step at a time, holding the acceleration constant over each step.
+     * The acceleration of each step is limited by the torque curve at the velocity the step starts at. With jerk limiting, it is also limited by how far
+     * it can have ramped up since the last step, and by how far it can ramp down before reaching the maximum velocity. The first step then follows the jerk alone.
+     */
+    if ( !torque.flat () )
+    {
+        double velocity = 0., acceleration = 0., step_time = 0.;
+        if ( max_jerk > 0. )
+        {
+            step_time = std::cbrt ( 6. * step_angle / max_jerk );
+            velocity = std::min ( max_jerk * step_time * step_time / 2., max_velocity ); acceleration = std::min ( max_jerk * step_time, torque.max_acceleration () );
+            intervals.push_back ( std::max ( to_interval ( step_time ), cruise_interval ) );
+        }
+        while ( intervals.empty () || intervals.back () > cruise_interval )
+        {
+            double limit = torque.acceleration_at ( velocity );
+            if ( max_jerk > 0. ) limit = std::min ( { limit, acceleration + max_jerk * step_time, std::sqrt ( 2. * max_jerk * ( max_velocity - velocity ) ) } );
+            acceleration = limit;
+            const double next_velocity = std::min ( std::sqrt ( velocity * velocity + 2. * acceleration * step_angle ), max_velocity );
+            step_time = ( next_velocity > velocity ? 2. * step_angle / ( velocity + next_velocity ) : step_angle / max_velocity );
+            intervals.push_back ( std::max ( to_interval ( step_time ), cruise_interval ) );
+            velocity = next_velocity;
+        }
+        return;
+    }
+
+    /* Otherwise the acceleration is the same at every velocity */
+    const double max_acceleration = torque.max_acceleration ();
+
+    /* Without jerk limiting, use the integer recurrence c_n = c_n-1 - 2 c_n-1 / ( 4n + 1 ), carrying the remainder of the division to the next step.
+     * The first interval is scaled by 0.676 to correct the error the recurrence's approximation makes at the start of the ramp.
+     */
+    if ( max_jerk == 0. )
+    {
+        std::uint64_t interval = to_interval ( 0.676 * std::sqrt ( 2. * step_angle / max_acceleration ) ), remainder = 0;
+        for ( std::uint64_t n = 1; interval > cruise_interval; ++n )
+        {
+            intervals.push_back ( interval );
+            const std::uint64_t numerator = 2 * interval + remainder, denominator = 4 * n + 1;
+            interval -= numerator / denominator; remainder = numerator % denominator;
+        }
+        intervals.push_back ( cruise_interval );
+        return;
+    }
+
+    /* With jerk limiting, the acceleration ramps up linearly, holds at its maximum, then ramps down linearly to reach the maximum velocity.
+     * If the maximum velocity is too low to reach the maximum acceleration, the acceleration peaks early and is never held.
+     */
+    const double peak_acceleration = std::min ( max_acceleration, std::sqrt ( max_velocity * max_jerk ) );
+    const double jerk_time = peak_acceleration / max_jerk, hold_time = ( max_velocity - peak_acceleration * jerk_time ) / peak_acceleration;
+    const double jerk_velocity = max_jerk * jerk_time * jerk_time / 2., jerk_angle = max_jerk * jerk_time * jerk_time * jerk_time / 6.;
+    const double hold_velocity = jerk_velocity + peak_acceleration * hold_time, hold_angle = jerk_angle + jerk_velocity * hold_time + peak_acceleration * hold_time * hold_time / 2.;
+    const double ramp_time = jerk_time * 2. + hold_time, ramp_angle = max_velocity * ramp_time / 2.;
+
+    /* The angle moved through at a time during the ramp */
+    auto angle_at = [ & ] ( const double t )
+    {
+        if ( t <= jerk_time ) return max_jerk * t * t * t / 6.;
+        if ( t <= jerk_time + hold_time ) { const double dt = t - jerk_time; return jerk_angle + jerk_velocity * dt + peak_acceleration * dt * dt / 2.; }
+        const double dt = std::min ( t, ramp_time ) - jerk_time - hold_time;
+        return hold_angle + hold_velocity * dt + peak_acceleration * dt * dt / 2. - max_jerk * dt * dt * dt / 6.;
+    };
+
+    /* Solve for the time of each step during the ramp by bisection, and store the intervals between them */
+    double step_time = 0.;
+    for ( std::size_t i = 1; i * step_angle <= ramp_angle; ++i )
+    {
+        double lower = step_time, upper = ramp_time;
+        for ( int j = 0; j < 64; ++j ) { const double middle = ( lower + upper ) / 2.; if ( angle_at ( middle ) < i * step_angle ) lower = middle; else upper = middle; }
+        intervals.push_back ( std::max ( to_interval ( upper - step_time ), cruise_interval ) );
+        step_time = upper;
+    }
+    intervals.push_back ( cruise_interval );
+}
+
+
+
+/** @name  level_for_velocity
+ * 
+ * @brief  Find the lowest level of the ramp at which the motor moves at least as fast as a velocity.
+ *         The level is the number of intervals walked up the table, and a motor cruising at level k waits the interval at index k - 1 between steps.
+ * @param  velocity: The angular velocity in rad/sec.
+ * @return The level, which is between one and the size of the table.
+ */
+std::size_t watergun::step_ramp::level_for_velocity ( const double velocity ) const noexcept
+{
+    /* Find the first interval which is at most the interval for the velocity. The table is non-increasing, so binary search. */
+    const double target = step_angle / velocity * 1e9;
+    const auto match = std::partition_point ( intervals.begin (), intervals.end (), [ target ] ( const interval_type interval ) { return interval > target; } );
+    return std::clamp<std::size_t> ( match - intervals.begin () + 1, 1, intervals.size () );
+}
+
+
+
+/* STEP_GENERATOR IMPLEMENTATION */
+
+
+
+/** @name  retarget
+ * 
+ * @brief  Change the number of steps remaining and the cruising level. The ramp can only be changed while at rest.
+ * @param  _ramp: The ramp to follow, which must remain valid until the motion has finished.
+ * @param  _remaining: The signed number of steps to the new target from the current position.
+ * @param  _cruise_level: The level on the ramp to cruise at, which is clamped to the ramp.
+ * @return Nothing.
+ */
+void watergun::step_generator::retarget ( const step_ramp& _ramp, const std::int64_t _remaining, const std::size_t _cruise_level ) noexcept
+{
+    /* Change the ramp only if at rest, then set the remaining steps and cruising level */
+    if ( at_rest () ) ramp = &_ramp;
+    remaining = _remaining;
+    cruise_level = std::clamp<std::size_t> ( _cruise_level, 1, ramp->size () );
+}
+
+
+
+/** @name  change_ramp
+ * 
+ * @brief  Change to a different ramp mid-motion, such as one for a different step size, moving to the level of the new ramp with the same velocity.
+ * @param  _ramp: The ramp to follow, which must remain valid until the motion has finished.
+ * @param  _remaining: The signed number of steps of the new ramp to the target from the current position.
+ * @param  _cruise_level: The level on the new ramp to cruise at, which is clamped to the ramp.
+ * @return Nothing.
+ */
+void watergun::step_generator::change_ramp ( const step_ramp& _ramp, const std::int64_t _remaining, const std::size_t _cruise_level ) noexcept
+{
+    /* If moving, find the level of the new ramp with the velocity of the current level */
+    if ( level > 0 ) level = _ramp.level_for_velocity ( ramp->microstep_size () * 1e9 / ( * ramp ) [ level - 1 ] );
+
+    /* Change the ramp, remaining steps and cruising level */
+    ramp = &_ramp;
+    remaining = _remaining;
+    cruise_level = std::clamp<std::size_t> ( _cruise_level, 1, ramp->size () );
+}
+
+
+
+/** @name  next
+ * 
+ * @brief  Get the next step to make, updating the state of the motion as though it has been made. Should only be called while moving.
+ * @return The step.
+ */
+watergun::step_generator::step watergun::step_generator::next () noexcept
+{
+    /* If at rest, head towards the target */
+    if ( level == 0 ) direction = ( remaining < 0 ? -1 : 1 );
+
+    /* Make the step, and find how many steps remain ahead in the direction of travel, which is negative if the target is behind */
+    remaining -= direction;
+    const std::int64_t ahead = remaining * direction;
+
+    /* If there is room to stop, walk towards the cruising level, otherwise walk down the ramp to stop */
+    step_ramp::interval_type interval;
+    if ( ahead > static_cast<std::int64_t> ( level ) )
+    {
+        if ( level < cruise_level ) interval = ( * ramp ) [ level++ ]; else
+        if ( level > cruise_level ) interval = ( * ramp ) [ --level ]; else
+        interval = ( * ramp ) [ level - 1 ];
+    } else interval = ( level > 0 ? ( * ramp ) [ --level ] : ( * ramp ) [ 0 ] );
+
+    /* Return the step, with no interval if the motion has finished */
+    return step { direction, moving () ? interval : 0 };
+}
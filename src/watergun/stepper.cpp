@@ -32,9 +32,11 @@
  * @param _microstep_pin_1: The second pin for microstepping control, or -1 for always off, or -2 for always on.
  * @param _microstep_pin_2: The third pin for microstepping control, or -1 for always off, or -2 for always on.
  * @param _sleep_pin: The pin number for motor sleep control, or -1 for not present.
+ * @param gpio_step: True if the step pin is controlled by GPIO, so is requested along with the other control pins.
+ * @param _backend: The backend which provides the GPIO lines.
  */
-watergun::stepper_base::stepper_base ( const double _step_size, const double _min_step_freq, const int _step_pin, const int _dir_pin, const int _microstep_pin_0, const int _microstep_pin_1, const int _microstep_pin_2, const int _sleep_pin ) try
-    : step_size { step_size }
+watergun::stepper_base::stepper_base ( const double _step_size, const double _min_step_freq, const int _step_pin, const int _dir_pin, const int _microstep_pin_0, const int _microstep_pin_1, const int _microstep_pin_2, const int _sleep_pin, const bool gpio_step, gpio_backend& _backend ) try
+    : step_size { _step_size }
     , min_step_freq { _min_step_freq }
     , step_pin { _step_pin }
     , dir_pin { _dir_pin }
@@ -42,14 +44,15 @@ watergun::stepper_base::stepper_base ( const double _step_size, const double _mi
     , microstep_pin_1 { _microstep_pin_1 }
     , microstep_pin_2 { _microstep_pin_2 }
     , sleep_pin { _sleep_pin }
+    , backend { _backend }
 {
-    /* Open pins and consider the implications of each pin number being -1 */
-    if ( step_pin <  0 ) throw watergun_exception { "Stepper step pin cannot be always off" };
-    if ( dir_pin  >= 0 ) dir_gpio = create_output_gpio ( dir_pin ); else throw watergun_exception { "Stepper dir pin cannot be always off" };
-    if ( microstep_pin_2 >= 0 ) microstep_gpio_2 = create_output_gpio ( microstep_pin_2 );
-    if ( microstep_pin_1 >= 0 ) microstep_gpio_1 = create_output_gpio ( microstep_pin_1 );
-    if ( microstep_pin_0 >= 0 ) microstep_gpio_0 = create_output_gpio ( microstep_pin_0 );
-    if ( sleep_pin >= 0 ) sleep_gpio = create_output_gpio ( sleep_pin );
+    /* Consider the implications of each pin number being -1 */
+    if ( step_pin < 0 ) throw watergun_exception { "Stepper step pin cannot be always off" };
+    if ( dir_pin  < 0 ) throw watergun_exception { "Stepper dir pin cannot be always off" };
+
+    /* Request all of the control lines together, in the order of their control bits, leaving out pins which are always off or on */
+    auto line = [] ( const int pin ) { return pin >= 0 ? pin : -1; };
+    control_lines = backend.request_outputs ( { gpio_step ? step_pin : -1, dir_pin, line ( microstep_pin_0 ), line ( microstep_pin_1 ), line ( microstep_pin_2 ), line ( sleep_pin ) } );
 
     /* Sort out availible microstepping numbers */
     if ( microstep_pin_0 == -1 ) availible_microstep_numbers.remove_if ( [] ( int m ) { return  m & 1; } ); else
@@ -89,110 +92,82 @@ int watergun::stepper_base::choose_microstep_number ( const double velocity ) co
 
 
 
-/** @name  disable_motor
+/** @name  choose_microstep_number
  * 
- * @brief  Put the motor tp sleep and turn off all direction and microstepping pins.
- * @return Nothing.
+ * @brief  Choose the best microstep number for a given angular velocity, keeping the current microstep number unless the velocity
+ *         is outside of its band by more than the hysteresis, so that a velocity near the edge of a band does not keep changing the microstep number.
+ * @param  velocity: The angular velocity to choose based on.
+ * @param  current: The current microstep number, or -1 for none.
+ * @return The microstep number (one of availible_microstep_numbers).
  */
-void watergun::stepper_base::disable_motor ()
+int watergun::stepper_base::choose_microstep_number ( const double velocity, const int current ) const
 {
-    /* Set the sleep pin to on */
-    if ( sleep_gpio.isValid () && !sleep_state ) sleep_gpio.write ( sleep_state = 1 );
-
-    /* Disable all microstepping pins */
-    if ( microstep_gpio_0.isValid () && microstep_state_0 ) microstep_gpio_0.write ( microstep_state_0 = 0 );
-    if ( microstep_gpio_1.isValid () && microstep_state_1 ) microstep_gpio_1.write ( microstep_state_1 = 0 );
-    if ( microstep_gpio_2.isValid () && microstep_state_2 ) microstep_gpio_2.write ( microstep_state_2 = 0 );
+    /* Find the best microstep numbers for the velocity widened either side by the hysteresis. A faster velocity gives a coarser number. */
+    const int coarsest = choose_microstep_number ( velocity * ( 1. + microstep_hysteresis ) );
+    const int finest   = choose_microstep_number ( velocity / ( 1. + microstep_hysteresis ) );
 
-    /* Set the direction pin to off */
-    if ( dir_state ) dir_gpio.write ( dir_state = 0 );
-} 
+    /* Keep the current number if it lies between them, otherwise choose the best number for the velocity */
+    return ( current >= coarsest && current <= finest ? current : choose_microstep_number ( velocity ) );
+}
 
 
 
-/** @name  enable_motor
+/** @name  advance_phase
  * 
- * @brief  Take the motor out of sleep, and set up the microstepping and direction pins.
- * @param  microstep_number: The microstep number to use.
- * @param  direction: True for clockwise, false for anticlockwise.
- * @return Nothing.
+ * @brief  Advance an indexer phase by the steps which make up an angle.
+ * @param  phase: The indexer phase before the steps.
+ * @param  angle: The change in angle the steps caused (negative for anti-clockwise).
+ * @return The indexer phase after the steps, wrapped into an electrical cycle.
  */
-void watergun::stepper_base::enable_motor ( const int microstep_number, const bool direction )
+int watergun::stepper_base::advance_phase ( const int phase, const double angle ) const noexcept
 {
-    /* Set the sleep pin to off */
-    if ( sleep_gpio.isValid () && sleep_state ) sleep_gpio.write ( sleep_state = 0 );
-
-    /* Set the microstep pin values */
-    if ( microstep_gpio_0.isValid () && microstep_state_0 != microstep_number & 1 ) microstep_gpio_0.write ( microstep_state_0 = microstep_number & 1 );
-    if ( microstep_gpio_1.isValid () && microstep_state_1 != microstep_number & 2 ) microstep_gpio_1.write ( microstep_state_1 = microstep_number & 2 );
-    if ( microstep_gpio_2.isValid () && microstep_state_2 != microstep_number & 4 ) microstep_gpio_2.write ( microstep_state_2 = microstep_number & 4 );
-
-    /* Set the direction pin */
-    if ( dir_state != !direction ) dir_gpio.write ( dir_state = !direction );
+    /* Convert the angle to the finest microsteps, and wrap the phase into an electrical cycle */
+    return ( ( phase + static_cast<int> ( std::lround ( angle / step_size * indexer_resolution ) % indexer_cycle ) ) % indexer_cycle + indexer_cycle ) % indexer_cycle;
 }
 
 
 
-/** @name  create_pwm
+/** @name  disable_motor
  * 
- * @brief  Create a PWM pin
- * @param  pin: The pin to create the PWM object on.
- * @return The PWM object.
+ * @brief  Put the motor tp sleep and turn off all direction and microstepping pins.
+ * @return Nothing.
  */
-mraa::Pwm watergun::stepper_base::create_pwm ( const int pin )
+void watergun::stepper_base::disable_motor ()
 {
-    /* Create object from pin number */
-    mraa::Pwm pwm { pin };
-    
-    /* Disable the pin, and set the duty cycle to a half */
-    pwm.enable ( false );
-    pwm.write ( 0.5 );
-    
-    /* Return the object */
-    return pwm;
+    /* Set the sleep pin to on, and all of the other pins to off */
+    write_control_lines ( sleep_bit );
 }
 
 
 
-/** @name  create_output_gpio
+/** @name  enable_motor
  * 
- * @brief  Create an output GPIO pin.
- * @param  pin: The pin to create the GPIO object on.
- * @return The GPIO object.
+ * @brief  Take the motor out of sleep, and set up the microstepping and direction pins.
+ * @param  microstep_number: The microstep number to use.
+ * @param  direction: True for clockwise, false for anticlockwise.
+ * @return Nothing.
  */
-mraa::Gpio watergun::stepper_base::create_output_gpio ( const int pin )
+void watergun::stepper_base::enable_motor ( const int microstep_number, const bool direction )
 {
-    /* Create object from the pin number */
-    mraa::Gpio gpio { pin };
-
-    /* Set to output and write a 0 */
-    gpio.dir ( mraa::DIR_OUT );
-    gpio.write ( 0 );
+    /* Remember the microstep number */
+    active_microstep_number = microstep_number;
 
-    /* Return the object */
-    return gpio;
+    /* Set the sleep pin to off, and the microstep and direction pins, all with one update. The step pin is left as it is. */
+    write_control_lines ( ( control_state & step_bit ) | ( microstep_number & 1 ? microstep_bit_0 : 0 ) | ( microstep_number & 2 ? microstep_bit_1 : 0 ) | ( microstep_number & 4 ? microstep_bit_2 : 0 ) | ( direction ? 0 : dir_bit ) );
 }
 
 
 
-/** @name  create_input_gpio
+/** @name  write_control_lines
  * 
- * @brief  Create an input GPIO pin.
- * @param  pin: The pin to create the GPIO object on.
- * @param  mode: False for pull down, true for pull up.
- * @return The GPIO object.
+ * @brief  Write any control lines which have changed, with a single update.
+ * @param  values: The values of the control lines, as a mask of control_bits.
+ * @return Nothing.
  */
-mraa::Gpio watergun::stepper_base::create_input_gpio ( const int pin, const bool mode )
+void watergun::stepper_base::write_control_lines ( const std::uint32_t values )
 {
-    /* Create object from the pin number */
-    mraa::Gpio gpio { pin };
-
-    /* Set to input and set pull up/down mode */
-    gpio.dir ( mraa::Dir::DIR_IN );
-    gpio.mode ( mode ? mraa::MODE_PULLUP : mraa::MODE_PULLDOWN );
-
-    /* Return the object */
-    return gpio;
+    /* Write only if something has changed */
+    if ( values != control_state ) { control_lines->write ( values, values ^ control_state ); control_state = values; }
 }
 
 
@@ -206,18 +181,36 @@ mraa::Gpio watergun::stepper_base::create_input_gpio ( const int pin, const bool
  * @brief Set the motor stepping angle, controlling GPIO pins and min step frequency.
  * @param _step_size: The number of radians per whole step of the motor.
  * @param _min_step_freq: The minimum step frequency before microstepping is increased.
+ * @param _max_velocity: The maximum motor velocity.
+ * @param _torque: The torque curve of the motor, giving the maximum acceleration at each velocity. A constant acceleration converts to a flat curve.
+ * @param _update_frequency: The frequency at which the PWM period is updated while ramping.
  * @param _step_pin: The pin number for the step control.
  * @param _dir_pin: The pin number for direction control.
  * @param _microstep_pin_0: The first pin for microstepping control, or -1 for always off, or -2 for always on.
  * @param _microstep_pin_1: The second pin for microstepping control, or -1 for always off, or -2 for always on.
  * @param _microstep_pin_2: The third pin for microstepping control, or -1 for always off, or -2 for always on.
  * @param _sleep_pin: The pin number for motor sleep control, or -1 for not present.
+ * @param _position_pin: The pin number which provides stepper positioning capabilities, or -1 for not present.
+ * @param _backend: The backend which provides the GPIO lines and PWM outputs. Defaults to default_gpio_backend.
  */
-watergun::pwm_stepper::pwm_stepper ( const double _step_size, const double _min_step_freq, const int _step_pin, const int _dir_pin, const int _microstep_pin_0, const int _microstep_pin_1, const int _microstep_pin_2, const int _sleep_pin ) try
-    : stepper_base { _step_size, _min_step_freq, _step_pin, _dir_pin, _microstep_pin_0, _microstep_pin_1, _microstep_pin_2, _sleep_pin }
+watergun::pwm_stepper::pwm_stepper ( const double _step_size, const double _min_step_freq, const double _max_velocity, const torque_curve& _torque, const double _update_frequency, const int _step_pin, const int _dir_pin, const int _microstep_pin_0, const int _microstep_pin_1, const int _microstep_pin_2, const int _sleep_pin, const int _position_pin, gpio_backend& _backend ) try
+    : stepper_base { _step_size, _min_step_freq, _step_pin, _dir_pin, _microstep_pin_0, _microstep_pin_1, _microstep_pin_2, _sleep_pin, false, _backend }
+    , position_pin { _position_pin }
+    , max_velocity { _max_velocity }
+    , torque { _torque }
+    , update_period { std::chrono::duration_cast<clock::duration> ( std::chrono::duration<double> { 1. / _update_frequency } ) }
+    , odometry { odometry_size }
 {
-    /* Initialize the PWM pin */
-    step_pwm = create_pwm ( step_pin );
+    /* Throw if the limits or update frequency are not positive, or the motor cannot accelerate at its maximum velocity */
+    if ( !( max_velocity > 0. && _update_frequency > 0. ) ) throw watergun_exception { "PWM stepper maximum velocity and update frequency must be positive" };
+    if ( !( torque.acceleration_at ( max_velocity ) > 0. ) ) throw watergun_exception { "PWM stepper torque curve must be able to accelerate at the maximum velocity" };
+
+    /* Initialize the PWM output, and the position line if present */
+    step_pwm = backend.request_pwm ( step_pin );
+    if ( position_pin >= 0 ) position_line = backend.request_input ( position_pin, true );
+
+    /* Start the thread */
+    ramp_thread = std::jthread { [ this ] ( std::stop_token stoken ) { ramp_thread_function ( std::move ( stoken ) ); } };
 } catch ( const std::exception& e )
 {
     /* Rethrow, stating that stepper motor setup failed */
@@ -238,35 +231,284 @@ watergun::stepper_base::~stepper_base ()
 
 
 
+/** @name destructor
+ * 
+ * @brief Close and join the ramp thread, and stop the PWM output.
+ */
+watergun::pwm_stepper::~pwm_stepper ()
+{
+    /* Join the thread, then stop the PWM output */
+    if ( ramp_thread.joinable () ) { ramp_thread.request_stop (); ramp_thread.join (); }
+    step_pwm->enable ( false );
+}
+
+
+
 /** @name  set_velocity
  * 
- * @brief  Set a new rotation velocity.
- * @param  velocity: The new angular velocity in rad/sec, positive meaning clockwise and vice versa.
+ * @brief  Set a new rotation velocity, which the motor ramps to as fast as the acceleration limit allows.
+ * @param  velocity: The new angular velocity in rad/sec, positive meaning clockwise and vice versa, which is limited by the maximum velocity.
+ * @return Nothing.
+ */
+void watergun::pwm_stepper::set_velocity ( const double velocity )
+{
+    /* Aquire lock */
+    std::unique_lock<std::mutex> lock { ramp_mx };
+
+    /* Set the target, ramping only limited by the acceleration limit, and end any coordinated movement */
+    target_velocity = std::clamp ( velocity, -max_velocity, max_velocity );
+    ramp_acceleration = std::numeric_limits<double>::infinity ();
+    segment_end = clock::time_point {};
+
+    /* Notify and return */
+    ramp_cv.notify_all ();
+}
+
+
+
+/** @name  calibrate_position
+ * 
+ * @brief  Use the position pin to calibrate the position of the stepper, by rotating slowly until the pin activates, then stopping.
+ *         If the pin does not activate within the maximum travel or the timeout of the settings, the motor is stopped uncalibrated.
+ * @param  angle: The angle at which the position pin will activate.
+ * @param  direction: The direction the motor should move in to hit the position pin. True for clockwise, false for anti-clockwise.
+ * @param  config: The homing settings, of which only the slow velocity, maximum travel and timeout are used.
+ * @throw  watergun_exception, if there is no position pin, the settings are invalid, or the pin does not activate within the maximum travel or the timeout.
+ * @return Nothing.
+ */
+void watergun::pwm_stepper::calibrate_position ( const double angle, const bool direction, const homing_config& config )
+{
+    /* Throw if there is no position pin, or the settings are invalid */
+    if ( position_pin < 0 ) throw watergun_exception { "PWM stepper cannot calibrate without a position pin" };
+    if ( !( config.slow_velocity > 0. && config.max_travel > 0. ) || config.timeout.count () <= 0 )
+        throw watergun_exception { "PWM stepper homing velocity, max travel and timeout must be positive" };
+
+    /* Discard any edges from before calibration started */
+    gpio_input_line::edge_event edge { clock::now (), true };
+    while ( position_line->wait_edge ( clock::duration::zero (), edge ) );
+
+    /* Rotate at the slow homing velocity, though no slower than the minimum step frequency of the smallest microstep, so that the motor overshoots the pin by as little as possible */
+    const double velocity = std::max ( config.slow_velocity, step_size / std::exp2 ( availible_microstep_numbers.back () ) * min_step_freq );
+    const clock::time_point start = clock::now ();
+    set_velocity ( direction ? velocity : -velocity );
+
+    /* Wait for the position pin to activate, then stop. The activation is timestamped by the backend when the edge happened, rather than when it was noticed.
+     * Between edges, stop and give up if the motor has travelled too far or homing has taken too long, so that a missing pin cannot leave the motor running.
+     */
+    edge.timestamp = start;
+    if ( position_line->read () == 0 ) while ( !position_line->wait_edge ( std::chrono::milliseconds { 100 }, edge ) || !edge.rising )
+    {
+        const clock::time_point now = clock::now ();
+        if ( std::abs ( get_rotation ( start, now ) ) > config.max_travel ) { set_velocity ( 0. ); throw watergun_exception { "PWM stepper homing failed: exceeded the maximum travel" }; }
+        if ( now - start > config.timeout ) { set_velocity ( 0. ); throw watergun_exception { "PWM stepper homing failed: timed out" }; }
+    }
+    const clock::time_point activated = edge.timestamp;
+    set_velocity ( 0. );
+
+    /* Offset the odometry so that the angle when the pin activated is the calibrated angle */
+    std::unique_lock<std::mutex> lock { odometry_mx };
+    position_offset = angle - odometry.value_at ( activated );
+}
+
+
+
+/** @name  begin_segment
+ * 
+ * @brief  Begin a segment of a coordinated movement. The angle is added to whatever previous segments did not make, according to the odometry.
+ *         The velocity ramps over the first half of the segment, then cruises at the velocity which makes the angle owed, limited by the maximum velocity.
+ *         If the acceleration limit makes the ramp take longer, or a segment is missed, the difference is carried into later segments. If no segment follows, the motor stops. Should not be mixed with set_velocity.
+ * @param  angle: The change in angle over the segment, positive meaning clockwise.
+ * @param  duration: The duration of the segment.
+ * @return Zero, since the PWM times its own steps.
+ */
+std::uint64_t watergun::pwm_stepper::begin_segment ( const double angle, const clock::duration duration )
+{
+    /* Stop as fast as possible if the segment has no duration */
+    if ( duration.count () <= 0 ) { set_velocity ( 0. ); return 0; }
+
+    /* Aquire lock */
+    std::unique_lock<std::mutex> lock { ramp_mx };
+
+    /* Ramp linearly over the first half of the segment and cruise for the second, so the angle made is a quarter of the duration at the current velocity, plus three quarters at the cruise velocity */
+    const clock::time_point now = clock::now ();
+    const double duration_s = std::chrono::duration<double> { duration }.count ();
+
+    /* If the last segment ended more than a segment ago, the movement was interrupted, so start owing afresh.
+     * The velocity the motor still has was written off along with the movement, so credit the quarter segment it contributes rather than compensating for it, which plans the segment as if from rest.
+     * Otherwise take off how far the motor turned since the last segment began, so that what is owed is what the segments asked for less what the motor really made.
+     */
+    if ( now - segment_end > duration ) segment_residual = commanded_velocity * duration_s / 4.; else
+    {
+        std::unique_lock<std::mutex> odometry_lock { odometry_mx };
+        segment_residual -= odometry.delta ( segment_start, now );
+    }
+    segment_residual += angle; segment_start = now; segment_end = now + duration;
+
+    /* Choose the cruise velocity which makes the angle owed, and the acceleration which reaches it halfway through the segment */
+    target_velocity = std::clamp ( ( segment_residual * 4. / duration_s - commanded_velocity ) / 3., -max_velocity, max_velocity );
+    ramp_acceleration = std::abs ( target_velocity - commanded_velocity ) / ( duration_s / 2. );
+
+    /* Notify and return */
+    ramp_cv.notify_all ();
+    return 0;
+}
+
+
+
+/** @name  get_position
+ * 
+ * @brief  Estimate the angle of the motor at a point in time, from the step rates which have been commanded.
+ *         The estimate is relative to the last calibration, or the angle at construction if never calibrated.
+ * @param  timestamp: The point in time. Defaults to now.
+ * @return The angle in radians.
+ */
+double watergun::pwm_stepper::get_position ( const clock::time_point timestamp ) const
+{
+    /* Lock the mutex and integrate the odometry */
+    std::unique_lock<std::mutex> lock { odometry_mx };
+    return odometry.value_at ( timestamp ) + position_offset;
+}
+
+
+
+/** @name  get_rotation
+ * 
+ * @brief  Estimate the change in angle of the motor between two points in time, from the step rates which have been commanded.
+ * @param  from: The first point in time.
+ * @param  to: The second point in time.
+ * @return The change in angle in radians, positive meaning clockwise.
+ */
+double watergun::pwm_stepper::get_rotation ( const clock::time_point from, const clock::time_point to ) const
+{
+    /* Lock the mutex and integrate the odometry */
+    std::unique_lock<std::mutex> lock { odometry_mx };
+    return odometry.delta ( from, to );
+}
+
+
+
+/** @name  acceleration_limit
+ * 
+ * @brief  Find the acceleration which the torque of the motor allows at a velocity.
+ * @param  velocity: The angular velocity in rad/sec.
+ * @return The acceleration in rad/sec^2.
+ */
+double watergun::pwm_stepper::acceleration_limit ( const double velocity ) const noexcept
+{
+    /* Look up the velocity on the torque curve, which can accelerate at any velocity up to the maximum */
+    return torque.acceleration_at ( std::min ( std::abs ( velocity ), max_velocity ) );
+}
+
+
+
+/** @name  apply_velocity
+ * 
+ * @brief  Program the PWM output and control lines for a velocity, writing nothing if the period, direction and microstepping would not change.
+ *         The ramp mutex should already be locked before this function is called.
+ * @param  velocity: The angular velocity in rad/sec, positive meaning clockwise and vice versa.
  * @return Nothing.
  */
-void watergun::pwm_stepper::set_velocity ( double velocity )
+void watergun::pwm_stepper::apply_velocity ( const double velocity )
 {
-    /* If the velocity is 0, disable the motor and the PWM pin, and return */
-    if ( velocity == 0. ) { disable_motor (); step_pwm.enable ( false ); return; }
+    /* If the velocity is 0, stop the PWM pin and record that the motor has stopped. Only put the motor to sleep once it is meant to stay stopped, rather than passing through zero. */
+    if ( velocity == 0. )
+    {
+        if ( target_velocity == 0. ) disable_motor ();
+        if ( step_state == 0. ) return;
+        step_pwm->enable ( false );
+        step_state = 0.;
+        std::unique_lock<std::mutex> lock { odometry_mx };
+        odometry.push ( clock::now (), 0. );
+        return;
+    }
 
-    /* Get the microstep number to keep the PWM frequency over the minimum */
-    int microstep_number = choose_microstep_number ( velocity );
+    /* Get the microstep number to keep the PWM frequency over the minimum, only changing it once the velocity is clearly outside of the current number's band */
+    const int microstep_number = choose_microstep_number ( velocity, active_microstep_number );
 
     /* Get the microstep size */
-    double microstep_size = step_size / std::exp2 ( microstep_number );
+    const double microstep_size = step_size / std::exp2 ( microstep_number );
 
-    /* Get the PWM period */
-    double pwm_period = microstep_size / std::abs ( velocity ); 
+    /* Get the PWM period, rounded to the whole microseconds which the PWM pin can produce, and signed by the direction */
+    const int pwm_period_us = static_cast<int> ( std::clamp<double> ( std::round ( microstep_size / std::abs ( velocity ) * 1e6 ), 1., std::numeric_limits<int>::max () ) );
+    const double pwm_period = pwm_period_us * 1e-6;
+    const double new_step_state = std::copysign ( pwm_period, velocity );
 
-    /* Only change motor settings if period has changed */
-    if ( pwm_period != step_state )
+    /* Only change motor settings if the period, direction or microstepping has changed */
+    if ( new_step_state == step_state && microstep_number == active_microstep_number ) return;
+
+    /* Note whether the motor is asleep, then enable it, which only writes the control lines which change */
+    const bool waking = asleep ();
+    enable_motor ( microstep_number, velocity > 0. );
+
+    /* Set the PWM period if it has changed, and start the PWM pin if it was stopped */
+    if ( pwm_period != std::abs ( step_state ) ) step_pwm->set_period_us ( pwm_period_us );
+    if ( step_state == 0. ) step_pwm->enable ( true );
+    step_state = new_step_state;
+
+    /* Record the velocity which the rounded period really produces, starting once the driver has woken if it was asleep */
+    std::unique_lock<std::mutex> lock { odometry_mx };
+    odometry.push ( clock::now () + ( waking ? wake_up_time : clock::duration::zero () ), microstep_size / new_step_state );
+}
+
+
+
+/** @name  stop_after_segment
+ * 
+ * @brief  Set the target velocity to zero if the last segment of a coordinated movement has ended, since otherwise the motor would cruise on indefinitely.
+ *         The end of the segment is kept, so that a segment which begins shortly after still carries on the movement. The ramp mutex must be held.
+ * @return Nothing.
+ */
+void watergun::pwm_stepper::stop_after_segment ()
+{
+    /* Stop, limited only by the acceleration limit, if a segment has ended and the motor is not already stopping */
+    if ( segment_end != clock::time_point {} && target_velocity != 0. && clock::now () >= segment_end )
+        { target_velocity = 0.; ramp_acceleration = std::numeric_limits<double>::infinity (); }
+}
+
+
+
+/** @name  ramp_thread_function
+ * 
+ * @brief  The function which the ramp thread runs to ramp the velocity towards its target.
+ * @param  stoken: The stop token for the jthread.
+ * @return Nothing.
+ */
+void watergun::pwm_stepper::ramp_thread_function ( std::stop_token stoken )
+{
+    /* Take on the stepper real-time role */
+    enter_realtime_role ( thread_role::stepper );
+
+    /* Create a lock on the mutex */
+    std::unique_lock<std::mutex> lock { ramp_mx };
+
+    /* Loop while the stop token is unset */
+    while ( !stoken.stop_requested () )
     {
-        /* Enable the motor */
-        enable_motor ( microstep_number, velocity > 0. );
+        /* If the last segment of a coordinated movement has ended without another beginning, stop as fast as the torque allows, rather than cruising on */
+        stop_after_segment ();
 
-        /* Set the PWM pin */
-        step_pwm.period ( pwm_period );
-        step_pwm.enable ( true );
+        /* If at the target, make sure it has been applied, then wait for a new one, or for the current segment to end */
+        if ( commanded_velocity == target_velocity )
+        {
+            apply_velocity ( commanded_velocity );
+            if ( segment_end == clock::time_point {} || target_velocity == 0. ) ramp_cv.wait ( lock, stoken, [ this ] { return commanded_velocity != target_velocity; } );
+            else ramp_cv.wait_until ( lock, stoken, segment_end, [ this ] { return commanded_velocity != target_velocity; } );
+            continue;
+        }
+
+        /* Ramp towards the target, one update at a time, until it is reached. Each update is scheduled from when the last was due, and a new target is picked up at the next update. */
+        for ( clock::time_point update_time = clock::now (); commanded_velocity != target_velocity && !stoken.stop_requested (); update_time += update_period )
+        {
+            /* Stop if the segment has ended, then change the velocity by at most what the ramp and the torque allow over an update period, and apply it */
+            stop_after_segment ();
+            const double max_change = std::min ( ramp_acceleration, acceleration_limit ( commanded_velocity ) ) * std::chrono::duration<double> { update_period }.count ();
+            const double change = target_velocity - commanded_velocity;
+            commanded_velocity = ( std::abs ( change ) <= max_change ? target_velocity : commanded_velocity + std::copysign ( max_change, change ) );
+            apply_velocity ( commanded_velocity );
+
+            /* Wait until the next update, waking only to stop */
+            ramp_cv.wait_until ( lock, stoken, update_time + update_period, [] { return false; } );
+        }
     }
 }
 
@@ -282,6 +524,8 @@ void watergun::pwm_stepper::set_velocity ( double velocity )
  * @param _step_size: The number of radians per whole step of the motor.
  * @param _min_step_freq: The minimum PWM frequency before microstepping is increased.
  * @param _max_velocity: The maximum motor velocity.
+ * @param _torque: The torque curve of the motor, giving the maximum acceleration at each velocity. A constant acceleration converts to a flat curve.
+ * @param _max_jerk: The maximum motor jerk, or 0 for unlimited jerk.
  * @param _step_pin: The pin number for the step control.
  * @param _dir_pin: The pin number for direction control.
  * @param _microstep_pin_0: The first pin for microstepping control, or -1 for always off, or -2 for always on.
@@ -289,15 +533,22 @@ void watergun::pwm_stepper::set_velocity ( double velocity )
  * @param _microstep_pin_2: The third pin for microstepping control, or -1 for always off, or -2 for always on.
  * @param _sleep_pin: The pin number for motor sleep control, or -1 for not present.
  * @param _position_pin: The pin number which provides stepper positioning capabilities, or -1 for not present.
+ * @param _backend: The backend which provides the GPIO lines and PWM outputs. Defaults to default_gpio_backend.
  */
-watergun::gpio_stepper::gpio_stepper ( const double _step_size, const double _min_step_freq, const double _max_velocity, const int _step_pin, const int _dir_pin, const int _microstep_pin_0, const int _microstep_pin_1, const int _microstep_pin_2, const int _sleep_pin, const int _position_pin ) try
-    : stepper_base { _step_size, _min_step_freq, _step_pin, _dir_pin, _microstep_pin_0, _microstep_pin_1, _microstep_pin_2, _sleep_pin }
-    , max_velocity { _max_velocity }
+watergun::gpio_stepper::gpio_stepper ( const double _step_size, const double _min_step_freq, const double _max_velocity, const torque_curve& _torque, const double _max_jerk, const int _step_pin, const int _dir_pin, const int _microstep_pin_0, const int _microstep_pin_1, const int _microstep_pin_2, const int _sleep_pin, const int _position_pin, gpio_backend& _backend ) try
+    : stepper_base { _step_size, _min_step_freq, _step_pin, _dir_pin, _microstep_pin_0, _microstep_pin_1, _microstep_pin_2, _sleep_pin, true, _backend }
     , position_pin { _position_pin }
+    , max_velocity { _max_velocity }
+    , max_jerk { _max_jerk }
+    , torque { _torque }
 {
-    /* Initialize the step and position GPIOs */
-    step_gpio = create_output_gpio ( step_pin );
-    position_gpio = create_input_gpio ( position_pin, true );
+    /* Initialize the position line if present. The step line was requested along with the other control lines. */
+    if ( position_pin >= 0 ) position_line = backend.request_input ( position_pin, true );
+
+    /* Precompute the acceleration ramp for each microstep number, so that each step only costs a table lookup */
+    const auto min_interval = std::chrono::duration_cast<std::chrono::nanoseconds> ( std::chrono::duration<double> { min_step_period } );
+    for ( const int microstep_number : availible_microstep_numbers )
+        ramps.try_emplace ( microstep_number, step_size / std::exp2 ( microstep_number ), max_velocity, torque, max_jerk, min_interval );
 
     /* Start the thread */
     stepper_thread = std::jthread { [ this ] ( std::stop_token stoken ) { stepper_thread_function ( std::move ( stoken ) ); } };
@@ -348,47 +599,284 @@ void watergun::gpio_stepper::set_position ( const double angle, const clock::dur
 
 
 
+/** @name  render_segment
+ * 
+ * @brief  Render the next segment of a movement into a waveform ahead of time, which the stepper thread plays back immediately after the previous segment.
+ *         The movement carries on from where the last segment left off, so consecutive segments play as one continuous movement.
+ *         Should only be called by a single thread, and not mixed with set_position.
+ * @param  angle: The desired finishing angle.
+ * @param  duration: The duration of the segment.
+ * @return True if the segment was rendered, or false if the previous segment has not yet started playing, in which case it should be retried later.
+ */
+bool watergun::gpio_stepper::render_segment ( const double angle, const clock::duration duration )
+{
+    /* If duration is negative, throw */
+    if ( duration.count () < 0 ) throw watergun_exception { "GPIO stepper segment duration cannot be negative" };
+
+    /* Return if the previous segment is still waiting to be played */
+    if ( waveform_handoff.pending () ) return false;
+
+    /* Calculate the velocity to cruise at, which is the maximum velocity if the duration is zero */
+    double velocity = std::abs ( rate_of_change ( angle - rendered_angle, duration ) );
+    if ( !( velocity <= max_velocity ) ) velocity = max_velocity;
+
+    /* Choose the microstepping number, with hysteresis, which the renderer can only change while at rest, and only once the indexer is aligned for it */
+    int microstep_number = renderer.get_microstep_number ();
+    if ( renderer.at_rest () )
+    {
+        const int desired_microstep_number = ( velocity > 0. ? choose_microstep_number ( velocity, microstep_number ) : microstep_number );
+        if ( !ramps.contains ( microstep_number ) || microstep_aligned ( rendered_phase, desired_microstep_number ) ) microstep_number = desired_microstep_number;
+    }
+    if ( !ramps.contains ( microstep_number ) ) microstep_number = availible_microstep_numbers.back ();
+
+    /* Retarget along the ramp for the microstep number */
+    const step_ramp& ramp = ramps.at ( microstep_number );
+    renderer.retarget ( ramp, microstep_number, std::llround ( ( angle - rendered_angle ) / ramp.microstep_size () ), ramp.level_for_velocity ( velocity ) );
+
+    /* Render the segment and publish it */
+    renderer.render ( waveform_handoff.back (), duration, pulse_width );
+    rendered_angle += waveform_handoff.back ().get_net_angle ();
+    rendered_phase = advance_phase ( rendered_phase, waveform_handoff.back ().get_net_angle () );
+    waveform_handoff.publish ();
+
+    /* Notify the stepper thread, locking the mutex so that the notification cannot be missed, and return */
+    { std::unique_lock<std::mutex> lock { stepper_mx }; }
+    stepper_cv.notify_all ();
+    return true;
+}
+
+
+
 /** @name  calibrate_position
  * 
- * @brief  Use the position pin to calibrate the position of the stepper.
+ * @brief  Use the position pin to calibrate the position of the stepper, by homing in two phases on the stepper thread, which stays responsive throughout.
+ *         The motor approaches the pin quickly along its ramp, backs off, then approaches again slowly at the finest microstepping, calibrating the angle where the pin activates.
+ *         The motor is then returned to that angle. Targets set during homing are only followed once it has finished. Should not be mixed with render_segment or begin_segment.
  * @param  angle: The angle at which the position pin will activate.
  * @param  direction: The direction the motor should move in to hit the position pin. True for clockwise, false for anti-clockwise.
+ * @param  config: The homing settings.
+ * @throw  watergun_exception, if there is no position pin, the settings are invalid, or the pin does not activate within the maximum travel or the timeout.
+ * @return How repeatable homing was.
+ */
+watergun::homing_result watergun::gpio_stepper::calibrate_position ( const double angle, const bool direction, const homing_config& config )
+{
+    /* Throw if there is no position pin, or the settings are invalid */
+    if ( position_pin < 0 ) throw watergun_exception { "GPIO stepper cannot calibrate without a position pin" };
+    if ( !( config.fast_velocity > 0. && config.slow_velocity > 0. && config.back_off > 0. && config.max_travel > 0. ) || config.timeout.count () <= 0 )
+        throw watergun_exception { "GPIO stepper homing velocities, back off, max travel and timeout must be positive" };
+
+    /* Aquire lock */
+    std::unique_lock<std::mutex> lock { stepper_mx };
+
+    /* Request homing from the stepper thread, and wait for it to finish */
+    homing_angle = angle;
+    homing_direction = direction;
+    homing_settings = config;
+    new_homing = true;
+    homing_finished = false;
+    stepper_cv.notify_all ();
+    stepper_cv.wait ( lock, [ this ] { return homing_finished; } );
+
+    /* Throw if homing failed, otherwise return the outcome */
+    if ( !homing_error.empty () ) throw watergun_exception { "GPIO stepper homing failed: " + homing_error };
+    return homing_outcome;
+}
+
+
+
+/** @name  begin_segment
+ * 
+ * @brief  Begin a segment of a coordinated movement. The angle is added to whatever could not be made in whole steps in previous segments,
+ *         and is limited by the maximum velocity, with the remainder carried into later segments. The microstep number is chosen for the velocity of the segment,
+ *         with hysteresis, and only changed once the indexer is aligned for it. Should not be mixed with set_position or render_segment.
+ * @param  angle: The change in angle over the segment, positive meaning clockwise.
+ * @param  duration: The duration of the segment.
+ * @return The number of steps for the executor to clock over the segment.
+ */
+std::uint64_t watergun::gpio_stepper::begin_segment ( const double angle, const clock::duration duration )
+{
+    /* Aquire lock */
+    std::unique_lock<std::mutex> lock { stepper_mx };
+
+    /* Add the angle to what is still owed, and limit the angle of this segment by the maximum velocity */
+    segment_residual += angle;
+    const double max_angle = max_velocity * std::chrono::duration<double> { duration }.count ();
+    const double segment_angle = std::clamp ( segment_residual, -max_angle, max_angle );
+
+    /* Choose the microstep number for the velocity of the segment, changing only once the indexer is aligned for it */
+    if ( segment_angle != 0. )
+    {
+        const int desired_microstep_number = choose_microstep_number ( std::abs ( rate_of_change ( segment_angle, duration ) ), segment_microstep_number );
+        if ( microstep_aligned ( indexer_phase, desired_microstep_number ) ) segment_microstep_number = desired_microstep_number;
+    }
+
+    /* Find the whole number of steps towards the angle, and carry the rest */
+    const double microstep_size = ramps.at ( segment_microstep_number ).microstep_size ();
+    const std::int64_t steps = static_cast<std::int64_t> ( segment_angle / microstep_size );
+    segment_residual -= steps * microstep_size;
+    segment_step_size = std::copysign ( microstep_size, segment_angle );
+
+    /* Enable the motor if there are steps to make, and return the number of steps */
+    if ( steps != 0 ) enable_motor ( segment_microstep_number, steps > 0 );
+    return std::abs ( steps );
+}
+
+
+
+/** @name  segment_step
+ * 
+ * @brief  Make the next step of the current segment.
  * @return Nothing.
  */
-void watergun::gpio_stepper::calibrate_position ( const double angle, const bool direction )
+void watergun::gpio_stepper::segment_step ()
 {
-    /* Create a lock on the mutex */
+    /* Aquire lock and make the step. If the angle was corrected at the position pin, owe the correction to later segments. */
     std::unique_lock<std::mutex> lock { stepper_mx };
+    segment_residual -= make_step ( segment_step_size );
+}
 
-    /* Enable the motor to the maximum microstep number */
-    enable_motor ( availible_microstep_numbers.back (), direction );
 
-    /* While high, make a step */
-    while ( position_gpio.read () == 0 ) make_step ( step_size * std::exp2 ( availible_microstep_numbers.back () ) );
 
-    /* Set the angle */
-    current_angle = angle;
+/** @name  get_position
+ * 
+ * @brief  Get the angle of the motor from the steps which have been made.
+ * @return The angle in radians.
+ */
+double watergun::gpio_stepper::get_position () const
+{
+    /* Aquire lock and return the angle */
+    std::unique_lock<std::mutex> lock { stepper_mx };
+    return current_angle;
+}
+
+
+
+/** @name  get_index_corrections
+ * 
+ * @brief  Get the remembered corrections made when passing the position pin in normal operation, oldest first.
+ * @return Vector of corrections.
+ */
+std::vector<watergun::index_correction> watergun::gpio_stepper::get_index_corrections () const
+{
+    /* Aquire lock and copy out the log in order */
+    std::unique_lock<std::mutex> lock { stepper_mx };
+    std::vector<index_correction> corrections; corrections.reserve ( index_log.size () );
+    for ( std::size_t i = 0; i < index_log.size (); ++i ) corrections.push_back ( index_log [ i ] );
+    return corrections;
+}
+
+
+
+/** @name  get_accumulated_index_error
+ * 
+ * @brief  Get the total of the corrections applied when passing the position pin since the last calibration, which is the net number of steps missed in radians.
+ * @return The angle in radians.
+ */
+double watergun::gpio_stepper::get_accumulated_index_error () const
+{
+    /* Aquire lock and return the total */
+    std::unique_lock<std::mutex> lock { stepper_mx };
+    return accumulated_index_error;
 }
 
 
 
 /** @name  make_step
  * 
- * @brief  Makes a single step assuming the motor has been previously enabled then modifies the current angle.
+ * @brief  Makes a single step pulse, spinning for the pulse width, assuming the motor has been previously enabled, then modifies the current angle.
+ *         If the position pin activated since the last step, the angle is corrected.
  *         The stepper mutex should already be locked before this function is called.
  * @param  microstep_size: The change in angle the step causes (negative for anti-clockwise)
+ * @return The correction made to the current angle, or 0 if none was made.
+ */
+double watergun::gpio_stepper::make_step ( const double microstep_size )
+{
+    /* Turn on the step GPIO, spin for the pulse width, then turn it back off.
+     * The pulse is far shorter than the scheduler's wake up latency, so sleeping would only lengthen it, and the time until the next step is left to the caller.
+     */
+    const clock::time_point pulse_start = clock::now ();
+    write_control_lines ( control_state | step_bit );
+    sleep_then_spin_until_monotonic ( pulse_start + pulse_width, spin_window );
+    write_control_lines ( control_state & ~step_bit );
+
+    /* Modify the current angle and indexer phase */
+    current_angle += microstep_size;
+    indexer_phase = advance_phase ( indexer_phase, microstep_size );
+
+    /* Correct the angle if the position pin has been passed */
+    return correct_at_index ( pulse_start, microstep_size );
+}
+
+
+
+/** @name  correct_at_index
+ * 
+ * @brief  Take the edges of the position pin since the last step, and if the pin activated while moving in the direction it was calibrated in, correct the current angle.
+ *         The stepper mutex should already be locked before this function is called.
+ * @param  step_time: When the step which was just made started.
+ * @param  microstep_size: The change in angle the step caused.
+ * @return The correction made to the current angle, or 0 if none was made.
+ */
+double watergun::gpio_stepper::correct_at_index ( const clock::time_point step_time, const double microstep_size )
+{
+    /* Return if there is no position line */
+    if ( !position_line ) return 0.;
+
+    /* Take each edge without waiting. Edges from before the previous step are stale, and edges are ignored while homing or moving against the direction of calibration. */
+    double correction = 0.;
+    gpio_input_line::edge_event edge;
+    while ( position_line->wait_edge ( clock::duration::zero (), edge ) )
+    {
+        if ( !edge.rising || !calibrated || homing != homing_phase::idle || edge.timestamp < last_step_time || ( microstep_size > 0. ) != homing_direction ) continue;
+
+        /* The pin activated at the angle before this step if it activated before the step was made, and the error is how far that was from the calibrated angle */
+        const double index_angle = ( edge.timestamp < step_time ? current_angle - microstep_size : current_angle );
+        const double error = homing_angle - index_angle;
+
+        /* Errors smaller than a step are only the resolution of the microstepping in use, so are ignored. Otherwise correct the angle if the error is small enough. */
+        if ( std::abs ( error ) < std::abs ( microstep_size ) ) continue;
+        const bool applied = std::abs ( error ) <= homing_settings.max_index_correction;
+        if ( applied ) { current_angle += error; correction += error; accumulated_index_error += error; }
+
+        /* Record the correction, dropping the oldest once the log is full */
+        index_log.push_back ( index_correction { edge.timestamp, error, applied } );
+    }
+
+    /* Remember when this step was made, and return the correction */
+    last_step_time = step_time;
+    return correction;
+}
+
+
+
+/** @name  play_waveforms
+ * 
+ * @brief  Play rendered waveforms back to back, until there are none left pending.
+ *         The stepper mutex should already be locked before this function is called, and is unlocked during playback.
+ * @param  lock: The lock on the stepper mutex.
+ * @param  stoken: The stop token for the jthread.
  * @return Nothing.
  */
-void watergun::gpio_stepper::make_step ( const double microstep_size )
+void watergun::gpio_stepper::play_waveforms ( std::unique_lock<std::mutex>& lock, const std::stop_token stoken )
 {
-    /* Turn on the step GPIO, sleep for half the minimum period, then turn it back off, and sleep for the other half */
-    step_gpio.write ( 1 );
-    std::this_thread::sleep_for ( std::chrono::duration<double> { min_step_period / 2. } );
-    step_gpio.write ( 0 );
-    std::this_thread::sleep_for ( std::chrono::duration<double> { min_step_period / 2. } );
+    /* Wake the motor */
+    write_control_lines ( control_state & ~sleep_bit );
 
-    /* Modify the current angle */
-    current_angle += microstep_size;
+    /* Play each waveform from the end of the last, so that there is no gap at segment boundaries, and update the current angle after each */
+    clock::time_point start = clock::now ();
+    while ( !stoken.stop_requested () && waveform_handoff.consume () )
+    {
+        const waveform& segment = waveform_handoff.front ();
+        lock.unlock ();
+        start = segment.play ( start, spin_window, [ this ] ( const std::uint8_t pins, const clock::time_point due, const clock::time_point written )
+            { write_control_lines ( pins ); if ( pins & waveform::step_bit ) step_jitter.record ( written - due ); }, stoken );
+        lock.lock ();
+        current_angle += segment.get_net_angle ();
+        indexer_phase = advance_phase ( indexer_phase, segment.get_net_angle () );
+    }
+
+    /* The steps of waveforms are not timed individually, so edges of the position pin during playback cannot be corrected for, and are made stale */
+    last_step_time = clock::now ();
 }
 
 
@@ -401,44 +889,143 @@ void watergun::gpio_stepper::make_step ( const double microstep_size )
  */
 void watergun::gpio_stepper::stepper_thread_function ( std::stop_token stoken )
 {
+    /* Take on the stepper real-time role */
+    enter_realtime_role ( thread_role::stepper );
+
     /* Create a lock on the mutex */
     std::unique_lock<std::mutex> lock { stepper_mx };
 
+    /* The microstep number of the ramp being followed, the microstep number to change to once the indexer is aligned for it, the angle and velocity the motion is aiming for, and when the next step is due */
+    int microstep_number = availible_microstep_numbers.back (), desired_microstep_number = microstep_number;
+    double motion_target = current_angle, cruise_velocity = 0.;
+    clock::time_point step_time = clock::now ();
+
+    /* Retarget the motion, which continues from its current velocity. If at rest, choose the microstepping number for the velocity, and start stepping now. */
+    auto move_to = [ & ] ( const double angle, const double velocity )
+    {
+        motion_target = angle;
+        cruise_velocity = std::min ( velocity, max_velocity );
+        if ( motion.at_rest () ) { if ( cruise_velocity > 0. ) desired_microstep_number = choose_microstep_number ( cruise_velocity, microstep_number ); step_time = clock::now (); }
+        const step_ramp& ramp = ramps.at ( microstep_number );
+        motion.retarget ( ramp, std::llround ( ( motion_target - current_angle ) / ramp.microstep_size () ), ramp.level_for_velocity ( cruise_velocity ) );
+    };
+
+    /* Finish homing, stopping the motor where it is if homing failed, and wake the thread waiting for it */
+    auto finish_homing = [ & ] ( std::string error )
+    {
+        if ( !error.empty () ) move_to ( current_angle, cruise_velocity );
+        homing = homing_phase::idle;
+        homing_error = std::move ( error );
+        homing_finished = true;
+        stepper_cv.notify_all ();
+    };
+
+    /* Whether a wait should be interrupted. New targets are held back until homing has finished. */
+    auto interrupted = [ this, &stoken ] { return ( new_target && homing == homing_phase::idle ) || new_homing || stoken.stop_requested (); };
+
     /* Loop while the stop token is unset */
     while ( !stoken.stop_requested () )
     {
-        /* Set there to be no new target */
-        new_target = false;
+        /* If a waveform has been rendered, play it and any which follow it */
+        if ( waveform_handoff.pending () ) { play_waveforms ( lock, stoken ); continue; }
 
-        /* Calculate the required velocity */
-        double velocity = watergun::clamp ( rate_of_change ( target_angle - current_angle, target_transition_time ), -max_velocity, +max_velocity );
+        /* If homing has been requested, start the fast approach towards the position pin, limited by the maximum travel */
+        if ( new_homing )
+        {
+            new_homing = false;
+            homing = homing_phase::fast_approach;
+            homing_start = clock::now ();
+            move_to ( current_angle + ( homing_direction ? homing_settings.max_travel : -homing_settings.max_travel ), homing_settings.fast_velocity );
+        }
 
-        /* Get the microstepping number */
-        int microstep_number = choose_microstep_number ( velocity );
+        /* If homing has taken too long, give up */
+        if ( homing != homing_phase::idle && clock::now () - homing_start > homing_settings.timeout ) finish_homing ( "timed out" );
 
-        /* Get the microstep size (negative for anti-clockwise) */
-        double microstep_size = std::copysign ( step_size / std::exp2 ( microstep_number ), velocity );
+        /* If there is a new target and not homing, retarget the motion, at a velocity which is the maximum velocity if the transition time is zero */
+        if ( new_target && homing == homing_phase::idle )
+        {
+            new_target = false;
+            move_to ( target_angle, std::abs ( rate_of_change ( target_angle - current_angle, target_transition_time ) ) );
+        }
 
-        /* Get the period */
-        double period = std::max ( microstep_size / velocity, min_step_period );
+        /* If a different microstep number is wanted and the indexer is aligned for it, change to its ramp, carrying on at the same velocity.
+         * The remaining steps are recalculated from the target, so that no rounding error accumulates across changes.
+         */
+        if ( desired_microstep_number != microstep_number && microstep_aligned ( indexer_phase, desired_microstep_number ) )
+        {
+            microstep_number = desired_microstep_number;
+            const step_ramp& ramp = ramps.at ( microstep_number );
+            motion.change_ramp ( ramp, std::llround ( ( motion_target - current_angle ) / ramp.microstep_size () ), ramp.level_for_velocity ( cruise_velocity ) );
+        }
 
-        /* Get the number of steps required, and if there are none, continue */
-        int required_steps = ( target_angle - current_angle ) / microstep_size;
-        
-        /* Do any steps */
-        if ( required_steps != 0 )
+        /* If there are steps to make, wait until the next is due */
+        if ( motion.moving () )
         {
-            /* Enable the motor */
-            enable_motor ( microstep_number, velocity > 0. );
+            /* Sleep on the condition variable until shortly before the step is due, so that a new target or stop request interrupts the wait.
+             * If the step is due within the spin window, do not sleep at all, so that dense pulse trains are made without waking the scheduler.
+             */
+            if ( step_time - clock::now () > spin_window && stepper_cv.wait_until ( lock, stoken, step_time - spin_window, interrupted ) ) continue;
+
+            /* Spin until the step is due without holding the lock, and record how late it is made */
+            lock.unlock ();
+            step_jitter.record ( sleep_then_spin_until_monotonic ( step_time, spin_window ) - step_time );
+            lock.lock ();
+
+            /* Make the step, in the direction given by the generator.
+             * Each step is scheduled from when the last was due, so that wake up latency does not accumulate.
+             */
+            const step_generator::step next_step = motion.next ();
+            const double microstep_size = ramps.at ( microstep_number ).microstep_size ();
+            enable_motor ( microstep_number, next_step.direction > 0 );
+            const double correction = make_step ( next_step.direction * microstep_size );
+            step_time += std::chrono::nanoseconds { next_step.interval };
+
+            /* If the angle was corrected at the position pin, retarget so that the motion still finishes at its target */
+            if ( correction != 0. ) move_to ( motion_target, cruise_velocity );
+
+            /* At each full step, choose the microstep number for the velocity the motor is now moving at, so that fast slews use coarse microstepping.
+             * The slow approach of homing stays at the finest microstepping, for precision.
+             */
+            if ( next_step.interval != 0 && indexer_phase % indexer_resolution == 0 && homing != homing_phase::slow_approach ) desired_microstep_number = choose_microstep_number ( microstep_size * 1e9 / next_step.interval, microstep_number );
+
+            /* If approaching the position pin and it has activated, either back off from it after the fast approach, which reverses along the ramp,
+             * or calibrate the angle after the slow approach, and return to where the pin activated
+             */
+            if ( ( homing == homing_phase::fast_approach || homing == homing_phase::slow_approach ) && position_line->read () != 0 )
+            {
+                if ( homing == homing_phase::fast_approach )
+                {
+                    homing = homing_phase::back_off;
+                    fast_trigger_angle = current_angle;
+                    move_to ( current_angle + ( homing_direction ? -homing_settings.back_off : homing_settings.back_off ), homing_settings.fast_velocity );
+                } else
+                {
+                    homing_outcome = homing_result { ( homing_direction ? 1. : -1. ) * ( fast_trigger_angle - current_angle ), homing_angle - current_angle, clock::now () - homing_start };
+                    current_angle = homing_angle;
+                    calibrated = true;
+                    accumulated_index_error = 0.;
+                    move_to ( homing_angle, homing_settings.slow_velocity );
+                    finish_homing ( {} );
+                }
+            }
+        }
 
-            /* Keep making steps, until they have all been made, or a new position is requirested (via the condition variable) */
-            do make_step ( microstep_size );
-            while ( --required_steps != 0 && !stepper_cv.wait_for ( lock, stoken, std::chrono::duration<double> { period - min_step_period }, [ this, &stoken ] { return new_target || stoken.stop_requested (); } ) );
+        /* Otherwise if homing, the motion of the current phase has finished. After backing off, approach slowly at the finest microstepping, but otherwise the pin was not found. */
+        else if ( homing == homing_phase::back_off )
+        {
+            if ( position_line->read () != 0 ) { finish_homing ( "position pin still active after backing off" ); continue; }
+            homing = homing_phase::slow_approach;
+            move_to ( current_angle + ( homing_direction ? 2. : -2. ) * homing_settings.back_off, homing_settings.slow_velocity );
+            desired_microstep_number = availible_microstep_numbers.back ();
         }
+        else if ( homing != homing_phase::idle ) finish_homing ( homing == homing_phase::fast_approach ? "position pin did not activate within the maximum travel" : "position pin did not activate on the slow approach" );
 
-        /* Wait for new steps, if all of the previous ones were fully completed */
-        if ( required_steps == 0 ) { disable_motor (); stepper_cv.wait ( lock, stoken, [ this, &stoken ] { return new_target || stoken.stop_requested (); } ); }
+        /* Otherwise disable the motor and wait for a new target */
+        else { disable_motor (); stepper_cv.wait ( lock, stoken, [ this, &interrupted ] { return interrupted () || waveform_handoff.pending (); } ); }
     }
+
+    /* If stopped while homing, do not leave the thread waiting for homing blocked */
+    if ( homing != homing_phase::idle || new_homing ) { new_homing = false; finish_homing ( "stepper stopped" ); }
 }
 
 
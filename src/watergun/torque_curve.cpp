@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * src/watergun/torque_curve.cpp
+ * 
+ * Implementation of include/watergun/torque_curve.h
+ * 
+ */
+
+
+
+/* INCLUDES */
+#include <watergun/torque_curve.h>
+
+
+
+/* TORQUE_CURVE IMPLEMENTATION */
+
+
+
+/** @name constructor
+ * 
+ * @brief Construct a flat curve from a constant acceleration.
+ * @param max_acceleration: The angular acceleration in rad/sec^2 at every velocity.
+ * @throw watergun_exception, if the acceleration is not positive.
+ */
+watergun::torque_curve::torque_curve ( const double max_acceleration )
+    : lines { line { max_acceleration, 0. } }
+{
+    /* Check the acceleration */
+    if ( !( max_acceleration > 0. ) ) throw watergun_exception { "Torque curve acceleration must be positive" };
+}
+
+/** @name constructor
+ * 
+ * @brief Construct a curve from points of torque against velocity.
+ * @param points: The points, in order of increasing velocity, starting at rest.
+ * @param inertia: The moment of inertia of the axis, in units consistent with the torque.
+ * @throw watergun_exception, if the points are not a positive, non-increasing and concave curve starting at rest, or the inertia is not positive.
+ */
+watergun::torque_curve::torque_curve ( const std::vector<point>& points, const double inertia )
+{
+    /* Check the inertia and that the curve starts at rest */
+    if ( !( inertia > 0. ) ) throw watergun_exception { "Torque curve inertia must be positive" };
+    if ( points.empty () || points.front ().velocity != 0. ) throw watergun_exception { "Torque curve must start at rest" };
+
+    /* Check the points are in order of velocity, and the torque is positive and non-increasing */
+    for ( std::size_t i = 0; i < points.size (); ++i )
+    {
+        if ( !( points [ i ].torque > 0. ) ) throw watergun_exception { "Torque curve torques must be positive" };
+        if ( i > 0 && !( points [ i ].velocity > points [ i - 1 ].velocity ) ) throw watergun_exception { "Torque curve velocities must be increasing" };
+        if ( i > 0 && points [ i ].torque > points [ i - 1 ].torque ) throw watergun_exception { "Torque curve torques must be non-increasing" };
+    }
+
+    /* A single point is a flat curve */
+    if ( points.size () == 1 ) { lines.push_back ( line { points.front ().torque / inertia, 0. } ); return; }
+
+    /* Otherwise add a line through each pair of consecutive points */
+    for ( std::size_t i = 1; i < points.size (); ++i )
+    {
+        const double slope = ( points [ i - 1 ].torque - points [ i ].torque ) / ( points [ i ].velocity - points [ i - 1 ].velocity ) / inertia;
+        lines.push_back ( line { points [ i - 1 ].torque / inertia + slope * points [ i - 1 ].velocity, slope } );
+    }
+
+    /* The minimum of the lines only passes through every point if each line is steeper than the last, which is when the curve is concave.
+     * Allow for rounding error, so that collinear points are accepted.
+     */
+    for ( std::size_t i = 1; i < lines.size (); ++i ) if ( lines [ i ].slope < lines [ i - 1 ].slope * ( 1. - 1e-9 ) ) throw watergun_exception { "Torque curve must be concave" };
+}
+
+
+
+/** @name  acceleration_at
+ * 
+ * @brief  Get the acceleration availible at a velocity.
+ * @param  velocity: The angular velocity in rad/sec, of either sign.
+ * @return The acceleration in rad/sec^2, which is negative if the velocity is beyond what the curve can reach.
+ */
+double watergun::torque_curve::acceleration_at ( const double velocity ) const noexcept
+{
+    /* Take the minimum over the lines */
+    double acceleration = std::numeric_limits<double>::infinity ();
+    for ( const line& l : lines ) acceleration = std::min ( acceleration, l.acceleration - l.slope * std::abs ( velocity ) );
+    return acceleration;
+}
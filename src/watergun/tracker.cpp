@@ -107,17 +107,30 @@ int watergun::tracker::get_num_tracked_users () const
  * @return Vector of users.
  */
 std::vector<watergun::tracker::tracked_user> watergun::tracker::get_tracked_users () const
+{
+    /* Get the tracked users into a new vector, and return it */
+    std::vector<tracked_user> tracked_users_copy;
+    get_tracked_users ( tracked_users_copy );
+    return tracked_users_copy;
+}
+
+
+
+/** @name  get_tracked_users
+ * 
+ * @brief  As above, but write the tracked users into a caller-provided vector, which does not allocate if it has the capacity for them.
+ * @param  users: The vector to write the tracked users into.
+ * @return Nothing.
+ */
+void watergun::tracker::get_tracked_users ( std::vector<tracked_user>& users ) const
 {
     /* Lock the mutex, copy the tracked users, then unlock */
     std::unique_lock<std::mutex> lock { tracked_users_mx };
-    auto tracked_users_copy = tracked_users;
+    users.assign ( tracked_users.begin (), tracked_users.end () );
     lock.unlock ();
 
     /* Update their positions */
-    for ( tracked_user& user : tracked_users_copy ) user = dynamic_project_tracked_user ( user );
-    
-    /* Return the tracked users */
-    return tracked_users_copy;
+    for ( tracked_user& user : users ) user = dynamic_project_tracked_user ( user );
 }
 
 
@@ -211,26 +224,6 @@ bool watergun::tracker::wait_for_detected_tracked_users ( clock::time_point time
 
 
 
-/** @name  project_tracked_user
- * 
- * @brief  Update a user's position to match a new timestamp, given that they follow the same velocity.
- * @param  user: The user to update.
- * @param  timestamp: The new timestamp that their position should match.
- * @return The updated tracked user.
- */
-watergun::tracker::tracked_user watergun::tracker::project_tracked_user ( const tracked_user& user, const clock::time_point timestamp ) const
-{
-    /* Return a tracked user with updated timestamp and position */
-    return tracked_user
-    {
-        user.id, timestamp,
-        user.com + user.com_rate * duration_to_seconds ( timestamp - user.timestamp ).count (),
-        user.com_rate,
-    };
-}
-
-
-
 /** @name  onNewFrame
  * 
  * @brief  Overload of pure virtual method, which will be called when new frame data is available.
@@ -239,6 +232,9 @@ watergun::tracker::tracked_user watergun::tracker::project_tracked_user ( const
  */
 void watergun::tracker::onNewFrame ( nite::UserTracker& ) 
 {
+    /* Take on the tracker real-time role the first time NiTE calls back on its thread */
+    [[maybe_unused]] static thread_local const bool realtime_role_entered = enter_realtime_role ( thread_role::tracker );
+
     /* Read the new frame */
     nite::UserTrackerFrameRef frame;
     check_status ( user_tracker.readFrame ( &frame ), "Failed to read user tracker frame" );
@@ -260,7 +256,7 @@ void watergun::tracker::onNewFrame ( nite::UserTracker& )
     for ( int i = 0; i < users.getSize (); ++i )
     {
         /* Create the new user */
-        tracked_user user { users [ i ].getId (), frame_timestamp, users [ i ].getCenterOfMass (), vector3d {} };
+        tracked_user user { users [ i ].getId (), frame_timestamp, to_vector3d ( users [ i ].getCenterOfMass () ), vector3d {} };
 
         /* If the Z-coord is 0 (the user is lost), ignore this user. Else change to meters and add the camera offset. */
         if ( user.com.z == 0. ) continue; user.com = user.com / 1000. + camera_offset;
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * src/watergun/waveform.cpp
+ * 
+ * Implementation of include/watergun/waveform.h
+ * 
+ */
+
+
+
+/* INCLUDES */
+#include <watergun/waveform.h>
+
+
+
+/* WAVEFORM IMPLEMENTATION */
+
+
+
+/** @name  append
+ * 
+ * @brief  Append a pin state, splitting delays too long for a single entry across several.
+ * @param  pins: The pin states as a mask of pin_bits.
+ * @param  delay: The delay in nanoseconds before the next entry.
+ * @return Nothing.
+ */
+void watergun::waveform::append ( const std::uint8_t pins, const std::uint64_t delay )
+{
+    /* Add the delay to the duration, then append entries until all of it is covered */
+    duration += delay;
+    std::uint64_t remaining = delay;
+    do
+    {
+        const std::uint32_t entry_delay = std::min<std::uint64_t> ( remaining, std::numeric_limits<std::uint32_t>::max () );
+        entries.push_back ( entry { pins, entry_delay } );
+        remaining -= entry_delay;
+    } while ( remaining > 0 );
+}
+
+
+
+/** @name  capture
+ * 
+ * @brief  Find the time at which each entry would be written if played, without waiting or driving any pins.
+ * @param  start: The time at which the first entry would be written.
+ * @return Vector of edges, one per entry.
+ */
+std::vector<watergun::waveform::edge> watergun::waveform::capture ( const clock::time_point start ) const
+{
+    /* Accumulate the delays of each entry */
+    std::vector<edge> edges; edges.reserve ( entries.size () );
+    clock::time_point due = start;
+    for ( const entry& e : entries ) { edges.push_back ( edge { due, e.pins } ); due += std::chrono::nanoseconds { e.delay }; }
+    return edges;
+}
+
+
+
+/* WAVEFORM_RENDERER IMPLEMENTATION */
+
+
+
+/** @name  retarget
+ * 
+ * @brief  Change the target of the motion.
+ * @param  ramp: The ramp to follow, which is only changed if at rest, and must remain valid until the motion has finished.
+ * @param  _microstep_number: The microstep number which the ramp is for, which is only changed if at rest.
+ * @param  remaining: The signed number of steps to the new target from the end of the last rendered segment.
+ * @param  cruise_level: The level on the ramp to cruise at.
+ * @return Nothing.
+ */
+void watergun::waveform_renderer::retarget ( const step_ramp& ramp, const int _microstep_number, const std::int64_t remaining, const std::size_t cruise_level ) noexcept
+{
+    /* Change the microstep number only if at rest, then retarget the motion */
+    if ( motion.at_rest () ) { microstep_number = _microstep_number; microstep_size = ramp.microstep_size (); }
+    motion.retarget ( ramp, remaining, cruise_level );
+}
+
+
+
+/** @name  render
+ * 
+ * @brief  Render the next segment of the motion.
+ * @param  output: The waveform to render into, which is cleared first.
+ * @param  segment_duration: The duration of the segment.
+ * @param  pulse_width: The width of each step pulse.
+ * @return Nothing.
+ */
+void watergun::waveform_renderer::render ( waveform& output, const std::chrono::nanoseconds segment_duration, const std::chrono::nanoseconds pulse_width )
+{
+    /* Clear the output, and shorten the segment by however much the last one was lengthened */
+    output.clear ();
+    const std::uint64_t pulse = pulse_width.count ();
+    const std::uint64_t end = std::max<std::int64_t> ( segment_duration.count () - static_cast<std::int64_t> ( overrun ), 0 );
+
+    /* The pin state currently being held, and when it started, starting with the pins as they were at the end of the last segment.
+     * A state is only appended once the next is known, so that its delay is known, and states held for no time are dropped.
+     */
+    std::uint8_t open_pins = pins; std::uint64_t open_time = 0;
+    auto change_pins = [ & ] ( const std::uint8_t new_pins, const std::uint64_t time )
+        { if ( time > open_time ) output.append ( open_pins, time - open_time ); open_pins = new_pins; open_time = std::max ( time, open_time ); };
+
+    /* The microstep pins, which cannot change mid-motion */
+    const std::uint8_t microstep_pins = ( microstep_number & 1 ? waveform::microstep_bit_0 : 0 ) | ( microstep_number & 2 ? waveform::microstep_bit_1 : 0 ) | ( microstep_number & 4 ? waveform::microstep_bit_2 : 0 );
+
+    /* Render steps while they are due before the end of the segment */
+    std::uint64_t next_due = carry;
+    while ( motion.moving () && next_due < end )
+    {
+        /* Get the step, and if the direction or microstep pins change, give the driver time to set up */
+        const step_generator::step next_step = motion.next ();
+        const std::uint8_t step_pins = microstep_pins | ( next_step.direction < 0 ? waveform::dir_bit : 0 );
+        std::uint64_t step_time = next_due;
+        if ( step_pins != pins ) { change_pins ( pins = step_pins, step_time ); step_time += setup_time; }
+
+        /* Make the pulse, and find when the next step is due */
+        change_pins ( pins | waveform::step_bit, step_time );
+        change_pins ( pins, step_time + pulse );
+        output.add_angle ( next_step.direction * microstep_size );
+        next_due = step_time + std::max<std::uint64_t> ( next_step.interval, pulse );
+    }
+
+    /* Hold the last state until the end of the segment, or the end of the last pulse if it straddles the end of the segment.
+     * The last state is always appended, even if held for no time, so that a pulse is never left high across the boundary.
+     */
+    const std::uint64_t segment_end = std::max ( end, open_time );
+    output.append ( open_pins, segment_end - open_time );
+    overrun = segment_end - end;
+
+    /* Carry the time until the next step into the next segment. If at rest, the first step of the next motion waits for a pulse width, so that the step pin is low for long enough. */
+    carry = ( motion.moving () ? next_due - std::min ( next_due, segment_end ) : pulse );
+}
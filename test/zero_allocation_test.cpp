@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2021 Louis Hobson <louis-hobson@hotmail.co.uk>. All Rights Reserved.
+ * 
+ * Distributed under MIT licence as a part of a self aiming watergun project.
+ * For details, see: https://github.com/louishobson/WaterGun/blob/master/LICENSE
+ * 
+ * test/zero_allocation_test.cpp
+ * 
+ * Checks that steady-state planning does not allocate, by counting calls to the global operator new around several planning iterations.
+ * This covers target sequencing, the planning pool and the fixed planners' own bookkeeping. Allocations made inside ClpSimplex are counted too, but whether
+ * there are any depends on the Clp build linked against, so a failure with no change to the planning code points at the solver rather than the planner.
+ * 
+ */
+
+
+
+/* INCLUDES */
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <vector>
+#include <watergun/planning_pool.h>
+
+
+
+/* ALLOCATION COUNTING */
+
+/* The number of allocations made by any thread while counting is enabled */
+static std::atomic<std::size_t> allocations { 0 };
+static std::atomic<bool> counting { false };
+
+/** @name  operator new
+ * 
+ * @brief  Allocate with malloc, counting the allocation if counting is enabled.
+ * @param  size: The number of bytes to allocate.
+ * @throw  std::bad_alloc, if the allocation fails.
+ * @return The allocated memory.
+ */
+void * operator new ( const std::size_t size )
+{
+    /* Count the allocation, then allocate */
+    if ( counting.load ( std::memory_order_relaxed ) ) allocations.fetch_add ( 1, std::memory_order_relaxed );
+    if ( void * const ptr = std::malloc ( size ? size : 1 ) ) return ptr;
+    throw std::bad_alloc {};
+}
+
+/** @name  operator delete
+ * 
+ * @brief  Free memory allocated by operator new.
+ * @param  ptr: The memory to free.
+ * @return Nothing.
+ */
+void operator delete ( void * const ptr ) noexcept { std::free ( ptr ); }
+void operator delete ( void * const ptr, std::size_t ) noexcept { std::free ( ptr ); }
+
+
+
+/* MAIN */
+
+/** @name  main
+ * 
+ * @brief  Plan for a few users until the buffers are warm, then count the allocations made by several more planning iterations.
+ * @return 0 if no allocations were made, 1 otherwise.
+ */
+int main ()
+{
+    /* The horizon to plan over, the number of candidates to plan for, and the number of warm up and counted iterations */
+    constexpr int horizon = 15, num_candidates = 3, warm_up_iterations = 3, counted_iterations = 10;
+    typedef watergun::planning_pool<horizon> pool_type;
+
+    /* Create the planner, with the torque curves of main.cpp and a gun which can reach every test user */
+    const std::vector<watergun::torque_curve::point> stepper_torque { { 0., 0.40 }, { 2 * M_PI, 0.35 }, { 3 * 2 * M_PI, 0.10 } };
+    const watergun::torque_curve yaw_torque { stepper_torque, 0.40 / ( 4 * 2 * M_PI ) }, pitch_torque { stepper_torque, 0.40 / ( 8 * 2 * M_PI ) };
+    const watergun::planner movement_planner { 10., 0., M_PI, yaw_torque, M_PI, pitch_torque, std::chrono::milliseconds { 33 }, 5. };
+
+    /* Create the pool and the buffers which would be owned by the controller's planner thread */
+    pool_type candidate_planner { movement_planner, num_candidates };
+    std::vector<watergun::tracked_user> users, candidates; users.reserve ( 8 ); candidates.reserve ( num_candidates );
+    std::vector<watergun::planner::target_score> scores; scores.reserve ( 8 );
+    std::vector<watergun::planner::engagement> sequence; sequence.reserve ( 8 );
+    watergun::planner::sequencing_workspace workspace = movement_planner.create_sequencing_workspace ( 8 );
+    std::array<pool_type::candidate_plan, num_candidates> plans;
+    watergun::planner::target_selection selection { std::chrono::milliseconds { 200 }, std::chrono::milliseconds { 500 } };
+    const watergun::planner::single_movement current_movement { std::chrono::milliseconds { 33 }, watergun::tracking_clock::now (), 0., 0., 0. };
+
+    /* Plan for four users walking in front of the gun, counting allocations after the warm up */
+    for ( int iteration = 0; iteration < warm_up_iterations + counted_iterations; ++iteration )
+    {
+        /* Enable counting once warm */
+        if ( iteration == warm_up_iterations ) counting.store ( true );
+
+        /* Refresh the users as the tracker would */
+        const watergun::tracking_clock::time_point now = watergun::tracking_clock::now ();
+        users.clear ();
+        for ( int i = 0; i < 4; ++i ) users.push_back ( watergun::tracked_user { i + 1, now, watergun::vector3d { -0.3 + 0.2 * i, -0.5, 2. + 0.5 * i }, watergun::vector3d { 0.05 * ( i % 2 ? 1 : -1 ), 0., 0. } } );
+
+        /* Sequence the users without keeping the selection, so that no target is locked and every user is scored, then plan for the head of the sequence and the best scoring others */
+        watergun::planner::target_selection trial_selection = selection;
+        movement_planner.sequence_targets ( users, current_movement, trial_selection, workspace, sequence, &scores );
+        candidates.clear ();
+        if ( !sequence.empty () ) candidates.push_back ( sequence.front ().user );
+        for ( const watergun::planner::target_score& score : scores ) if ( candidates.size () < static_cast<std::size_t> ( num_candidates ) && ( candidates.empty () || score.id != candidates.front ().id ) )
+            for ( const watergun::tracked_user& user : users ) if ( user.id == score.id ) candidates.push_back ( user );
+        candidate_planner.plan ( candidates, current_movement, plans );
+    }
+
+    /* Stop counting, and report the result */
+    counting.store ( false );
+    if ( allocations.load () != 0 )
+    {
+        std::cerr << "FAIL: " << allocations.load () << " allocations in " << counted_iterations << " steady-state planning iterations\n";
+        return 1;
+    }
+    std::cout << "PASS: no allocations in " << counted_iterations << " steady-state planning iterations\n";
+    return 0;
+}